@@ -31,5 +31,8 @@ static const int DELETED_STUDENT_ID = 0;
 
 #define DB_FILE "student.db"          // name of database file
 #define TMP_DB_FILE ".tmp_student.db" // for extra credit
+#define TGX_FILE "student.tgx"        // trigram index for name searches
+#define SHARD_MANIFEST_FILE "student.shards"          // lists shard files
+#define TMP_SHARD_MANIFEST_FILE ".tmp_student.shards" // written then renamed
 
 #endif
\ No newline at end of file
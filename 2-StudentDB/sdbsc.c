@@ -5,10 +5,15 @@
 #include <sys/stat.h>
 #include <unistd.h>
 #include <stdbool.h>
+#include <errno.h>
+#include <limits.h>
 
 // database include files
 #include "db.h"
 #include "sdbsc.h"
+#include "trigram.h"
+#include "shard.h"
+#include "sort.h"
 
 /*
  *  open_db
@@ -44,6 +49,15 @@ int open_db(char *dbFile, bool should_truncate)
         return ERR_DB_FILE;
     }
 
+    // a sharded database keeps its students in the files listed in the
+    // manifest, open (and truncate) all of them along with dbFile
+    if (shard_load(should_truncate) < 0)
+    {
+        printf(M_ERR_DB_OPEN);
+        close(fd);
+        return ERR_DB_FILE;
+    }
+
     return fd;
 }
 
@@ -62,6 +76,9 @@ int open_db(char *dbFile, bool should_truncate)
  */
 int get_student(int fd, int id, student_t *s)
 {
+    // use the shard that holds this id
+    fd = shard_fd(fd, id);
+
     // move to file pointer and check for errors
     off_t offset = id * STUDENT_RECORD_SIZE;
     off_t lseekResult = lseek(fd, offset, SEEK_SET);
@@ -113,6 +130,9 @@ int get_student(int fd, int id, student_t *s)
  */
 int add_student(int fd, int id, char *fname, char *lname, int gpa)
 {
+    // use the shard that holds this id
+    fd = shard_fd(fd, id);
+
     // create an empty student struct
     student_t student = {0};
     off_t offset = id * STUDENT_RECORD_SIZE;
@@ -154,6 +174,13 @@ int add_student(int fd, int id, char *fname, char *lname, int gpa)
         return ERR_DB_FILE;
     }
 
+    // keep the name search index in sync with the database
+    if (tgidx_add(id, student.fname, student.lname) < 0)
+    {
+        printf(M_ERR_DB_WRITE);
+        return ERR_DB_FILE;
+    }
+
     printf(M_STD_ADDED, id);
     return NO_ERROR;
 }
@@ -182,6 +209,9 @@ int add_student(int fd, int id, char *fname, char *lname, int gpa)
  */
 int del_student(int fd, int id)
 {
+    // use the shard that holds this id
+    fd = shard_fd(fd, id);
+
     // get the student to be deleted
     student_t student = {0};
     int getStudentResult = get_student(fd, id, &student);
@@ -208,10 +238,232 @@ int del_student(int fd, int id)
         return ERR_DB_FILE;
     }
 
+    // the names read by get_student() tell us which postings to clear
+    if (tgidx_del(id, student.fname, student.lname) < 0)
+    {
+        printf(M_ERR_DB_WRITE);
+        return ERR_DB_FILE;
+    }
+
     printf(M_STD_DEL_MSG, id);
     return NO_ERROR;
 }
 
+/*
+ *  update_student
+ *      fd:     linux file descriptor
+ *      id:     student id to be updated
+ *      fname:  new first name, or NULL to keep the current one
+ *      lname:  new last name, or NULL to keep the current one
+ *      gpa:    new GPA, or NULL to keep the current one
+ *
+ *  Changes some of the fields of an existing student in place.  The updated
+ *  record is built in memory and compared with the one read by get_student(),
+ *  then only the span of bytes that actually changed is written back with a
+ *  single pwrite().  Unlike deleting and re-adding the student, there is never
+ *  a moment where the student is missing from the database.
+ *
+ *  returns:  NO_ERROR       student updated (or nothing needed to change)
+ *            ERR_DB_FILE    database file I/O issue
+ *            ERR_DB_OP      database operation logically failed (aka student
+ *                           not in database)
+ *
+ *  console:  M_STD_UPDATED      on success
+ *            M_STD_NOT_FND_MSG  student not in database, cant be updated
+ *            M_ERR_DB_READ      error reading the database file
+ *            M_ERR_DB_WRITE     error writing to db file
+ */
+int update_student(int fd, int id, char *fname, char *lname, const int *gpa)
+{
+    // use the shard that holds this id
+    fd = shard_fd(fd, id);
+
+    student_t student = {0};
+    int getStudentResult = get_student(fd, id, &student);
+    if (getStudentResult == ERR_DB_FILE)
+    {
+        printf(M_ERR_DB_READ);
+        return ERR_DB_FILE;
+    }
+    if (getStudentResult != NO_ERROR)
+    {
+        printf(M_STD_NOT_FND_MSG, id);
+        return ERR_DB_OP;
+    }
+
+    // build the new version of the record, zero filling changed names the
+    // same way add_student() does so stale characters do not survive
+    student_t updated = student;
+    if (fname != NULL)
+    {
+        memset(updated.fname, 0, sizeof(updated.fname));
+        strncpy(updated.fname, fname, sizeof(updated.fname));
+    }
+    if (lname != NULL)
+    {
+        memset(updated.lname, 0, sizeof(updated.lname));
+        strncpy(updated.lname, lname, sizeof(updated.lname));
+    }
+    if (gpa != NULL)
+    {
+        updated.gpa = *gpa;
+    }
+
+    // find the first and last byte that differ between the two records
+    const char *oldBytes = (const char *)&student;
+    const char *newBytes = (const char *)&updated;
+    int first = 0;
+    int last = STUDENT_RECORD_SIZE - 1;
+    while (first < STUDENT_RECORD_SIZE && oldBytes[first] == newBytes[first])
+    {
+        first++;
+    }
+    while (last > first && oldBytes[last] == newBytes[last])
+    {
+        last--;
+    }
+
+    if (first < STUDENT_RECORD_SIZE)
+    {
+        off_t offset = (off_t)id * STUDENT_RECORD_SIZE + first;
+        ssize_t len = last - first + 1;
+        if (pwrite(fd, newBytes + first, len, offset) != len)
+        {
+            printf(M_ERR_DB_WRITE);
+            return ERR_DB_FILE;
+        }
+
+        // re-index the student only if a name was part of the change
+        if (fname != NULL || lname != NULL)
+        {
+            if (tgidx_del(id, student.fname, student.lname) < 0 ||
+                tgidx_add(id, updated.fname, updated.lname) < 0)
+            {
+                printf(M_ERR_DB_WRITE);
+                return ERR_DB_FILE;
+            }
+        }
+    }
+
+    printf(M_STD_UPDATED, id);
+    return NO_ERROR;
+}
+
+// counts a valid student, ctx is the counter of the shard being scanned
+static int count_visit(student_t *s, void *ctx)
+{
+    (void)s;
+    (*(int *)ctx)++;
+    return NO_ERROR;
+}
+
+static int count_shard_task(db_shard_t *shard, int idx, void *ctx)
+{
+    int *counts = (int *)ctx;
+    return shard_scan(shard, count_visit, &counts[idx]);
+}
+
+// where print_db() sends the rows of one shard
+typedef struct print_ctx
+{
+    FILE *out;   // console or an in memory stream for parallel scans
+    char *buf;   // contents of the in memory stream
+    size_t len;  // length of buf
+    int rows;    // students printed so far
+    bool header; // print the header before the first row
+} print_ctx_t;
+
+static int print_visit(student_t *s, void *ctx)
+{
+    print_ctx_t *print = (print_ctx_t *)ctx;
+
+    // prints the first row string
+    if (print->rows == 0 && print->header)
+    {
+        fprintf(print->out, STUDENT_PRINT_HDR_STRING, "ID", "FIRST NAME", "LAST_NAME", "GPA");
+    }
+
+    float calculated_gpa_from_student = s->gpa / 100.0;
+    fprintf(print->out, STUDENT_PRINT_FMT_STRING, s->id, s->fname, s->lname, calculated_gpa_from_student);
+    print->rows++;
+    return NO_ERROR;
+}
+
+static int print_shard_task(db_shard_t *shard, int idx, void *ctx)
+{
+    print_ctx_t *print = &((print_ctx_t *)ctx)[idx];
+
+    if (print->out == NULL)
+    {
+        print->out = open_memstream(&print->buf, &print->len);
+        if (print->out == NULL)
+        {
+            return ERR_DB_FILE;
+        }
+    }
+    return shard_scan(shard, print_visit, print);
+}
+
+// copies a valid student into the temporary file of the shard being compressed
+static int compress_visit(student_t *s, void *ctx)
+{
+    int tempFd = *(int *)ctx;
+    off_t offset = (off_t)s->id * STUDENT_RECORD_SIZE;
+
+    if (pwrite(tempFd, s, STUDENT_RECORD_SIZE, offset) != STUDENT_RECORD_SIZE)
+    {
+        return ERR_DB_FILE;
+    }
+    return NO_ERROR;
+}
+
+static int compress_shard_task(db_shard_t *shard, int idx, void *ctx)
+{
+    int only = *(int *)ctx;
+    if (only != SHARD_ALL && only != idx)
+    {
+        return NO_ERROR;
+    }
+
+    // create a new empty temporary database
+    int tempFd = shard_open_file(shard->tmp_path, true);
+    if (tempFd < 0)
+    {
+        printf(M_ERR_DB_OPEN);
+        return ERR_DB_FILE;
+    }
+
+    // copy every real student over to the temporary database
+    int rc = shard_scan(shard, compress_visit, &tempFd);
+    if (rc < 0)
+    {
+        printf(M_ERR_DB_WRITE);
+        close(tempFd);
+        return ERR_DB_FILE;
+    }
+
+    // close the files for renaming
+    close(shard->fd);
+    close(tempFd);
+
+    // rename the temporary file to the original file name
+    if (rename(shard->tmp_path, shard->path) < 0)
+    {
+        printf(M_ERR_DB_CREATE);
+        return ERR_DB_FILE;
+    }
+
+    // open the renamed compressed database
+    shard->fd = shard_open_file(shard->path, false);
+    if (shard->fd < 0)
+    {
+        printf(M_ERR_DB_OPEN);
+        return ERR_DB_FILE;
+    }
+
+    return NO_ERROR;
+}
+
 /*
  *  count_db_records
  *      fd:     linux file descriptor
@@ -230,6 +482,8 @@ int del_student(int fd, int id)
  *                           not in database)
  *
  *
+ *  A sharded database is counted one thread per shard, see shard_for_each().
+ *
  *  console:  M_DB_RECORD_CNT  on success, to report the number of students in db
  *            M_DB_EMPTY       on success if the record count in db is zero
  *            M_ERR_DB_READ    error reading or seeking the database file
@@ -238,34 +492,19 @@ int del_student(int fd, int id)
  */
 int count_db_records(int fd)
 {
-    // just to hold the student data
-    student_t student = {0};
+    // one counter per shard, the shards are counted in parallel
+    int counts[MAX_SHARDS] = {0};
 
-    // return to the beginning of the file
-    int lseekResult = lseek(fd, STUDENT_RECORD_SIZE, SEEK_SET);
-    if (lseekResult < 0)
+    if (shard_for_each(fd, count_shard_task, counts) < 0)
     {
         printf(M_ERR_DB_READ);
         return ERR_DB_FILE;
     }
 
-    // initial variables to perform loop operation through entire database
     int count = 0;
-    ssize_t bytesRead;
-    while ((bytesRead = read(fd, &student, STUDENT_RECORD_SIZE)) == STUDENT_RECORD_SIZE)
+    for (int i = 0; i < MAX_SHARDS; i++)
     {
-        // increment counter if the record is not empty
-        if (memcmp(&student, &EMPTY_STUDENT_RECORD, STUDENT_RECORD_SIZE) != 0)
-        {
-            count++;
-        }
-    }
-
-    // check if there was an error with reading the file
-    if (bytesRead < 0)
-    {
-        printf(M_ERR_DB_READ);
-        return ERR_DB_FILE;
+        count += counts[i];
     }
 
     if (count == 0)
@@ -305,6 +544,9 @@ int count_db_records(int fd)
  *  the GPA in the student structure is an int, to convert it into a real
  *  gpa divide by 100.0 and store in a float variable.
  *
+ *  A sharded database is scanned one thread per shard, each shard buffering
+ *  its rows so the table still comes out in id order.
+ *
  *  returns:  NO_ERROR       on success
  *            ERR_DB_FILE    database file I/O issue
  *
@@ -315,44 +557,52 @@ int count_db_records(int fd)
  */
 int print_db(int fd)
 {
-    // just to hold the student data
-    student_t student = {0};
+    print_ctx_t ctx[MAX_SHARDS] = {0};
+    db_shard_t *table;
+    int count = shard_table(fd, &table);
 
-    // return to the beginning of the file
-    int lseekResult = lseek(fd, STUDENT_RECORD_SIZE, SEEK_SET);
-    if (lseekResult < 0)
+    // a single shard streams straight to the console, while shards that are
+    // scanned in parallel buffer their rows so they can be printed in order
+    if (count == 1)
     {
-        printf(M_ERR_DB_READ);
-        return ERR_DB_FILE;
+        ctx[0].out = stdout;
+        ctx[0].header = true;
     }
 
-    // Perform a loop through the database
-    bool passedFirstRow = false;
-    ssize_t bytesRead;
-    while ((bytesRead = read(fd, &student, STUDENT_RECORD_SIZE)) == STUDENT_RECORD_SIZE)
+    int rc = shard_for_each(fd, print_shard_task, ctx);
+
+    int rows = 0;
+    for (int i = 0; i < count; i++)
     {
-        // print student if the record is not empty
-        if (memcmp(&student, &EMPTY_STUDENT_RECORD, STUDENT_RECORD_SIZE) != 0)
+        if (count > 1 && ctx[i].out != NULL)
         {
-            // prints the first row string
-            if (!passedFirstRow)
-            {
-                printf(STUDENT_PRINT_HDR_STRING, "ID", "FIRST NAME", "LAST_NAME", "GPA");
-                passedFirstRow = true;
-            }
-            float calculated_gpa_from_student = student.gpa / 100.0;
-            printf(STUDENT_PRINT_FMT_STRING, student.id, student.fname, student.lname, calculated_gpa_from_student);
+            fclose(ctx[i].out);
         }
+        rows += ctx[i].rows;
+    }
+
+    if (rc == NO_ERROR && count > 1 && rows > 0)
+    {
+        printf(STUDENT_PRINT_HDR_STRING, "ID", "FIRST NAME", "LAST_NAME", "GPA");
+        for (int i = 0; i < count; i++)
+        {
+            fwrite(ctx[i].buf, 1, ctx[i].len, stdout);
+        }
+    }
+
+    for (int i = 0; i < count; i++)
+    {
+        free(ctx[i].buf);
     }
 
     // check if there was an error with reading the file
-    if (bytesRead < 0)
+    if (rc < 0)
     {
         printf(M_ERR_DB_READ);
         return ERR_DB_FILE;
     }
 
-    if (!passedFirstRow)
+    if (rows == 0)
     {
         printf(M_DB_EMPTY);
     }
@@ -453,83 +703,47 @@ void print_student(student_t *s)
  */
 int compress_db(int fd)
 {
-    // create a new empty temporary database
-    int tempFd = open_db(TMP_DB_FILE, true);
-    if (tempFd < 0)
-    {
-        printf(M_ERR_DB_OPEN);
-        return ERR_DB_FILE;
-    }
-
-    // just to hold the student data
-    student_t student = {0};
-
-    // return to the beginning of the file
-    int lseekResult = lseek(fd, STUDENT_RECORD_SIZE, SEEK_SET);
-    if (lseekResult < 0)
-    {
-        printf(M_ERR_DB_READ);
-        return ERR_DB_FILE;
-    }
-
-    // iterate through the original database to write to the temporary
-    int i = 1;
-    ssize_t bytesRead;
-    while ((bytesRead = read(fd, &student, STUDENT_RECORD_SIZE)) == STUDENT_RECORD_SIZE)
-    {
-        // write the student to the temporary database if it is a real student
-        if (memcmp(&student, &EMPTY_STUDENT_RECORD, STUDENT_RECORD_SIZE) != 0)
-        {
-            // go to the right file position
-            off_t offset = i * STUDENT_RECORD_SIZE;
-            off_t lseekResult = lseek(tempFd, offset, SEEK_SET);
-            if (lseekResult < 0)
-            {
-                printf(M_ERR_DB_READ);
-                return ERR_DB_FILE;
-            }
-
-            // write the student into the database
-            ssize_t bytesWritten = write(tempFd, &student, STUDENT_RECORD_SIZE);
-            if (bytesWritten < 0)
-            {
-                printf(M_ERR_DB_WRITE);
-                return ERR_DB_FILE;
-            }
-        }
-
-        i++;
-    }
-
-    // check if there was an error with reading the file
-    if (bytesRead < 0)
-    {
-        printf(M_ERR_DB_READ);
-        return ERR_DB_FILE;
-    }
+    return compress_db_shard(fd, SHARD_ALL);
+}
 
-    // close the files for renaming
-    close(fd);
-    close(tempFd);
+/*
+ *  compress_db_shard
+ *      fd:     linux file descriptor
+ *      shard:  number of the shard to compress, or SHARD_ALL
+ *
+ *  Compresses a single shard, or all of them in parallel, the same way
+ *  compress_db() describes.  Each shard is rewritten to its own temporary
+ *  file which is then renamed over the shard.  For the single file layout
+ *  this is TMP_DB_FILE and DB_FILE.
+ *
+ *  returns:  <number>       the fd of the database (the compressed file for
+ *                           the single file layout)
+ *            ERR_DB_FILE    database file I/O issue
+ *            ERR_DB_OP      there is no such shard
+ *
+ *  console:  see compress_db()
+ */
+int compress_db_shard(int fd, int shard)
+{
+    db_shard_t *table;
+    int count = shard_table(fd, &table);
 
-    // rename the temporary file to the original file name
-    int renameResult = rename(TMP_DB_FILE, DB_FILE);
-    if (renameResult < 0)
+    if (shard != SHARD_ALL && (shard < 0 || shard >= count))
     {
-        printf(M_ERR_DB_CREATE);
-        return ERR_DB_FILE;
+        printf(M_ERR_SHARD_NUM, shard, count - 1);
+        return ERR_DB_OP;
     }
 
-    // open the renamed compressed database
-    int newFd = open_db(DB_FILE, false);
-    if (newFd < 0)
+    int rc = shard_for_each(fd, compress_shard_task, &shard);
+    if (rc < 0)
     {
-        printf(M_ERR_DB_OPEN);
         return ERR_DB_FILE;
     }
 
     printf(M_DB_COMPRESSED_OK);
-    return newFd;
+
+    // the single file layout got a new fd for the compressed database
+    return (count > 1) ? fd : table[0].fd;
 }
 
 /*
@@ -559,6 +773,127 @@ int validate_range(int id, int gpa)
     return NO_ERROR;
 }
 
+/*
+ *  parse_update_args
+ *      count:   number of field=value arguments
+ *      args:    the field=value arguments from argv
+ *      fname:   set to the new first name, or NULL if not being changed
+ *      lname:   set to the new last name, or NULL if not being changed
+ *      gpa:     set to the new gpa
+ *      gpaSet:  set to whether the gpa is being changed
+ *
+ *  Splits the arguments of the -u option into the values that are passed
+ *  to update_student().  The valid fields are fname, lname and gpa.
+ *
+ *  returns:    EXIT_OK         all arguments were valid
+ *              EXIT_FAIL_ARGS  an argument was not a known field=value pair,
+ *                              or the gpa was not a whole number
+ *
+ *  console:  M_ERR_STD_UPD_FIELD  on an invalid argument
+ */
+int parse_update_args(int count, char *args[], char **fname, char **lname, int *gpa, bool *gpaSet)
+{
+    *fname = NULL;
+    *lname = NULL;
+    *gpa = 0;
+    *gpaSet = false;
+
+    for (int i = 0; i < count; i++)
+    {
+        char *value = strchr(args[i], '=');
+        if (value == NULL)
+        {
+            printf(M_ERR_STD_UPD_FIELD, args[i]);
+            return EXIT_FAIL_ARGS;
+        }
+
+        size_t fieldLen = value - args[i];
+        value++;
+
+        if (fieldLen == 5 && strncmp(args[i], "fname", fieldLen) == 0)
+            *fname = value;
+        else if (fieldLen == 5 && strncmp(args[i], "lname", fieldLen) == 0)
+            *lname = value;
+        else if (fieldLen == 3 && strncmp(args[i], "gpa", fieldLen) == 0)
+        {
+            // the whole value has to be a number that fits an int
+            char *end;
+            errno = 0;
+            long num = strtol(value, &end, 10);
+            if (*value == '\0' || *end != '\0' || errno != 0 || num < INT_MIN || num > INT_MAX)
+            {
+                printf(M_ERR_STD_UPD_FIELD, args[i]);
+                return EXIT_FAIL_ARGS;
+            }
+            *gpa = (int)num;
+            *gpaSet = true;
+        }
+        else
+        {
+            printf(M_ERR_STD_UPD_FIELD, args[i]);
+            return EXIT_FAIL_ARGS;
+        }
+    }
+
+    return EXIT_OK;
+}
+
+/*
+ *  parse_sort_args
+ *      count:       number of arguments after -p
+ *      args:        the arguments after -p from argv
+ *      key:         set to the SORT_KEY_* to sort by
+ *      mem_budget:  set to the memory budget, SORT_DEF_MEM_BUDGET by default
+ *
+ *  Handles the --sort=lname|gpa and --mem=bytes options of -p.  A sort key
+ *  is required when options are given.
+ *
+ *  returns:    EXIT_OK         all arguments were valid
+ *              EXIT_FAIL_ARGS  an argument was not valid
+ *
+ *  console:  M_ERR_SORT_ARGS  on an invalid argument
+ */
+int parse_sort_args(int count, char *args[], int *key, size_t *mem_budget)
+{
+    *key = -1;
+    *mem_budget = SORT_DEF_MEM_BUDGET;
+
+    for (int i = 0; i < count; i++)
+    {
+        if (strncmp(args[i], "--sort=", 7) == 0)
+        {
+            *key = parse_sort_key(args[i] + 7);
+        }
+        else if (strncmp(args[i], "--mem=", 6) == 0)
+        {
+            // the whole value has to be a number of bytes, and enough of them
+            char *value = args[i] + 6;
+            char *end;
+            errno = 0;
+            long num = strtol(value, &end, 10);
+            if (*value == '\0' || *end != '\0' || errno != 0 || num < SORT_MIN_MEM_BUDGET)
+            {
+                printf(M_ERR_SORT_ARGS, args[i]);
+                return EXIT_FAIL_ARGS;
+            }
+            *mem_budget = (size_t)num;
+        }
+        else
+        {
+            printf(M_ERR_SORT_ARGS, args[i]);
+            return EXIT_FAIL_ARGS;
+        }
+    }
+
+    if (*key < 0)
+    {
+        printf(M_ERR_SORT_ARGS, count > 0 ? args[0] : "");
+        return EXIT_FAIL_ARGS;
+    }
+
+    return EXIT_OK;
+}
+
 /*
  *  usage
  *      exename:  the name of the executable from argv[0]
@@ -572,14 +907,17 @@ int validate_range(int id, int gpa)
  */
 void usage(char *exename)
 {
-    printf("usage: %s -[h|a|c|d|f|p|z] options.  Where:\n", exename);
+    printf("usage: %s -[h|a|c|d|f|p|q|s|u|x|z] options.  Where:\n", exename);
     printf("\t-h:  prints help\n");
     printf("\t-a id first_name last_name gpa(as 3 digit int):  adds a student\n");
     printf("\t-c:  counts the records in the database\n");
     printf("\t-d id:  deletes a student\n");
     printf("\t-f id:  finds and prints a student in the database\n");
-    printf("\t-p:  prints all records in the student database\n");
-    printf("\t-x:  compress the database file [EXTRA CREDIT]\n");
+    printf("\t-p [--sort=lname|gpa] [--mem=bytes]:  prints all records in the student database\n");
+    printf("\t-q fragment:  finds students whose first or last name contains fragment\n");
+    printf("\t-s count [dir ...]:  splits the database into count shards placed in dirs\n");
+    printf("\t-u id field=value ...:  updates fname, lname and/or gpa of a student\n");
+    printf("\t-x [shard]:  compress the database file, or only one shard of it [EXTRA CREDIT]\n");
     printf("\t-z:  zero db file (remove all records)\n");
 }
 
@@ -592,6 +930,11 @@ int main(int argc, char *argv[])
     int exit_code; // exit code to shell
     int id;        // userid from argv[2]
     int gpa;       // gpa from argv[5]
+    char *fname;   // first name from a field=value update
+    char *lname;   // last name from a field=value update
+    bool gpaSet;   // whether a field=value update sets the gpa
+    int sortKey;      // sort order for -p --sort=
+    size_t memBudget; // memory budget for -p --mem=
 
     // space for a student structure which we will get back from
     // some of the functions we will be writing such as get_student(),
@@ -626,6 +969,17 @@ int main(int argc, char *argv[])
         exit(EXIT_FAIL_DB);
     }
 
+    // operations that change or search names also need the trigram index,
+    // zeroing the db reopens it below so both files are emptied together
+    if (opt == 'a' || opt == 'd' || opt == 'q' || opt == 'u')
+    {
+        if (tgidx_open(fd, TGX_FILE, false) < 0)
+        {
+            close(fd);
+            exit(EXIT_FAIL_DB);
+        }
+    }
+
     // set rc to the return code of the operation to ensure the program
     // use that to determine the proper exit_code.  Look at the header
     // sdbsc.h for expected values.
@@ -726,7 +1080,70 @@ int main(int argc, char *argv[])
         // prog_name     -p
         //-----------------
         // example:  prog_name -p
-        rc = print_db(fd);
+        if (argc == 2)
+        {
+            rc = print_db(fd);
+            if (rc < 0)
+                exit_code = EXIT_FAIL_DB;
+            break;
+        }
+
+        // example:  prog_name -p --sort=gpa --mem=1048576
+        exit_code = parse_sort_args(argc - 2, &argv[2], &sortKey, &memBudget);
+        if (exit_code != EXIT_OK)
+        {
+            break;
+        }
+        rc = print_db_sorted(fd, sortKey, memBudget);
+        if (rc < 0)
+            exit_code = EXIT_FAIL_DB;
+        break;
+
+    case 'q':
+        //    arv[0] arv[1]  arv[2]
+        // prog_name     -q  fragment
+        //---------------------------
+        // example:  prog_name -q ohns
+        if (argc != 3)
+        {
+            usage(argv[0]);
+            exit_code = EXIT_FAIL_ARGS;
+            break;
+        }
+        rc = search_students(fd, argv[2]);
+        if (rc < 0)
+            exit_code = EXIT_FAIL_DB;
+        break;
+
+    case 'u':
+        //   arv[0] arv[1]  arv[2]         arv[3] ...
+        // prog_name     -u      id  field=value ...
+        //--------------------------------------------
+        // example:  prog_name -u 1 gpa=355 lname=Smith
+        if (argc < 4)
+        {
+            usage(argv[0]);
+            exit_code = EXIT_FAIL_ARGS;
+            break;
+        }
+        id = atoi(argv[2]);
+        exit_code = parse_update_args(argc - 3, &argv[3], &fname, &lname, &gpa, &gpaSet);
+        if (exit_code == EXIT_OK)
+        {
+            // only validate the gpa if it is being changed
+            exit_code = validate_range(id, gpaSet ? gpa : MIN_STD_GPA);
+            if (exit_code == EXIT_FAIL_ARGS)
+            {
+                printf(M_ERR_STD_RNG_UPD);
+                break;
+            }
+        }
+        if (exit_code != EXIT_OK)
+        {
+            break;
+        }
+
+        rc = update_student(fd, id, fname, lname, gpaSet ? &gpa : NULL);
         if (rc < 0)
             exit_code = EXIT_FAIL_DB;
         break;
@@ -739,8 +1156,52 @@ int main(int argc, char *argv[])
 
         // remember compress_db returns a fd of the compressed database.
         // we close it after this switch statement
-        fd = compress_db(fd);
-        if (fd < 0)
+        if (argc == 3)
+        {
+            // example:  prog_name -x 2   (only compress shard 2)
+            db_shard_t *table;
+            int count = shard_table(fd, &table);
+            char *end;
+            errno = 0;
+            long shard = strtol(argv[2], &end, 10);
+            if (argv[2][0] == '\0' || *end != '\0' || errno != 0 || shard < 0 || shard >= count)
+            {
+                printf(M_ERR_SHARD_ARG, argv[2], count - 1);
+                exit_code = EXIT_FAIL_ARGS;
+                break;
+            }
+            rc = compress_db_shard(fd, (int)shard);
+        }
+        else
+        {
+            rc = compress_db(fd);
+        }
+        if (rc < 0)
+            exit_code = EXIT_FAIL_DB;
+        else
+            fd = rc;
+        break;
+
+    case 's':
+        //    arv[0] arv[1] arv[2]   arv[3] ...
+        // prog_name     -s  count  [dir ...]
+        //-------------------------------------
+        // example:  prog_name -s 4 /mnt/disk1 /mnt/disk2
+        if (argc < 3)
+        {
+            usage(argv[0]);
+            exit_code = EXIT_FAIL_ARGS;
+            break;
+        }
+        int shards = atoi(argv[2]);
+        if (shards < 2 || shards > MAX_SHARDS)
+        {
+            printf(M_ERR_SHARD_CNT, MAX_SHARDS);
+            exit_code = EXIT_FAIL_ARGS;
+            break;
+        }
+        rc = shard_create(fd, shards, &argv[3], argc - 3);
+        if (rc < 0)
             exit_code = EXIT_FAIL_DB;
         break;
 
@@ -758,6 +1219,11 @@ int main(int argc, char *argv[])
             exit_code = EXIT_FAIL_DB;
             break;
         }
+        if (tgidx_open(fd, TGX_FILE, true) < 0)
+        {
+            exit_code = EXIT_FAIL_DB;
+            break;
+        }
         printf(M_DB_ZERO_OK);
         exit_code = EXIT_OK;
         break;
@@ -768,6 +1234,8 @@ int main(int argc, char *argv[])
 
     // dont forget to close the file before exiting, and setting the
     // proper exit code - see the header file for expected values
+    tgidx_close();
+    shard_close_all();
     close(fd);
     exit(exit_code);
 }
\ No newline at end of file
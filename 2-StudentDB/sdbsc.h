@@ -7,7 +7,11 @@ int open_db(char *dbFile, bool should_truncate);
 int add_student(int fd, int id, char *fname, char *lname, int gpa);
 int get_student(int fd, int id, student_t *s);
 int del_student(int fd, int id);
+int update_student(int fd, int id, char *fname, char *lname, const int *gpa);
+int parse_update_args(int count, char *args[], char **fname, char **lname, int *gpa, bool *gpaSet);
+int parse_sort_args(int count, char *args[], int *key, size_t *mem_budget);
 int compress_db(int fd);
+int compress_db_shard(int fd, int shard);
 void print_student(student_t *s);
 int validate_range(int id, int gpa);
 int count_db_records(int fd);
@@ -42,15 +46,26 @@ void usage(char *);
 #define M_ERR_DB_READ "Error reading DB file, exiting!\n"
 #define M_ERR_DB_WRITE "Error writing DB file, exiting!\n"
 #define M_ERR_DB_ADD_DUP "Cant add student with ID=%d, already exists in db.\n"
+#define M_ERR_STD_RNG_UPD "Cant update student, either ID or GPA out of allowable range!\n"
+#define M_ERR_STD_UPD_FIELD "Cant update student, invalid field=value argument '%s'.\n"
+#define M_ERR_DB_SHARDED "Database is already sharded.\n"
+#define M_ERR_SHARD_MANIFEST "Error reading shard manifest, exiting!\n"
+#define M_ERR_SHARD_NUM "Shard %d does not exist, shards are numbered 0 to %d.\n"
+#define M_ERR_SHARD_ARG "Shard '%s' does not exist, shards are numbered 0 to %d.\n"
+#define M_ERR_SHARD_CNT "Cant shard database, shard count must be between 2 and %d.\n"
+#define M_ERR_SORT_ARGS "Cant print sorted, invalid argument '%s' (use --sort=lname|gpa [--mem=bytes]).\n"
 #define M_ERR_STD_PRINT "Cant print student. Student is NULL or ID is zero\n"
 
 #define M_STD_ADDED "Student %d added to database.\n"
+#define M_STD_UPDATED "Student %d updated in database.\n"
 #define M_STD_DEL_MSG "Student %d was deleted from database.\n"
 #define M_STD_NOT_FND_MSG "Student %d was not found in database.\n"
 #define M_DB_COMPRESSED_OK "Database successfully compressed!\n"
+#define M_DB_SHARDED_OK "Database split into %d shards.\n"
 #define M_DB_ZERO_OK "All database records removed!\n"
 #define M_DB_EMPTY "Database contains no student records.\n"
 #define M_DB_RECORD_CNT "Database contains %d student record(s).\n"
+#define M_STD_SRCH_NONE "No students matched '%s'.\n"
 #define M_NOT_IMPL "The requested operation is not implemented yet!\n"
 
 // useful format strings for print students
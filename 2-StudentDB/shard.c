@@ -0,0 +1,476 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <stdbool.h>
+
+// database include files
+#include "db.h"
+#include "sdbsc.h"
+#include "shard.h"
+
+// the shards listed in the manifest, num_shards is 0 for the single file
+// layout.  Loaded by open_db() and used by every operation after that
+static db_shard_t shards[MAX_SHARDS];
+static int num_shards = 0;
+
+// the single file layout presented as a table with one shard
+static db_shard_t solo_shard;
+
+// arguments for running a shard_task_fn on its own thread
+typedef struct shard_job
+{
+    shard_task_fn task;
+    db_shard_t *shard;
+    int idx;
+    void *ctx;
+    int rc;
+} shard_job_t;
+
+// opens (creating if needed) a shard or scratch file with the same
+// permissions that open_db() uses for the database
+int shard_open_file(const char *path, bool should_truncate)
+{
+    mode_t mode = S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP;
+    int flags = O_RDWR | O_CREAT;
+
+    if (should_truncate)
+        flags |= O_TRUNC;
+
+    return open(path, flags, mode);
+}
+
+// sets the file and scratch file names of a shard, returns ERR_DB_FILE if
+// path does not fit
+static int shard_set_path(db_shard_t *shard, const char *path)
+{
+    if (strlen(path) >= sizeof(shard->path))
+    {
+        return ERR_DB_FILE;
+    }
+    strcpy(shard->path, path);
+    snprintf(shard->tmp_path, sizeof(shard->tmp_path), "%s.tmp", path);
+    return NO_ERROR;
+}
+
+// finds the shard that owns id, ids outside every range go to the closest one
+static db_shard_t *find_shard(db_shard_t *table, int count, int id)
+{
+    int low = 0;
+    int high = count - 1;
+
+    while (low < high)
+    {
+        int mid = (low + high) / 2;
+        if (id > table[mid].hi)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+    return &table[low];
+}
+
+/*
+ *  shard_load
+ *      should_truncate:  indicates if opening the shards also empties them
+ *
+ *  Reads the shard manifest, if there is one, and opens every shard listed
+ *  in it.  Any shards that were already open are closed first.
+ *
+ *  returns:  <number>       number of shards, 0 for the single file layout
+ *            ERR_DB_FILE    the manifest is invalid or a shard can't be opened
+ *
+ *  console:  M_ERR_SHARD_MANIFEST  the manifest could not be parsed
+ */
+int shard_load(bool should_truncate)
+{
+    char magic[sizeof(SHARD_MANIFEST_MAGIC) + 1];
+    char path[SHARD_PATH_MAX];
+    int version;
+    int count;
+
+    shard_close_all();
+
+    FILE *manifest = fopen(SHARD_MANIFEST_FILE, "r");
+    if (manifest == NULL)
+    {
+        return (errno == ENOENT) ? 0 : ERR_DB_FILE;
+    }
+
+    if (fscanf(manifest, "%9s %d %d", magic, &version, &count) != 3 ||
+        strcmp(magic, SHARD_MANIFEST_MAGIC) != 0 ||
+        version != SHARD_MANIFEST_VERSION || count < 1 || count > MAX_SHARDS)
+    {
+        printf(M_ERR_SHARD_MANIFEST);
+        fclose(manifest);
+        return ERR_DB_FILE;
+    }
+
+    for (int i = 0; i < count; i++)
+    {
+        db_shard_t *shard = &shards[i];
+        if (fscanf(manifest, "%d %d %255s", &shard->lo, &shard->hi, path) != 3 ||
+            shard_set_path(shard, path) < 0)
+        {
+            printf(M_ERR_SHARD_MANIFEST);
+            fclose(manifest);
+            shard_close_all();
+            return ERR_DB_FILE;
+        }
+        shard->fd = shard_open_file(shard->path, should_truncate);
+        if (shard->fd < 0)
+        {
+            fclose(manifest);
+            shard_close_all();
+            return ERR_DB_FILE;
+        }
+        num_shards = i + 1;
+    }
+
+    fclose(manifest);
+    return num_shards;
+}
+
+// closes every open shard and goes back to the single file layout
+void shard_close_all(void)
+{
+    for (int i = 0; i < num_shards; i++)
+    {
+        close(shards[i].fd);
+    }
+    num_shards = 0;
+}
+
+// returns the file descriptor that holds student id, this is fd itself
+// when the database is not sharded
+int shard_fd(int fd, int id)
+{
+    if (num_shards == 0)
+    {
+        return fd;
+    }
+    return find_shard(shards, num_shards, id)->fd;
+}
+
+// points *table at the shards of the database and returns how many there
+// are.  The single file layout is returned as one shard wrapping fd
+int shard_table(int fd, db_shard_t **table)
+{
+    if (num_shards > 0)
+    {
+        *table = shards;
+        return num_shards;
+    }
+
+    solo_shard.lo = MIN_STD_ID;
+    solo_shard.hi = MAX_STD_ID;
+    solo_shard.fd = fd;
+    strcpy(solo_shard.path, DB_FILE);
+    strcpy(solo_shard.tmp_path, TMP_DB_FILE);
+    *table = &solo_shard;
+    return 1;
+}
+
+/*
+ *  shard_scan
+ *      shard:  the shard to read
+ *      visit:  called with every valid student in the shard, in id order
+ *      ctx:    passed through to visit
+ *
+ *  Reads the id range of a shard SHARD_SCAN_BATCH records at a time using
+ *  pread(), so scans of different shards can safely run at the same time.
+ *  Reading stops at the end of the shard file or its last id.
+ *
+ *  returns:  NO_ERROR       on success
+ *            ERR_DB_FILE    database file I/O issue
+ *            <negative>     the first error returned by visit
+ *
+ *  console:  Does not produce any console I/O
+ */
+int shard_scan(db_shard_t *shard, record_visit_fn visit, void *ctx)
+{
+    student_t *batch = malloc(SHARD_SCAN_BATCH * STUDENT_RECORD_SIZE);
+    if (batch == NULL)
+    {
+        return ERR_DB_FILE;
+    }
+
+    off_t offset = (off_t)shard->lo * STUDENT_RECORD_SIZE;
+    off_t end = ((off_t)shard->hi + 1) * STUDENT_RECORD_SIZE;
+    int rc = NO_ERROR;
+
+    while (offset < end && rc == NO_ERROR)
+    {
+        size_t want = SHARD_SCAN_BATCH * STUDENT_RECORD_SIZE;
+        if ((off_t)want > end - offset)
+        {
+            want = end - offset;
+        }
+
+        ssize_t bytesRead = pread(shard->fd, batch, want, offset);
+        if (bytesRead < 0)
+        {
+            rc = ERR_DB_FILE;
+            break;
+        }
+
+        int records = bytesRead / STUDENT_RECORD_SIZE;
+        for (int i = 0; i < records && rc == NO_ERROR; i++)
+        {
+            if (memcmp(&batch[i], &EMPTY_STUDENT_RECORD, STUDENT_RECORD_SIZE) != 0)
+            {
+                rc = visit(&batch[i], ctx);
+            }
+        }
+
+        // a short read means we hit the end of the file
+        if ((size_t)bytesRead < want)
+        {
+            break;
+        }
+        offset += bytesRead;
+    }
+
+    free(batch);
+    return rc;
+}
+
+static void *shard_job_main(void *arg)
+{
+    shard_job_t *job = (shard_job_t *)arg;
+    job->rc = job->task(job->shard, job->idx, job->ctx);
+    return NULL;
+}
+
+/*
+ *  shard_for_each
+ *      fd:    linux file descriptor of the database
+ *      task:  the work to do for each shard
+ *      ctx:   passed through to task, typically an array indexed by shard
+ *
+ *  Runs task for every shard of the database.  With more than one shard
+ *  each task gets its own thread so the shards are scanned in parallel,
+ *  otherwise the task simply runs on the calling thread.
+ *
+ *  returns:  NO_ERROR       every task succeeded
+ *            <negative>     the error returned by the first failing shard
+ *
+ *  console:  Does not produce any console I/O
+ */
+int shard_for_each(int fd, shard_task_fn task, void *ctx)
+{
+    db_shard_t *table;
+    int count = shard_table(fd, &table);
+
+    if (count == 1)
+    {
+        return task(&table[0], 0, ctx);
+    }
+
+    shard_job_t jobs[MAX_SHARDS];
+    pthread_t threads[MAX_SHARDS];
+    bool started[MAX_SHARDS] = {false};
+
+    for (int i = 0; i < count; i++)
+    {
+        jobs[i].task = task;
+        jobs[i].shard = &table[i];
+        jobs[i].idx = i;
+        jobs[i].ctx = ctx;
+        jobs[i].rc = NO_ERROR;
+
+        // if we are out of threads just do the work here instead
+        if (pthread_create(&threads[i], NULL, shard_job_main, &jobs[i]) == 0)
+        {
+            started[i] = true;
+        }
+        else
+        {
+            shard_job_main(&jobs[i]);
+        }
+    }
+
+    int rc = NO_ERROR;
+    for (int i = 0; i < count; i++)
+    {
+        if (started[i])
+        {
+            pthread_join(threads[i], NULL);
+        }
+        if (rc == NO_ERROR && jobs[i].rc < 0)
+        {
+            rc = jobs[i].rc;
+        }
+    }
+
+    return rc;
+}
+
+// returns the highest id that can be stored in the existing shard files,
+// slots past the end of a file can't hold a student
+int shard_max_id(int fd)
+{
+    db_shard_t *table;
+    int count = shard_table(fd, &table);
+    int maxId = 0;
+    struct stat st;
+
+    for (int i = 0; i < count; i++)
+    {
+        if (fstat(table[i].fd, &st) < 0)
+        {
+            return table[count - 1].hi;
+        }
+
+        off_t lastSlot = st.st_size / STUDENT_RECORD_SIZE - 1;
+        int shardMax = (lastSlot < table[i].hi) ? (int)lastSlot : table[i].hi;
+        if (shardMax > maxId)
+        {
+            maxId = shardMax;
+        }
+    }
+
+    return maxId;
+}
+
+// copies a student from the single file layout into the new shard that owns it
+static int migrate_visit(student_t *s, void *ctx)
+{
+    db_shard_t *shard = find_shard((db_shard_t *)ctx, num_shards, s->id);
+    off_t offset = (off_t)s->id * STUDENT_RECORD_SIZE;
+
+    if (pwrite(shard->fd, s, STUDENT_RECORD_SIZE, offset) != STUDENT_RECORD_SIZE)
+    {
+        return ERR_DB_FILE;
+    }
+    return NO_ERROR;
+}
+
+// writes the manifest for table, renaming it into place only once complete
+static int write_manifest(db_shard_t *table, int count)
+{
+    FILE *manifest = fopen(TMP_SHARD_MANIFEST_FILE, "w");
+    if (manifest == NULL)
+    {
+        return ERR_DB_FILE;
+    }
+
+    fprintf(manifest, "%s %d %d\n", SHARD_MANIFEST_MAGIC, SHARD_MANIFEST_VERSION, count);
+    for (int i = 0; i < count; i++)
+    {
+        fprintf(manifest, "%d %d %s\n", table[i].lo, table[i].hi, table[i].path);
+    }
+
+    if (fclose(manifest) != 0 || rename(TMP_SHARD_MANIFEST_FILE, SHARD_MANIFEST_FILE) < 0)
+    {
+        return ERR_DB_FILE;
+    }
+    return NO_ERROR;
+}
+
+/*
+ *  shard_create
+ *      fd:        linux file descriptor of the (single file) database
+ *      count:     number of shards to split the id range into
+ *      dirs:      directories to place the shards in, used round robin
+ *      num_dirs:  number of entries in dirs, 0 places every shard in "."
+ *
+ *  Splits the student id range into count equal ranges, creates a shard
+ *  file for each one and moves the students already in DB_FILE into their
+ *  shard.  The manifest is written to a temporary file and renamed into
+ *  place so a failed split leaves the single file layout untouched.
+ *  Finally DB_FILE is emptied since its students now live in the shards.
+ *
+ *  returns:  NO_ERROR       the database was split
+ *            ERR_DB_FILE    database, shard or manifest file I/O issue
+ *            ERR_DB_OP      the database is already sharded
+ *
+ *  console:  M_DB_SHARDED_OK    on success
+ *            M_ERR_DB_SHARDED   the database is already sharded
+ *            M_ERR_DB_CREATE    a shard or the manifest could not be created
+ *            M_ERR_DB_WRITE     error moving students into the shards
+ */
+int shard_create(int fd, int count, char *dirs[], int num_dirs)
+{
+    db_shard_t table[MAX_SHARDS];
+    int span = (MAX_STD_ID - MIN_STD_ID + count) / count;
+
+    if (num_shards > 0)
+    {
+        printf(M_ERR_DB_SHARDED);
+        return ERR_DB_OP;
+    }
+
+    for (int i = 0; i < count; i++)
+    {
+        db_shard_t *shard = &table[i];
+        const char *dir = (num_dirs > 0) ? dirs[i % num_dirs] : ".";
+
+        shard->lo = MIN_STD_ID + i * span;
+        shard->hi = (i == count - 1) ? MAX_STD_ID : shard->lo + span - 1;
+
+        char path[SHARD_PATH_MAX];
+        int len = snprintf(path, sizeof(path), "%s/student.%d.db", dir, i);
+        shard->fd = -1;
+        if (len < (int)sizeof(path) && shard_set_path(shard, path) == NO_ERROR)
+        {
+            shard->fd = shard_open_file(shard->path, true);
+        }
+        if (shard->fd < 0)
+        {
+            printf(M_ERR_DB_CREATE);
+            for (int j = 0; j < i; j++)
+            {
+                close(table[j].fd);
+            }
+            return ERR_DB_FILE;
+        }
+    }
+
+    // move the existing students over, find_shard() needs num_shards set
+    db_shard_t *solo;
+    shard_table(fd, &solo);
+    num_shards = count;
+    int rc = shard_scan(solo, migrate_visit, table);
+    num_shards = 0;
+
+    if (rc == NO_ERROR && write_manifest(table, count) < 0)
+    {
+        printf(M_ERR_DB_CREATE);
+        rc = ERR_DB_FILE;
+    }
+    else if (rc != NO_ERROR)
+    {
+        printf(M_ERR_DB_WRITE);
+    }
+
+    if (rc != NO_ERROR)
+    {
+        for (int i = 0; i < count; i++)
+        {
+            close(table[i].fd);
+        }
+        return ERR_DB_FILE;
+    }
+
+    // the students are safely in the shards now
+    if (ftruncate(fd, 0) < 0)
+    {
+        printf(M_ERR_DB_WRITE);
+        for (int i = 0; i < count; i++)
+        {
+            close(table[i].fd);
+        }
+        return ERR_DB_FILE;
+    }
+
+    memcpy(shards, table, sizeof(db_shard_t) * count);
+    num_shards = count;
+
+    printf(M_DB_SHARDED_OK, count);
+    return NO_ERROR;
+}
@@ -0,0 +1,58 @@
+#ifndef __SHARD_H__
+#define __SHARD_H__
+
+#include <stdio.h>
+#include <stdbool.h>
+
+#include "db.h" //get student record type
+
+// A sharded database splits the student id range over several files that
+// are listed in a small text manifest next to DB_FILE:
+//
+//      SDBSHARDS 1 <number of shards>
+//      <first id> <last id> <path of shard file>
+//      ...
+//
+// Each shard keeps its students at the same offset they would have in the
+// single file layout (id * STUDENT_RECORD_SIZE), so the part of the id range
+// that belongs to other shards is just a hole in the sparse shard file.
+// When there is no manifest the database is a single shard covering every
+// id that is stored in DB_FILE.
+#define SHARD_MANIFEST_MAGIC "SDBSHARDS"
+#define SHARD_MANIFEST_VERSION 1
+#define MAX_SHARDS 64
+#define SHARD_PATH_MAX 256
+
+// number of records read by a single pread() while scanning a shard
+#define SHARD_SCAN_BATCH 256
+
+// used instead of a shard number to work on all of the shards
+#define SHARD_ALL -1
+
+typedef struct db_shard
+{
+    int lo;                       // first student id stored in this shard
+    int hi;                       // last student id stored in this shard
+    int fd;                       // open file descriptor of the shard file
+    char path[SHARD_PATH_MAX];        // where the shard file lives
+    char tmp_path[SHARD_PATH_MAX + 8]; // scratch file used to compress the shard
+} db_shard_t;
+
+// called for every valid student found by shard_scan()
+typedef int (*record_visit_fn)(student_t *s, void *ctx);
+
+// called once per shard, on its own thread when there is more than one shard
+typedef int (*shard_task_fn)(db_shard_t *shard, int idx, void *ctx);
+
+// prototypes for the shard layer, see shard.c
+int shard_open_file(const char *path, bool should_truncate);
+int shard_load(bool should_truncate);
+void shard_close_all(void);
+int shard_fd(int fd, int id);
+int shard_table(int fd, db_shard_t **table);
+int shard_scan(db_shard_t *shard, record_visit_fn visit, void *ctx);
+int shard_for_each(int fd, shard_task_fn task, void *ctx);
+int shard_max_id(int fd);
+int shard_create(int fd, int count, char *dirs[], int num_dirs);
+
+#endif
@@ -0,0 +1,473 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdbool.h>
+#include <sys/types.h>
+
+// database include files
+#include "db.h"
+#include "sdbsc.h"
+#include "shard.h"
+#include "sort.h"
+
+// where a sorted run sits in a spill file
+typedef struct sort_extent
+{
+    off_t off;    // byte offset of its first student
+    size_t count; // students in the run
+} sort_extent_t;
+
+// the in memory part of a sorted listing
+typedef struct sort_buff
+{
+    student_t *recs;     // students gathered so far
+    size_t count;        // number of students in recs
+    size_t cap;          // how many students fit in the memory budget
+    int key;             // SORT_KEY_*
+    FILE *spill;         // every spilled run, one after another
+    sort_extent_t *runs; // the runs in spill, each one sorted
+    int num_runs;
+    size_t spilled;      // students written to spill so far
+} sort_buff_t;
+
+// one spilled run while it is being merged
+typedef struct sort_run
+{
+    int fd;          // of the spill file, shared by all the runs
+    off_t next;      // where the next batch of the run is read from
+    size_t left;     // students of the run not read yet
+    student_t *buff; // read ahead buffer for this run
+    size_t count;    // valid students in buff
+    size_t pos;      // next student to hand out
+} sort_run_t;
+
+// called with every student in merged order
+typedef int (*sort_emit_fn)(student_t *s, void *ctx);
+
+// an intermediate merge pass writing its runs to a new spill file
+typedef struct sort_pass
+{
+    FILE *dst;
+    size_t written; // students written to dst so far
+} sort_pass_t;
+
+// maps the value of --sort= to a SORT_KEY_*, returns -1 if it is unknown
+int parse_sort_key(const char *name)
+{
+    if (strcmp(name, "lname") == 0)
+        return SORT_KEY_LNAME;
+    if (strcmp(name, "gpa") == 0)
+        return SORT_KEY_GPA;
+    return -1;
+}
+
+// orders by last name, then first name, then id so the listing is the same
+// no matter how the students were split into runs
+static int cmp_lname(const void *a, const void *b)
+{
+    const student_t *x = (const student_t *)a;
+    const student_t *y = (const student_t *)b;
+
+    int rc = strncmp(x->lname, y->lname, sizeof(x->lname));
+    if (rc == 0)
+        rc = strncmp(x->fname, y->fname, sizeof(x->fname));
+    if (rc == 0)
+        rc = (x->id > y->id) - (x->id < y->id);
+    return rc;
+}
+
+// orders by gpa then id, matching what gpa_counting_sort() produces
+static int cmp_gpa(const void *a, const void *b)
+{
+    const student_t *x = (const student_t *)a;
+    const student_t *y = (const student_t *)b;
+
+    if (x->gpa != y->gpa)
+        return (x->gpa > y->gpa) - (x->gpa < y->gpa);
+    return (x->id > y->id) - (x->id < y->id);
+}
+
+// gpas only have MAX_STD_GPA + 1 possible values, so a stable counting sort
+// is linear.  Students are gathered in id order so ties stay in id order
+static int gpa_counting_sort(student_t *recs, size_t count)
+{
+    size_t starts[MAX_STD_GPA + 2] = {0};
+    student_t *sorted = malloc(count * sizeof(student_t));
+    if (sorted == NULL)
+    {
+        return ERR_DB_OP;
+    }
+
+    for (size_t i = 0; i < count; i++)
+    {
+        starts[recs[i].gpa + 1]++;
+    }
+    for (int g = 1; g <= MAX_STD_GPA + 1; g++)
+    {
+        starts[g] += starts[g - 1];
+    }
+    for (size_t i = 0; i < count; i++)
+    {
+        sorted[starts[recs[i].gpa]++] = recs[i];
+    }
+
+    memcpy(recs, sorted, count * sizeof(student_t));
+    free(sorted);
+    return NO_ERROR;
+}
+
+static int sort_recs(sort_buff_t *sb)
+{
+    if (sb->key == SORT_KEY_GPA)
+    {
+        // fall back to qsort if a gpa is somehow out of range or there is
+        // no memory for the counting sort's second buffer
+        bool inRange = true;
+        for (size_t i = 0; i < sb->count && inRange; i++)
+        {
+            inRange = sb->recs[i].gpa >= MIN_STD_GPA && sb->recs[i].gpa <= MAX_STD_GPA;
+        }
+        if (!inRange || gpa_counting_sort(sb->recs, sb->count) != NO_ERROR)
+        {
+            qsort(sb->recs, sb->count, sizeof(student_t), cmp_gpa);
+        }
+        return NO_ERROR;
+    }
+
+    qsort(sb->recs, sb->count, sizeof(student_t), cmp_lname);
+    return NO_ERROR;
+}
+
+// sorts the buffer and appends it to the spill file as a new run, emptying
+// the buffer
+static int spill_run(sort_buff_t *sb)
+{
+    sort_extent_t *runs = realloc(sb->runs, (sb->num_runs + 1) * sizeof(sort_extent_t));
+    if (runs == NULL)
+    {
+        return ERR_DB_FILE;
+    }
+    sb->runs = runs;
+
+    // tmpfile() is removed automatically once it is closed
+    if (sb->spill == NULL && (sb->spill = tmpfile()) == NULL)
+    {
+        return ERR_DB_FILE;
+    }
+
+    sort_recs(sb);
+    if (fwrite(sb->recs, sizeof(student_t), sb->count, sb->spill) != sb->count)
+    {
+        return ERR_DB_FILE;
+    }
+    sb->runs[sb->num_runs].off = (off_t)sb->spilled * sizeof(student_t);
+    sb->runs[sb->num_runs].count = sb->count;
+    sb->num_runs++;
+    sb->spilled += sb->count;
+
+    sb->count = 0;
+    return NO_ERROR;
+}
+
+static int gather_visit(student_t *s, void *ctx)
+{
+    sort_buff_t *sb = (sort_buff_t *)ctx;
+
+    if (sb->count == sb->cap && spill_run(sb) < 0)
+    {
+        return ERR_DB_FILE;
+    }
+    sb->recs[sb->count++] = *s;
+    return NO_ERROR;
+}
+
+static int print_sorted_row(student_t *s, void *ctx)
+{
+    int *rows = (int *)ctx;
+    if (*rows == 0)
+    {
+        printf(STUDENT_PRINT_HDR_STRING, "ID", "FIRST NAME", "LAST_NAME", "GPA");
+    }
+    float calculated_gpa_from_student = s->gpa / 100.0;
+    printf(STUDENT_PRINT_FMT_STRING, s->id, s->fname, s->lname, calculated_gpa_from_student);
+    (*rows)++;
+    return NO_ERROR;
+}
+
+static int write_pass_row(student_t *s, void *ctx)
+{
+    sort_pass_t *pass = (sort_pass_t *)ctx;
+    if (fwrite(s, sizeof(student_t), 1, pass->dst) != 1)
+    {
+        return ERR_DB_FILE;
+    }
+    pass->written++;
+    return NO_ERROR;
+}
+
+// moves heap[i] down until both of its children are larger
+static void heap_sift_down(sort_run_t **heap, int size, int i, int (*cmp)(const void *, const void *))
+{
+    while (1)
+    {
+        int smallest = i;
+        int left = 2 * i + 1;
+        int right = 2 * i + 2;
+
+        if (left < size && cmp(&heap[left]->buff[heap[left]->pos], &heap[smallest]->buff[heap[smallest]->pos]) < 0)
+            smallest = left;
+        if (right < size && cmp(&heap[right]->buff[heap[right]->pos], &heap[smallest]->buff[heap[smallest]->pos]) < 0)
+            smallest = right;
+        if (smallest == i)
+            return;
+
+        sort_run_t *tmp = heap[i];
+        heap[i] = heap[smallest];
+        heap[smallest] = tmp;
+        i = smallest;
+    }
+}
+
+// reads the next batch of a run into its buffer, an empty buffer means the
+// run is done
+static int run_refill(sort_run_t *run, size_t per_run)
+{
+    size_t want = (run->left < per_run) ? run->left : per_run;
+    ssize_t len = (ssize_t)(want * sizeof(student_t));
+    if (want > 0 && pread(run->fd, run->buff, len, run->next) != len)
+    {
+        return ERR_DB_FILE;
+    }
+    run->next += len;
+    run->left -= want;
+    run->count = want;
+    run->pos = 0;
+    return NO_ERROR;
+}
+
+// merges num runs of the spill file fd with a min heap keyed on each run's
+// next student.  runs and heap have room for num, and each run's buff for
+// per_run students
+static int merge_group(int fd, sort_extent_t *ext, int num, sort_run_t *runs, sort_run_t **heap, size_t per_run,
+                       int (*cmp)(const void *, const void *), sort_emit_fn emit, void *ctx)
+{
+    int size = 0;
+    int rc = NO_ERROR;
+
+    for (int i = 0; i < num && rc == NO_ERROR; i++)
+    {
+        runs[i].fd = fd;
+        runs[i].next = ext[i].off;
+        runs[i].left = ext[i].count;
+        rc = run_refill(&runs[i], per_run);
+        if (runs[i].count > 0)
+        {
+            heap[size++] = &runs[i];
+        }
+    }
+
+    if (rc == NO_ERROR)
+    {
+        for (int i = size / 2 - 1; i >= 0; i--)
+        {
+            heap_sift_down(heap, size, i, cmp);
+        }
+    }
+
+    while (rc == NO_ERROR && size > 0)
+    {
+        sort_run_t *top = heap[0];
+        rc = emit(&top->buff[top->pos++], ctx);
+
+        // pull the next batch of this run once its buffer is used up
+        if (rc == NO_ERROR && top->pos == top->count)
+        {
+            rc = run_refill(top, per_run);
+            if (top->count == 0)
+            {
+                heap[0] = heap[--size];
+            }
+        }
+        heap_sift_down(heap, size, 0, cmp);
+    }
+
+    return rc;
+}
+
+// merges the runs of one spill file SORT_MAX_FAN_IN or fewer at a time into
+// a new spill file, which replaces it.  Returns NO_ERROR or ERR_DB_FILE
+static int merge_pass(sort_buff_t *sb, int fan_in, sort_run_t *runs, sort_run_t **heap, size_t per_run,
+                      int (*cmp)(const void *, const void *))
+{
+    int numMerged = (sb->num_runs + fan_in - 1) / fan_in;
+    sort_extent_t *merged = malloc(numMerged * sizeof(sort_extent_t));
+    sort_pass_t pass = {tmpfile(), 0};
+    int rc = (merged == NULL || pass.dst == NULL) ? ERR_DB_FILE : NO_ERROR;
+
+    for (int g = 0; g < numMerged && rc == NO_ERROR; g++)
+    {
+        int first = g * fan_in;
+        int num = (sb->num_runs - first < fan_in) ? sb->num_runs - first : fan_in;
+
+        merged[g].off = (off_t)pass.written * sizeof(student_t);
+        rc = merge_group(fileno(sb->spill), &sb->runs[first], num, runs, heap, per_run, cmp, write_pass_row, &pass);
+        merged[g].count = pass.written - merged[g].off / sizeof(student_t);
+    }
+    if (rc == NO_ERROR && fflush(pass.dst) != 0)
+    {
+        rc = ERR_DB_FILE;
+    }
+
+    if (rc != NO_ERROR)
+    {
+        if (pass.dst != NULL)
+            fclose(pass.dst);
+        free(merged);
+        return ERR_DB_FILE;
+    }
+
+    fclose(sb->spill);
+    free(sb->runs);
+    sb->spill = pass.dst;
+    sb->runs = merged;
+    sb->num_runs = numMerged;
+    return NO_ERROR;
+}
+
+// merges every spilled run and prints the result.  The memory budget is
+// split evenly between the read buffers of the runs being merged, so at most
+// a budget's worth of SORT_MIN_RUN_BUFF buffers, and never more than
+// SORT_MAX_FAN_IN, are merged at once.  More runs than that are merged in
+// passes through another spill file until few enough are left
+static int merge_runs(sort_buff_t *sb, size_t mem_budget, int *rows)
+{
+    int (*cmp)(const void *, const void *) = (sb->key == SORT_KEY_GPA) ? cmp_gpa : cmp_lname;
+    size_t budgetRecs = mem_budget / sizeof(student_t);
+    size_t fanIn = budgetRecs / SORT_MIN_RUN_BUFF;
+    if (fanIn > SORT_MAX_FAN_IN)
+        fanIn = SORT_MAX_FAN_IN;
+    if (fanIn < 2)
+        fanIn = 2;
+    size_t perRun = budgetRecs / fanIn;
+
+    sort_run_t *runs = calloc(fanIn, sizeof(sort_run_t));
+    sort_run_t **heap = calloc(fanIn, sizeof(sort_run_t *));
+    student_t *buffs = malloc(fanIn * perRun * sizeof(student_t));
+    int rc = (runs == NULL || heap == NULL || buffs == NULL) ? ERR_DB_FILE : NO_ERROR;
+
+    for (size_t i = 0; i < fanIn && rc == NO_ERROR; i++)
+    {
+        runs[i].buff = buffs + i * perRun;
+    }
+
+    if (rc == NO_ERROR && fflush(sb->spill) != 0)
+    {
+        rc = ERR_DB_FILE;
+    }
+    while (rc == NO_ERROR && sb->num_runs > (int)fanIn)
+    {
+        rc = merge_pass(sb, (int)fanIn, runs, heap, perRun, cmp);
+    }
+    if (rc == NO_ERROR)
+    {
+        rc = merge_group(fileno(sb->spill), sb->runs, sb->num_runs, runs, heap, perRun, cmp, print_sorted_row, rows);
+    }
+
+    free(buffs);
+    free(runs);
+    free(heap);
+    return rc;
+}
+
+/*
+ *  print_db_sorted
+ *      fd:          linux file descriptor
+ *      key:         SORT_KEY_LNAME or SORT_KEY_GPA
+ *      mem_budget:  most bytes of student records to keep in memory
+ *
+ *  Prints all records in the database like print_db(), but ordered by last
+ *  name (then first name) or by gpa, lowest first, with ties in id order.
+ *  When the valid students don't fit in mem_budget they are sorted in
+ *  budget sized runs that are spilled to temporary files and merged.
+ *
+ *  returns:  NO_ERROR       on success
+ *            ERR_DB_FILE    database or temporary file I/O issue
+ *
+ *  console:  <table>          on success, same format as print_db()
+ *            M_DB_EMPTY       the database has no students
+ *            M_ERR_DB_READ    error reading the database or a run file
+ */
+int print_db_sorted(int fd, int key, size_t mem_budget)
+{
+    sort_buff_t sb = {0};
+    db_shard_t *table;
+    int count = shard_table(fd, &table);
+    int rows = 0;
+    int rc = NO_ERROR;
+
+    sb.key = key;
+    sb.cap = mem_budget / sizeof(student_t);
+
+    // the counting sort used for gpas needs a second buffer of the same size
+    if (key == SORT_KEY_GPA && sb.cap > 1)
+    {
+        sb.cap /= 2;
+    }
+    sb.recs = malloc(sb.cap * sizeof(student_t));
+    if (sb.recs == NULL)
+    {
+        printf(M_ERR_DB_READ);
+        return ERR_DB_FILE;
+    }
+
+    for (int i = 0; i < count && rc == NO_ERROR; i++)
+    {
+        rc = shard_scan(&table[i], gather_visit, &sb);
+    }
+
+    if (rc == NO_ERROR && sb.num_runs == 0)
+    {
+        // everything fit, no need to go through the disk
+        sort_recs(&sb);
+        for (size_t i = 0; i < sb.count; i++)
+        {
+            print_sorted_row(&sb.recs[i], &rows);
+        }
+    }
+    else if (rc == NO_ERROR)
+    {
+        if (sb.count > 0)
+        {
+            rc = spill_run(&sb);
+        }
+
+        // the gather buffer is no longer needed, give its memory to the merge
+        free(sb.recs);
+        sb.recs = NULL;
+        if (rc == NO_ERROR)
+        {
+            rc = merge_runs(&sb, mem_budget, &rows);
+        }
+    }
+
+    if (sb.spill != NULL)
+    {
+        fclose(sb.spill);
+    }
+    free(sb.runs);
+    free(sb.recs);
+
+    if (rc < 0)
+    {
+        printf(M_ERR_DB_READ);
+        return ERR_DB_FILE;
+    }
+
+    if (rows == 0)
+    {
+        printf(M_DB_EMPTY);
+    }
+
+    return NO_ERROR;
+}
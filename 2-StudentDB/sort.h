@@ -0,0 +1,32 @@
+#ifndef __SORT_H__
+#define __SORT_H__
+
+#include <stddef.h>
+
+#include "db.h" //get student record type
+
+// Sorted listings gather the valid students into a buffer of at most
+// mem_budget bytes.  If every student fits, the buffer is sorted and printed
+// directly.  Otherwise each full buffer is sorted and appended as a run to
+// a temporary file, and the runs are merged with a k-way heap merge at the
+// end, so a listing never holds more than the budget in memory.  The merge
+// takes at most SORT_MAX_FAN_IN runs at a time, in several passes when there
+// are more.
+#define SORT_KEY_LNAME 1
+#define SORT_KEY_GPA 2
+
+#define SORT_DEF_MEM_BUDGET (16 * 1024 * 1024) // 16M
+#define SORT_MIN_MEM_BUDGET (2 * (int)sizeof(student_t))
+
+// read buffer, in records, each run being merged should get at least.
+// Fewer runs are merged at once to keep to it, down to two
+#define SORT_MIN_RUN_BUFF 16
+
+// most runs merged at once
+#define SORT_MAX_FAN_IN 64
+
+// prototypes for sorted listings, see sort.c
+int parse_sort_key(const char *name);
+int print_db_sorted(int fd, int key, size_t mem_budget);
+
+#endif
@@ -6,6 +6,8 @@ setup_file() {
     if [ -f "student.db" ]; then
         rm "student.db"
     fi
+    rm -f "student.tgx" "student.shards"
+    rm -rf "shard_dir"
 }
 
 @test "Check if database is empty to start" {
@@ -191,4 +193,211 @@ setup_file() {
         echo "Failed Output:  $output"
         return 1
     }
+}
+
+@test "Search names by fragment" {
+    run ./sdbsc -q JA
+    [ "$status" -eq 0 ]
+
+    normalized_output=$(echo -n "$output" | tr -s '[:space:]' ' ')
+    expected_output="ID FIRST NAME LAST_NAME GPA 3 jane doe 3.90"
+
+    [ "$normalized_output" = "$expected_output" ] || {
+        echo "Failed Output: $normalized_output"
+        echo "Expected Output: $expected_output"
+        return 1
+    }
+
+    run ./sdbsc -q oe
+    [ "$status" -eq 0 ]
+    normalized_output=$(echo -n "$output" | tr -s '[:space:]' ' ')
+    expected_output="ID FIRST NAME LAST_NAME GPA 1 john doe 3.45 3 jane doe 3.90 63 jim doe 2.85"
+    [ "$normalized_output" = "$expected_output" ] || {
+        echo "Failed Output: $normalized_output"
+        echo "Expected Output: $expected_output"
+        return 1
+    }
+}
+
+@test "Search finds nothing after the only match is deleted" {
+    run ./sdbsc -a 500 dora explorer 300
+    [ "$status" -eq 0 ]
+
+    run ./sdbsc -q plore
+    [ "$status" -eq 0 ]
+    [ "${lines[1]:0:3}" = "500" ] || {
+        echo "Failed Output:  $output"
+        return 1
+    }
+
+    run ./sdbsc -d 500
+    [ "$status" -eq 0 ]
+
+    run ./sdbsc -q plore
+    [ "$status" -eq 0 ]
+    [ "${lines[0]}" = "No students matched 'plore'." ] || {
+        echo "Failed Output:  $output"
+        return 1
+    }
+}
+
+@test "Update a student in place" {
+    run ./sdbsc -u 3 gpa=395 lname=doe-smith
+    [ "$status" -eq 0 ]
+    [ "${lines[0]}" = "Student 3 updated in database." ] || {
+        echo "Failed Output:  $output"
+        return 1
+    }
+
+    run ./sdbsc -f 3
+    [ "$status" -eq 0 ]
+    normalized_output=$(echo -n "${lines[1]}" | tr -s '[:space:]' ' ')
+    [ "$normalized_output" = "3 jane doe-smith 3.95" ] || {
+        echo "Failed Output:  $normalized_output"
+        return 1
+    }
+
+    run ./sdbsc -q smi
+    [ "$status" -eq 0 ]
+    [ "${lines[1]:0:1}" = "3" ] || {
+        echo "Failed Output:  $output"
+        return 1
+    }
+}
+
+@test "Update fails for a missing student or bad field" {
+    run ./sdbsc -u 4 gpa=300
+    [ "$status" -eq 1 ]
+    [ "${lines[0]}" = "Student 4 was not found in database." ] || {
+        echo "Failed Output:  $output"
+        return 1
+    }
+
+    run ./sdbsc -u 3 major=cs
+    [ "$status" -eq 2 ]
+    [ "${lines[0]}" = "Cant update student, invalid field=value argument 'major=cs'." ] || {
+        echo "Failed Output:  $output"
+        return 1
+    }
+
+    run ./sdbsc -u 3 gpa=abc
+    [ "$status" -eq 2 ]
+    [ "${lines[0]}" = "Cant update student, invalid field=value argument 'gpa=abc'." ] || {
+        echo "Failed Output:  $output"
+        return 1
+    }
+
+    # -1 once meant keep the gpa, it is just out of range now
+    run ./sdbsc -u 3 gpa=-1
+    [ "$status" -eq 2 ]
+    [ "${lines[0]}" = "Cant update student, either ID or GPA out of allowable range!" ] || {
+        echo "Failed Output:  $output"
+        return 1
+    }
+}
+
+@test "Split the database into shards" {
+    mkdir -p shard_dir
+    run ./sdbsc -s 3 shard_dir
+    [ "$status" -eq 0 ]
+    [ "${lines[0]}" = "Database split into 3 shards." ] || {
+        echo "Failed Output:  $output"
+        return 1
+    }
+    [ -f shard_dir/student.2.db ]
+
+    run ./sdbsc -c
+    [ "$status" -eq 0 ]
+    [ "${lines[0]}" = "Database contains 3 student record(s)." ] || {
+        echo "Failed Output:  $output"
+        return 1
+    }
+
+    run ./sdbsc -s 2
+    [ "$status" -eq 1 ]
+    [ "${lines[0]}" = "Database is already sharded." ] || {
+        echo "Failed Output:  $output"
+        return 1
+    }
+}
+
+@test "Sharded database add, print and compress one shard" {
+    run ./sdbsc -a 70000 sam shardson 250
+    [ "$status" -eq 0 ]
+
+    run ./sdbsc -x 2
+    [ "$status" -eq 0 ]
+    [ "${lines[0]}" = "Database successfully compressed!" ] || {
+        echo "Failed Output:  $output"
+        return 1
+    }
+
+    run ./sdbsc -x abc
+    [ "$status" -eq 2 ]
+    [ "${lines[0]}" = "Shard 'abc' does not exist, shards are numbered 0 to 2." ] || {
+        echo "Failed Output:  $output"
+        return 1
+    }
+
+    run ./sdbsc -x 3
+    [ "$status" -eq 2 ]
+
+    run ./sdbsc -p
+    [ "$status" -eq 0 ]
+    normalized_output=$(echo -n "$output" | tr -s '[:space:]' ' ')
+    expected_output="ID FIRST NAME LAST_NAME GPA 1 john doe 3.45 3 jane doe-smith 3.95 63 jim doe 2.85 70000 sam shardson 2.50"
+    [ "$normalized_output" = "$expected_output" ] || {
+        echo "Failed Output: $normalized_output"
+        echo "Expected Output: $expected_output"
+        return 1
+    }
+
+    run ./sdbsc -q SHARD
+    [ "$status" -eq 0 ]
+    [ "${lines[1]:0:5}" = "70000" ] || {
+        echo "Failed Output:  $output"
+        return 1
+    }
+}
+
+@test "Sorted listings match with and without spilling runs" {
+    run ./sdbsc -p --sort=lname
+    [ "$status" -eq 0 ]
+    normalized_output=$(echo -n "$output" | tr -s '[:space:]' ' ')
+    expected_output="ID FIRST NAME LAST_NAME GPA 63 jim doe 2.85 1 john doe 3.45 3 jane doe-smith 3.95 70000 sam shardson 2.50"
+    [ "$normalized_output" = "$expected_output" ] || {
+        echo "Failed Output: $normalized_output"
+        echo "Expected Output: $expected_output"
+        return 1
+    }
+
+    run ./sdbsc -p --sort=gpa
+    [ "$status" -eq 0 ]
+    normalized_output=$(echo -n "$output" | tr -s '[:space:]' ' ')
+    expected_output="ID FIRST NAME LAST_NAME GPA 70000 sam shardson 2.50 63 jim doe 2.85 1 john doe 3.45 3 jane doe-smith 3.95"
+    [ "$normalized_output" = "$expected_output" ] || {
+        echo "Failed Output: $normalized_output"
+        echo "Expected Output: $expected_output"
+        return 1
+    }
+
+    # a 128 byte budget only holds one or two students, forcing spilled runs
+    # that are merged two at a time over several passes, whatever the fd limit
+    run bash -c "ulimit -n 10; ./sdbsc -p --sort=gpa --mem=128"
+    [ "$status" -eq 0 ]
+    normalized_output=$(echo -n "$output" | tr -s '[:space:]' ' ')
+    [ "$normalized_output" = "$expected_output" ] || {
+        echo "Failed Output: $normalized_output"
+        echo "Expected Output: $expected_output"
+        return 1
+    }
+
+    run ./sdbsc -p --sort=id
+    [ "$status" -eq 2 ]
+
+    run ./sdbsc -p --sort=gpa --mem=65536abc
+    [ "$status" -eq 2 ]
+
+    run ./sdbsc -p --sort=gpa --mem=
+    [ "$status" -eq 2 ]
 }
\ No newline at end of file
@@ -0,0 +1,369 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <string.h>
+#include <ctype.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <stdbool.h>
+
+// database include files
+#include "db.h"
+#include "sdbsc.h"
+#include "trigram.h"
+#include "shard.h"
+
+// the index is opened once by main() and kept here so that add_student()
+// and del_student() can maintain it without changing their prototypes.
+// -1 means there is no index and maintenance is skipped
+static int tgx_fd = -1;
+
+// most trigrams a single student can produce, one per starting position
+#define TGX_MAX_STD_GRAMS (sizeof(((student_t *)0)->fname) + sizeof(((student_t *)0)->lname))
+
+// copies at most max chars of src into dst as a lower cased, null terminated
+// string.  Names in student_t are not null terminated if they fill the field
+static int lower_copy(char *dst, const char *src, size_t max)
+{
+    size_t i = 0;
+    while (i < max && src[i] != '\0')
+    {
+        dst[i] = (char)tolower((unsigned char)src[i]);
+        i++;
+    }
+    dst[i] = '\0';
+    return (int)i;
+}
+
+// maps a lower cased trigram to its bucket using multiplicative hashing,
+// keeping the top TGX_BUCKET_BITS bits of the product
+static unsigned int tgx_bucket(const char *gram)
+{
+    unsigned int key = ((unsigned char)gram[0] << 16) |
+                       ((unsigned char)gram[1] << 8) |
+                       (unsigned char)gram[2];
+    return (key * 2654435761u) >> (32 - TGX_BUCKET_BITS);
+}
+
+static int cmp_uint(const void *a, const void *b)
+{
+    unsigned int x = *(const unsigned int *)a;
+    unsigned int y = *(const unsigned int *)b;
+    return (x > y) - (x < y);
+}
+
+// appends the buckets of every trigram in name to buckets, returns new count
+static int collect_buckets(const char *name, size_t max, unsigned int *buckets, int count)
+{
+    char low[TGX_MAX_FRAGMENT + 1];
+    int len = lower_copy(low, name, max);
+
+    for (int i = 0; i + TGX_GRAM_LEN <= len; i++)
+    {
+        buckets[count++] = tgx_bucket(low + i);
+    }
+    return count;
+}
+
+// sets or clears the bit for id in every bucket the student's names hash to
+static int tgx_update(int id, const char *fname, const char *lname, bool set)
+{
+    unsigned int buckets[TGX_MAX_STD_GRAMS];
+    int count = 0;
+
+    if (tgx_fd < 0)
+    {
+        return NO_ERROR;
+    }
+
+    count = collect_buckets(fname, sizeof(((student_t *)0)->fname), buckets, count);
+    count = collect_buckets(lname, sizeof(((student_t *)0)->lname), buckets, count);
+
+    // only touch each bucket once, the same trigram often repeats
+    qsort(buckets, count, sizeof(unsigned int), cmp_uint);
+
+    unsigned char mask = (unsigned char)(1 << (id % 8));
+    for (int i = 0; i < count; i++)
+    {
+        if (i > 0 && buckets[i] == buckets[i - 1])
+        {
+            continue;
+        }
+
+        off_t offset = TGX_HDR_SZ + (off_t)buckets[i] * TGX_BITMAP_SZ + id / 8;
+        unsigned char byte = 0;
+
+        // reading a hole or past the end just means the bit was never set
+        if (pread(tgx_fd, &byte, 1, offset) < 0)
+        {
+            return ERR_DB_FILE;
+        }
+
+        byte = set ? (byte | mask) : (byte & ~mask);
+        if (pwrite(tgx_fd, &byte, 1, offset) != 1)
+        {
+            return ERR_DB_FILE;
+        }
+    }
+
+    return NO_ERROR;
+}
+
+/*
+ *  tgidx_open
+ *      db_fd:            the already opened database, used to build the index
+ *                        the first time it is opened
+ *      idxFile:          name of the index file
+ *      should_truncate:  indicates if opening the file also empties it
+ *
+ *  Opens the trigram index and remembers it for tgidx_add() and tgidx_del().
+ *  An index without a valid header is (re)built from the database so older
+ *  database files get an index the first time they are used.
+ *
+ *  returns:  File descriptor on success, or ERR_DB_FILE on failure
+ *
+ *  console:  M_ERR_DB_OPEN on error
+ */
+int tgidx_open(int db_fd, char *idxFile, bool should_truncate)
+{
+    mode_t mode = S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP;
+    int flags = O_RDWR | O_CREAT;
+    char hdr[sizeof(TGX_MAGIC)] = {0};
+
+    if (should_truncate)
+        flags |= O_TRUNC;
+
+    tgx_fd = open(idxFile, flags, mode);
+    if (tgx_fd == -1)
+    {
+        printf(M_ERR_DB_OPEN);
+        return ERR_DB_FILE;
+    }
+
+    if (pread(tgx_fd, hdr, sizeof(TGX_MAGIC), 0) < 0)
+    {
+        printf(M_ERR_DB_READ);
+        tgidx_close();
+        return ERR_DB_FILE;
+    }
+
+    if (memcmp(hdr, TGX_MAGIC, sizeof(TGX_MAGIC)) != 0)
+    {
+        if (tgidx_rebuild(db_fd) < 0)
+        {
+            tgidx_close();
+            return ERR_DB_FILE;
+        }
+    }
+
+    return tgx_fd;
+}
+
+// closes the index, later add/delete calls will no longer maintain it
+void tgidx_close(void)
+{
+    if (tgx_fd >= 0)
+    {
+        close(tgx_fd);
+    }
+    tgx_fd = -1;
+}
+
+// indexes the names of a student that was just added to the database
+int tgidx_add(int id, const char *fname, const char *lname)
+{
+    return tgx_update(id, fname, lname, true);
+}
+
+// removes a deleted student's names from the index
+int tgidx_del(int id, const char *fname, const char *lname)
+{
+    return tgx_update(id, fname, lname, false);
+}
+
+static int rebuild_visit(student_t *s, void *ctx)
+{
+    (void)ctx;
+    return tgidx_add(s->id, s->fname, s->lname);
+}
+
+/*
+ *  tgidx_rebuild
+ *      db_fd:  linux file descriptor of the database
+ *
+ *  Empties the open index and adds every valid student in the database to
+ *  it.  The header is written last so an interrupted rebuild is redone the
+ *  next time the index is opened.
+ *
+ *  returns:  NO_ERROR       on success
+ *            ERR_DB_FILE    database or index file I/O issue
+ *
+ *  console:  M_ERR_DB_READ    error reading the database or writing the index
+ *            M_ERR_DB_WRITE   error emptying the index file
+ */
+int tgidx_rebuild(int db_fd)
+{
+    db_shard_t *table;
+    int count = shard_table(db_fd, &table);
+
+    if (ftruncate(tgx_fd, 0) < 0)
+    {
+        printf(M_ERR_DB_WRITE);
+        return ERR_DB_FILE;
+    }
+
+    // shards are indexed one after the other, updates to a bucket are a
+    // read-modify-write of a single byte and must not run concurrently
+    for (int i = 0; i < count; i++)
+    {
+        if (shard_scan(&table[i], rebuild_visit, NULL) < 0)
+        {
+            printf(M_ERR_DB_READ);
+            return ERR_DB_FILE;
+        }
+    }
+
+    if (pwrite(tgx_fd, TGX_MAGIC, sizeof(TGX_MAGIC), 0) != sizeof(TGX_MAGIC))
+    {
+        printf(M_ERR_DB_WRITE);
+        return ERR_DB_FILE;
+    }
+
+    return NO_ERROR;
+}
+
+// case insensitive check if the (possibly unterminated) field holds lowfrag
+static bool field_contains(const char *field, size_t max, const char *lowfrag)
+{
+    char low[TGX_MAX_FRAGMENT + 1];
+    lower_copy(low, field, max);
+    return strstr(low, lowfrag) != NULL;
+}
+
+// ands the posting list of a single bucket into the candidate bitmap
+static int and_bucket(unsigned char *cand, unsigned char *tmp, unsigned int bucket)
+{
+    off_t offset = TGX_HDR_SZ + (off_t)bucket * TGX_BITMAP_SZ;
+    ssize_t bytesRead = pread(tgx_fd, tmp, TGX_BITMAP_SZ, offset);
+    if (bytesRead < 0)
+    {
+        return ERR_DB_FILE;
+    }
+
+    // a short read means the tail of this bucket lies past the end of file
+    memset(tmp + bytesRead, 0, TGX_BITMAP_SZ - bytesRead);
+    for (int i = 0; i < TGX_BITMAP_SZ; i++)
+    {
+        cand[i] &= tmp[i];
+    }
+    return NO_ERROR;
+}
+
+/*
+ *  search_students
+ *      db_fd:     linux file descriptor of the database
+ *      fragment:  part of a first or last name to look for
+ *
+ *  Prints every student whose first or last name contains fragment,
+ *  ignoring case, in id order.  For fragments of at least 3 characters the
+ *  posting lists of all of the fragment's trigrams are intersected so only
+ *  the surviving candidates are read from the database and verified.
+ *  Shorter fragments, or a missing index, fall back to checking every slot.
+ *
+ *  returns:  <number>       number of students that matched
+ *            ERR_DB_FILE    database or index file I/O issue
+ *
+ *  console:  <table>          matching students, same format as print_db()
+ *            M_STD_SRCH_NONE  no student matched
+ *            M_ERR_DB_READ    error reading the database or index file
+ */
+int search_students(int db_fd, char *fragment)
+{
+    char lowfrag[TGX_MAX_FRAGMENT + 1];
+    student_t student = {0};
+    int found = 0;
+    int rc = NO_ERROR;
+
+    // a fragment longer than any name can never match
+    if (strlen(fragment) > TGX_MAX_FRAGMENT)
+    {
+        printf(M_STD_SRCH_NONE, fragment);
+        return 0;
+    }
+    int fragLen = lower_copy(lowfrag, fragment, TGX_MAX_FRAGMENT);
+
+    unsigned char *cand = malloc(TGX_BITMAP_SZ);
+    unsigned char *tmp = malloc(TGX_BITMAP_SZ);
+    if (cand == NULL || tmp == NULL)
+    {
+        free(cand);
+        free(tmp);
+        printf(M_ERR_DB_READ);
+        return ERR_DB_FILE;
+    }
+    memset(cand, 0xFF, TGX_BITMAP_SZ);
+
+    if (tgx_fd >= 0 && fragLen >= TGX_GRAM_LEN)
+    {
+        for (int i = 0; i + TGX_GRAM_LEN <= fragLen && rc == NO_ERROR; i++)
+        {
+            rc = and_bucket(cand, tmp, tgx_bucket(lowfrag + i));
+        }
+    }
+
+    // slots past the end of the database (or its shards) can't hold a student
+    int maxId = shard_max_id(db_fd);
+
+    for (int id = MIN_STD_ID; id <= maxId && rc == NO_ERROR; id++)
+    {
+        // skip a whole byte of ids at a time when none of them are candidates
+        if (cand[id / 8] == 0)
+        {
+            id |= 7;
+            continue;
+        }
+        if ((cand[id / 8] & (1 << (id % 8))) == 0)
+        {
+            continue;
+        }
+
+        int getStudentResult = get_student(db_fd, id, &student);
+        if (getStudentResult == ERR_DB_FILE)
+        {
+            rc = ERR_DB_FILE;
+            break;
+        }
+        if (getStudentResult != NO_ERROR)
+        {
+            continue;
+        }
+
+        if (field_contains(student.fname, sizeof(student.fname), lowfrag) ||
+            field_contains(student.lname, sizeof(student.lname), lowfrag))
+        {
+            if (found == 0)
+            {
+                printf(STUDENT_PRINT_HDR_STRING, "ID", "FIRST NAME", "LAST_NAME", "GPA");
+            }
+            float calculated_gpa_from_student = student.gpa / 100.0;
+            printf(STUDENT_PRINT_FMT_STRING, student.id, student.fname, student.lname, calculated_gpa_from_student);
+            found++;
+        }
+    }
+
+    free(cand);
+    free(tmp);
+
+    if (rc != NO_ERROR)
+    {
+        printf(M_ERR_DB_READ);
+        return ERR_DB_FILE;
+    }
+
+    if (found == 0)
+    {
+        printf(M_STD_SRCH_NONE, fragment);
+    }
+
+    return found;
+}
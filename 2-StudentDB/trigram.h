@@ -0,0 +1,37 @@
+#ifndef __TRIGRAM_H__
+#define __TRIGRAM_H__
+
+#include <stdbool.h>
+
+#include "db.h" //get student record type
+
+// The trigram index is a second sparse file that lives next to the database.
+// Every trigram (3 consecutive characters, lower cased) of a student's first
+// and last name is hashed into one of TGX_BUCKETS buckets.  Each bucket is a
+// bitmap with one bit per possible student id, so posting lists are found at
+// a fixed offset exactly like student records are in the database file:
+//
+//      offset = TGX_HDR_SZ + bucket * TGX_BITMAP_SZ + id / 8
+//
+// Buckets that are never touched are holes and take no physical storage.
+// Since different trigrams can share a bucket, a hit is only a candidate and
+// must be verified against the real student record.
+#define TGX_BUCKET_BITS 12
+#define TGX_BUCKETS (1 << TGX_BUCKET_BITS)
+#define TGX_BITMAP_SZ ((MAX_STD_ID / 8) + 1)
+#define TGX_HDR_SZ 64
+#define TGX_MAGIC "TGX1"
+#define TGX_GRAM_LEN 3
+
+// longest fragment that can be searched for, a name is at most 32 chars
+#define TGX_MAX_FRAGMENT 32
+
+// prototypes for the trigram index, see trigram.c
+int tgidx_open(int db_fd, char *idxFile, bool should_truncate);
+void tgidx_close(void);
+int tgidx_add(int id, const char *fname, const char *lname);
+int tgidx_del(int id, const char *fname, const char *lname);
+int tgidx_rebuild(int db_fd);
+int search_students(int db_fd, char *fragment);
+
+#endif
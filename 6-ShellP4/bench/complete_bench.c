@@ -0,0 +1,146 @@
+/*
+ * complete_bench.c
+ *
+ * Measures how long Tab takes to complete a command: a lookup in the
+ * command trie (see cmdtrie.h) against reading every PATH directory again
+ * the way a shell without one does.  A directory with the given number of
+ * extra executables is put in front of PATH so the trie has thousands of
+ * names, and the prefixes looked up are the first one and two letters of
+ * those and of the commands in /usr/bin.
+ *
+ *      usage:  bench/complete_bench [programs] [lookups]
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include "cmdtrie.h"
+
+#define DEF_PROGRAMS 5000
+#define DEF_LOOKUPS 2000
+
+static const char *prefixes[] = {"g", "gi", "p", "py", "s", "sy", "l", "ls", "x", "tool1", "tool42", "zz"};
+#define NUM_PREFIXES (int)(sizeof(prefixes) / sizeof(prefixes[0]))
+
+static double now_sec(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int make_programs(const char *dir, long programs)
+{
+    char name[PATH_MAX];
+    for (long i = 0; i < programs; i++)
+    {
+        snprintf(name, sizeof(name), "%s/tool%ld", dir, i);
+        int fd = open(name, O_WRONLY | O_CREAT | O_EXCL, 0755);
+        if (fd < 0)
+        {
+            return -1;
+        }
+        close(fd);
+    }
+    return 0;
+}
+
+static void remove_programs(const char *dir, long programs)
+{
+    char name[PATH_MAX];
+    for (long i = 0; i < programs; i++)
+    {
+        snprintf(name, sizeof(name), "%s/tool%ld", dir, i);
+        unlink(name);
+    }
+    rmdir(dir);
+}
+
+// what completion costs without the trie: every PATH directory is read and
+// every name starting with prefix is checked for being executable.  Names
+// in more than one directory, like /bin and /usr/bin, are counted twice
+static int scan_path(const char *prefix)
+{
+    char *path = strdup(getenv("PATH"));
+    size_t len = strlen(prefix);
+    int num = 0;
+
+    for (char *dir = strtok(path, ":"); dir != NULL; dir = strtok(NULL, ":"))
+    {
+        DIR *d = opendir(dir);
+        if (d == NULL)
+        {
+            continue;
+        }
+        struct dirent *e;
+        while ((e = readdir(d)) != NULL)
+        {
+            if (strncmp(e->d_name, prefix, len) == 0 && faccessat(dirfd(d), e->d_name, X_OK, 0) == 0)
+            {
+                num++;
+            }
+        }
+        closedir(d);
+    }
+    free(path);
+    return num;
+}
+
+int main(int argc, char *argv[])
+{
+    long programs = argc > 1 ? atol(argv[1]) : DEF_PROGRAMS;
+    int lookups = argc > 2 ? atoi(argv[2]) : DEF_LOOKUPS;
+    // every prefix is looked up as often as the others
+    lookups = lookups > NUM_PREFIXES ? lookups - lookups % NUM_PREFIXES : NUM_PREFIXES;
+    char dir[] = "/tmp/complete_bench.XXXXXX";
+    char path[PATH_MAX * 2];
+
+    if (mkdtemp(dir) == NULL || make_programs(dir, programs) != 0)
+    {
+        perror("complete_bench");
+        remove_programs(dir, programs);
+        return 1;
+    }
+    snprintf(path, sizeof(path), "%s:%s", dir, getenv("PATH") ? getenv("PATH") : "/usr/bin:/bin");
+    setenv("PATH", path, 1);
+
+    comp_list_t list = {0};
+    double t = now_sec();
+    int all = cmd_trie_complete("", true, &list);
+    double build = now_sec() - t;
+    comp_list_clear(&list);
+    printf("%d commands, trie built in the background in %.2f ms\n", all, build * 1e3);
+
+    // every Tab also checks the PATH directories' mtimes, which is counted
+    int found = 0;
+    t = now_sec();
+    for (int i = 0; i < lookups; i++)
+    {
+        found += cmd_trie_complete(prefixes[i % NUM_PREFIXES], false, &list);
+        comp_list_clear(&list);
+    }
+    double trie = (now_sec() - t) / lookups;
+
+    int scanLookups = NUM_PREFIXES * (lookups / (NUM_PREFIXES * 20) + 1);
+    int scanned = 0;
+    t = now_sec();
+    for (int i = 0; i < scanLookups; i++)
+    {
+        scanned += scan_path(prefixes[i % NUM_PREFIXES]);
+    }
+    double scan = (now_sec() - t) / scanLookups;
+
+    printf("%-16s %12s %12s\n", "", "per Tab (us)", "matches");
+    printf("%-16s %12.1f %12.1f\n", "trie", trie * 1e6, (double)found / lookups);
+    printf("%-16s %12.1f %12.1f\n", "scan PATH", scan * 1e6, (double)scanned / scanLookups);
+
+    cmd_trie_free();
+    remove_programs(dir, programs);
+    return 0;
+}
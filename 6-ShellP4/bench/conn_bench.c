@@ -0,0 +1,293 @@
+/*
+ * conn_bench.c
+ *
+ * Measures how the rsh server holds up as sessions are added: the threaded
+ * server (dsh -s -x) against the event server (dsh -s -e, see evserver.h).
+ * For each number of sessions that many clients connect and stay
+ * connected, then every round each one sends the command and waits for its
+ * reply, all at once.  Printed are the commands served per second, the
+ * median and 99th percentile time to a reply, and the server's threads and
+ * resident memory with every session connected.  The default command, rc,
+ * is a built in, so what is timed is the server and not fork().
+ *
+ * Run it from the directory dsh is built in.
+ *
+ *      usage:  bench/conn_bench [max sessions] [rounds] [command]
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#define PORT 7990
+#define DEF_MAX_SESSIONS 1000
+#define DEF_ROUNDS 20
+#define DEF_COMMAND "rc"
+#define EOF_CHAR 0x04
+
+static const char *modes[][2] = {{"-x", "threaded"}, {"-e", "event loops"}};
+#define NUM_MODES (int)(sizeof(modes) / sizeof(modes[0]))
+
+typedef struct conn
+{
+    int fd;
+    double sent; // when the command went out
+} conn_t;
+
+static double now_sec(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static int dial(void)
+{
+    struct sockaddr_in addr = {.sin_family = AF_INET, .sin_port = htons(PORT)};
+    addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+    {
+        return -1;
+    }
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0)
+    {
+        close(fd);
+        return -1;
+    }
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    return fd;
+}
+
+// the threaded server runs a session per worker, so it gets one for each
+static pid_t start_dsh(const char *mode, int sessions)
+{
+    char port[16], workers[16];
+    snprintf(port, sizeof(port), "%d", PORT);
+    snprintf(workers, sizeof(workers), "%d", sessions + 1);
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        int null = open("/dev/null", O_WRONLY);
+        dup2(null, STDOUT_FILENO);
+        dup2(null, STDERR_FILENO);
+        if (strcmp(mode, "-e") == 0)
+            execl("./dsh", "dsh", "-s", "-p", port, "-e", "0", (char *)NULL);
+        else
+            execl("./dsh", "dsh", "-s", "-p", port, mode, "-w", workers, (char *)NULL);
+        _exit(127);
+    }
+
+    // wait until it listens
+    for (int i = 0; i < 200; i++)
+    {
+        int fd = dial();
+        if (fd >= 0)
+        {
+            send(fd, "exit", 5, MSG_NOSIGNAL);
+            close(fd);
+            return pid;
+        }
+        usleep(10000);
+    }
+    kill(pid, SIGKILL);
+    waitpid(pid, NULL, 0);
+    return -1;
+}
+
+static void stop_dsh(pid_t pid)
+{
+    int fd = dial();
+    if (fd >= 0)
+    {
+        send(fd, "stop-server", 12, MSG_NOSIGNAL);
+        char c;
+        (void)!recv(fd, &c, 1, 0);
+        close(fd);
+    }
+    waitpid(pid, NULL, 0);
+}
+
+// a field of /proc/pid/status, like Threads or VmRSS
+static long proc_status(pid_t pid, const char *field)
+{
+    char path[64], line[256];
+    snprintf(path, sizeof(path), "/proc/%d/status", pid);
+    FILE *f = fopen(path, "r");
+    long val = -1;
+    size_t len = strlen(field);
+    while (f != NULL && fgets(line, sizeof(line), f) != NULL)
+    {
+        if (strncmp(line, field, len) == 0 && line[len] == ':')
+        {
+            val = atol(line + len + 1);
+            break;
+        }
+    }
+    if (f != NULL)
+    {
+        fclose(f);
+    }
+    return val;
+}
+
+// every connection sends the command, then the replies are read as they
+// come.  Returns the commands answered
+static int round_trip(conn_t *conns, int num, int epfd, const char *cmd, double *lat, int *numLat)
+{
+    size_t len = strlen(cmd) + 1;
+    for (int i = 0; i < num; i++)
+    {
+        conns[i].sent = now_sec();
+        if (send(conns[i].fd, cmd, len, MSG_NOSIGNAL) != (ssize_t)len)
+        {
+            return -1;
+        }
+    }
+
+    int left = num;
+    struct epoll_event events[256];
+    char buff[4096];
+    while (left > 0)
+    {
+        int n = epoll_wait(epfd, events, 256, 10000);
+        if (n <= 0)
+        {
+            return -1;
+        }
+        for (int i = 0; i < n; i++)
+        {
+            conn_t *c = events[i].data.ptr;
+            ssize_t got = recv(c->fd, buff, sizeof(buff), MSG_DONTWAIT);
+            if (got <= 0)
+            {
+                if (got < 0 && errno == EAGAIN)
+                {
+                    continue;
+                }
+                return -1;
+            }
+            // replies are short and the next command waits for this one,
+            // so the end of output is the last byte
+            if (buff[got - 1] == EOF_CHAR)
+            {
+                lat[(*numLat)++] = now_sec() - c->sent;
+                left--;
+            }
+        }
+    }
+    return num;
+}
+
+static void run(const char *mode, const char *name, int sessions, int rounds, const char *cmd)
+{
+    pid_t pid = start_dsh(mode, sessions);
+    if (pid < 0)
+    {
+        fprintf(stderr, "conn_bench: ./dsh -s %s did not start\n", mode);
+        return;
+    }
+
+    conn_t *conns = calloc(sessions, sizeof(conn_t));
+    double *lat = malloc(sizeof(double) * sessions * rounds);
+    int epfd = epoll_create1(0);
+    int num = 0;
+    for (; num < sessions; num++)
+    {
+        conns[num].fd = dial();
+        if (conns[num].fd < 0)
+        {
+            break;
+        }
+        struct epoll_event ev = {.events = EPOLLIN, .data.ptr = &conns[num]};
+        epoll_ctl(epfd, EPOLL_CTL_ADD, conns[num].fd, &ev);
+    }
+
+    int numLat = 0;
+    int ok = num == sessions;
+    double t = now_sec();
+    for (int r = 0; r < rounds && ok; r++)
+    {
+        ok = round_trip(conns, num, epfd, cmd, lat, &numLat) == num;
+        if (r == 0)
+        {
+            // the clock starts once every session has run a command
+            numLat = 0;
+            t = now_sec();
+        }
+    }
+    double elapsed = now_sec() - t;
+    long threads = proc_status(pid, "Threads");
+    long rss = proc_status(pid, "VmRSS");
+
+    if (ok && numLat > 0)
+    {
+        qsort(lat, numLat, sizeof(double), cmp_double);
+        printf("%-12s %8d %12.0f %10.1f %10.1f %8ld %9.1f\n", name, sessions, numLat / elapsed,
+               lat[numLat / 2] * 1e6, lat[(int)(numLat * 0.99)] * 1e6, threads, rss / 1024.0);
+    }
+    else
+    {
+        printf("%-12s %8d %12s   (%d of %d sessions connected)\n", name, sessions, "failed", num, sessions);
+    }
+    fflush(stdout);
+
+    for (int i = 0; i < num; i++)
+    {
+        send(conns[i].fd, "exit", 5, MSG_NOSIGNAL);
+        close(conns[i].fd);
+    }
+    close(epfd);
+    free(conns);
+    free(lat);
+    stop_dsh(pid);
+}
+
+int main(int argc, char *argv[])
+{
+    int maxSessions = argc > 1 ? atoi(argv[1]) : DEF_MAX_SESSIONS;
+    int rounds = argc > 2 ? atoi(argv[2]) : DEF_ROUNDS;
+    const char *cmd = argc > 3 ? argv[3] : DEF_COMMAND;
+    if (rounds < 2)
+    {
+        rounds = 2;
+    }
+
+    struct rlimit rl;
+    if (getrlimit(RLIMIT_NOFILE, &rl) == 0)
+    {
+        rl.rlim_cur = rl.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &rl);
+    }
+
+    printf("%d rounds of \"%s\" on every session\n", rounds, cmd);
+    printf("%-12s %8s %12s %10s %10s %8s %9s\n", "server", "sessions", "commands/s", "p50 (us)", "p99 (us)",
+           "threads", "RSS (MB)");
+    for (int m = 0; m < NUM_MODES; m++)
+    {
+        for (int sessions = 1; sessions <= maxSessions; sessions *= 10)
+        {
+            run(modes[m][0], modes[m][1], sessions, rounds, cmd);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,177 @@
+/*
+ * glob_bench.c
+ *
+ * Measures glob expansion on one big directory: path_glob_expand(), which
+ * dsh's parser uses, against glob(3) from libc, and against what a shell
+ * without it would do, spawning /bin/sh to expand the pattern and reading
+ * the paths back from a pipe.  The directory is filled with the given
+ * number of empty files first and removed afterwards.
+ *
+ *      usage:  bench/glob_bench [files] [runs]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <glob.h>
+
+#include "pathglob.h"
+
+#define DEF_FILES 100000
+#define DEF_RUNS 5
+
+static const char *patterns[] = {
+    "*",
+    "*5*",
+    "f?????7",
+    "f[0-4]*[13579]",
+};
+#define NUM_PATTERNS (int)(sizeof(patterns) / sizeof(patterns[0]))
+
+static double now_sec(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int make_files(long files)
+{
+    char name[32];
+    for (long i = 0; i < files; i++)
+    {
+        snprintf(name, sizeof(name), "f%06ld", i);
+        int fd = open(name, O_WRONLY | O_CREAT | O_EXCL, 0644);
+        if (fd < 0)
+        {
+            return -1;
+        }
+        close(fd);
+    }
+    return 0;
+}
+
+static void remove_files(long files)
+{
+    char name[32];
+    for (long i = 0; i < files; i++)
+    {
+        snprintf(name, sizeof(name), "f%06ld", i);
+        unlink(name);
+    }
+}
+
+// best time of runs in ms, *num gets the number of paths matched
+static double time_path_glob(const char *pat, int runs, int *num)
+{
+    path_glob_chunk_t *mem = NULL;
+    path_glob_list_t out = {0};
+    double best = -1;
+
+    for (int r = 0; r < runs; r++)
+    {
+        path_glob_reset(mem);
+        double t = now_sec();
+        *num = path_glob_expand(pat, pat + strlen(pat), &mem, &out);
+        t = now_sec() - t;
+        best = (best < 0 || t < best) ? t : best;
+    }
+    free(out.paths);
+    path_glob_free(&mem);
+    return best * 1e3;
+}
+
+static double time_libc_glob(const char *pat, int runs, int *num)
+{
+    double best = -1;
+
+    for (int r = 0; r < runs; r++)
+    {
+        glob_t g;
+        double t = now_sec();
+        *num = glob(pat, 0, NULL, &g) == 0 ? (int)g.gl_pathc : 0;
+        t = now_sec() - t;
+        globfree(&g);
+        best = (best < 0 || t < best) ? t : best;
+    }
+    return best * 1e3;
+}
+
+// the paths are printed one per line by sh and counted as they are read
+static double time_spawn_sh(const char *pat, int runs, int *num)
+{
+    char cmd[128];
+    char buff[64 * 1024];
+    double best = -1;
+
+    snprintf(cmd, sizeof(cmd), "printf '%%s\\n' %s", pat);
+    for (int r = 0; r < runs; r++)
+    {
+        double t = now_sec();
+        FILE *f = popen(cmd, "r");
+        if (f == NULL)
+        {
+            return -1;
+        }
+        *num = 0;
+        size_t n;
+        while ((n = fread(buff, 1, sizeof(buff), f)) > 0)
+        {
+            for (size_t i = 0; i < n; i++)
+            {
+                *num += buff[i] == '\n';
+            }
+        }
+        pclose(f);
+        t = now_sec() - t;
+        best = (best < 0 || t < best) ? t : best;
+    }
+    return best * 1e3;
+}
+
+int main(int argc, char *argv[])
+{
+    long files = argc > 1 ? atol(argv[1]) : DEF_FILES;
+    int runs = argc > 2 ? atoi(argv[2]) : DEF_RUNS;
+    char dir[] = "/tmp/glob_bench.XXXXXX";
+
+    if (mkdtemp(dir) == NULL || chdir(dir) != 0)
+    {
+        perror("glob_bench");
+        return 1;
+    }
+    if (make_files(files) != 0)
+    {
+        perror("glob_bench");
+        remove_files(files);
+        rmdir(dir);
+        return 1;
+    }
+
+    printf("%ld files, best of %d runs, ms\n", files, runs);
+    printf("%-18s %8s %10s %10s %10s\n", "pattern", "matches", "path_glob", "glob(3)", "sh");
+    for (int i = 0; i < NUM_PATTERNS; i++)
+    {
+        int numOurs = 0;
+        int numLibc = 0;
+        int numSh = 0;
+        double ours = time_path_glob(patterns[i], runs, &numOurs);
+        double libc = time_libc_glob(patterns[i], runs, &numLibc);
+        double sh = time_spawn_sh(patterns[i], runs, &numSh);
+        if (numOurs != numLibc || numOurs != numSh)
+        {
+            printf("%-18s matches differ: %d %d %d\n", patterns[i], numOurs, numLibc, numSh);
+            continue;
+        }
+        printf("%-18s %8d %10.2f %10.2f %10.2f\n", patterns[i], numOurs, ours, libc, sh);
+    }
+
+    remove_files(files);
+    if (chdir("/") == 0)
+    {
+        rmdir(dir);
+    }
+    return 0;
+}
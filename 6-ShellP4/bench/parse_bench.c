@@ -0,0 +1,167 @@
+/*
+ * parse_bench.c
+ *
+ * Measures how fast dsh parses command lines and how many heap allocations
+ * it makes doing so.  The allocator is wrapped at link time (see the bench
+ * target in the makefile) so every malloc/calloc/realloc/free made by the
+ * parser is counted.  Two mixes are run: short interactive style lines, and
+ * long generated lines with hundreds of file arguments.  Each is run with
+ * the parse cache off, so every line is lexed, and then on, where the
+ * same lines come back from the cache (see parsecache.h).
+ *
+ *      usage:  bench/parse_bench [iterations]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/types.h>
+
+#include "dshlib.h"
+#include "parsecache.h"
+
+#define DEF_ITERATIONS 200000
+
+// arguments in each of the generated long lines
+#define LONG_LINE_ARGS 400
+
+// counters for the wrapped allocator
+static unsigned long num_allocs = 0;
+static unsigned long num_frees = 0;
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t nmemb, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+void __real_free(void *ptr);
+
+void *__wrap_malloc(size_t size)
+{
+    num_allocs++;
+    return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t nmemb, size_t size)
+{
+    num_allocs++;
+    return __real_calloc(nmemb, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size)
+{
+    num_allocs++;
+    return __real_realloc(ptr, size);
+}
+
+void __wrap_free(void *ptr)
+{
+    if (ptr != NULL)
+    {
+        num_frees++;
+    }
+    __real_free(ptr);
+}
+
+// a mix of the kinds of lines the shell sees, all of them valid
+static const char *lines[] = {
+    "ls",
+    "ls -la /tmp",
+    "echo \"hello      world\"",
+    "   echo    hello   world    ",
+    "cat < input.txt | grep -v foo | sort > output.txt",
+    "echo 'one two' | tr a-z A-Z | sort | uniq -c",
+    "grep \"a | b\" notes.txt >> matches.txt",
+    "gcc -Wall -Wextra -g -o dsh dsh_cli.c dshlib.c",
+    "cd ..",
+};
+#define NUM_LINES (int)(sizeof(lines) / sizeof(lines[0]))
+
+static double now_sec(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// parses mix[i % num] iterations times and prints what it cost.  Each line
+// is copied into scratch first since older parsers wrote into the line
+static void run_mix(const char *name, command_list_t *clist, char **mix, int num, long iterations, char *scratch)
+{
+    // only count what the parse path itself does
+    unsigned long startAllocs = num_allocs;
+    unsigned long startFrees = num_frees;
+    long parsed = 0;
+    size_t bytes = 0;
+    double start = now_sec();
+
+    for (long i = 0; i < iterations; i++)
+    {
+        size_t len = strlen(mix[i % num]);
+        memcpy(scratch, mix[i % num], len + 1);
+        clear_cmd_list(clist);
+        if (build_cmd_list(scratch, clist) == OK)
+        {
+            parsed++;
+        }
+        bytes += len;
+    }
+
+    double elapsed = now_sec() - start;
+    unsigned long allocs = num_allocs - startAllocs;
+    unsigned long frees = num_frees - startFrees;
+
+    printf("%s lines\n", name);
+    printf("  lines parsed:   %ld of %ld\n", parsed, iterations);
+    printf("  elapsed:        %.3f sec\n", elapsed);
+    printf("  lines/sec:      %.0f\n", iterations / elapsed);
+    printf("  MB/sec:         %.1f\n", bytes / elapsed / (1024 * 1024));
+    printf("  allocations:    %.2f per line\n", (double)allocs / iterations);
+    printf("  frees:          %.2f per line\n", (double)frees / iterations);
+}
+
+int main(int argc, char *argv[])
+{
+    long iterations = (argc > 1) ? atol(argv[1]) : DEF_ITERATIONS;
+    command_list_t *clist = NULL;
+    char *shortLines[NUM_LINES];
+    char *longLines[2];
+    char *scratch = malloc(LONG_LINE_ARGS * 32 + 64);
+
+    if (iterations <= 0 || scratch == NULL || alloc_cmd_list(&clist) != OK)
+    {
+        fprintf(stderr, "usage: %s [iterations]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    for (int i = 0; i < NUM_LINES; i++)
+    {
+        shortLines[i] = (char *)lines[i];
+    }
+
+    // something like "rm -f build/obj/file0001.o ... | wc -l"
+    for (int i = 0; i < 2; i++)
+    {
+        longLines[i] = malloc(LONG_LINE_ARGS * 32 + 64);
+        int len = sprintf(longLines[i], "%s", i == 0 ? "rm -f" : "tar czf out.tgz");
+        for (int a = 0; a < LONG_LINE_ARGS; a++)
+        {
+            len += sprintf(longLines[i] + len, " build/obj/file%04d.o", a);
+        }
+        sprintf(longLines[i] + len, " | wc -l");
+    }
+
+    char *off[] = {PARSE_CACHE_CMD, "off", NULL};
+    char *on[] = {PARSE_CACHE_CMD, "on", NULL};
+    parse_cache_cmd(2, off, stdout);
+    run_mix("short", clist, shortLines, NUM_LINES, iterations, scratch);
+    run_mix("long", clist, longLines, 2, iterations / 100 + 1, scratch);
+    parse_cache_cmd(2, on, stdout);
+    run_mix("cached short", clist, shortLines, NUM_LINES, iterations, scratch);
+    run_mix("cached long", clist, longLines, 2, iterations / 100 + 1, scratch);
+    parse_cache_free();
+
+    free(scratch);
+    free(longLines[0]);
+    free(longLines[1]);
+    free_cmd_list(clist);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,141 @@
+/*
+ * pipe_bench.c
+ *
+ * Measures how fast dsh pipelines move data, in GB/s, with the cat and tee
+ * built ins compared to the programs in /bin.  /bin/cat copies every byte
+ * into the process and back out again, the built ins move it between the
+ * file and the stage pipes with splice() and tee() instead, see splice.c.
+ * Each pipeline runs through execute_pipeline() on a file of the given size
+ * and the best of a few runs is reported.  Into /dev/null the built ins
+ * only pass page references along, the wc lines show what is left when the
+ * last stage reads every byte.
+ *
+ *      usage:  bench/pipe_bench [MB] [runs]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "dshlib.h"
+
+#define DEF_MB 1024
+#define DEF_RUNS 3
+
+// %s is the input file, /bin/... runs the program, the bare name the built in
+static const char *pipelines[] = {
+    "/bin/cat %s | /bin/cat > /dev/null",
+    "cat %s | cat > /dev/null",
+    "/bin/cat %s | /bin/tee /dev/null | /bin/cat > /dev/null",
+    "cat %s | tee /dev/null | cat > /dev/null",
+    "/bin/cat %s | /usr/bin/wc -l > /dev/null",
+    "cat %s | /usr/bin/wc -l > /dev/null",
+};
+#define NUM_PIPELINES (int)(sizeof(pipelines) / sizeof(pipelines[0]))
+
+// exit status of the last pipeline, see dshlib.c
+extern int last_rc;
+
+static double now_sec(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// fills a temporary file with mb megabytes, returns 0 on success
+static int make_input(char *path, long mb)
+{
+    int fd = mkstemp(path);
+    if (fd < 0)
+    {
+        return -1;
+    }
+
+    char block[1024 * 1024];
+    for (size_t i = 0; i < sizeof(block); i++)
+    {
+        block[i] = "abcdefghijklmnopqrstuvwxyz\n"[i % 27];
+    }
+    for (long i = 0; i < mb; i++)
+    {
+        if (write(fd, block, sizeof(block)) != (ssize_t)sizeof(block))
+        {
+            close(fd);
+            return -1;
+        }
+    }
+    close(fd);
+    return 0;
+}
+
+// returns GB/s for the best of runs, or -1 if the pipeline failed
+static double run_pipeline(const char *fmt, const char *input, long mb, int runs)
+{
+    command_list_t *clist = NULL;
+    char line[SH_CMD_MAX];
+    double best = -1;
+
+    if (alloc_cmd_list(&clist) != OK)
+    {
+        return -1;
+    }
+
+    for (int r = 0; r < runs; r++)
+    {
+        snprintf(line, sizeof(line), fmt, input);
+        clear_cmd_list(clist);
+        if (build_cmd_list(line, clist) != OK)
+        {
+            break;
+        }
+
+        double start = now_sec();
+        execute_pipeline(clist);
+        double elapsed = now_sec() - start;
+        if (last_rc != 0)
+        {
+            best = -1;
+            break;
+        }
+
+        double rate = mb / 1024.0 / elapsed;
+        best = rate > best ? rate : best;
+    }
+
+    free_cmd_list(clist);
+    return best;
+}
+
+int main(int argc, char *argv[])
+{
+    long mb = (argc > 1) ? atol(argv[1]) : DEF_MB;
+    int runs = (argc > 2) ? atoi(argv[2]) : DEF_RUNS;
+    char input[] = "/tmp/pipe_bench.XXXXXX";
+
+    if (mb <= 0 || runs <= 0)
+    {
+        fprintf(stderr, "usage: %s [MB] [runs]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    if (make_input(input, mb) < 0)
+    {
+        perror("pipe_bench");
+        return EXIT_FAILURE;
+    }
+
+    printf("%ld MB input, best of %d\n", mb, runs);
+    for (int i = 0; i < NUM_PIPELINES; i++)
+    {
+        double rate = run_pipeline(pipelines[i], input, mb, runs);
+        printf("  %-56s ", pipelines[i]);
+        if (rate < 0)
+            printf("failed\n");
+        else
+            printf("%6.2f GB/s\n", rate);
+    }
+
+    unlink(input);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,147 @@
+/*
+ * spawn_bench.c
+ *
+ * Measures how many processes per second a parent can start and reap with
+ * fork()+execve() compared to posix_spawn(), which is what exec_cmd() uses.
+ * fork() has to copy the parent's page tables, so it slows down as the
+ * parent gets bigger, while posix_spawn() starts the child without copying
+ * them.  Each round grows the parent by touching a buffer of the given size
+ * before spawning /bin/true over and over.
+ *
+ *      usage:  bench/spawn_bench [iterations] [rss MB ...]
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <spawn.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#define DEF_ITERATIONS 500
+#define SPAWN_PATH "/bin/true"
+
+// parent sizes, in MB, used when none are given
+static const long def_rss_mb[] = {0, 64, 256, 1024};
+
+static double now_sec(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// the resident size of this process in MB, from /proc/self/statm
+static long rss_mb(void)
+{
+    long pages = 0;
+    long resident = 0;
+    FILE *f = fopen("/proc/self/statm", "r");
+    if (f == NULL)
+    {
+        return -1;
+    }
+    if (fscanf(f, "%ld %ld", &pages, &resident) != 2)
+    {
+        resident = -1;
+    }
+    fclose(f);
+    return resident < 0 ? -1 : resident * sysconf(_SC_PAGESIZE) / (1024 * 1024);
+}
+
+// returns spawns per second, or -1 if a child could not be started
+static double run_fork(long iterations)
+{
+    char *argv[] = {SPAWN_PATH, NULL};
+    double start = now_sec();
+
+    for (long i = 0; i < iterations; i++)
+    {
+        pid_t pid = fork();
+        if (pid < 0)
+        {
+            return -1;
+        }
+        if (pid == 0)
+        {
+            execve(SPAWN_PATH, argv, environ);
+            _exit(127);
+        }
+        waitpid(pid, NULL, 0);
+    }
+
+    return iterations / (now_sec() - start);
+}
+
+static double run_spawn(long iterations)
+{
+    char *argv[] = {SPAWN_PATH, NULL};
+    double start = now_sec();
+
+    for (long i = 0; i < iterations; i++)
+    {
+        pid_t pid;
+        if (posix_spawn(&pid, SPAWN_PATH, NULL, NULL, argv, environ) != 0)
+        {
+            return -1;
+        }
+        waitpid(pid, NULL, 0);
+    }
+
+    return iterations / (now_sec() - start);
+}
+
+int main(int argc, char *argv[])
+{
+    long iterations = DEF_ITERATIONS;
+    if (argc > 1)
+    {
+        iterations = atol(argv[1]);
+    }
+    if (iterations <= 0)
+    {
+        fprintf(stderr, "usage: %s [iterations] [rss MB ...]\n", argv[0]);
+        return 1;
+    }
+
+    int numSizes = argc > 2 ? argc - 2 : (int)(sizeof(def_rss_mb) / sizeof(def_rss_mb[0]));
+    char *ballast = NULL;
+    size_t ballastSize = 0;
+
+    printf("%-10s %12s %12s %12s\n", "rss MB", "fork/sec", "spawn/sec", "speedup");
+    for (int i = 0; i < numSizes; i++)
+    {
+        long mb = argc > 2 ? atol(argv[i + 2]) : def_rss_mb[i];
+        size_t size = (size_t)mb * 1024 * 1024;
+
+        // grow the parent, touching every page so it is really resident
+        if (size > ballastSize)
+        {
+            char *grown = realloc(ballast, size);
+            if (grown == NULL)
+            {
+                fprintf(stderr, "could not grow the parent to %ld MB\n", mb);
+                break;
+            }
+            ballast = grown;
+            memset(ballast + ballastSize, 1, size - ballastSize);
+            ballastSize = size;
+        }
+
+        double forkRate = run_fork(iterations);
+        double spawnRate = run_spawn(iterations);
+        if (forkRate < 0 || spawnRate < 0)
+        {
+            fprintf(stderr, "could not start %s\n", SPAWN_PATH);
+            free(ballast);
+            return 1;
+        }
+
+        printf("%-10ld %12.0f %12.0f %11.2fx\n", rss_mb(), forkRate, spawnRate, spawnRate / forkRate);
+    }
+
+    free(ballast);
+    return 0;
+}
@@ -0,0 +1,634 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <ctype.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "builtins.h"
+
+static void out_init(bi_out_t *out, int fd)
+{
+    out->fd = fd;
+    out->len = 0;
+    out->failed = false;
+}
+
+static void out_flush(bi_out_t *out)
+{
+    size_t done = 0;
+    while (!out->failed && done < out->len)
+    {
+        ssize_t n = write(out->fd, out->buff + done, out->len - done);
+        if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n <= 0)
+        {
+            out->failed = true;
+            break;
+        }
+        done += n;
+    }
+    out->len = 0;
+}
+
+static void out_write(bi_out_t *out, const char *s, size_t n)
+{
+    while (n > 0)
+    {
+        if (out->len == BI_OUT_BUFF_SZ)
+        {
+            out_flush(out);
+        }
+        size_t room = BI_OUT_BUFF_SZ - out->len;
+        size_t chunk = n < room ? n : room;
+        memcpy(out->buff + out->len, s, chunk);
+        out->len += chunk;
+        s += chunk;
+        n -= chunk;
+    }
+}
+
+static void out_char(bi_out_t *out, char c)
+{
+    out_write(out, &c, 1);
+}
+
+// formats straight into the buffer, going through the heap only for a
+// single conversion that is bigger than the whole buffer
+static void out_format(bi_out_t *out, const char *fmt, ...)
+{
+    va_list args;
+    va_start(args, fmt);
+    va_list again;
+    va_copy(again, args);
+
+    size_t room = BI_OUT_BUFF_SZ - out->len;
+    int n = vsnprintf(out->buff + out->len, room, fmt, args);
+    if (n >= 0 && (size_t)n < room)
+    {
+        out->len += n;
+    }
+    else if (n >= 0)
+    {
+        char *big = malloc(n + 1);
+        if (big != NULL)
+        {
+            vsnprintf(big, n + 1, fmt, again);
+            out_write(out, big, n);
+            free(big);
+        }
+    }
+
+    va_end(again);
+    va_end(args);
+}
+
+// finishes the output, returns the status for a built in that wrote it
+static int out_close(bi_out_t *out, int rc)
+{
+    out_flush(out);
+    return out->failed ? 1 : rc;
+}
+
+// writes the character for the escape at p, just past the backslash, and
+// returns where the escape ends.  With zeroOctal octal escapes start with
+// \0 like echo -e, otherwise they are \NNN like printf formats.  \c sets
+// *stop, nothing more is printed after it
+static const char *out_escape(bi_out_t *out, const char *p, bool zeroOctal, bool *stop)
+{
+    switch (*p)
+    {
+    case 'a':
+        out_char(out, '\a');
+        return p + 1;
+    case 'b':
+        out_char(out, '\b');
+        return p + 1;
+    case 'c':
+        *stop = true;
+        return p + 1;
+    case 'e':
+        out_char(out, 0x1b);
+        return p + 1;
+    case 'f':
+        out_char(out, '\f');
+        return p + 1;
+    case 'n':
+        out_char(out, '\n');
+        return p + 1;
+    case 'r':
+        out_char(out, '\r');
+        return p + 1;
+    case 't':
+        out_char(out, '\t');
+        return p + 1;
+    case 'v':
+        out_char(out, '\v');
+        return p + 1;
+    case '\\':
+        out_char(out, '\\');
+        return p + 1;
+    case '\0':
+        out_char(out, '\\');
+        return p;
+    default:
+        break;
+    }
+
+    if (*p >= '0' && *p <= '7' && (!zeroOctal || *p == '0'))
+    {
+        if (zeroOctal)
+        {
+            p++;
+        }
+        int value = 0;
+        for (int digits = 0; digits < 3 && *p >= '0' && *p <= '7'; digits++, p++)
+        {
+            value = value * 8 + (*p - '0');
+        }
+        out_char(out, (char)value);
+        return p;
+    }
+
+    // not an escape, printed as it is
+    out_char(out, '\\');
+    out_char(out, *p);
+    return p + 1;
+}
+
+static void out_escaped(bi_out_t *out, const char *s, bool zeroOctal, bool *stop)
+{
+    while (*s != '\0' && !*stop)
+    {
+        const char *slash = strchr(s, '\\');
+        if (slash == NULL)
+        {
+            out_write(out, s, strlen(s));
+            return;
+        }
+        out_write(out, s, slash - s);
+        s = out_escape(out, slash + 1, zeroOctal, stop);
+    }
+}
+
+/*
+ *  bi_echo
+ *
+ *  echo [-neE] [string ...]
+ *      -n  no newline at the end
+ *      -e  backslash escapes are interpreted
+ *      -E  backslash escapes are printed as they are, the default
+ *
+ *  An argument is only an option when every letter in it is one of these,
+ *  like coreutils, so `echo -nope` prints -nope.
+ */
+int bi_echo(int argc, char *argv[], int fd)
+{
+    bi_out_t out;
+    bool newline = true;
+    bool escapes = false;
+    bool stop = false;
+    int i = 1;
+
+    out_init(&out, fd);
+    for (; i < argc && argv[i][0] == '-' && argv[i][1] != '\0'; i++)
+    {
+        if (strspn(argv[i] + 1, "neE") != strlen(argv[i] + 1))
+        {
+            break;
+        }
+        for (char *c = argv[i] + 1; *c != '\0'; c++)
+        {
+            if (*c == 'n')
+                newline = false;
+            else
+                escapes = (*c == 'e');
+        }
+    }
+
+    for (int first = i; i < argc && !stop; i++)
+    {
+        if (i > first)
+        {
+            out_char(&out, ' ');
+        }
+        if (escapes)
+        {
+            out_escaped(&out, argv[i], true, &stop);
+        }
+        else
+        {
+            out_write(&out, argv[i], strlen(argv[i]));
+        }
+    }
+
+    if (newline && !stop)
+    {
+        out_char(&out, '\n');
+    }
+    return out_close(&out, 0);
+}
+
+// pwd, the -L and -P options are accepted and ignored since the shell
+// doesn't track a logical directory
+int bi_pwd(int argc, char *argv[], int fd)
+{
+    (void)argc;
+    (void)argv;
+
+    char *cwd = getcwd(NULL, 0);
+    if (cwd == NULL)
+    {
+        fprintf(stderr, "pwd: %s\n", strerror(errno));
+        return 1;
+    }
+
+    bi_out_t out;
+    out_init(&out, fd);
+    out_write(&out, cwd, strlen(cwd));
+    out_char(&out, '\n');
+    free(cwd);
+    return out_close(&out, 0);
+}
+
+// state of one test expression while it is being evaluated
+typedef struct test_expr
+{
+    int argc;
+    char **argv;
+    int pos;  // next argument to look at
+    bool err; // a syntax error was reported
+} test_expr_t;
+
+static bool test_or(test_expr_t *t);
+
+// reports the first syntax error only, arg is the argument it is about
+static void test_error(test_expr_t *t, const char *arg, const char *msg)
+{
+    if (!t->err && arg != NULL)
+    {
+        fprintf(stderr, "test: %s: %s\n", arg, msg);
+    }
+    else if (!t->err)
+    {
+        fprintf(stderr, "test: %s\n", msg);
+    }
+    t->err = true;
+}
+
+static long long test_number(test_expr_t *t, const char *arg)
+{
+    char *end;
+    errno = 0;
+    long long value = strtoll(arg, &end, 10);
+    while (isspace((unsigned char)*end))
+    {
+        end++;
+    }
+    if (errno != 0 || end == arg || *end != '\0')
+    {
+        test_error(t, arg, "integer expression expected");
+    }
+    return value;
+}
+
+static bool is_test_binary(const char *op)
+{
+    static const char *ops[] = {"=", "==", "!=", "-eq", "-ne", "-lt", "-le", "-gt", "-ge", NULL};
+    for (int i = 0; ops[i] != NULL; i++)
+    {
+        if (strcmp(op, ops[i]) == 0)
+            return true;
+    }
+    return false;
+}
+
+static bool test_binary(test_expr_t *t, const char *left, const char *op, const char *right)
+{
+    if (strcmp(op, "=") == 0 || strcmp(op, "==") == 0)
+        return strcmp(left, right) == 0;
+    if (strcmp(op, "!=") == 0)
+        return strcmp(left, right) != 0;
+
+    long long l = test_number(t, left);
+    long long r = test_number(t, right);
+    if (strcmp(op, "-eq") == 0)
+        return l == r;
+    if (strcmp(op, "-ne") == 0)
+        return l != r;
+    if (strcmp(op, "-lt") == 0)
+        return l < r;
+    if (strcmp(op, "-le") == 0)
+        return l <= r;
+    if (strcmp(op, "-gt") == 0)
+        return l > r;
+    return l >= r;
+}
+
+// the file and string tests, returns -1 if op isn't one of them
+static int test_unary(const char *op, const char *arg)
+{
+    struct stat st;
+
+    if (op[0] != '-' || op[1] == '\0' || op[2] != '\0')
+    {
+        return -1;
+    }
+
+    switch (op[1])
+    {
+    case 'n':
+        return arg[0] != '\0';
+    case 'z':
+        return arg[0] == '\0';
+    case 'e':
+        return stat(arg, &st) == 0;
+    case 'f':
+        return stat(arg, &st) == 0 && S_ISREG(st.st_mode);
+    case 'd':
+        return stat(arg, &st) == 0 && S_ISDIR(st.st_mode);
+    case 'p':
+        return stat(arg, &st) == 0 && S_ISFIFO(st.st_mode);
+    case 'S':
+        return stat(arg, &st) == 0 && S_ISSOCK(st.st_mode);
+    case 'b':
+        return stat(arg, &st) == 0 && S_ISBLK(st.st_mode);
+    case 'c':
+        return stat(arg, &st) == 0 && S_ISCHR(st.st_mode);
+    case 's':
+        return stat(arg, &st) == 0 && st.st_size > 0;
+    case 'h':
+    case 'L':
+        return lstat(arg, &st) == 0 && S_ISLNK(st.st_mode);
+    case 'r':
+        return access(arg, R_OK) == 0;
+    case 'w':
+        return access(arg, W_OK) == 0;
+    case 'x':
+        return access(arg, X_OK) == 0;
+    default:
+        return -1;
+    }
+}
+
+// ( expr ), a binary test, a unary test or a lone string
+static bool test_primary(test_expr_t *t)
+{
+    if (t->pos >= t->argc)
+    {
+        test_error(t, NULL, "argument expected");
+        return false;
+    }
+
+    char **argv = t->argv;
+    int pos = t->pos;
+
+    // a binary operator in the middle wins, so `test -n = -n` compares
+    if (pos + 2 < t->argc && is_test_binary(argv[pos + 1]))
+    {
+        t->pos += 3;
+        return test_binary(t, argv[pos], argv[pos + 1], argv[pos + 2]);
+    }
+
+    if (strcmp(argv[pos], "(") == 0 && pos + 1 < t->argc)
+    {
+        t->pos++;
+        bool value = test_or(t);
+        if (t->pos >= t->argc || strcmp(argv[t->pos], ")") != 0)
+        {
+            test_error(t, NULL, "')' expected");
+            return false;
+        }
+        t->pos++;
+        return value;
+    }
+
+    if (pos + 1 < t->argc)
+    {
+        int value = test_unary(argv[pos], argv[pos + 1]);
+        if (value >= 0)
+        {
+            t->pos += 2;
+            return value;
+        }
+    }
+
+    t->pos++;
+    return argv[pos][0] != '\0';
+}
+
+static bool test_not(test_expr_t *t)
+{
+    if (t->pos + 1 < t->argc && strcmp(t->argv[t->pos], "!") == 0)
+    {
+        t->pos++;
+        return !test_not(t);
+    }
+    return test_primary(t);
+}
+
+static bool test_and(test_expr_t *t)
+{
+    bool value = test_not(t);
+    while (t->pos < t->argc && strcmp(t->argv[t->pos], "-a") == 0)
+    {
+        t->pos++;
+        bool right = test_not(t);
+        value = value && right;
+    }
+    return value;
+}
+
+static bool test_or(test_expr_t *t)
+{
+    bool value = test_and(t);
+    while (t->pos < t->argc && strcmp(t->argv[t->pos], "-o") == 0)
+    {
+        t->pos++;
+        bool right = test_and(t);
+        value = value || right;
+    }
+    return value;
+}
+
+/*
+ *  bi_test
+ *
+ *  test expr, or [ expr ]
+ *
+ *  Supports ! ( ) -a -o, the string tests = == != -n -z, the integer tests
+ *  -eq -ne -lt -le -gt -ge and the file tests -e -f -d -p -S -b -c -s -h -L
+ *  -r -w -x.  A single argument is true when it isn't empty.
+ *
+ *  returns:  0 true, 1 false, 2 the expression could not be parsed
+ */
+int bi_test(int argc, char *argv[])
+{
+    if (strcmp(argv[0], TEST_BRACKET_CMD) == 0)
+    {
+        if (strcmp(argv[argc - 1], "]") != 0)
+        {
+            fprintf(stderr, "[: missing ']'\n");
+            return 2;
+        }
+        argc--;
+    }
+
+    if (argc == 1)
+    {
+        return 1;
+    }
+
+    test_expr_t t = {argc, argv, 1, false};
+    bool value = test_or(&t);
+    if (!t.err && t.pos < t.argc)
+    {
+        test_error(&t, argv[t.pos], "extra argument");
+    }
+
+    if (t.err)
+    {
+        return 2;
+    }
+    return value ? 0 : 1;
+}
+
+// a numeric printf argument, 'c or "c is the value of the character c
+static long long printf_number(const char *arg, int *rc)
+{
+    if (arg == NULL)
+    {
+        return 0;
+    }
+    if (arg[0] == '\'' || arg[0] == '"')
+    {
+        return (unsigned char)arg[1];
+    }
+
+    char *end;
+    errno = 0;
+    long long value = strtoll(arg, &end, 0);
+    if (errno != 0 || end == arg || *end != '\0')
+    {
+        fprintf(stderr, "printf: %s: invalid number\n", arg);
+        *rc = 1;
+    }
+    return value;
+}
+
+/*
+ *  bi_printf
+ *
+ *  printf format [argument ...]
+ *
+ *  Supports the escapes of echo -e (octal is \NNN), and the conversions
+ *  %s %b %c %d %i %u %o %x %X %% with flags, width and precision.  The
+ *  format is reused while there are arguments left, and missing arguments
+ *  are empty strings or zero.
+ *
+ *  returns:  0 on success, 1 on a bad number or conversion
+ */
+int bi_printf(int argc, char *argv[], int fd)
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, "printf: missing operand\n");
+        return 1;
+    }
+
+    bi_out_t out;
+    const char *fmt = argv[1];
+    int argi = 2;
+    int rc = 0;
+    bool stop = false;
+
+    out_init(&out, fd);
+    do
+    {
+        int before = argi;
+        for (const char *p = fmt; *p != '\0' && !stop; p++)
+        {
+            if (*p == '\\')
+            {
+                p = out_escape(&out, p + 1, false, &stop) - 1;
+                continue;
+            }
+            if (*p != '%')
+            {
+                out_char(&out, *p);
+                continue;
+            }
+            if (p[1] == '%')
+            {
+                out_char(&out, '%');
+                p++;
+                continue;
+            }
+
+            // copy the flags, width and precision so snprintf does the work,
+            // numbers are always converted as long long
+            const char *spec = p++;
+            p += strspn(p, "-+ #0");
+            while (isdigit((unsigned char)*p))
+                p++;
+            if (*p == '.')
+            {
+                p++;
+                while (isdigit((unsigned char)*p))
+                    p++;
+            }
+
+            char conv = *p;
+            char specBuff[64];
+            int specLen = p - spec;
+            if (conv == '\0' || strchr("sbcdiuoxX", conv) == NULL || specLen > (int)sizeof(specBuff) - 4)
+            {
+                fprintf(stderr, "printf: %.*s: invalid conversion\n", (int)(p - spec + (conv != '\0')), spec);
+                rc = 1;
+                stop = true;
+                break;
+            }
+            memcpy(specBuff, spec, specLen);
+
+            const char *arg = argi < argc ? argv[argi++] : NULL;
+            switch (conv)
+            {
+            case 's':
+                strcpy(specBuff + specLen, "s");
+                out_format(&out, specBuff, arg != NULL ? arg : "");
+                break;
+            case 'b':
+                if (arg != NULL)
+                    out_escaped(&out, arg, true, &stop);
+                break;
+            case 'c':
+                if (arg != NULL && arg[0] != '\0')
+                    out_char(&out, arg[0]);
+                break;
+            case 'd':
+            case 'i':
+                sprintf(specBuff + specLen, "ll%c", conv);
+                out_format(&out, specBuff, printf_number(arg, &rc));
+                break;
+            default:
+                sprintf(specBuff + specLen, "ll%c", conv);
+                out_format(&out, specBuff, (unsigned long long)printf_number(arg, &rc));
+                break;
+            }
+        }
+
+        // the format is used again only if it took some of the arguments
+        if (argi == before)
+        {
+            break;
+        }
+    } while (argi < argc && !stop);
+
+    return out_close(&out, rc);
+}
@@ -0,0 +1,36 @@
+#ifndef __BUILTINS_H__
+#define __BUILTINS_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// Small utilities that scripts run all the time are built into dsh, so a
+// line like `echo done` doesn't cost a whole fork and exec.  They behave
+// like their coreutils counterparts for the common options, write to the
+// descriptor they are given and return the exit status of the command.
+#define ECHO_CMD "echo"
+#define PWD_CMD "pwd"
+#define TRUE_CMD "true"
+#define FALSE_CMD "false"
+#define TEST_CMD "test"
+#define TEST_BRACKET_CMD "["
+#define PRINTF_CMD "printf"
+
+// output of a built in is gathered and written in chunks this big
+#define BI_OUT_BUFF_SZ 4096
+
+typedef struct bi_out
+{
+    int fd;      // where the output goes
+    size_t len;  // bytes waiting in buff
+    bool failed; // a write() failed, the rest of the output is dropped
+    char buff[BI_OUT_BUFF_SZ];
+} bi_out_t;
+
+// prototypes for the utility built ins, see builtins.c
+int bi_echo(int argc, char *argv[], int fd);
+int bi_pwd(int argc, char *argv[], int fd);
+int bi_test(int argc, char *argv[]);
+int bi_printf(int argc, char *argv[], int fd);
+
+#endif
@@ -0,0 +1,439 @@
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#include "cmdtrie.h"
+#include "pathhash.h"
+#include "registry.h"
+
+static cmd_trie_t *trie = NULL; // the one completion uses
+static pthread_t builder;
+static bool building = false; // builder is running or hasn't been joined
+
+// names found on PATH, collected before they are put in the trie
+typedef struct name_list
+{
+    char **names;
+    int num;
+    int cap;
+} name_list_t;
+
+static const char *current_path(void)
+{
+    const char *path = getenv("PATH");
+    return path != NULL ? path : PATH_HASH_DEF_PATH;
+}
+
+static int count_dirs(const char *path)
+{
+    int n = 1;
+    for (; *path != '\0'; path++)
+    {
+        n += *path == ':';
+    }
+    return n;
+}
+
+// the mtime of the PATH directory in the len bytes at dir, zero if it
+// can't be stat()ed
+static struct timespec dir_mtime(const char *dir, size_t len)
+{
+    char buff[PATH_MAX];
+    struct stat st;
+    struct timespec none = {0, 0};
+    if (len == 0 || len >= sizeof(buff))
+    {
+        return none;
+    }
+    memcpy(buff, dir, len);
+    buff[len] = '\0';
+    return stat(buff, &st) == 0 ? st.st_mtim : none;
+}
+
+void comp_list_clear(comp_list_t *list)
+{
+    for (int i = 0; i < list->num; i++)
+    {
+        free(list->items[i]);
+    }
+    free(list->items);
+    memset(list, 0, sizeof(comp_list_t));
+}
+
+// adds the first len bytes of s and then suffix, returns -1 without memory
+int comp_list_add(comp_list_t *list, const char *s, size_t len, const char *suffix)
+{
+    if (list->num == list->cap)
+    {
+        int newCap = list->cap == 0 ? 16 : list->cap * 2;
+        char **grown = realloc(list->items, newCap * sizeof(char *));
+        if (grown == NULL)
+        {
+            return -1;
+        }
+        list->items = grown;
+        list->cap = newCap;
+    }
+
+    size_t suffixLen = strlen(suffix);
+    char *item = malloc(len + suffixLen + 1);
+    if (item == NULL)
+    {
+        return -1;
+    }
+    memcpy(item, s, len);
+    memcpy(item + len, suffix, suffixLen + 1);
+    list->items[list->num++] = item;
+    return 0;
+}
+
+static int add_name(name_list_t *list, const char *name)
+{
+    if (list->num == list->cap)
+    {
+        int newCap = list->cap == 0 ? 1024 : list->cap * 2;
+        char **grown = realloc(list->names, newCap * sizeof(char *));
+        if (grown == NULL)
+        {
+            return -1;
+        }
+        list->names = grown;
+        list->cap = newCap;
+    }
+    list->names[list->num] = strdup(name);
+    return list->names[list->num++] != NULL ? 0 : -1;
+}
+
+// adds the executables in the directory, skipping what can't be read
+static int read_dir(const char *dir, size_t len, name_list_t *list)
+{
+    char buff[PATH_MAX];
+    if (len == 0 || len >= sizeof(buff))
+    {
+        return 0;
+    }
+    memcpy(buff, dir, len);
+    buff[len] = '\0';
+
+    DIR *d = opendir(buff);
+    if (d == NULL)
+    {
+        return 0;
+    }
+
+    int rc = 0;
+    struct dirent *e;
+    while (rc == 0 && (e = readdir(d)) != NULL)
+    {
+        struct stat st;
+        if (e->d_name[0] == '.' || e->d_type == DT_DIR)
+        {
+            continue;
+        }
+        if (e->d_type != DT_REG && fstatat(dirfd(d), e->d_name, &st, 0) != 0)
+        {
+            continue;
+        }
+        if (e->d_type != DT_REG && !S_ISREG(st.st_mode))
+        {
+            continue;
+        }
+        if (faccessat(dirfd(d), e->d_name, X_OK, 0) == 0)
+        {
+            rc = add_name(list, e->d_name);
+        }
+    }
+    closedir(d);
+    return rc;
+}
+
+static int cmp_names(const void *a, const void *b)
+{
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+// returns the index of the new node, or 0 if it couldn't be allocated.  The
+// root is node 0, so making it is checked with t->nodes instead
+static uint32_t new_node(cmd_trie_t *t, unsigned char ch)
+{
+    if (t->num == t->cap)
+    {
+        uint32_t newCap = t->cap == 0 ? 4096 : t->cap * 2;
+        cmd_trie_node_t *grown = realloc(t->nodes, newCap * sizeof(cmd_trie_node_t));
+        if (grown == NULL)
+        {
+            return 0;
+        }
+        t->nodes = grown;
+        t->cap = newCap;
+    }
+    memset(&t->nodes[t->num], 0, sizeof(cmd_trie_node_t));
+    t->nodes[t->num].ch = ch;
+    return t->num++;
+}
+
+// names are inserted in sorted order, so the child a name continues with
+// is either its parent's last child or a new one appended after it
+static int insert(cmd_trie_t *t, const char *name)
+{
+    uint32_t n = 0;
+    for (; *name != '\0'; name++)
+    {
+        uint32_t last = t->nodes[n].last;
+        if (last != 0 && t->nodes[last].ch == (unsigned char)*name)
+        {
+            n = last;
+            continue;
+        }
+
+        uint32_t m = new_node(t, *name);
+        if (m == 0)
+        {
+            return -1;
+        }
+        if (last == 0)
+            t->nodes[n].child = m;
+        else
+            t->nodes[last].sibling = m;
+        t->nodes[n].last = m;
+        n = m;
+    }
+    t->nodes[n].terminal = true;
+    return 0;
+}
+
+static void free_trie(cmd_trie_t *t)
+{
+    if (t != NULL)
+    {
+        free(t->nodes);
+        free(t->path);
+        free(t->mtimes);
+        free(t);
+    }
+}
+
+/*
+ *  build_trie
+ *      arg:  a malloc'd copy of PATH, owned by the trie
+ *
+ *  Runs on the builder thread.  Each directory's mtime is taken before it
+ *  is read, so a program added while it is read still makes the trie
+ *  stale.  The names are sorted before they are inserted, which lets
+ *  insert() append children without searching for them.
+ *
+ *  returns:  the trie, or NULL if there was no memory
+ */
+static void *build_trie(void *arg)
+{
+    name_list_t list = {0};
+    cmd_trie_t *t = calloc(1, sizeof(cmd_trie_t));
+    if (t == NULL)
+    {
+        free(arg);
+        return NULL;
+    }
+    t->path = arg;
+    t->numDirs = count_dirs(t->path);
+    t->mtimes = calloc(t->numDirs, sizeof(struct timespec));
+
+    new_node(t, '\0');
+    bool failed = t->mtimes == NULL || t->nodes == NULL;
+    const char *dir = t->path;
+    for (int i = 0; i < t->numDirs && !failed; i++)
+    {
+        size_t len = strcspn(dir, ":");
+        t->mtimes[i] = dir_mtime(dir, len);
+        failed = read_dir(dir, len, &list) != 0;
+        dir += len + (dir[len] == ':');
+    }
+
+    const bi_entry_t *e;
+    for (int slot = 0; !failed && (e = bi_next(&slot, BI_F_LOCAL)) != NULL;)
+    {
+        failed = add_name(&list, e->name) != 0;
+    }
+
+    if (!failed)
+    {
+        qsort(list.names, list.num, sizeof(char *), cmp_names);
+    }
+    for (int i = 0; i < list.num; i++)
+    {
+        failed = failed || insert(t, list.names[i]) != 0;
+        free(list.names[i]);
+    }
+    free(list.names);
+
+    if (failed)
+    {
+        free_trie(t);
+        return NULL;
+    }
+    return t;
+}
+
+// true if there is no trie, or PATH or one of its directories changed
+static bool is_stale(const char *path)
+{
+    if (trie == NULL || strcmp(trie->path, path) != 0)
+    {
+        return true;
+    }
+
+    const char *dir = path;
+    for (int i = 0; i < trie->numDirs; i++)
+    {
+        size_t len = strcspn(dir, ":");
+        struct timespec m = dir_mtime(dir, len);
+        if (m.tv_sec != trie->mtimes[i].tv_sec || m.tv_nsec != trie->mtimes[i].tv_nsec)
+        {
+            return true;
+        }
+        dir += len + (dir[len] == ':');
+    }
+    return false;
+}
+
+// swaps in the trie the builder made, if it is done.  With block it is
+// waited for
+static void take_built(bool block)
+{
+    if (!building)
+    {
+        return;
+    }
+
+    void *built = NULL;
+    int rc = block ? pthread_join(builder, &built) : pthread_tryjoin_np(builder, &built);
+    if (rc != 0)
+    {
+        return;
+    }
+    building = false;
+    if (built != NULL)
+    {
+        free_trie(trie);
+        trie = built;
+    }
+}
+
+/*
+ *  cmd_trie_refresh
+ *
+ *  Starts building the trie in the background if there is none or it is
+ *  stale, which costs a stat() of each PATH directory.  The line editor
+ *  calls this as it starts reading a line, so the trie is ready by the
+ *  time Tab is pressed.
+ */
+void cmd_trie_refresh(void)
+{
+    take_built(false);
+    const char *path = current_path();
+    if (building || !is_stale(path))
+    {
+        return;
+    }
+
+    char *copy = strdup(path);
+    if (copy == NULL)
+    {
+        return;
+    }
+    if (pthread_create(&builder, NULL, build_trie, copy) != 0)
+    {
+        free(copy);
+        return;
+    }
+    building = true;
+}
+
+// adds every name below node n, prefix is the name so far in buff
+static int collect(uint32_t n, char *buff, size_t len, comp_list_t *out)
+{
+    if (trie->nodes[n].terminal && comp_list_add(out, buff, len, "") != 0)
+    {
+        return -1;
+    }
+    if (len + 1 >= NAME_MAX + 1)
+    {
+        return 0;
+    }
+    for (uint32_t c = trie->nodes[n].child; c != 0; c = trie->nodes[c].sibling)
+    {
+        buff[len] = trie->nodes[c].ch;
+        if (collect(c, buff, len + 1, out) != 0)
+        {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/*
+ *  cmd_trie_complete
+ *      prefix:  what was typed of the command
+ *      wait:    wait for a trie being built instead of using the old one,
+ *               which is always done if there is no old one
+ *      out:     gets the commands starting with prefix, sorted
+ *
+ *  returns:  the number of commands found, -1 if there was no memory
+ */
+int cmd_trie_complete(const char *prefix, bool wait, comp_list_t *out)
+{
+    cmd_trie_refresh();
+    if (wait || trie == NULL)
+    {
+        take_built(true);
+    }
+    if (trie == NULL)
+    {
+        return 0;
+    }
+
+    size_t len = strlen(prefix);
+    if (len > NAME_MAX)
+    {
+        return 0;
+    }
+
+    uint32_t n = 0;
+    for (size_t i = 0; i < len; i++)
+    {
+        uint32_t c = trie->nodes[n].child;
+        while (c != 0 && trie->nodes[c].ch != (unsigned char)prefix[i])
+        {
+            c = trie->nodes[c].sibling;
+        }
+        if (c == 0)
+        {
+            return 0;
+        }
+        n = c;
+    }
+
+    char buff[NAME_MAX + 1];
+    memcpy(buff, prefix, len);
+    return collect(n, buff, len, out) == 0 ? out->num : -1;
+}
+
+void cmd_trie_free(void)
+{
+    if (building)
+    {
+        void *built = NULL;
+        pthread_join(builder, &built);
+        free_trie(built);
+        building = false;
+    }
+    free_trie(trie);
+    trie = NULL;
+}
@@ -0,0 +1,51 @@
+#ifndef __CMDTRIE_H__
+#define __CMDTRIE_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+// Commands are completed from a prefix trie of every executable on PATH and
+// every built in, so Tab walks the few nodes of what was typed instead of
+// reading every PATH directory again.  The trie is built on a thread of its
+// own when the first prompt is shown, and built again the same way once
+// PATH changes or the mtime of one of its directories does, which is what
+// installing or removing a program changes.  Completion keeps using the
+// old trie until the new one is done.
+
+typedef struct cmd_trie_node
+{
+    uint32_t child;   // first child, 0 for none as the root is no child
+    uint32_t sibling; // next child of the same parent, in byte order
+    uint32_t last;    // last child, only used while building
+    unsigned char ch;
+    bool terminal; // a name ends here
+} cmd_trie_node_t;
+
+typedef struct cmd_trie
+{
+    cmd_trie_node_t *nodes; // nodes[0] is the root
+    uint32_t num;
+    uint32_t cap;
+    char *path;              // the PATH it was built from
+    struct timespec *mtimes; // of each PATH directory, before it was read
+    int numDirs;
+} cmd_trie_t;
+
+// what a word can be completed to, sorted
+typedef struct comp_list
+{
+    char **items; // malloc'd
+    int num;
+    int cap;
+} comp_list_t;
+
+// prototypes for command completion, see cmdtrie.c
+void cmd_trie_refresh(void);
+int cmd_trie_complete(const char *prefix, bool wait, comp_list_t *out);
+void cmd_trie_free(void);
+int comp_list_add(comp_list_t *list, const char *s, size_t len, const char *suffix);
+void comp_list_clear(comp_list_t *list);
+
+#endif
@@ -6,6 +6,8 @@
 
 #include "dshlib.h"
 #include "rshlib.h"
+#include "evserver.h"
+#include "workpool.h"
 
 /*
  * Used to pass startup parameters back to main
@@ -13,6 +15,7 @@
 #define MODE_LCLI 0 // Local client
 #define MODE_SCLI 1 // Socket client
 #define MODE_SSVR 2 // Socket server
+#define MODE_SCRIPT 3 // Local script, no prompts
 
 typedef struct cmd_args
 {
@@ -20,6 +23,12 @@ typedef struct cmd_args
     char ip[16]; // e.g., 192.168.100.101\0
     int port;
     int threaded_server;
+    int event_loops; // -e, -1 when the server doesn't use event loops
+    int pool_workers; // -w, -q and -t, -1 for the server's default
+    int pool_slots;
+    int pool_timeout;
+    char *script; // file run by -f, "-" for stdin
+    int legacy;   // -l, the client speaks the legacy protocol
 } cmd_args_t;
 
 // You dont really need to understand this but the C runtime library provides
@@ -29,13 +38,19 @@ typedef struct cmd_args
 
 void print_usage(const char *progname)
 {
-    printf("Usage: %s [-c | -s] [-i IP] [-p PORT] [-x] [-h]\n", progname);
+    printf("Usage: %s [-c | -s | -f SCRIPT] [-i IP] [-p PORT] [-x | -e LOOPS] [-w N] [-q N] [-t MS] [-l] [-h]\n", progname);
     printf("  Default is to run %s in local mode\n", progname);
     printf("  -c            Run as client\n");
     printf("  -s            Run as server\n");
+    printf("  -f SCRIPT     Run the commands in SCRIPT without prompts, - reads stdin\n");
     printf("  -i IP         Set IP/Interface address (only valid with -c or -s)\n");
     printf("  -p PORT       Set port number (only valid with -c or -s)\n");
     printf("  -x            Enable threaded mode (only valid with -s)\n");
+    printf("  -e LOOPS      Serve from epoll event loops, 0 is one per core (only valid with -s)\n");
+    printf("  -w N          Run the server's work on N worker threads (only valid with -x or -e)\n");
+    printf("  -q N          Queue at most N connections or commands for the workers (only valid with -x or -e)\n");
+    printf("  -t MS         Wait MS for room in a full queue, 0 turns clients away (only valid with -x)\n");
+    printf("  -l            Send commands ending in a null, not as frames (only valid with -c)\n");
     printf("  -h            Show this help message\n");
     exit(0);
 }
@@ -48,8 +63,12 @@ void parse_args(int argc, char *argv[], cmd_args_t *cargs)
     // defaults
     cargs->mode = MODE_LCLI;
     cargs->port = RDSH_DEF_PORT;
+    cargs->event_loops = -1;
+    cargs->pool_workers = -1;
+    cargs->pool_slots = -1;
+    cargs->pool_timeout = -1;
 
-    while ((opt = getopt(argc, argv, "csi:p:xh")) != -1)
+    while ((opt = getopt(argc, argv, "csi:p:xe:w:q:t:f:lh")) != -1)
     {
         switch (opt)
         {
@@ -72,7 +91,7 @@ void parse_args(int argc, char *argv[], cmd_args_t *cargs)
             strncpy(cargs->ip, RDSH_DEF_SVR_INTFACE, sizeof(cargs->ip) - 1);
             break;
         case 'i':
-            if (cargs->mode == MODE_LCLI)
+            if (cargs->mode != MODE_SCLI && cargs->mode != MODE_SSVR)
             {
                 fprintf(stderr, "Error: -i can only be used with -c or -s\n");
                 exit(EXIT_FAILURE);
@@ -81,7 +100,7 @@ void parse_args(int argc, char *argv[], cmd_args_t *cargs)
             cargs->ip[sizeof(cargs->ip) - 1] = '\0'; // Ensure null termination
             break;
         case 'p':
-            if (cargs->mode == MODE_LCLI)
+            if (cargs->mode != MODE_SCLI && cargs->mode != MODE_SSVR)
             {
                 fprintf(stderr, "Error: -p can only be used with -c or -s\n");
                 exit(EXIT_FAILURE);
@@ -101,6 +120,55 @@ void parse_args(int argc, char *argv[], cmd_args_t *cargs)
             }
             cargs->threaded_server = 1;
             break;
+        case 'e':
+            if (cargs->mode != MODE_SSVR)
+            {
+                fprintf(stderr, "Error: -e can only be used with -s\n");
+                exit(EXIT_FAILURE);
+            }
+            cargs->event_loops = atoi(optarg);
+            if (cargs->event_loops < 0)
+            {
+                fprintf(stderr, "Error: Invalid number of event loops\n");
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'w':
+            cargs->pool_workers = atoi(optarg);
+            if (cargs->pool_workers <= 0)
+            {
+                fprintf(stderr, "Error: Invalid number of workers\n");
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'q':
+            cargs->pool_slots = atoi(optarg);
+            if (cargs->pool_slots <= 0)
+            {
+                fprintf(stderr, "Error: Invalid queue size\n");
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 't':
+            cargs->pool_timeout = atoi(optarg);
+            if (cargs->pool_timeout < 0)
+            {
+                fprintf(stderr, "Error: Invalid queue timeout\n");
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'f':
+            if (cargs->mode != MODE_LCLI)
+            {
+                fprintf(stderr, "Error: -f can only be used in local mode\n");
+                exit(EXIT_FAILURE);
+            }
+            cargs->mode = MODE_SCRIPT;
+            cargs->script = optarg;
+            break;
+        case 'l':
+            cargs->legacy = 1;
+            break;
         case 'h':
             print_usage(argv[0]);
             break;
@@ -114,6 +182,25 @@ void parse_args(int argc, char *argv[], cmd_args_t *cargs)
         fprintf(stderr, "Error: -x can only be used with -s\n");
         exit(EXIT_FAILURE);
     }
+
+    if (cargs->threaded_server && cargs->event_loops >= 0)
+    {
+        fprintf(stderr, "Error: Cannot use both -x and -e\n");
+        exit(EXIT_FAILURE);
+    }
+
+    if (cargs->legacy && cargs->mode != MODE_SCLI)
+    {
+        fprintf(stderr, "Error: -l can only be used with -c\n");
+        exit(EXIT_FAILURE);
+    }
+
+    bool pooled = cargs->threaded_server || cargs->event_loops >= 0;
+    if (!pooled && (cargs->pool_workers >= 0 || cargs->pool_slots >= 0 || cargs->pool_timeout >= 0))
+    {
+        fprintf(stderr, "Error: -w, -q and -t can only be used with -x or -e\n");
+        exit(EXIT_FAILURE);
+    }
 }
 
 /* DO NOT EDIT
@@ -136,12 +223,24 @@ int main(int argc, char *argv[])
         printf("local mode\n");
         rc = exec_local_cmd_loop();
         break;
+    case MODE_SCRIPT:
+        // batch mode stays quiet, only the commands' output is printed and
+        // the status of the last one is the exit status
+        return exec_script(cargs.script);
     case MODE_SCLI:
         printf("socket client mode:  addr:%s:%d\n", cargs.ip, cargs.port);
+        set_legacy_protocol(cargs.legacy);
         rc = exec_remote_cmd_loop(cargs.ip, cargs.port);
         break;
     case MODE_SSVR:
         printf("socket server mode:  addr:%s:%d\n", cargs.ip, cargs.port);
+        work_pool_config(cargs.pool_workers, cargs.pool_slots, cargs.pool_timeout);
+        if (cargs.event_loops >= 0)
+        {
+            // prints how many loops and workers it runs
+            rc = start_event_server(cargs.ip, cargs.port, cargs.event_loops);
+            break;
+        }
         if (cargs.threaded_server)
         {
             printf("-> Multi-Threaded Mode\n");
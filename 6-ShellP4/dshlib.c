@@ -1,3 +1,4 @@
+#define _GNU_SOURCE
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
@@ -6,8 +7,24 @@
 #include <unistd.h>
 #include <fcntl.h>
 #include <sys/wait.h>
+#include <spawn.h>
+#include <stdio_ext.h>
 #include <errno.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 #include "dshlib.h"
+#include "pathhash.h"
+#include "builtins.h"
+#include "jobs.h"
+#include "parallel.h"
+#include "splice.h"
+#include "stats.h"
+#include "trace.h"
+#include "registry.h"
+#include "pathglob.h"
+#include "lineedit.h"
+#include "parsecache.h"
 
 /****
  **** FOR REMOTE SHELL USE YOUR SOLUTION FROM SHELL PART 3 HERE
@@ -19,303 +36,294 @@
 // global variable to hold the last error return code for the child process
 int last_rc = 0;
 
-// copies the oldStr into the newStr without any of the leading and trailing whitespace
-// does not mutate the old string or the new string
-// returns a return code in case bugs crop up
-int str_trim_cpy(char *newStr, char *oldStr)
+// sets up an empty arena that can hold cap bytes
+int arena_init(parse_arena_t *arena, size_t cap)
 {
-    // check for null pointers
-    if (oldStr == NULL || newStr == NULL)
+    arena->base = malloc(cap);
+    if (arena->base == NULL)
     {
         return ERR_MEMORY;
     }
+    arena->used = 0;
+    arena->cap = cap;
+    return OK;
+}
 
-    int length = strlen(oldStr);
-    int start = 0;
+void arena_free(parse_arena_t *arena)
+{
+    free(arena->base);
+    arena->base = NULL;
+    arena->used = 0;
+    arena->cap = 0;
+}
 
-    // find the first character non whitespace char
-    while (start < length && oldStr[start] == SPACE_CHAR)
-    {
-        start++;
-    }
+// forgets everything handed out, the memory is kept for the next line
+void arena_reset(parse_arena_t *arena)
+{
+    arena->used = 0;
+}
 
-    // if the string is all spaces, newStr is empty
-    if (start == length)
+// makes sure need more bytes fit in the arena.  Growing moves the arena, so
+// this is only called before anything is handed out for the current line
+int arena_reserve(parse_arena_t *arena, size_t need)
+{
+    if (arena->used + need <= arena->cap)
     {
-        newStr[0] = '\0';
         return OK;
     }
 
-    int end = length - 1;
-
-    // find the last character non whitespace char
-    while (end > start && oldStr[end] == SPACE_CHAR)
+    char *grown = realloc(arena->base, arena->used + need);
+    if (grown == NULL)
     {
-        end--;
+        return ERR_MEMORY;
     }
-
-    int trueLength = end - start + 1;
-
-    // copy substring from start all for the true length of characters
-    strncpy(newStr, oldStr + start, trueLength);
-    newStr[trueLength] = '\0';
-
+    arena->base = grown;
+    arena->cap = arena->used + need;
     return OK;
 }
 
-// helper function to allocate memory
-int alloc_cmd_buff(cmd_buff_t *cmd_buff)
+// hands out size bytes from the arena, returns NULL if they don't fit
+char *arena_alloc(parse_arena_t *arena, size_t size)
 {
-    // nullify every string in the array for now, this will be built in the build function
-    for (int i = 0; i < CMD_ARGV_MAX; i++)
+    if (arena->used + size > arena->cap)
     {
-        if (cmd_buff->argv[i] != NULL)
-        {
-            free(cmd_buff->argv[i]);
-        }
-        cmd_buff->argv[i] = NULL;
+        return NULL;
     }
-    cmd_buff->argc = 0;
+    char *mem = arena->base + arena->used;
+    arena->used += size;
+    return mem;
+}
 
-    cmd_buff->_cmd_buffer = malloc(SH_CMD_MAX);
-    if (cmd_buff->_cmd_buffer == NULL)
+// the kernel's limit on the size of the arguments to exec, looked up once
+long sh_arg_max(void)
+{
+    static long argMax = 0;
+    if (argMax == 0)
     {
-        return ERR_MEMORY;
+        long limit = sysconf(_SC_ARG_MAX);
+        argMax = (limit > 0) ? limit : SH_ARG_MAX_DEF;
     }
-    cmd_buff->_cmd_buffer[0] = '\0'; // initialize as empty string
-    return OK;
+    return argMax;
+}
+
+// helper function to allocate memory
+// the strings of a cmd_buff all live in the command list's arena and argv
+// starts out inline, so nothing is allocated until argv outgrows it
+int alloc_cmd_buff(cmd_buff_t *cmd_buff)
+{
+    cmd_buff->argv = cmd_buff->argv_inline;
+    cmd_buff->argv_cap = CMD_ARGV_MAX;
+    return clear_cmd_buff(cmd_buff);
 }
 
 // helper function to free the memory
 int free_cmd_buff(cmd_buff_t *cmd_buff)
 {
-    for (int i = 0; i < CMD_ARGV_MAX; i++)
+    if (cmd_buff->argv != cmd_buff->argv_inline)
     {
-        if (cmd_buff->argv[i] != NULL)
-        {
-            free(cmd_buff->argv[i]);
-            cmd_buff->argv[i] = NULL;
-        }
+        free(cmd_buff->argv);
     }
-
-    free(cmd_buff->_cmd_buffer);
-
-    return OK;
+    cmd_buff->argv = cmd_buff->argv_inline;
+    cmd_buff->argv_cap = CMD_ARGV_MAX;
+    return clear_cmd_buff(cmd_buff);
 }
 
 // clears all parts of the cmd_buff
+// argv only points into the arena so nothing is freed, a grown argv is kept
+// for the next command that needs it
 int clear_cmd_buff(cmd_buff_t *cmd_buff)
 {
     cmd_buff->argc = 0;
     cmd_buff->append_mode = 0;
     cmd_buff->input_file = NULL;
     cmd_buff->output_file = NULL;
-
-    // clears argv by freeing char pointers and setting them to null
-    for (int i = 0; i < CMD_ARGV_MAX; i++)
-    {
-        if (cmd_buff->argv[i] != NULL)
-        {
-            free(cmd_buff->argv[i]);
-            cmd_buff->argv[i] = NULL;
-        }
-    }
-    strcpy(cmd_buff->_cmd_buffer, "\0");
+    cmd_buff->argv[0] = NULL;
 
     return OK;
 }
 
+// empties the list for the next line in O(1), every command is reset by
+// build_cmd_buff() when it gets reused
 int clear_cmd_list(command_list_t *cmd_buff)
 {
-    for (int i = 0; i < CMD_MAX; i++)
-    {
-        clear_cmd_buff(&cmd_buff->commands[i]);
-    }
+    arena_reset(&cmd_buff->arena);
+    path_glob_reset(cmd_buff->glob_mem);
+    cmd_buff->expanded = false;
     cmd_buff->num = 0;
+    cmd_buff->background = false;
+    cmd_buff->out_fd = -1;
     return OK;
 }
 
-char *get_next_token(char **p, int *tokenLen)
+// true for the characters that end a run of ordinary word characters
+static inline bool is_lex_special(char c)
 {
-    // skip any leading spaces
-    while (**p == SPACE_CHAR)
+    switch (c)
     {
-        (*p)++;
+    case SPACE_CHAR:
+    case TAB_CHAR:
+    case PIPE_CHAR:
+    case REDIR_IN_CHAR:
+    case REDIR_OUT_CHAR:
+    case BG_CHAR:
+    case '\"':
+    case '\'':
+        return true;
+    default:
+        return false;
     }
-    if (**p == '\0')
+}
+
+// the glob characters also end a run, so lex_word() sees them without
+// another pass over the word
+static inline bool is_glob_char(char c)
+{
+    return c == '*' || c == '?' || c == '[';
+}
+
+// returns how many ordinary characters start at p, stopping at end or the
+// first space, operator, quote or glob character.  With SSE2 this checks 16
+// bytes at a time and never reads past end
+static size_t plain_run(const char *p, const char *end)
+{
+    const char *start = p;
+
+#ifdef __SSE2__
+    const __m128i space = _mm_set1_epi8(SPACE_CHAR);
+    const __m128i tab = _mm_set1_epi8(TAB_CHAR);
+    const __m128i pipe = _mm_set1_epi8(PIPE_CHAR);
+    const __m128i in = _mm_set1_epi8(REDIR_IN_CHAR);
+    const __m128i out = _mm_set1_epi8(REDIR_OUT_CHAR);
+    const __m128i bg = _mm_set1_epi8(BG_CHAR);
+    const __m128i dquote = _mm_set1_epi8('\"');
+    const __m128i squote = _mm_set1_epi8('\'');
+    const __m128i star = _mm_set1_epi8('*');
+    const __m128i query = _mm_set1_epi8('?');
+    const __m128i bracket = _mm_set1_epi8('[');
+
+    while (end - p >= 16)
     {
-        return NULL;
+        __m128i chunk = _mm_loadu_si128((const __m128i *)p);
+        __m128i hit = _mm_or_si128(_mm_cmpeq_epi8(chunk, space), _mm_cmpeq_epi8(chunk, tab));
+        hit = _mm_or_si128(hit, _mm_cmpeq_epi8(chunk, pipe));
+        hit = _mm_or_si128(hit, _mm_cmpeq_epi8(chunk, in));
+        hit = _mm_or_si128(hit, _mm_cmpeq_epi8(chunk, out));
+        hit = _mm_or_si128(hit, _mm_cmpeq_epi8(chunk, bg));
+        hit = _mm_or_si128(hit, _mm_cmpeq_epi8(chunk, dquote));
+        hit = _mm_or_si128(hit, _mm_cmpeq_epi8(chunk, squote));
+        hit = _mm_or_si128(hit, _mm_cmpeq_epi8(chunk, star));
+        hit = _mm_or_si128(hit, _mm_cmpeq_epi8(chunk, query));
+        hit = _mm_or_si128(hit, _mm_cmpeq_epi8(chunk, bracket));
+
+        int mask = _mm_movemask_epi8(hit);
+        if (mask != 0)
+        {
+            return (p - start) + __builtin_ctz(mask);
+        }
+        p += 16;
     }
+#endif
 
-    // allocate a temporary buffer large enough for the token
-    int maxLen = strlen(*p);
-    char *token = malloc(maxLen + 1);
-    if (!token)
+    while (p < end && !is_lex_special(*p) && !is_glob_char(*p))
     {
-        return NULL; // memory allocation error
+        p++;
     }
+    return p - start;
+}
+
+// copies the word at *p into out without its quotes and moves *p past it
+// a quote runs to its matching quote (or the end of the line), so spaces,
+// pipes and redirections inside quotes are part of the word
+// returns the length of the word, out is null terminated, and sets *magic
+// if an unquoted part of it has a glob character.  It is forced inline, the
+// word loop of the parser runs about half as fast when it is a call
+__attribute__((always_inline)) static inline int lex_word(const char **p, const char *end, char *out, bool *magic)
+{
+    const char *s = *p;
     int pos = 0;
 
-    // read until a whitespace is encountered
-    while (**p != '\0' && **p != SPACE_CHAR)
+    while (s < end)
     {
-        // handle quotes within the token
-        if (**p == '\"') // handle double quotes
+        if (*s == '\"' || *s == '\'')
         {
-            // skip the quote and keep copying until we reach the closing quote
-            (*p)++; // Skip the opening quote
-            while (**p != '\0' && **p != '\"')
-            {
-                token[pos++] = **p;
-                (*p)++;
-            }
-            if (**p == '\"')
-            {
-                (*p)++; // skip the closing quote
-            }
+            const char *close = memchr(s + 1, *s, end - (s + 1));
+            const char *stop = (close != NULL) ? close : end;
+            memcpy(out + pos, s + 1, stop - (s + 1));
+            pos += stop - (s + 1);
+            s = (close != NULL) ? close + 1 : end;
         }
-        else if (**p == '\'') // handle single quotes
+        else if (is_lex_special(*s))
         {
-            // skip the quote and keep copying until we reach the closing quote
-            (*p)++; // Skip the opening quote
-            while (**p != '\0' && **p != '\'')
-            {
-                token[pos++] = **p;
-                (*p)++;
-            }
-            if (**p == '\'')
+            break;
+        }
+        else if (is_glob_char(*s))
+        {
+            if (magic != NULL)
             {
-                (*p)++; // skip the closing quote
+                *magic = true;
             }
+            out[pos++] = *s++;
         }
         else
         {
-            // regular character: copy it
-            token[pos++] = **p;
-            (*p)++;
+            size_t run = plain_run(s, end);
+            memcpy(out + pos, s, run);
+            pos += run;
+            s += run;
         }
     }
-    // cap the token with a null terminator
-    token[pos] = '\0';
-    if (tokenLen)
-    {
-        *tokenLen = pos;
-    }
-    return token;
+
+    out[pos] = '\0';
+    *p = s;
+    return pos;
 }
 
 int validate_token_length(cmd_buff_t *cmd, int tokenLen, int *totalArgLen)
 {
-    if (cmd->argc == 0)
+    if (cmd->argc == 0 && tokenLen > EXE_MAX)
     {
-        if (tokenLen > EXE_MAX)
-        {
-            return ERR_CMD_OR_ARGS_TOO_BIG;
-        }
+        return ERR_CMD_OR_ARGS_TOO_BIG;
     }
-    else
-    {
-        *totalArgLen += tokenLen;
-        if (*totalArgLen > ARG_MAX)
-        {
-            return ERR_CMD_OR_ARGS_TOO_BIG;
-        }
-    }
-    return OK;
-}
 
-int add_token(cmd_buff_t *cmd, char *tokenStart, int tokenLen)
-{
-    cmd->argv[cmd->argc] = malloc(tokenLen + 1);
-    if (cmd->argv[cmd->argc] == NULL)
+    *totalArgLen += tokenLen + 1 + sizeof(char *);
+    if (*totalArgLen > sh_arg_max())
     {
-        return ERR_MEMORY;
+        return ERR_CMD_OR_ARGS_TOO_BIG;
     }
-    strncpy(cmd->argv[cmd->argc], tokenStart, tokenLen);
-    cmd->argv[cmd->argc][tokenLen] = '\0';
-    cmd->argc++;
-
     return OK;
 }
 
-int parse_cmd_line(cmd_buff_t *cmd, char *trimmed)
+// the token already lives in the arena, argv just points at it
+// argv is doubled when full, leaving room for the NULL at the end
+int add_token(cmd_buff_t *cmd, char *tokenStart, int tokenLen)
 {
-    // set up pointer for token parsing
-    char *p = trimmed;
-    int totalArgLen = 0;
-    cmd->argc = 0;
-    int rc = 0;
-
-    while (*p != '\0')
+    (void)tokenLen;
+    if (cmd->argc + 1 >= cmd->argv_cap)
     {
-        int tokenLen = 0;
-        char *token = get_next_token(&p, &tokenLen);
-        if (token == NULL)
+        int newCap = cmd->argv_cap * 2;
+        char **grown;
+        if (cmd->argv == cmd->argv_inline)
         {
-            rc = OK;
-            break;
+            grown = malloc(newCap * sizeof(char *));
+            if (grown != NULL)
+            {
+                memcpy(grown, cmd->argv, cmd->argc * sizeof(char *));
+            }
         }
-
-        // validate token length for the command or arguments
-        int validateRc = validate_token_length(cmd, tokenLen, &totalArgLen);
-        if (validateRc < 0)
+        else
         {
-            rc = validateRc;
-            free(token);
-            break;
+            grown = realloc(cmd->argv, newCap * sizeof(char *));
         }
-
-        int addTokenRc = add_token(cmd, token, tokenLen);
-        free(token); // free the temporary token after adding it
-        if (addTokenRc < 0)
+        if (grown == NULL)
         {
-            rc = ERR_MEMORY;
-            break;
+            return ERR_MEMORY;
         }
+        cmd->argv = grown;
+        cmd->argv_cap = newCap;
     }
 
-    return rc;
-}
-
-// sets the argc and argv of the command with the proper values
-int build_cmd_buff(char *cmd_line, cmd_buff_t *cmd)
-{
-    if (cmd_line == NULL)
-    {
-        return WARN_NO_CMDS;
-    }
-
-    // copy the original cmd_line to the cmd buffer
-    strcpy(cmd->_cmd_buffer, cmd_line);
-
-    // trim whitespace and copy it to the new string
-    char *trimmed = malloc(strlen(cmd_line) + 1);
-    int trimRc = str_trim_cpy(trimmed, cmd_line);
-    if (trimRc != OK)
-    {
-        free(trimmed);
-        return trimRc;
-    }
-
-    // parse the cmd_line with the trimmed version
-    int parseCmdLineRc = parse_cmd_line(cmd, trimmed);
-
-    free(trimmed);
-
-    // check for any errors returned
-    if (parseCmdLineRc < 0)
-    {
-        return parseCmdLineRc;
-    }
-
-    // if there were no tokens, then send the warning
-    if (cmd->argc == 0)
-    {
-        return WARN_NO_CMDS;
-    }
-
-    // finally, set the last array position to be null
-    cmd->argv[cmd->argc] = NULL;
+    cmd->argv[cmd->argc] = tokenStart;
+    cmd->argc++;
 
     return OK;
 }
@@ -324,38 +332,119 @@ int build_cmd_buff(char *cmd_line, cmd_buff_t *cmd)
 // if not a built in command, returns not a built in command
 Built_In_Cmds match_command(const char *input)
 {
-    if (strcmp(input, EXIT_CMD) == 0)
+    const bi_entry_t *e = bi_lookup(input, BI_F_LOCAL);
+    return e != NULL ? e->code : BI_NOT_BI;
+}
+
+// the utility built ins are the ones that stand in for a program in PATH
+bool is_util_built_in(Built_In_Cmds cmd)
+{
+    return cmd >= BI_CMD_ECHO && cmd <= BI_CMD_TEE;
+}
+
+// runs a utility built in in the shell itself.  Its output is written
+// straight to the descriptor, not through stdout's buffer, so it stays in
+// order with the output of the programs dsh runs.  The redirections are
+// opened here the same way a spawned program would get them
+// returns the exit status of the command
+static int exec_util_built_in(cmd_buff_t *cmd, Built_In_Cmds code)
+{
+    int in = STDIN_FILENO;
+    int out = STDOUT_FILENO;
+
+    if (cmd->input_file != NULL)
     {
-        return BI_CMD_EXIT;
+        // only cat and tee read their input, but a missing file is still an
+        // error for the others
+        in = open(cmd->input_file, O_RDONLY);
+        if (in < 0)
+        {
+            int err = errno;
+            output_exec_error(err);
+            return err;
+        }
     }
 
-    if (strcmp(input, DRAGON_CMD) == 0)
+    if (cmd->output_file != NULL)
     {
-        return BI_CMD_DRAGON;
+        int flags = O_WRONLY | O_CREAT | (cmd->append_mode ? O_APPEND : O_TRUNC);
+        out = open(cmd->output_file, flags, 0644);
+        if (out < 0)
+        {
+            int err = errno;
+            output_exec_error(err);
+            if (in != STDIN_FILENO)
+            {
+                close(in);
+            }
+            return err;
+        }
     }
 
-    if (strcmp(input, CD_CMD) == 0)
+    int rc;
+    switch (code)
     {
-        return BI_CMD_CD;
+    case BI_CMD_ECHO:
+        rc = bi_echo(cmd->argc, cmd->argv, out);
+        break;
+    case BI_CMD_PWD:
+        rc = bi_pwd(cmd->argc, cmd->argv, out);
+        break;
+    case BI_CMD_TRUE:
+        rc = 0;
+        break;
+    case BI_CMD_FALSE:
+        rc = 1;
+        break;
+    case BI_CMD_TEST:
+        rc = bi_test(cmd->argc, cmd->argv);
+        break;
+    case BI_CMD_PRINTF:
+        rc = bi_printf(cmd->argc, cmd->argv, out);
+        break;
+    case BI_CMD_CAT:
+        rc = bi_cat(cmd->argc, cmd->argv, in, out);
+        break;
+    case BI_CMD_TEE:
+        rc = bi_tee(cmd->argc, cmd->argv, in, out);
+        break;
+    default:
+        rc = BI_NOT_BI;
+        break;
     }
 
-    if (strcmp(input, RC_CMD) == 0)
+    if (in != STDIN_FILENO)
     {
-        return BI_CMD_RC;
+        close(in);
     }
-
-    return BI_NOT_BI;
+    if (out != STDOUT_FILENO)
+    {
+        close(out);
+    }
+    return rc;
 }
 
 // executes the built in command
 Built_In_Cmds exec_built_in_cmd(cmd_buff_t *cmd)
 {
-    Built_In_Cmds commandCode = match_command(cmd->argv[0]);
+    const bi_entry_t *e = bi_lookup(cmd->argv[0], BI_F_LOCAL);
+    if (e == NULL)
+    {
+        return BI_NOT_BI;
+    }
+
+    // most built ins are just a function of their arguments
+    Built_In_Cmds commandCode = e->code;
+    if (e->handler != NULL)
+    {
+        last_rc = e->handler(cmd->argc, cmd->argv, stdout);
+        return commandCode;
+    }
 
     switch (commandCode)
     {
     case BI_CMD_DRAGON:
-        print_dragon();
+        print_dragon(stdout);
         return BI_CMD_DRAGON;
     case BI_CMD_CD:
         if (cmd->argc == 2)
@@ -367,6 +456,19 @@ Built_In_Cmds exec_built_in_cmd(cmd_buff_t *cmd)
         // print the last return code
         printf("%d\n", last_rc);
         return BI_CMD_RC;
+    case BI_CMD_PARALLEL:
+        last_rc = parallel_cmd(cmd);
+        return BI_CMD_PARALLEL;
+    case BI_CMD_ECHO:
+    case BI_CMD_PWD:
+    case BI_CMD_TRUE:
+    case BI_CMD_FALSE:
+    case BI_CMD_TEST:
+    case BI_CMD_PRINTF:
+    case BI_CMD_CAT:
+    case BI_CMD_TEE:
+        last_rc = exec_util_built_in(cmd, commandCode);
+        return commandCode;
     default:
         return commandCode;
     }
@@ -383,130 +485,379 @@ int alloc_cmd_list(command_list_t **pCmdList)
     }
     memset(*pCmdList, 0, sizeof(command_list_t)); // zero out the memory
 
-    // allocate the command buffer for each command in the list
+    // the arena is the only allocation made for parsing, lines reuse it
+    if (arena_init(&(*pCmdList)->arena, PARSE_ARENA_SZ) != OK)
+    {
+        free(*pCmdList);
+        return ERR_MEMORY;
+    }
+
+    // short pipelines use the commands inside the list itself
+    (*pCmdList)->commands = (*pCmdList)->commands_inline;
+    (*pCmdList)->out_fd = -1;
+    (*pCmdList)->cap = CMD_MAX;
     for (int i = 0; i < CMD_MAX; i++)
     {
-        int rc = alloc_cmd_buff(&(*pCmdList)->commands[i]);
-        if (rc != OK)
+        alloc_cmd_buff(&(*pCmdList)->commands[i]);
+    }
+
+    return OK;
+}
+
+// doubles the room for commands in the list.  Commands are moved to the new
+// array, so any that still use their inline argv are pointed at its new home
+int grow_cmd_list(command_list_t *clist)
+{
+    int newCap = clist->cap * 2;
+    cmd_buff_t *grown = malloc(newCap * sizeof(cmd_buff_t));
+    if (grown == NULL)
+    {
+        return ERR_MEMORY;
+    }
+
+    memcpy(grown, clist->commands, clist->cap * sizeof(cmd_buff_t));
+    for (int i = 0; i < clist->cap; i++)
+    {
+        if (clist->commands[i].argv == clist->commands[i].argv_inline)
         {
-            // free them before returning an error
-            for (int j = 0; j < i; j++)
-            {
-                free_cmd_buff(&(*pCmdList)->commands[j]);
-            }
-            free(*pCmdList);
-            return ERR_MEMORY;
+            grown[i].argv = grown[i].argv_inline;
         }
     }
+    for (int i = clist->cap; i < newCap; i++)
+    {
+        alloc_cmd_buff(&grown[i]);
+    }
 
+    if (clist->commands != clist->commands_inline)
+    {
+        free(clist->commands);
+    }
+    clist->commands = grown;
+    clist->cap = newCap;
     return OK;
 }
 
 int free_cmd_list(command_list_t *cmd_lst)
 {
-    for (int i = 0; i < CMD_MAX; i++)
+    for (int i = 0; i < cmd_lst->cap; i++)
     {
         free_cmd_buff(&cmd_lst->commands[i]);
     }
+    if (cmd_lst->commands != cmd_lst->commands_inline)
+    {
+        free(cmd_lst->commands);
+    }
+    arena_free(&cmd_lst->arena);
+    path_glob_free(&cmd_lst->glob_mem);
     free(cmd_lst);
     return OK;
 }
 
-// reads input from stdin, prints the prompt, and removes the trailing newline
-// returns 0 if input was read, returns -1 on EOF to exit early
-int get_input(char *cmd_buff)
-{
-    if (fgets(cmd_buff, SH_CMD_MAX, stdin) == NULL)
+// reads input from stdin, prints the prompt, and removes the trailing newline
+// the buffer is grown by getline() to fit lines of any length, a terminal
+// gets the line editor instead (see lineedit.h)
+// returns 0 if input was read, returns -1 on EOF to exit early
+int get_input(char **cmd_buff, size_t *cmd_cap)
+{
+    if (isatty(STDIN_FILENO) && isatty(STDOUT_FILENO))
+    {
+        return line_edit_read(SH_PROMPT, cmd_buff, cmd_cap);
+    }
+    if (getline(cmd_buff, cmd_cap, stdin) < 0)
+    {
+        printf("\n");
+        return EOF;
+    }
+    (*cmd_buff)[strcspn(*cmd_buff, "\n")] = '\0';
+    return OK;
+}
+
+// takes the next unused command of the list, making room for it if needed
+// it is only counted in cmd_list->num once end_cmd() finds it has a word
+static cmd_buff_t *start_cmd(command_list_t *cmd_list)
+{
+    if (cmd_list->num >= cmd_list->cap && grow_cmd_list(cmd_list) != OK)
+    {
+        return NULL;
+    }
+    cmd_buff_t *cmd = &cmd_list->commands[cmd_list->num];
+    clear_cmd_buff(cmd);
+    return cmd;
+}
+
+// finishes the command being lexed, returns false if it had no words
+static bool end_cmd(command_list_t *cmd_list, cmd_buff_t *cmd)
+{
+    if (cmd->argc == 0)
+    {
+        return false;
+    }
+    cmd->argv[cmd->argc] = NULL;
+    cmd_list->num++;
+    return true;
+}
+
+// a word with an unquoted glob character is replaced by the paths it
+// matches, sorted, or added as it is if it matches none.  The paths live in
+// the list's glob_mem, and count against ARG_MAX like any other word
+static int add_glob_word(command_list_t *cmd_list, cmd_buff_t *cmd, const char *word, const char *end,
+                         char *token, int tokenLen, int *totalArgLen)
+{
+    path_glob_list_t matches = {0};
+    int num = path_glob_expand(word, end, &cmd_list->glob_mem, &matches);
+    cmd_list->expanded = true;
+    int rc = num < 0 ? ERR_MEMORY : OK;
+    for (int i = 0; rc == OK && i < (num > 0 ? num : 1); i++)
+    {
+        char *path = num > 0 ? matches.paths[i] : token;
+        int len = num > 0 ? (int)strlen(path) : tokenLen;
+        if (validate_token_length(cmd, len, totalArgLen) < 0)
+            rc = ERR_CMD_OR_ARGS_TOO_BIG;
+        else if (add_token(cmd, path, len) < 0)
+            rc = ERR_MEMORY;
+    }
+    free(matches.paths);
+
+    if (rc == ERR_MEMORY)
+        printf(CMD_ERR_MEMORY);
+    else if (rc == ERR_CMD_OR_ARGS_TOO_BIG)
+        printf(CMD_ERR_CMD_OR_ARGS_TOO_BIG);
+    return rc;
+}
+
+// the line is lexed in a single pass: quotes, pipes and the <, > and >>
+// redirections are all handled as they are met, words are copied into the
+// list's arena and redirection targets are recorded in the command's
+// input_file and output_file.  cmd_line is left untouched
+static int parse_cmd_list(char *cmd_line, command_list_t *cmd_list)
+{
+    size_t lineLen = strlen(cmd_line);
+    if ((long)lineLen > sh_arg_max())
+    {
+        printf(CMD_ERR_CMD_OR_ARGS_TOO_BIG);
+        return ERR_CMD_OR_ARGS_TOO_BIG;
+    }
+
+    // reserve room for all of the words up front, so the arena never moves
+    // while argv[] points into it
+    if (arena_reserve(&cmd_list->arena, lineLen + 1) != OK)
+    {
+        printf(CMD_ERR_MEMORY);
+        return ERR_MEMORY;
+    }
+
+    const char *p = cmd_line;
+    const char *end = cmd_line + lineLen;
+    cmd_buff_t *cmd = NULL; // command being lexed, NULL right after a pipe
+    int totalArgLen = 0;
+    bool anyWord = false;      // the line has at least one word
+    bool emptySegment = false; // a pipe had no command on one of its sides
+
+    while (p < end)
+    {
+        if (*p == SPACE_CHAR || *p == TAB_CHAR)
+        {
+            p++;
+            continue;
+        }
+
+        if (*p == PIPE_CHAR)
+        {
+            if (cmd == NULL || !end_cmd(cmd_list, cmd))
+            {
+                emptySegment = true;
+            }
+            cmd = NULL;
+            p++;
+            continue;
+        }
+
+        // & runs the whole line in the background, so nothing may follow it
+        if (*p == BG_CHAR)
+        {
+            p++;
+            while (p < end && (*p == SPACE_CHAR || *p == TAB_CHAR))
+            {
+                p++;
+            }
+            if (p != end)
+            {
+                printf(CMD_ERR_BG_FORMAT);
+                return ERR_CMD_ARGS_BAD;
+            }
+            cmd_list->background = true;
+            continue;
+        }
+
+        if (cmd == NULL)
+        {
+            cmd = start_cmd(cmd_list);
+            if (cmd == NULL)
+            {
+                printf(CMD_ERR_MEMORY);
+                return ERR_MEMORY;
+            }
+            totalArgLen = 0;
+        }
+
+        if (*p == REDIR_IN_CHAR || *p == REDIR_OUT_CHAR)
+        {
+            char op = *p++;
+            bool append = false;
+            if (op == REDIR_OUT_CHAR && p < end && *p == REDIR_OUT_CHAR)
+            {
+                append = true;
+                p++;
+            }
+
+            // the target is the next word, anything else is a format error
+            while (p < end && (*p == SPACE_CHAR || *p == TAB_CHAR))
+            {
+                p++;
+            }
+            if (p == end || *p == PIPE_CHAR || *p == REDIR_IN_CHAR || *p == REDIR_OUT_CHAR || *p == BG_CHAR)
+            {
+                printf(CMD_ERR_REDIRECTION_FORMAT);
+                return ERR_CMD_ARGS_BAD;
+            }
+
+            char *file = arena_alloc(&cmd_list->arena, 0);
+            int fileLen = lex_word(&p, end, file, NULL);
+            arena_alloc(&cmd_list->arena, fileLen + 1);
+
+            if (op == REDIR_IN_CHAR)
+            {
+                cmd->input_file = file;
+            }
+            else
+            {
+                cmd->output_file = file;
+                cmd->append_mode = append;
+            }
+            continue;
+        }
+
+        // a word, it is written at the top of the arena and claimed once
+        // its length is known
+        const char *word = p;
+        bool magic = false;
+        char *token = arena_alloc(&cmd_list->arena, 0);
+        int tokenLen = lex_word(&p, end, token, &magic);
+        arena_alloc(&cmd_list->arena, tokenLen + 1);
+
+        if (magic)
+        {
+            int rc = add_glob_word(cmd_list, cmd, word, p, token, tokenLen, &totalArgLen);
+            if (rc < 0)
+            {
+                return rc;
+            }
+            anyWord = true;
+            continue;
+        }
+
+        int rc = validate_token_length(cmd, tokenLen, &totalArgLen);
+        if (rc < 0)
+        {
+            printf(CMD_ERR_CMD_OR_ARGS_TOO_BIG);
+            return rc;
+        }
+        if (add_token(cmd, token, tokenLen) < 0)
+        {
+            printf(CMD_ERR_MEMORY);
+            return ERR_MEMORY;
+        }
+        anyWord = true;
+    }
+
+    // finish the last command, a line ending in a pipe has an empty one
+    if (cmd != NULL)
+    {
+        if (!end_cmd(cmd_list, cmd))
+        {
+            emptySegment = true;
+        }
+    }
+    else if (cmd_list->num > 0)
+    {
+        emptySegment = true;
+    }
+
+    if (!anyWord)
+    {
+        printf(CMD_WARN_NO_CMD);
+        return WARN_NO_CMDS;
+    }
+
+    if (emptySegment)
     {
-        printf("\n");
-        return EOF;
+        printf(CMD_ERR_PIPE_FORMAT);
+        return ERR_CMD_ARGS_BAD;
     }
-    cmd_buff[strcspn(cmd_buff, "\n")] = '\0';
+
     return OK;
 }
 
 // builds the cmd_list and its buffers handles errors
+// the list should be cleared first, see parse_cmd_list()
 int build_cmd_list(char *cmd_line, command_list_t *cmd_list)
 {
-    // run strtok on cmd_list, seperate by pipes
-    char *tok = strtok(cmd_line, PIPE_STRING);
-
-    // iterate through each command token
-    int rc = 0;
-    while (tok != NULL)
+    TRACE_BEGIN("parse", NULL);
+    if (!parse_cache_enabled())
     {
-        // error check for too many commands piped
-        if (cmd_list->num >= CMD_MAX)
-        {
-            printf(CMD_ERR_PIPE_LIMIT, CMD_MAX);
-            return ERR_TOO_MANY_COMMANDS;
-        }
-
-        // process it as a command buffer and store it into the cmd_list, incrementing the count
-        int rc = build_cmd_buff(tok, &cmd_list->commands[cmd_list->num]);
-        if (rc == WARN_NO_CMDS)
-        {
-            printf(CMD_ERR_PIPE_FORMAT);
-            return ERR_CMD_ARGS_BAD;
-        }
-        else if (rc == ERR_CMD_OR_ARGS_TOO_BIG)
-        {
-            printf(CMD_ERR_CMD_OR_ARGS_TOO_BIG);
-            return rc;
-        }
-
-        cmd_list->num++;
-        tok = strtok(NULL, PIPE_STRING);
+        int rc = parse_cmd_list(cmd_line, cmd_list);
+        TRACE_END("parse");
+        return rc;
     }
 
-    if (cmd_list->num == 0)
+    // a line parsed before is copied from the cache, see parsecache.h
+    size_t len = strlen(cmd_line);
+    uint64_t hash = parse_cache_hash(cmd_line, len);
+    int rc = parse_cache_lookup(cmd_line, len, hash, cmd_list);
+    if (rc != OK)
     {
-        printf(CMD_WARN_NO_CMD);
-        return WARN_NO_CMDS;
+        rc = parse_cmd_list(cmd_line, cmd_list);
+        if (rc == OK && cmd_list->expanded)
+            parse_cache_skip();
+        else if (rc == OK)
+            parse_cache_store(cmd_line, len, hash, cmd_list);
     }
-
+    TRACE_END("parse");
     return rc;
 }
 
-// prints the associated error message for each error type
-void output_exec_error(int err)
+// the message for a command that couldn't be run because of err
+const char *exec_error_msg(int err)
 {
     switch (err)
     {
     case EPERM:
-        printf(CMD_ERR_EPERM);
-        break;
+        return CMD_ERR_EPERM;
     case ENOENT:
-        printf(CMD_ERR_ENOENT);
-        break;
+        return CMD_ERR_ENOENT;
     case EACCES:
-        printf(CMD_ERR_EACCES);
-        break;
+        return CMD_ERR_EACCES;
     case E2BIG:
-        printf(CMD_ERR_E2BIG);
-        break;
+        return CMD_ERR_E2BIG;
     case ENOEXEC:
-        printf(CMD_ERR_ENOEXEC);
-        break;
+        return CMD_ERR_ENOEXEC;
     case EISDIR:
-        printf(CMD_ERR_EISDIR);
-        break;
+        return CMD_ERR_EISDIR;
     default:
-        printf(CMD_ERR_EXECUTE);
-        break;
+        return CMD_ERR_EXECUTE;
     }
 }
 
+// prints the associated error message for each error type
+void output_exec_error(int err)
+{
+    printf("%s", exec_error_msg(err));
+}
+
 // helper to handle input redirection ("<")
-int perform_input_redirection(char **argv_ptr)
+int perform_input_redirection(const char *file)
 {
-    // check if the filename is missing
-    if (argv_ptr[1] == NULL)
-    {
-        printf(CMD_ERR_REDIRECTION_FORMAT);
-        exit(ERR_CMD_ARGS_BAD);
-    }
-    int fd = open(argv_ptr[1], O_RDONLY);
+    int fd = open(file, O_RDONLY);
     if (fd < 0)
     {
         int err = errno;
@@ -515,22 +866,14 @@ int perform_input_redirection(char **argv_ptr)
     }
     dup2(fd, STDIN_FILENO);
     close(fd);
-    // set to null to prevent rest of arguments from being read
-    argv_ptr[0] = NULL;
     return OK;
 }
 
 // Helper to handle output redirection (">" or ">>")
 // 'flags' should be set appropriately for truncation or appending.
-int perform_output_redirection(char **argv_ptr, int flags)
+int perform_output_redirection(const char *file, int flags)
 {
-    // check if the filename is missing
-    if (argv_ptr[1] == NULL)
-    {
-        printf(CMD_ERR_REDIRECTION_FORMAT);
-        exit(ERR_CMD_ARGS_BAD);
-    }
-    int fd = open(argv_ptr[1], flags, 0644);
+    int fd = open(file, flags, 0644);
     if (fd < 0)
     {
         int err = errno;
@@ -539,130 +882,256 @@ int perform_output_redirection(char **argv_ptr, int flags)
     }
     dup2(fd, STDOUT_FILENO);
     close(fd);
-    // set to null to prevent rest of arguments from being read
-    argv_ptr[0] = NULL;
     return OK;
 }
 
 // handles the redirection of input and output for the command, also append
+// the files were recorded when the line was lexed.  This is called after the
+// pipes are connected so a redirection wins over the pipe, like in sh
 int handle_redirection(int i, command_list_t *clist)
 {
     cmd_buff_t *cmd = &clist->commands[i];
 
-    // If this is the first command, check for input redirection.
-    if (i == 0)
+    if (cmd->input_file != NULL)
     {
-        for (int j = 0; j < cmd->argc; j++)
-        {
-            if (strcmp(cmd->argv[j], "<") == 0)
-            {
-                clist->commands[i].input_file = cmd->argv[j + 1];
-                return perform_input_redirection(&cmd->argv[j]);
-            }
-        }
+        perform_input_redirection(cmd->input_file);
+    }
+
+    if (cmd->output_file != NULL)
+    {
+        int flags = O_WRONLY | O_CREAT | (cmd->append_mode ? O_APPEND : O_TRUNC);
+        perform_output_redirection(cmd->output_file, flags);
+    }
+
+    return OK;
+}
+
+// launches the command with posix_spawn(), only called if the built in
+// command failed.  The pipe dup2()s and the <, > and >> redirections are
+// spawn file actions, so the shell's memory is never copied the way fork()
+// copies it.  The pipes are close on exec, so the child only keeps the ends
+// it was given.  If the command could not be started the error is printed
+// here and returned, the same status a forked child used to exit with
+int exec_cmd(command_list_t *clist, int pipes[][2], pid_t *pids, int i)
+{
+    cmd_buff_t *cmd = &clist->commands[i];
+    posix_spawn_file_actions_t actions;
+
+    pids[i] = -1;
+    if (posix_spawn_file_actions_init(&actions) != 0)
+    {
+        printf(CMD_ERR_FORK);
+        return ERR_MEMORY;
+    }
+
+    int rc = 0;
+    // if not the first command, set the input to the previous pipe
+    if (i > 0)
+    {
+        rc = posix_spawn_file_actions_adddup2(&actions, pipes[i - 1][0], STDIN_FILENO);
+    }
+
+    // if not the last command, set the output to the next pipe
+    if (rc == 0 && i < clist->num - 1)
+    {
+        rc = posix_spawn_file_actions_adddup2(&actions, pipes[i][1], STDOUT_FILENO);
+    }
+    else if (rc == 0 && clist->out_fd >= 0)
+    {
+        rc = posix_spawn_file_actions_adddup2(&actions, clist->out_fd, STDOUT_FILENO);
+    }
+
+    // a background job must not read the shell's input
+    if (rc == 0 && i == 0 && clist->background && cmd->input_file == NULL)
+    {
+        rc = posix_spawn_file_actions_addopen(&actions, STDIN_FILENO, "/dev/null", O_RDONLY, 0);
+    }
+
+    // redirections replace the pipes they are on, actions run in order
+    if (rc == 0 && cmd->input_file != NULL)
+    {
+        rc = posix_spawn_file_actions_addopen(&actions, STDIN_FILENO, cmd->input_file, O_RDONLY, 0);
+    }
+    if (rc == 0 && cmd->output_file != NULL)
+    {
+        int flags = O_WRONLY | O_CREAT | (cmd->append_mode ? O_APPEND : O_TRUNC);
+        rc = posix_spawn_file_actions_addopen(&actions, STDOUT_FILENO, cmd->output_file, flags, 0644);
+    }
+
+    if (rc != 0)
+    {
+        posix_spawn_file_actions_destroy(&actions);
+        printf(CMD_ERR_FORK);
+        return ERR_MEMORY;
     }
 
-    // If this is the last command, check for output redirection.
-    if (i == clist->num - 1)
+    // the command is found through the PATH hash and started with
+    // posix_spawn(), a failed exec or redirection comes back as the return value
+    const char *path;
+    rc = path_hash_lookup(cmd->argv[0], &path);
+    if (rc == 0)
     {
-        for (int j = 0; j < cmd->argc; j++)
+        TRACE_BEGIN("spawn", cmd->argv[0]);
+        rc = posix_spawn(&pids[i], path, &actions, NULL, cmd->argv, environ);
+
+        // the hashed file went away, find the command in PATH again
+        if (rc == ENOENT && path != cmd->argv[0] && access(path, X_OK) != 0)
         {
-            if (strcmp(cmd->argv[j], ">") == 0)
+            path_hash_forget(cmd->argv[0]);
+            rc = path_hash_lookup(cmd->argv[0], &path);
+            if (rc == 0)
             {
-                clist->commands[i].output_file = cmd->argv[j + 1];
-                return perform_output_redirection(&cmd->argv[j], O_WRONLY | O_CREAT | O_TRUNC);
-            }
-            else if (strcmp(cmd->argv[j], ">>") == 0)
-            {
-                clist->commands[i].output_file = cmd->argv[j + 1];
-                return perform_output_redirection(&cmd->argv[j], O_WRONLY | O_CREAT | O_APPEND);
+                rc = posix_spawn(&pids[i], path, &actions, NULL, cmd->argv, environ);
             }
         }
+        TRACE_END("spawn");
+    }
+    posix_spawn_file_actions_destroy(&actions);
+    if (rc != 0)
+    {
+        pids[i] = -1;
+        output_exec_error(rc);
+        return rc;
     }
 
     return OK;
 }
 
-// forks and execs the command, only called if the built in command failed
-int exec_cmd(command_list_t *clist, int pipes[][2], pid_t *pids, int i)
+// runs a built in that is part of a pipeline, or in the background, in a
+// forked child, so it reads and writes the stage's pipes like any other
+// command and never blocks the shell on a full pipe.  Like sh, a cd or exit
+// in a pipeline only affects that child.  The child exits with the built
+// in's status
+int exec_built_in_stage(command_list_t *clist, int pipes[][2], pid_t *pids, int i, Built_In_Cmds code)
 {
+    cmd_buff_t *cmd = &clist->commands[i];
+
+    TRACE_BEGIN("fork", cmd->argv[0]);
     pids[i] = fork();
+    if (pids[i] != 0)
+    {
+        TRACE_END("fork");
+    }
     if (pids[i] < 0)
     {
+        pids[i] = -1;
         printf(CMD_ERR_FORK);
         return ERR_MEMORY;
     }
-
-    // this is a child process
-    if (pids[i] == 0)
+    if (pids[i] > 0)
     {
-        handle_redirection(i, clist);
-
-        // if not the first command, set the input to the previous pipe
-        if (i > 0)
-        {
-            dup2(pipes[i - 1][0], STDIN_FILENO);
-        }
+        return OK;
+    }
 
-        // if not the last command, set the output to the next pipe
-        if (i < clist->num - 1)
-        {
-            dup2(pipes[i][1], STDOUT_FILENO);
-        }
+    // the prompt waiting in stdout belongs to the shell, not this stage, and
+    // so do the lines it read ahead into stdin.  A stage reading stdin, like
+    // parallel, would run them otherwise
+    __fpurge(stdout);
+    __fpurge(stdin);
 
-        // Close all pipe ends in child
-        for (int j = 0; j < clist->num - 1; j++)
+    if (i > 0)
+    {
+        dup2(pipes[i - 1][0], STDIN_FILENO);
+    }
+    else if (clist->background)
+    {
+        // a background job must not read the shell's input
+        int devNull = open("/dev/null", O_RDONLY);
+        if (devNull >= 0)
         {
-            close(pipes[j][0]);
-            close(pipes[j][1]);
+            dup2(devNull, STDIN_FILENO);
+            close(devNull);
         }
+    }
+    if (i < clist->num - 1)
+    {
+        dup2(pipes[i][1], STDOUT_FILENO);
+    }
+    else if (clist->out_fd >= 0)
+    {
+        dup2(clist->out_fd, STDOUT_FILENO);
+    }
+    for (int j = 0; j < clist->num - 1; j++)
+    {
+        close(pipes[j][0]);
+        close(pipes[j][1]);
+    }
 
-        // execute the command
-        int childRc = execvp(clist->commands[i].argv[0], clist->commands[i].argv);
-        // Check for common file related error codes
-        if (childRc < 0)
-        {
-            int err = errno;
-            output_exec_error(err);
-            exit(err); // exit with the error code
-        }
+    // the utility built ins open their own redirections
+    if (is_util_built_in(code))
+    {
+        _exit(exec_util_built_in(cmd, code));
     }
 
-    return OK;
+    handle_redirection(i, clist);
+    exec_built_in_cmd(cmd);
+    fflush(stdout);
+    _exit(last_rc);
 }
 
-// executes the pipeline of commands, built in commands are not forked and piped
-int execute_pipeline(command_list_t *clist)
+// starts every command of the pipeline, connected by pipes, without waiting
+// for them.  pids[i] is set to the process of stage i, or -1 if the stage
+// ran in the shell or could not be started.  *spawnRc is why the last stage
+// could not be started, or 0.  Used by execute_pipeline() and by parallel
+// returns OK, ERR_TOO_MANY_COMMANDS if there are not enough descriptors for
+// the pipes, or ERR_MEMORY if a process could not be created
+int launch_pipeline(command_list_t *clist, pid_t *pids, int *spawnRc)
 {
-    // extra check for just the exit command
-    if (clist->num == 1 && match_command(clist->commands[0].argv[0]) == BI_CMD_EXIT)
+    *spawnRc = 0;
+    for (int i = 0; i < clist->num; i++)
     {
-        return OK_EXIT;
+        pids[i] = -1;
     }
 
-    // create an array of pipes and an array of process ids
-    int pipes[clist->num - 1][2];
-    pid_t pids[clist->num];
+    // on the heap, a line can hold far more stages than fit on the stack
+    int (*pipes)[2] = malloc(sizeof(int[2]) * (clist->num > 1 ? clist->num - 1 : 1));
+    if (pipes == NULL)
+    {
+        return ERR_MEMORY;
+    }
 
-    // create the pipes
+    // create the pipes, a pipeline can be longer than there are descriptors
+    // left, so that is reported as the limit instead of ending the shell
     for (int i = 0; i < clist->num - 1; i++)
     {
-        if (pipe(pipes[i]) < 0)
+        if (pipe2(pipes[i], O_CLOEXEC) < 0)
         {
-            return ERR_MEMORY;
+            printf(CMD_ERR_PIPE_LIMIT, i + 1);
+            for (int j = 0; j < i; j++)
+            {
+                close(pipes[j][0]);
+                close(pipes[j][1]);
+            }
+            free(pipes);
+            return ERR_TOO_MANY_COMMANDS;
         }
     }
 
-    // create processes for each command
-    for (int i = 0; i < clist->num; i++)
+    // create processes for each command, a command that could not be
+    // started still lets the rest of the pipeline run
+    int rc = OK;
+    for (int i = 0; i < clist->num && rc >= 0; i++)
     {
-        Built_In_Cmds cmd_rc = exec_built_in_cmd(&clist->commands[i]);
-        if (cmd_rc == BI_NOT_BI)
+        Built_In_Cmds cmd_rc = match_command(clist->commands[i].argv[0]);
+        if ((cmd_rc == BI_CMD_CAT || cmd_rc == BI_CMD_TEE) &&
+            !splice_handles(clist->commands[i].argc, clist->commands[i].argv))
         {
-            int rc = exec_cmd(clist, pipes, pids, i);
-            if (rc < 0)
+            cmd_rc = BI_NOT_BI;
+        }
+        if (cmd_rc != BI_NOT_BI && clist->num == 1 && !clist->background)
+        {
+            exec_built_in_cmd(&clist->commands[i]);
+        }
+        else if (cmd_rc != BI_NOT_BI)
+        {
+            rc = exec_built_in_stage(clist, pipes, pids, i, cmd_rc);
+        }
+        else
+        {
+            rc = exec_cmd(clist, pipes, pids, i);
+            if (rc > 0 && i == clist->num - 1)
             {
-                return rc;
+                *spawnRc = rc;
             }
         }
     }
@@ -673,19 +1142,119 @@ int execute_pipeline(command_list_t *clist)
         close(pipes[i][0]);
         close(pipes[i][1]);
     }
+    free(pipes);
+
+    return rc < 0 ? rc : OK;
+}
+
+// executes the pipeline of commands, a built in on its own runs in the shell
+// and every other command, built in or not, is its own process
+int execute_pipeline(command_list_t *clist)
+{
+    // time in front of the pipeline reports each stage once it is done
+    cmd_buff_t *first = &clist->commands[0];
+    bool timed = strcmp(first->argv[0], TIME_CMD) == 0;
+    if (timed && first->argc == 1)
+    {
+        last_rc = 0;
+        return OK;
+    }
+    if (timed)
+    {
+        memmove(first->argv, first->argv + 1, first->argc * sizeof(char *));
+        first->argc--;
+    }
+
+    // extra check for just the exit command
+    if (clist->num == 1 && !clist->background && match_command(clist->commands[0].argv[0]) == BI_CMD_EXIT)
+    {
+        return OK_EXIT;
+    }
+
+    // stats doesn't record itself, it shows the pipeline before it
+    bool account = (timed || stats_enabled()) && !clist->background &&
+                   !(clist->num == 1 && match_command(first->argv[0]) == BI_CMD_STATS);
+    if (account)
+    {
+        stats_begin(clist);
+    }
+
+    pid_t *pids = malloc(clist->num * sizeof(pid_t));
+    if (pids == NULL)
+    {
+        return ERR_MEMORY;
+    }
+    int spawnRc;
+    // trace on or off in this pipeline flips tracing while it launches, so
+    // launch is one complete event and only if tracing was on before
+    uint64_t start = trace_enabled() ? trace_now() : 0;
+    int rc = launch_pipeline(clist, pids, &spawnRc);
+    if (start != 0)
+    {
+        TRACE_COMPLETE("launch", first->argv[0], 0, start);
+    }
+    if (rc == ERR_TOO_MANY_COMMANDS)
+    {
+        free(pids);
+        return rc;
+    }
+
+    // a background job is reaped later, see jobs.c.  If it can't be added
+    // to the job table it is waited for like any other pipeline
+    if (rc == OK && clist->background)
+    {
+        if (jobs_add(clist, pids, spawnRc) > 0)
+        {
+            free(pids);
+            last_rc = 0;
+            return OK;
+        }
+        printf(CMD_ERR_MEMORY);
+    }
+
+    TRACE_BEGIN("wait", NULL);
+    if (account)
+    {
+        last_rc = stats_wait(clist->num, pids, spawnRc, last_rc);
+        TRACE_END("wait");
+        if (timed)
+        {
+            fflush(stdout);
+            stats_print(stderr);
+        }
+        free(pids);
+        return rc;
+    }
 
-    // Wait for all children
+    // Wait for all children, including the ones started before a failure
     int status;
     for (int i = 0; i < clist->num; i++)
     {
+        if (pids[i] == -1)
+        {
+            continue;
+        }
         waitpid(pids[i], &status, 0);
         if (WIFEXITED(status))
         {
             last_rc = WEXITSTATUS(status);
         }
+        // each stage gets its own row in the trace, from launch to exit
+        if (start != 0)
+        {
+            TRACE_COMPLETE("stage", clist->commands[i].argv[0], pids[i], start);
+        }
     }
+    TRACE_END("wait");
 
-    return OK;
+    // the last command never ran, its status is why
+    if (spawnRc > 0)
+    {
+        last_rc = spawnRc;
+    }
+
+    free(pids);
+    return rc;
 }
 
 /*
@@ -736,6 +1305,7 @@ int exec_local_cmd_loop()
 
     // declare the command buffer and command list
     char *cmd_buff = NULL;
+    size_t cmd_cap = SH_CMD_MAX;
     command_list_t *cmd_list = NULL;
 
     int rc = alloc_cmd_list(&cmd_list);
@@ -750,11 +1320,15 @@ int exec_local_cmd_loop()
         return ERR_MEMORY;
     }
 
+    trace_init();
+    jobs_set_notify(true);
     while (1)
     {
+        // report the background jobs that finished since the last prompt
+        jobs_notify();
         printf("%s", SH_PROMPT);
         // read input
-        if (get_input(cmd_buff) == EOF)
+        if (get_input(&cmd_buff, &cmd_cap) == EOF)
         {
             break;
         }
@@ -784,5 +1358,158 @@ int exec_local_cmd_loop()
 
     free_cmd_list(cmd_list);
     free(cmd_buff);
+    path_hash_clear();
+    jobs_free();
+    stats_free();
+    cmd_trie_free();
+    parse_cache_free();
+    trace_finish();
     return rc;
-}
\ No newline at end of file
+}
+
+// next line of a script, read from fd in SCRIPT_BUFF_SZ chunks into a buffer
+// that grows for longer lines.  The newline is replaced by a null so the line
+// can be parsed in place.  Plain read() is used instead of stdio because the
+// script's file offset is shared with every child, and a child that exit()s
+// would seek a stdio stream back to its logical position.
+// returns the line, or NULL at the end of the script
+static char *read_script_line(script_reader_t *sr)
+{
+    while (1)
+    {
+        char *nl = memchr(sr->buff + sr->start, '\n', sr->end - sr->start);
+        if (nl != NULL || (sr->eof && sr->start < sr->end))
+        {
+            char *line = sr->buff + sr->start;
+            if (nl == NULL)
+            {
+                // last line without a newline, there is always room for the null
+                sr->buff[sr->end] = '\0';
+                sr->start = sr->end;
+                return line;
+            }
+            *nl = '\0';
+            sr->start = nl - sr->buff + 1;
+            return line;
+        }
+        if (sr->eof)
+        {
+            return NULL;
+        }
+
+        // move the partial line to the front, grow if it fills the buffer
+        memmove(sr->buff, sr->buff + sr->start, sr->end - sr->start);
+        sr->end -= sr->start;
+        sr->start = 0;
+        if (sr->cap - sr->end < SCRIPT_BUFF_SZ / 2)
+        {
+            char *grown = realloc(sr->buff, sr->cap * 2);
+            if (grown == NULL)
+            {
+                return NULL;
+            }
+            sr->buff = grown;
+            sr->cap *= 2;
+        }
+
+        // leave a byte for the null of a last line without a newline
+        ssize_t n = read(sr->fd, sr->buff + sr->end, sr->cap - sr->end - 1);
+        if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n <= 0)
+        {
+            sr->eof = true;
+        }
+        else
+        {
+            sr->end += n;
+        }
+    }
+}
+
+// runs every line of a script without prompts, for using dsh as a batch job
+// runner.  path "-" reads the script from stdin.  Lines can be any length,
+// blank lines and # comments (including a #! line at the top) are skipped,
+// and `exit` ends the script.
+// returns the exit status of the last command, SCRIPT_PARSE_SC if the last
+// line could not be parsed, or SCRIPT_OPEN_SC if the script can't be opened
+int exec_script(const char *path)
+{
+    script_reader_t sr = {0};
+    sr.fd = (strcmp(path, "-") == 0) ? STDIN_FILENO : open(path, O_RDONLY | O_CLOEXEC);
+    if (sr.fd < 0)
+    {
+        printf(CMD_ERR_SCRIPT_OPEN, path);
+        return SCRIPT_OPEN_SC;
+    }
+
+    command_list_t *cmd_list = NULL;
+    sr.cap = SCRIPT_BUFF_SZ;
+    sr.buff = malloc(sr.cap);
+    if (sr.buff == NULL || alloc_cmd_list(&cmd_list) != OK)
+    {
+        printf(CMD_ERR_MEMORY);
+        free(sr.buff);
+        if (sr.fd != STDIN_FILENO)
+        {
+            close(sr.fd);
+        }
+        return EXIT_FAILURE;
+    }
+
+    trace_init();
+    char *line;
+    while ((line = read_script_line(&sr)) != NULL)
+    {
+        char *first = line + strspn(line, " \t");
+        if (*first == '\0' || *first == '#')
+        {
+            continue;
+        }
+
+        clear_cmd_list(cmd_list);
+        if (build_cmd_list(line, cmd_list) != OK)
+        {
+            last_rc = SCRIPT_PARSE_SC;
+            continue;
+        }
+
+        // children inherit anything still buffered, flush it so it is only
+        // written once and stays in order with what the commands print
+        fflush(stdout);
+
+        // collect finished background jobs so they don't pile up as zombies
+        jobs_notify();
+
+        int rc = execute_pipeline(cmd_list);
+        if (rc == OK_EXIT)
+        {
+            break;
+        }
+        else if (rc == ERR_MEMORY)
+        {
+            printf(CMD_ERR_MEMORY);
+            last_rc = EXIT_FAILURE;
+            break;
+        }
+        else if (rc < 0)
+        {
+            last_rc = EXIT_FAILURE;
+        }
+    }
+
+    free(sr.buff);
+    free_cmd_list(cmd_list);
+    path_hash_clear();
+    jobs_free();
+    stats_free();
+    parse_cache_free();
+    trace_finish();
+    if (sr.fd != STDIN_FILENO)
+    {
+        close(sr.fd);
+    }
+    return last_rc;
+}
@@ -3,39 +3,64 @@
 
 // Constants for command structure sizes
 #define EXE_MAX 64
-#define ARG_MAX 256
+// Pipelines and argument lists grow on demand, these many commands and argv
+// entries are kept inline so short command lines never touch the heap
 #define CMD_MAX 8
 #define CMD_ARGV_MAX (CMD_MAX + 1)
-// Longest command that can be read from the shell
-#define SH_CMD_MAX EXE_MAX + ARG_MAX
-
-typedef struct command
-{
-    char exe[EXE_MAX];
-    char args[ARG_MAX];
-} command_t;
+// Starting size of the line buffers, they grow to fit longer lines
+#define SH_CMD_MAX 320
+// A line, and the arguments of each of its commands, may be as long as the
+// kernel's ARG_MAX (see sh_arg_max()).  This is used if it can't be queried
+#define SH_ARG_MAX_DEF (128 * 1024)
 
 #include <stdbool.h>
+#include <stddef.h>
 
 typedef struct cmd_buff
 {
     int argc;
-    char *argv[CMD_ARGV_MAX];
-    char *_cmd_buffer;
+    char **argv;                      // argv_inline until it needs more room
+    int argv_cap;                     // entries that fit in argv
+    char *argv_inline[CMD_ARGV_MAX];
     char *input_file;  // extra credit, stores input redirection file (for `<`)
     char *output_file; // extra credit, stores output redirection file (for `>`)
     bool append_mode;  // extra credit, sets append mode fomr output_file
 } cmd_buff_t;
 
+// Each command line is parsed into one bump arena owned by the command list.
+// Every word of the line is carved out of it, so argv[] entries point into
+// the arena and clearing the list only resets it.  A word plus its null never
+// takes more room than its text and the character after it, so a line of n
+// characters needs at most n + 1 bytes.
+#define PARSE_ARENA_SZ SH_CMD_MAX
+
+typedef struct parse_arena
+{
+    char *base;  // start of the arena
+    size_t used; // bytes handed out since the last reset
+    size_t cap;  // size of the arena
+} parse_arena_t;
+
 typedef struct command_list
 {
     int num;
-    cmd_buff_t commands[CMD_MAX];
+    int cap;              // commands that fit in commands
+    cmd_buff_t *commands; // commands_inline until a pipeline needs more room
+    cmd_buff_t commands_inline[CMD_MAX];
+    parse_arena_t arena; // owns the line and every token of the commands
+    bool background;     // the line ended in &, see jobs.h
+    int out_fd;          // where the last command writes, -1 for stdout
+    struct path_glob_chunk *glob_mem; // paths words expanded to, see pathglob.h
+    bool expanded;                    // a word was a glob, see parsecache.h
 } command_list_t;
 
 // Special character #defines
 #define SPACE_CHAR ' '
+#define TAB_CHAR '\t'
+#define REDIR_IN_CHAR '<'
+#define REDIR_OUT_CHAR '>'
 #define PIPE_CHAR '|'
+#define BG_CHAR '&'
 #define PIPE_STRING "|"
 
 #define SH_PROMPT "dsh4> "
@@ -43,9 +68,27 @@ typedef struct command_list
 #define DRAGON_CMD "dragon"
 #define CD_CMD "cd"
 #define RC_CMD "rc"
+#define STOP_SVR_CMD "stop-server"
 #define RC_SC 99
 #define EXIT_SC 100
 
+// Script mode (dsh -f), exit statuses for a script that can't be opened or
+// whose last line could not be parsed, like sh uses
+#define SCRIPT_OPEN_SC 127
+#define SCRIPT_PARSE_SC 2
+// scripts are read in chunks this big
+#define SCRIPT_BUFF_SZ (1024 * 1024)
+
+typedef struct script_reader
+{
+    int fd;
+    char *buff;   // chunks read from fd, grows to fit long lines
+    size_t cap;   // size of buff
+    size_t start; // first byte not handed out as a line yet
+    size_t end;   // end of the bytes read into buff
+    bool eof;     // nothing more to read from fd
+} script_reader_t;
+
 // Standard Return Codes
 #define OK 0
 #define WARN_NO_CMDS -1
@@ -57,23 +100,27 @@ typedef struct command_list
 #define OK_EXIT -7
 
 // prototypes
+int arena_init(parse_arena_t *arena, size_t cap);
+void arena_free(parse_arena_t *arena);
+void arena_reset(parse_arena_t *arena);
+int arena_reserve(parse_arena_t *arena, size_t need);
+char *arena_alloc(parse_arena_t *arena, size_t size);
 int alloc_cmd_buff(cmd_buff_t *cmd_buff);
 int free_cmd_buff(cmd_buff_t *cmd_buff);
 int clear_cmd_buff(cmd_buff_t *cmd_buff);
-int build_cmd_buff(char *cmd_line, cmd_buff_t *cmd_buff);
 int close_cmd_buff(cmd_buff_t *cmd_buff);
 int alloc_cmd_list(command_list_t **pCmdList);
+int grow_cmd_list(command_list_t *clist);
 int build_cmd_list(char *cmd_line, command_list_t *clist);
 int free_cmd_list(command_list_t *cmd_lst);
 int clear_cmd_list(command_list_t *cmd_buff);
-int str_trim_cpy(char *newStr, char *oldStr);
-char *get_next_token(char **p, int *tokenLen);
+long sh_arg_max(void);
 int validate_token_length(cmd_buff_t *cmd, int tokenLen, int *totalArgLen);
 int add_token(cmd_buff_t *cmd, char *tokenStart, int tokenLen);
-int parse_cmd_line(cmd_buff_t *cmd, char *trimmed);
+const char *exec_error_msg(int err);
 void output_exec_error(int err);
-int perform_input_redirection(char **argv_ptr);
-int perform_output_redirection(char **argv_ptr, int flags);
+int perform_input_redirection(const char *file);
+int perform_output_redirection(const char *file, int flags);
 int handle_redirection(int i, command_list_t *clist);
 
 // built in command stuff
@@ -84,19 +131,41 @@ typedef enum
     BI_CMD_CD,
     BI_CMD_RC,       // extra credit command
     BI_CMD_STOP_SVR, // new command "stop-server"
+    BI_CMD_HASH,     // the PATH lookup cache, see pathhash.h
+    BI_CMD_JOBS,     // background jobs, see jobs.h
+    BI_CMD_WAIT,
+    BI_CMD_FG,
+    BI_CMD_PARALLEL, // see parallel.h
+    BI_CMD_STATS,    // see stats.h
+    BI_CMD_TRACE,    // see trace.h
+    BI_CMD_COMPGEN,  // see lineedit.h
+    BI_CMD_PARSE_CACHE, // see parsecache.h
+    BI_CMD_POOL,        // see workpool.h
+    BI_CMD_ECHO,     // utilities run in process, see builtins.h
+    BI_CMD_PWD,
+    BI_CMD_TRUE,
+    BI_CMD_FALSE,
+    BI_CMD_TEST,
+    BI_CMD_PRINTF,
+    BI_CMD_CAT,      // see splice.h
+    BI_CMD_TEE,
     BI_NOT_BI,
     BI_EXECUTED,
 } Built_In_Cmds;
 Built_In_Cmds match_command(const char *input);
 Built_In_Cmds exec_built_in_cmd(cmd_buff_t *cmd);
-extern void print_dragon();
+bool is_util_built_in(Built_In_Cmds cmd);
+extern void print_dragon(FILE *out);
 
 // main execution context
 int exec_local_cmd_loop();
+int exec_script(const char *path);
 int exec_cmd(command_list_t *clist, int pipes[][2], pid_t *pids, int i);
+int exec_built_in_stage(command_list_t *clist, int pipes[][2], pid_t *pids, int i, Built_In_Cmds code);
+int launch_pipeline(command_list_t *clist, pid_t *pids, int *spawnRc);
 int execute_pipeline(command_list_t *clist);
 int process_cmd_list(char *cmd_buff, command_list_t *cmd_list);
-int get_input(char *cmd_buff);
+int get_input(char **cmd_buff, size_t *cmd_cap);
 int init_shell(command_list_t **pCmdList, char **pCmdBuff);
 
 // output constants
@@ -105,10 +174,12 @@ int init_shell(command_list_t **pCmdList, char **pCmdBuff);
 #define CMD_ERR_PIPE_LIMIT "error: piping limited to %d commands\n"
 #define CMD_ERR_PIPE_FORMAT "error: piping is improperly formatted\n"
 #define CMD_ERR_REDIRECTION_FORMAT "error: redirection is improperly formatted\n"
+#define CMD_ERR_BG_FORMAT "error: & can only end a command line\n"
 #define CMD_ERR_CMD_OR_ARGS_TOO_BIG "error: command or arguments were too big\n"
 #define CMD_ERR_FORK "error: could not fork the process\n"
 #define CMD_ERR_EXECUTE "error: could not execute the program\n"
 #define CMD_ERR_MEMORY "error: could not allocate memory\n"
+#define CMD_ERR_SCRIPT_OPEN "error: could not open script %s\n"
 #define BI_NOT_IMPLEMENTED "not implemented"
 
 // errno related output constants
@@ -0,0 +1,917 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/resource.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#include "dshlib.h"
+#include "rshlib.h"
+#include "evserver.h"
+#include "trace.h"
+#include "parsecache.h"
+#include "workpool.h"
+#include "frame.h"
+
+static ev_loop_t loops[EV_LOOPS_MAX];
+static int num_loops = 0;
+static atomic_int ev_stop = 0;
+static int null_fd = -1; // what a session's first command reads
+
+// makes room for need more bytes at the end of b
+static int buf_reserve(ev_buf_t *b, size_t need)
+{
+    if (b->off > 0 && b->cap - b->len < need)
+    {
+        memmove(b->data, b->data + b->off, b->len - b->off);
+        b->len -= b->off;
+        b->off = 0;
+    }
+    if (b->cap - b->len >= need)
+    {
+        return OK;
+    }
+
+    size_t newCap = b->cap > 0 ? b->cap * 2 : EV_BUF_KEEP;
+    while (newCap - b->len < need)
+    {
+        newCap *= 2;
+    }
+    char *grown = realloc(b->data, newCap);
+    if (grown == NULL)
+    {
+        return ERR_MEMORY;
+    }
+    b->data = grown;
+    b->cap = newCap;
+    return OK;
+}
+
+static void buf_free(ev_buf_t *b)
+{
+    free(b->data);
+    memset(b, 0, sizeof(*b));
+}
+
+static int buf_append(ev_buf_t *b, const char *data, size_t n)
+{
+    if (buf_reserve(b, n) != OK)
+    {
+        return ERR_MEMORY;
+    }
+    memcpy(b->data + b->len, data, n);
+    b->len += n;
+    return OK;
+}
+
+// drops the first n unused bytes, a buffer that empties gives back its memory
+// if it had grown
+static void buf_consume(ev_buf_t *b, size_t n)
+{
+    b->off += n;
+    if (b->off == b->len)
+    {
+        b->off = b->len = 0;
+        if (b->cap > EV_BUF_KEEP)
+        {
+            buf_free(b);
+        }
+    }
+}
+
+static void wake(ev_loop_t *loop)
+{
+    uint64_t one = 1;
+    (void)!write(loop->wakeFd, &one, sizeof(one));
+}
+
+// changes what epoll watches fd for, 0 takes it out of the set
+static void watch(ev_loop_t *loop, int fd, ev_src_t *src, unsigned *cur, unsigned want)
+{
+    if (*cur == want)
+    {
+        return;
+    }
+    struct epoll_event ev = {.events = want, .data.ptr = src};
+    int op = *cur == 0 ? EPOLL_CTL_ADD : (want == 0 ? EPOLL_CTL_DEL : EPOLL_CTL_MOD);
+    if (epoll_ctl(loop->epfd, op, fd, &ev) == 0)
+    {
+        *cur = want;
+    }
+}
+
+static command_list_t *take_list(ev_loop_t *loop)
+{
+    if (loop->numSpare > 0)
+    {
+        return loop->spare[--loop->numSpare];
+    }
+    command_list_t *clist;
+    return alloc_cmd_list(&clist) == OK ? clist : NULL;
+}
+
+// idle sessions hold no list, a few are kept for the next commands
+static void put_list(ev_loop_t *loop, command_list_t *clist)
+{
+    if (loop->numSpare < CMD_MAX)
+    {
+        loop->spare[loop->numSpare++] = clist;
+    }
+    else
+    {
+        free_cmd_list(clist);
+    }
+}
+
+// a pipe read to the end.  A child forking for another session may hold a
+// copy until it execs, so closing alone might leave it in epoll
+static void pipe_close(ev_session_t *s, ev_pipe_t *p)
+{
+    watch(s->loop, p->fd, &p->src, &p->events, 0);
+    close(p->fd);
+    p->fd = -1;
+    p->events = 0;
+}
+
+static void session_free(ev_session_t *s)
+{
+    // taken out of epoll first, see pipe_close()
+    watch(s->loop, s->sock, &s->sockSrc, &s->sockEvents, 0);
+    close(s->sock);
+    for (int i = 0; i < 2; i++)
+    {
+        if (s->pipes[i].fd >= 0)
+        {
+            pipe_close(s, &s->pipes[i]);
+        }
+        if (s->pipes[i].wr >= 0)
+        {
+            close(s->pipes[i].wr);
+        }
+    }
+    if (s->clist != NULL)
+    {
+        free_cmd_list(s->clist);
+    }
+    buf_free(&s->in);
+    buf_free(&s->out);
+    free(s);
+}
+
+// events later in the same epoll_wait() batch may still name the session,
+// so it is only freed once the batch is done
+static void session_close(ev_session_t *s)
+{
+    ev_loop_t *loop = s->loop;
+    if (s->prev != NULL)
+        s->prev->next = s->next;
+    else
+        loop->sessions = s->next;
+    if (s->next != NULL)
+        s->next->prev = s->prev;
+    loop->numSessions--;
+
+    s->closed = true;
+    s->link = loop->dead;
+    loop->dead = s;
+}
+
+// sends what output it can without blocking
+static void session_flush(ev_session_t *s)
+{
+    while (s->out.len > s->out.off)
+    {
+        ssize_t n = send(s->sock, s->out.data + s->out.off, s->out.len - s->out.off, MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (n > 0)
+        {
+            buf_consume(&s->out, n);
+        }
+        else if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        {
+            return;
+        }
+        else
+        {
+            // the client is gone, its output goes nowhere
+            s->peerGone = true;
+            buf_free(&s->out);
+        }
+    }
+}
+
+// queues msg and the end of output for the client, in its protocol
+static void session_reply(ev_session_t *s, const char *msg, int status)
+{
+    if (s->peerGone)
+    {
+        return;
+    }
+
+    size_t len = strlen(msg);
+    int rc;
+    if (s->framed == 1)
+    {
+        char hdr[FRAME_HDR_SZ];
+        char exitFrame[FRAME_HDR_SZ + sizeof(uint32_t)];
+        frame_pack(hdr, FRAME_STDOUT, len);
+        frame_pack_exit(exitFrame, status);
+        rc = len > 0 ? buf_append(&s->out, hdr, FRAME_HDR_SZ) : OK;
+        rc = rc == OK ? buf_append(&s->out, msg, len) : rc;
+        rc = rc == OK ? buf_append(&s->out, exitFrame, sizeof(exitFrame)) : rc;
+    }
+    else
+    {
+        rc = buf_append(&s->out, msg, len);
+        rc = rc == OK ? buf_append(&s->out, &RDSH_EOF_CHAR, 1) : rc;
+    }
+    if (rc != OK)
+    {
+        // without memory for the reply the client would wait forever
+        s->peerGone = true;
+        buf_free(&s->out);
+    }
+}
+
+// runs a session's pipeline on a worker, see workpool.h
+static void *run_pipeline(void *arg)
+{
+    ev_session_t *s = arg;
+    TRACE_BEGIN("pipeline", s->clist->commands[0].argv[0]);
+    ev_pipe_t *out = &s->pipes[0];
+    ev_pipe_t *err = &s->pipes[s->numPipes - 1];
+    s->cmdRc = rsh_run_pipeline(null_fd, out->wr, err->wr, s->clist);
+    TRACE_END("pipeline");
+    for (int i = 0; i < s->numPipes; i++)
+    {
+        close(s->pipes[i].wr);
+        s->pipes[i].wr = -1;
+    }
+
+    // the loop may free the session as soon as it is on the list
+    ev_loop_t *loop = s->loop;
+    pthread_mutex_lock(&loop->lock);
+    s->link = loop->done;
+    loop->done = s;
+    pthread_mutex_unlock(&loop->lock);
+    wake(loop);
+    return NULL;
+}
+
+static void pipes_close(ev_session_t *s)
+{
+    for (int i = 0; i < s->numPipes; i++)
+    {
+        close(s->pipes[i].fd);
+        close(s->pipes[i].wr);
+        s->pipes[i].fd = s->pipes[i].wr = -1;
+    }
+    s->numPipes = 0;
+}
+
+// parses a command on the loop and hands it to a worker
+static void session_run(ev_session_t *s, char *line)
+{
+    s->clist = take_list(s->loop);
+    if (s->clist == NULL)
+    {
+        session_reply(s, CMD_ERR_MEMORY, ERR_MEMORY);
+        return;
+    }
+
+    clear_cmd_list(s->clist);
+    int rc = build_cmd_list(line, s->clist);
+    if (rc != OK)
+    {
+        session_reply(s, rsh_parse_error(rc), rc);
+        put_list(s->loop, s->clist);
+        s->clist = NULL;
+        return;
+    }
+
+    // only the ends the loop reads are non-blocking, the pipeline writes
+    // the others as it would a terminal
+    s->numPipes = 0;
+    for (int i = 0; i < (s->framed == 1 ? 2 : 1); i++)
+    {
+        int fds[2];
+        if (pipe2(fds, O_CLOEXEC) < 0)
+        {
+            pipes_close(s);
+            session_reply(s, CMD_ERR_RDSH_EXEC, ERR_RDSH_CMD_EXEC);
+            put_list(s->loop, s->clist);
+            s->clist = NULL;
+            return;
+        }
+        fcntl(fds[0], F_SETFL, O_NONBLOCK);
+        s->pipes[i].fd = fds[0];
+        s->pipes[i].wr = fds[1];
+        s->pipes[i].events = 0;
+        s->numPipes++;
+    }
+    s->openPipes = s->numPipes;
+    s->running = true;
+    s->ranDone = false;
+    s->outDone = false;
+    if (work_pool_submit(run_pipeline, s) != OK)
+    {
+        pipes_close(s);
+        s->running = false;
+        put_list(s->loop, s->clist);
+        s->clist = NULL;
+        session_reply(s, POOL_MSG_BUSY, ERR_POOL_FULL);
+    }
+}
+
+static void ev_server_stop(void)
+{
+    atomic_store(&ev_stop, 1);
+    for (int i = 0; i < num_loops; i++)
+    {
+        wake(&loops[i]);
+    }
+}
+
+// the pipeline finished and its output was read, the client is told
+static void session_finish(ev_session_t *s)
+{
+    s->running = false;
+    put_list(s->loop, s->clist);
+    s->clist = NULL;
+
+    int rc = s->cmdRc;
+    if (rc == EXIT_SC)
+    {
+        s->closing = true;
+    }
+    else if (rc == STOP_SERVER_SC)
+    {
+        printf(RCMD_SERVER_EXITED);
+        s->closing = true;
+        ev_server_stop();
+    }
+    else if (rc == RC_SC)
+    {
+        char msg[16];
+        snprintf(msg, sizeof(msg), "%d\n", s->lastRc);
+        session_reply(s, msg, 0);
+    }
+    else
+    {
+        session_reply(s, "", rc);
+    }
+    s->lastRc = rc;
+}
+
+// copies what the pipeline wrote to pipe idx to the output, up to
+// EV_OUT_HIGH.  For a framed session each read is one frame, its header
+// written in front of the bytes once their count is known
+static void session_read_out(ev_session_t *s, int idx)
+{
+    ev_pipe_t *p = &s->pipes[idx];
+    if (p->fd < 0)
+    {
+        return;
+    }
+    size_t hdrLen = s->framed == 1 ? FRAME_HDR_SZ : 0;
+    while (p->fd >= 0 && s->out.len - s->out.off < EV_OUT_HIGH)
+    {
+        if (buf_reserve(&s->out, hdrLen + EV_READ_SZ) != OK)
+        {
+            return;
+        }
+        char *at = s->out.data + s->out.len;
+        ssize_t n = read(p->fd, at + hdrLen, EV_READ_SZ);
+        if (n > 0)
+        {
+            // the pipe is still drained for a client that left, so the
+            // pipeline doesn't block on it
+            if (!s->peerGone)
+            {
+                if (hdrLen > 0)
+                {
+                    frame_pack(at, idx == 0 ? FRAME_STDOUT : FRAME_STDERR, n);
+                }
+                s->out.len += hdrLen + n;
+            }
+            continue;
+        }
+        if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        {
+            break;
+        }
+
+        // every writer closed it
+        pipe_close(s, p);
+        s->outDone = --s->openPipes == 0;
+    }
+    if (s->peerGone && s->out.len == s->out.off)
+    {
+        buf_free(&s->out);
+    }
+    if (s->outDone && s->ranDone)
+    {
+        session_finish(s);
+    }
+}
+
+static void session_read(ev_session_t *s)
+{
+    for (int i = 0; i < 4; i++)
+    {
+        if (buf_reserve(&s->in, EV_READ_SZ) != OK)
+        {
+            s->peerGone = true;
+            return;
+        }
+        ssize_t n = recv(s->sock, s->in.data + s->in.len, EV_READ_SZ, MSG_DONTWAIT);
+        if (n > 0)
+        {
+            s->in.len += n;
+            continue;
+        }
+        if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        {
+            break;
+        }
+        s->peerGone = true;
+        break;
+    }
+    if (s->in.len == s->in.off)
+    {
+        buf_consume(&s->in, 0);
+    }
+}
+
+/*
+ *  session_next_command
+ *
+ *  The first command waiting in the session's input, null terminated where
+ *  it is.  The first byte the client sent tells whether it sends frames or
+ *  legacy text, see frame.h.  A client breaking the protocol is told why
+ *  and closed.
+ *
+ *  returns:  the command, to be handed back with session_release_command()
+ *            once parsed, or NULL
+ */
+static char *session_next_command(ev_session_t *s)
+{
+    char *start = s->in.data + s->in.off;
+    size_t avail = s->in.len - s->in.off;
+    if (s->framed < 0)
+    {
+        s->framed = (unsigned char)start[0] == FRAME_MAGIC;
+    }
+    if (s->framed == 0)
+    {
+        char *end = memchr(start, '\0', avail);
+        if (end != NULL)
+        {
+            s->cmdLen = end - start + 1;
+            s->cmdEnd = end;
+        }
+        return end != NULL ? start : NULL;
+    }
+
+    frame_t f;
+    int rc = frame_parse(start, avail, &f);
+    if (rc == 1 && f.type != FRAME_CMD)
+    {
+        rc = ERR_FRAME_BAD;
+    }
+    if (rc < 0)
+    {
+        char msg[128];
+        if (rc == ERR_FRAME_VERSION)
+            snprintf(msg, sizeof(msg), FRAME_ERR_VERSION, f.version, FRAME_VERSION);
+        else if (rc == ERR_FRAME_TOO_BIG)
+            snprintf(msg, sizeof(msg), FRAME_ERR_TOO_BIG, FRAME_MAX);
+        else
+            snprintf(msg, sizeof(msg), "%s", FRAME_ERR_BAD);
+        session_reply(s, msg, rc);
+        s->closing = true;
+        return NULL;
+    }
+    if (rc == 0)
+    {
+        return NULL;
+    }
+
+    // the byte after the frame may be the next one's, it is put back.  One
+    // past the input always exists, read ahead keeps room at the end
+    if (buf_reserve(&s->in, 1) != OK)
+    {
+        s->peerGone = true;
+        return NULL;
+    }
+    s->cmdLen = FRAME_HDR_SZ + f.len;
+    s->cmdEnd = s->in.data + s->in.off + FRAME_HDR_SZ + f.len;
+    s->held = *s->cmdEnd;
+    *s->cmdEnd = '\0';
+    return s->cmdEnd - f.len;
+}
+
+// gives back the input the command took, once the parser copied it
+static void session_release_command(ev_session_t *s)
+{
+    if (s->framed == 1)
+    {
+        *s->cmdEnd = s->held;
+    }
+    buf_consume(&s->in, s->cmdLen);
+}
+
+/*
+ *  session_step
+ *
+ *  Moves a session along after anything happened to it: sends what output
+ *  it can, takes the next command once the last one's output is all sent,
+ *  and closes it when it is done.  Then epoll is told what the session now
+ *  waits for.  Commands are taken one at a time, so a client that sends
+ *  many keeps at most one running.
+ */
+static void session_step(ev_session_t *s)
+{
+    if (s->peerGone)
+    {
+        buf_free(&s->out);
+    }
+    session_flush(s);
+    while (!s->running && !s->closing && s->out.len == s->out.off && s->in.len > s->in.off)
+    {
+        char *line = session_next_command(s);
+        if (line == NULL)
+        {
+            break;
+        }
+        session_run(s, line);
+        session_release_command(s);
+        session_flush(s);
+    }
+
+    if (!s->running && s->out.len == s->out.off && (s->closing || s->peerGone))
+    {
+        session_close(s);
+        return;
+    }
+
+    unsigned want = 0;
+    if (!s->running && !s->closing && !s->peerGone)
+    {
+        want |= EPOLLIN | EPOLLRDHUP;
+    }
+    if (s->out.len > s->out.off)
+    {
+        want |= EPOLLOUT;
+    }
+    watch(s->loop, s->sock, &s->sockSrc, &s->sockEvents, want);
+
+    want = s->out.len - s->out.off < EV_OUT_HIGH ? EPOLLIN : 0;
+    for (int i = 0; i < s->numPipes; i++)
+    {
+        if (s->pipes[i].fd >= 0)
+        {
+            watch(s->loop, s->pipes[i].fd, &s->pipes[i].src, &s->pipes[i].events, want);
+        }
+    }
+}
+
+static void accept_all(ev_loop_t *loop)
+{
+    while (1)
+    {
+        int fd = accept4(loop->listenFd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0)
+        {
+            if (errno == EINTR || errno == ECONNABORTED)
+            {
+                continue;
+            }
+            return;
+        }
+
+        ev_session_t *s = calloc(1, sizeof(ev_session_t));
+        if (s == NULL)
+        {
+            close(fd);
+            continue;
+        }
+        // replies are one small write each, nagle would hold them back
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+        s->loop = loop;
+        s->sock = fd;
+        s->framed = -1;
+        s->sockSrc = (ev_src_t){EV_SRC_SOCK, s, 0};
+        for (int i = 0; i < 2; i++)
+        {
+            s->pipes[i].fd = s->pipes[i].wr = -1;
+            s->pipes[i].src = (ev_src_t){EV_SRC_OUT, s, i};
+        }
+        s->next = loop->sessions;
+        if (loop->sessions != NULL)
+        {
+            loop->sessions->prev = s;
+        }
+        loop->sessions = s;
+        loop->numSessions++;
+        watch(loop, fd, &s->sockSrc, &s->sockEvents, EPOLLIN | EPOLLRDHUP);
+    }
+}
+
+// sessions whose pipeline a worker finished
+static void take_done(ev_loop_t *loop)
+{
+    uint64_t n;
+    (void)!read(loop->wakeFd, &n, sizeof(n));
+
+    pthread_mutex_lock(&loop->lock);
+    ev_session_t *s = loop->done;
+    loop->done = NULL;
+    pthread_mutex_unlock(&loop->lock);
+
+    while (s != NULL)
+    {
+        ev_session_t *next = s->link;
+        s->ranDone = true;
+        if (s->outDone)
+        {
+            session_finish(s);
+        }
+        session_step(s);
+        s = next;
+    }
+}
+
+static void *loop_main(void *arg)
+{
+    ev_loop_t *loop = arg;
+    struct epoll_event events[EV_EVENTS];
+
+    while (!atomic_load(&ev_stop))
+    {
+        int n = epoll_wait(loop->epfd, events, EV_EVENTS, -1);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            perror("epoll_wait");
+            break;
+        }
+
+        for (int i = 0; i < n; i++)
+        {
+            ev_src_t *src = events[i].data.ptr;
+            switch (src->kind)
+            {
+            case EV_SRC_LISTEN:
+                accept_all(loop);
+                break;
+            case EV_SRC_WAKE:
+                take_done(loop);
+                break;
+            case EV_SRC_SOCK:
+                if (src->s->closed)
+                {
+                    break;
+                }
+                if (events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR))
+                {
+                    session_read(src->s);
+                }
+                session_step(src->s);
+                break;
+            case EV_SRC_OUT:
+                if (src->s->closed)
+                {
+                    break;
+                }
+                session_read_out(src->s, src->idx);
+                session_step(src->s);
+                break;
+            }
+        }
+
+        while (loop->dead != NULL)
+        {
+            ev_session_t *s = loop->dead;
+            loop->dead = s->link;
+            session_free(s);
+        }
+    }
+    return NULL;
+}
+
+// a non-blocking listening socket, shared with the other loops' through
+// SO_REUSEPORT
+static int ev_listen(char *ifaces, int port, bool reuseport)
+{
+    struct sockaddr_in addr;
+    int enable = 1;
+
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd == -1)
+    {
+        printf(CMD_ERR_RDSH_COMM);
+        return ERR_RDSH_COMMUNICATION;
+    }
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(int));
+    if (reuseport)
+    {
+        setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &enable, sizeof(int));
+    }
+
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = inet_addr(ifaces);
+    addr.sin_port = htons(port);
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1 || listen(fd, EV_BACKLOG) == -1)
+    {
+        printf(CMD_ERR_RDSH_COMM);
+        close(fd);
+        return ERR_RDSH_COMMUNICATION;
+    }
+    return fd;
+}
+
+static int loop_init(ev_loop_t *loop, char *ifaces, int port, bool reuseport)
+{
+    memset(loop, 0, sizeof(*loop));
+    pthread_mutex_init(&loop->lock, NULL);
+    loop->listenFd = ev_listen(ifaces, port, reuseport);
+    loop->epfd = epoll_create1(EPOLL_CLOEXEC);
+    loop->wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (loop->listenFd < 0 || loop->epfd < 0 || loop->wakeFd < 0)
+    {
+        return ERR_RDSH_SERVER;
+    }
+
+    loop->listenSrc.kind = EV_SRC_LISTEN;
+    loop->wakeSrc.kind = EV_SRC_WAKE;
+    unsigned cur = 0;
+    watch(loop, loop->listenFd, &loop->listenSrc, &cur, EPOLLIN);
+    cur = 0;
+    watch(loop, loop->wakeFd, &loop->wakeSrc, &cur, EPOLLIN);
+    return OK;
+}
+
+// once the loops are stopped nothing reads the pipelines still running, so
+// a pipeline with more output than a pipe holds would block its worker,
+// and work_pool_stop() with it.  Without the read ends its writes fail
+static void loop_close_output(ev_loop_t *loop)
+{
+    for (ev_session_t *s = loop->sessions; s != NULL; s = s->next)
+    {
+        for (int i = 0; i < s->numPipes; i++)
+        {
+            if (s->pipes[i].fd >= 0)
+            {
+                pipe_close(s, &s->pipes[i]);
+            }
+        }
+    }
+}
+
+static void loop_free(ev_loop_t *loop)
+{
+    while (loop->sessions != NULL)
+    {
+        ev_session_t *s = loop->sessions;
+        loop->sessions = s->next;
+        session_free(s);
+    }
+    while (loop->dead != NULL)
+    {
+        ev_session_t *s = loop->dead;
+        loop->dead = s->link;
+        session_free(s);
+    }
+    for (int i = 0; i < loop->numSpare; i++)
+    {
+        free_cmd_list(loop->spare[i]);
+    }
+    if (loop->listenFd >= 0)
+        close(loop->listenFd);
+    if (loop->epfd >= 0)
+        close(loop->epfd);
+    if (loop->wakeFd >= 0)
+        close(loop->wakeFd);
+    pthread_mutex_destroy(&loop->lock);
+}
+
+// thousands of sessions need as many descriptors, the soft limit is often
+// 1024
+static void raise_fd_limit(void)
+{
+    struct rlimit rl;
+    if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur < rl.rlim_max)
+    {
+        rl.rlim_cur = rl.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &rl);
+    }
+}
+
+/*
+ * start_event_server(ifaces, port, loops)
+ *      ifaces, port:  as for start_server()
+ *      loops:         event loops to run, 0 for one per core
+ *
+ *  Runs the server on epoll loops with the work pool running the
+ *  pipelines, see evserver.h, until a client sends stop-server.  Pipelines
+ *  running or queued then are waited for.
+ *
+ *  Returns:
+ *
+ *      OK_EXIT:  a client stopped the server
+ *
+ *      ERR_RDSH_COMMUNICATION, ERR_RDSH_SERVER:  the loops couldn't be set
+ *           up
+ */
+int start_event_server(char *ifaces, int port, int loops_wanted)
+{
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    if (cores < 1)
+    {
+        cores = 1;
+    }
+    num_loops = loops_wanted > 0 ? loops_wanted : cores;
+    if (num_loops > EV_LOOPS_MAX)
+    {
+        num_loops = EV_LOOPS_MAX;
+    }
+
+    raise_fd_limit();
+    trace_init();
+    atomic_store(&ev_stop, 0);
+    null_fd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+
+    int rc = OK;
+    int numInit = 0;
+    for (; numInit < num_loops && rc == OK; numInit++)
+    {
+        rc = loop_init(&loops[numInit], ifaces, port, num_loops > 1);
+    }
+    // the loops can't wait for room, a full queue turns the command away
+    int workers = rc == OK ? work_pool_start(cores * EV_WORKERS_PER_CORE, EV_QUEUE_SLOTS, 0, false) : 0;
+    if (rc == OK && workers <= 0)
+    {
+        rc = ERR_MEMORY;
+    }
+
+    if (rc == OK)
+    {
+        printf(EV_SERVER_MODE, num_loops, workers);
+        fflush(stdout);
+        for (int i = 1; i < num_loops; i++)
+        {
+            pthread_create(&loops[i].tid, NULL, loop_main, &loops[i]);
+        }
+        loop_main(&loops[0]);
+        for (int i = 1; i < num_loops; i++)
+        {
+            pthread_join(loops[i].tid, NULL);
+        }
+
+        // a built in writing to a closed pipe mustn't kill the server
+        signal(SIGPIPE, SIG_IGN);
+        for (int i = 0; i < num_loops; i++)
+        {
+            loop_close_output(&loops[i]);
+        }
+        work_pool_stop();
+        rc = OK_EXIT;
+    }
+
+    for (int i = 0; i < numInit; i++)
+    {
+        loop_free(&loops[i]);
+    }
+    close(null_fd);
+    parse_cache_free();
+    trace_finish();
+    return rc;
+}
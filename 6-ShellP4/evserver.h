@@ -0,0 +1,122 @@
+#ifndef __EVSERVER_H__
+#define __EVSERVER_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <pthread.h>
+
+#include "dshlib.h"
+
+// The event server (dsh -s -e LOOPS) serves every client from a few epoll
+// loops instead of a thread per connection.  A loop accepts, reads the
+// commands sessions send, parses them, and forwards their output, all
+// without blocking, so an idle session is a socket and a few bytes.  Only
+// running a pipeline blocks, so that is handed to the work pool, see
+// workpool.h.  The pipeline writes into a pipe the loop reads and copies to
+// the socket, and the worker tells the loop through an eventfd when it is
+// done.
+//
+// With more than one loop each has a listening socket of its own bound with
+// SO_REUSEPORT, and the kernel spreads the connections over them.  A
+// session's first command reads /dev/null, its socket only carries
+// commands.  Framed sessions (see frame.h) get a second pipe for stderr and
+// what comes out of each is framed as it is read, legacy ones get one pipe
+// for both.
+#define EV_LOOPS_MAX 64
+#define EV_WORKERS_PER_CORE 4
+// pipelines waiting for a worker, each session has at most one
+#define EV_QUEUE_SLOTS 4096
+#define EV_BACKLOG 4096
+
+// events taken per epoll_wait()
+#define EV_EVENTS 256
+// bytes read from a socket or pipe at a time
+#define EV_READ_SZ (64 * 1024)
+// the pipe isn't read while this much output waits for a slow client
+#define EV_OUT_HIGH (256 * 1024)
+// free buffers that have been emptied if they grew past this
+#define EV_BUF_KEEP (4 * 1024)
+
+// what an epoll event is for
+#define EV_SRC_LISTEN 0
+#define EV_SRC_WAKE 1
+#define EV_SRC_SOCK 2
+#define EV_SRC_OUT 3
+
+typedef struct ev_src
+{
+    int kind;
+    struct ev_session *s; // for EV_SRC_SOCK and EV_SRC_OUT
+    int idx;              // which of its pipes, for EV_SRC_OUT
+} ev_src_t;
+
+typedef struct ev_buf
+{
+    char *data;
+    size_t off; // bytes before this were already used
+    size_t len; // bytes in data
+    size_t cap;
+} ev_buf_t;
+
+// a pipe the running pipeline writes, its stdout or its stderr
+typedef struct ev_pipe
+{
+    int fd;          // the end the loop reads, -1 once read to the end
+    int wr;          // its write end, the worker's until it finishes
+    unsigned events; // what epoll watches on fd
+    ev_src_t src;
+} ev_pipe_t;
+
+typedef struct ev_session
+{
+    struct ev_loop *loop;
+    struct ev_session *prev; // every session of the loop
+    struct ev_session *next;
+    struct ev_session *link; // in the loop's done list
+    int sock;
+    int framed; // -1 until the client's first byte tells, see frame.h
+    ev_pipe_t pipes[2]; // stdout, and stderr if framed
+    int numPipes;       // of the running pipeline
+    int openPipes;      // not yet read to the end
+    unsigned sockEvents; // what epoll watches on sock
+    ev_src_t sockSrc;
+    ev_buf_t in;  // bytes received, frames or commands ending in a null
+    ev_buf_t out; // output waiting for the socket
+    size_t cmdLen; // input the command being parsed takes
+    char *cmdEnd;  // where its null went
+    char held;     // and the byte that was there, for a frame
+    command_list_t *clist; // the running command, from the loop's spares
+    bool running;
+    bool ranDone;  // the worker finished the pipeline
+    bool outDone;  // and its pipes were read to the end
+    bool closing;  // exit, close once the output is sent
+    bool peerGone; // the client closed or the socket failed
+    bool closed;   // freed once the epoll batch is done
+    int cmdRc;
+    int lastRc;
+} ev_session_t;
+
+typedef struct ev_loop
+{
+    int epfd;
+    int listenFd;
+    int wakeFd; // eventfd workers and stop-server poke
+    ev_src_t listenSrc;
+    ev_src_t wakeSrc;
+    pthread_t tid;
+    pthread_mutex_t lock;  // guards done
+    ev_session_t *done;    // sessions whose pipeline finished
+    ev_session_t *sessions;
+    ev_session_t *dead; // closed in this epoll batch
+    int numSessions;
+    command_list_t *spare[CMD_MAX]; // lists of finished commands, reused
+    int numSpare;
+} ev_loop_t;
+
+// output constants for the event server
+#define EV_SERVER_MODE "-> Event Loop Mode, %d loops, %d workers\n"
+
+// prototypes for the event server, see evserver.c
+int start_event_server(char *ifaces, int port, int loops);
+
+#endif
@@ -0,0 +1,329 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <arpa/inet.h>
+
+#include "dshlib.h"
+#include "rshlib.h"
+#include "frame.h"
+
+// a frame of FRAME_MAX and its header fit in this
+#define FRAME_RING_MAX (32 * 1024 * 1024)
+
+// cap bytes of memory mapped at two addresses next to each other
+static char *ring_map(size_t cap)
+{
+    int fd = memfd_create("rsh-ring", MFD_CLOEXEC);
+    if (fd < 0)
+    {
+        return NULL;
+    }
+
+    // the address range is reserved first, so both halves land in it
+    char *base = MAP_FAILED;
+    if (ftruncate(fd, cap) == 0)
+    {
+        base = mmap(NULL, 2 * cap, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    }
+    if (base != MAP_FAILED &&
+        (mmap(base, cap, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED ||
+         mmap(base + cap, cap, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED))
+    {
+        munmap(base, 2 * cap);
+        base = MAP_FAILED;
+    }
+    close(fd);
+    return base == MAP_FAILED ? NULL : base;
+}
+
+/*
+ *  frame_ring_init
+ *      r:    the ring
+ *      cap:  bytes it holds, rounded up to a power of two of whole pages
+ *
+ *  returns:  OK, or ERR_MEMORY if it couldn't be mapped
+ */
+int frame_ring_init(frame_ring_t *r, size_t cap)
+{
+    size_t len = (size_t)sysconf(_SC_PAGESIZE);
+    while (len < cap)
+    {
+        len *= 2;
+    }
+
+    memset(r, 0, sizeof(*r));
+    r->data = ring_map(len);
+    if (r->data == NULL)
+    {
+        return ERR_MEMORY;
+    }
+    r->cap = len;
+    return OK;
+}
+
+void frame_ring_free(frame_ring_t *r)
+{
+    if (r->data != NULL)
+    {
+        munmap(r->data, 2 * r->cap);
+    }
+    memset(r, 0, sizeof(*r));
+}
+
+// moves what the ring holds to a bigger one, for a message longer than it
+static int ring_grow(frame_ring_t *r, size_t need)
+{
+    size_t cap = r->cap * 2;
+    while (cap < need)
+    {
+        cap *= 2;
+    }
+    if (cap > FRAME_RING_MAX)
+    {
+        return ERR_FRAME_TOO_BIG;
+    }
+
+    frame_ring_t grown;
+    if (frame_ring_init(&grown, cap) != OK)
+    {
+        return ERR_MEMORY;
+    }
+    size_t used = frame_ring_used(r);
+    memcpy(grown.data, r->data + (r->head & (r->cap - 1)), used);
+    grown.tail = used;
+    grown.scan = r->scan;
+    frame_ring_free(r);
+    *r = grown;
+    return OK;
+}
+
+/*
+ *  frame_ring_recv
+ *      r:      the ring
+ *      fd:     the socket
+ *      flags:  for recv()
+ *
+ *  Receives straight into the free part of the ring, which is one run of
+ *  memory wherever it starts.  A full ring is grown first.
+ *
+ *  returns:  what recv() did, or ERR_FRAME_TOO_BIG when a message would
+ *            need a ring past FRAME_MAX, or ERR_MEMORY
+ */
+ssize_t frame_ring_recv(frame_ring_t *r, int fd, int flags)
+{
+    if (frame_ring_used(r) == r->cap)
+    {
+        int rc = ring_grow(r, r->cap + 1);
+        if (rc != OK)
+        {
+            return rc;
+        }
+    }
+
+    ssize_t n = recv(fd, r->data + (r->tail & (r->cap - 1)), r->cap - frame_ring_used(r), flags);
+    if (n > 0)
+    {
+        r->tail += n;
+    }
+    return n;
+}
+
+/*
+ *  frame_parse
+ *      buf, len:  received bytes, a frame starts at buf
+ *      f:         set to the frame, its payload pointing into buf
+ *
+ *  returns:  1 for a whole frame, 0 if more must be received first (f->len
+ *            says how much once the header is in), ERR_FRAME_BAD,
+ *            ERR_FRAME_VERSION (f->version is set) or ERR_FRAME_TOO_BIG for
+ *            a header that isn't one we take
+ */
+int frame_parse(char *buf, size_t len, frame_t *f)
+{
+    memset(f, 0, sizeof(*f));
+    if (len < FRAME_HDR_SZ)
+    {
+        return 0;
+    }
+
+    const unsigned char *hdr = (unsigned char *)buf;
+    uint32_t netLen;
+    memcpy(&netLen, hdr + 4, sizeof(netLen));
+    f->version = hdr[1];
+    f->type = hdr[2];
+    f->len = ntohl(netLen);
+    if (hdr[0] != FRAME_MAGIC)
+    {
+        return ERR_FRAME_BAD;
+    }
+    if (f->version != FRAME_VERSION)
+    {
+        return ERR_FRAME_VERSION;
+    }
+    if (f->type < FRAME_CMD || f->type > FRAME_EXIT || (f->type == FRAME_EXIT && f->len != sizeof(uint32_t)))
+    {
+        return ERR_FRAME_BAD;
+    }
+    if (f->len > FRAME_MAX)
+    {
+        return ERR_FRAME_TOO_BIG;
+    }
+    if (len - FRAME_HDR_SZ < f->len)
+    {
+        return 0;
+    }
+    f->payload = buf + FRAME_HDR_SZ;
+    return 1;
+}
+
+/*
+ *  frame_next
+ *      r:  the ring
+ *      f:  set to the first frame in it
+ *
+ *  frame_parse() on the ring, which is one run of memory even where the
+ *  frame wraps around.  The frame stays in the ring until
+ *  frame_ring_consume() takes FRAME_HDR_SZ + f->len bytes.  A header
+ *  announcing more than the ring holds grows it, so receiving can go on.
+ *
+ *  returns:  the same as frame_parse(), or ERR_MEMORY
+ */
+int frame_next(frame_ring_t *r, frame_t *f)
+{
+    int rc = frame_parse(r->data + (r->head & (r->cap - 1)), frame_ring_used(r), f);
+    size_t need = FRAME_HDR_SZ + f->len;
+    if (rc == 0 && f->len > 0 && need > r->cap)
+    {
+        rc = ring_grow(r, need);
+    }
+    return rc;
+}
+
+/*
+ *  frame_next_line
+ *      r:    the ring, holding legacy text
+ *      len:  set to the length of the line with its null
+ *
+ *  Each byte is looked at once however many receives a line takes.
+ *
+ *  returns:  the first line ending in a null, in the ring, or NULL if its
+ *            end hasn't come yet
+ */
+char *frame_next_line(frame_ring_t *r, size_t *len)
+{
+    size_t used = frame_ring_used(r);
+    char *start = r->data + (r->head & (r->cap - 1));
+    char *end = memchr(start + r->scan, '\0', used - r->scan);
+    if (end == NULL)
+    {
+        r->scan = used;
+        return NULL;
+    }
+    *len = end - start + 1;
+    return start;
+}
+
+void frame_ring_consume(frame_ring_t *r, size_t n)
+{
+    r->head += n;
+    r->scan = 0;
+    if (r->head == r->tail)
+    {
+        r->head = r->tail = 0;
+    }
+}
+
+// writes a header for a payload of len bytes
+void frame_pack(char *hdr, uint8_t type, uint32_t len)
+{
+    uint32_t netLen = htonl(len);
+    hdr[0] = (char)FRAME_MAGIC;
+    hdr[1] = FRAME_VERSION;
+    hdr[2] = type;
+    hdr[3] = 0;
+    memcpy(hdr + 4, &netLen, sizeof(netLen));
+}
+
+// writes a whole FRAME_EXIT, FRAME_HDR_SZ + 4 bytes
+void frame_pack_exit(char *frame, int status)
+{
+    uint32_t netStatus = htonl((uint32_t)status);
+    frame_pack(frame, FRAME_EXIT, sizeof(netStatus));
+    memcpy(frame + FRAME_HDR_SZ, &netStatus, sizeof(netStatus));
+}
+
+// sends every byte of iov, one sendmsg() unless the socket buffer fills
+static int send_iov(int fd, struct iovec *iov, int num)
+{
+    struct msghdr msg = {.msg_iov = iov, .msg_iovlen = num};
+    while (msg.msg_iovlen > 0)
+    {
+        ssize_t n = sendmsg(fd, &msg, MSG_NOSIGNAL);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return ERR_RDSH_COMMUNICATION;
+        }
+        while (msg.msg_iovlen > 0 && (size_t)n >= msg.msg_iov->iov_len)
+        {
+            n -= msg.msg_iov->iov_len;
+            msg.msg_iov++;
+            msg.msg_iovlen--;
+        }
+        if (msg.msg_iovlen > 0)
+        {
+            msg.msg_iov->iov_base = (char *)msg.msg_iov->iov_base + n;
+            msg.msg_iov->iov_len -= n;
+        }
+    }
+    return OK;
+}
+
+/*
+ *  frame_send
+ *      fd:        the socket
+ *      type:      FRAME_CMD, FRAME_STDOUT or FRAME_STDERR
+ *      buf, len:  the payload
+ *
+ *  returns:  OK, or ERR_RDSH_COMMUNICATION if the send failed
+ */
+int frame_send(int fd, uint8_t type, const void *buf, size_t len)
+{
+    char hdr[FRAME_HDR_SZ];
+    frame_pack(hdr, type, len);
+    struct iovec iov[2] = {{hdr, FRAME_HDR_SZ}, {(void *)buf, len}};
+    return send_iov(fd, iov, len > 0 ? 2 : 1);
+}
+
+/*
+ *  frame_send_reply
+ *      fd:      the socket
+ *      type:    FRAME_STDOUT or FRAME_STDERR for msg
+ *      msg:     output of the command, "" for none
+ *      status:  what it exited with
+ *
+ *  Sends the whole answer to a command that ran on the server itself, msg
+ *  and the FRAME_EXIT, with one send.
+ *
+ *  returns:  OK, or ERR_RDSH_COMMUNICATION if the send failed
+ */
+int frame_send_reply(int fd, uint8_t type, const char *msg, int status)
+{
+    char hdr[FRAME_HDR_SZ];
+    char exitFrame[FRAME_HDR_SZ + sizeof(uint32_t)];
+    size_t len = strlen(msg);
+    frame_pack(hdr, type, len);
+    frame_pack_exit(exitFrame, status);
+
+    struct iovec iov[3] = {{hdr, FRAME_HDR_SZ}, {(void *)msg, len}, {exitFrame, sizeof(exitFrame)}};
+    return len > 0 ? send_iov(fd, iov, 3) : send_iov(fd, iov + 2, 1);
+}
@@ -0,0 +1,96 @@
+#ifndef __FRAME_H__
+#define __FRAME_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+// The rsh client and servers talk in frames.  Each is an 8 byte header and
+// then its payload:
+//
+//      byte 0      FRAME_MAGIC
+//      byte 1      FRAME_VERSION
+//      byte 2      the type, FRAME_CMD ...
+//      byte 3      0, reserved
+//      bytes 4-7   length of the payload, network byte order
+//
+// The client sends a FRAME_CMD with the command line, no null.  The server
+// answers with FRAME_STDOUT and FRAME_STDERR chunks of the output as it
+// comes, and ends with a FRAME_EXIT whose payload is the status as 4 bytes
+// in network order.  Output may hold any bytes, nothing in it is special.
+//
+// The legacy protocol, commands ending in a null and output in
+// RDSH_EOF_CHAR, is still served: FRAME_MAGIC is never the first byte of a
+// text command, so the servers tell a session's protocol from the first
+// byte it sends.  dsh -c -l speaks it, see rshlib.h.
+//
+// Frames are received into a ring mapped twice back to back, so the bytes
+// after its end are its start again and a frame that wraps around is still
+// one run of memory.  The parser hands out pointers into the ring and
+// nothing is copied out of it.
+#define FRAME_MAGIC 0xFF
+#define FRAME_VERSION 1
+#define FRAME_HDR_SZ 8
+
+#define FRAME_CMD 1
+#define FRAME_STDOUT 2
+#define FRAME_STDERR 3
+#define FRAME_EXIT 4
+
+// the longest payload taken, and the ring a session starts with
+#define FRAME_MAX (16 * 1024 * 1024)
+#define FRAME_RING_SZ (64 * 1024)
+
+// returned by frame_parse(), frame_next() and frame_ring_recv()
+#define ERR_FRAME_BAD -62
+#define ERR_FRAME_VERSION -63
+#define ERR_FRAME_TOO_BIG -64
+
+typedef struct frame
+{
+    uint8_t version;
+    uint8_t type;
+    uint32_t len;
+    char *payload; // in what it was parsed from
+} frame_t;
+
+typedef struct frame_ring
+{
+    char *data;  // data[i] and data[i + cap] are the same byte
+    size_t cap;  // a power of two, whole pages
+    size_t head; // next byte to take, counts up without wrapping
+    size_t tail; // next byte to receive into
+    size_t scan; // bytes past head with no null in them, see frame_next_line()
+} frame_ring_t;
+
+// output constants for frames
+#define FRAME_ERR_BAD "rdsh-error: malformed frame\n"
+#define FRAME_ERR_VERSION "rdsh-error: protocol version %d isn't spoken here, only %d\n"
+#define FRAME_ERR_TOO_BIG "rdsh-error: message is longer than %d bytes\n"
+
+// prototypes for frames, see frame.c
+int frame_ring_init(frame_ring_t *r, size_t cap);
+void frame_ring_free(frame_ring_t *r);
+ssize_t frame_ring_recv(frame_ring_t *r, int fd, int flags);
+int frame_parse(char *buf, size_t len, frame_t *f);
+int frame_next(frame_ring_t *r, frame_t *f);
+char *frame_next_line(frame_ring_t *r, size_t *len);
+void frame_ring_consume(frame_ring_t *r, size_t n);
+void frame_pack(char *hdr, uint8_t type, uint32_t len);
+void frame_pack_exit(char *frame, int status);
+int frame_send(int fd, uint8_t type, const void *buf, size_t len);
+int frame_send_reply(int fd, uint8_t type, const char *msg, int status);
+
+static inline size_t frame_ring_used(const frame_ring_t *r)
+{
+    return r->tail - r->head;
+}
+
+// the first byte waiting, or -1 when there is none
+static inline int frame_ring_peek(const frame_ring_t *r)
+{
+    return r->tail > r->head ? (unsigned char)r->data[r->head & (r->cap - 1)] : -1;
+}
+
+#endif
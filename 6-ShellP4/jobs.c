@@ -0,0 +1,431 @@
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+
+#include "jobs.h"
+
+static job_t *jobs = NULL; // oldest job first
+static int num_jobs = 0;
+static int cap_jobs = 0;
+static bool notify = false; // print when jobs start and finish
+
+// an interactive shell says when a job starts and when it is done, a script
+// doesn't
+void jobs_set_notify(bool on)
+{
+    notify = on;
+}
+
+// a pidfd for the child, or -1 if the kernel doesn't have pidfd_open
+int jobs_open_pidfd(pid_t pid)
+{
+#ifdef SYS_pidfd_open
+    return (int)syscall(SYS_pidfd_open, pid, 0);
+#else
+    (void)pid;
+    return -1;
+#endif
+}
+
+// the command line of a job, rebuilt from its commands
+static char *describe(command_list_t *clist)
+{
+    size_t len = 1;
+    for (int i = 0; i < clist->num; i++)
+    {
+        cmd_buff_t *cmd = &clist->commands[i];
+        for (int a = 0; a < cmd->argc; a++)
+        {
+            len += strlen(cmd->argv[a]) + 1;
+        }
+        len += cmd->input_file ? strlen(cmd->input_file) + 3 : 0;
+        len += cmd->output_file ? strlen(cmd->output_file) + 4 : 0;
+        len += 3;
+    }
+
+    char *desc = malloc(len);
+    if (desc == NULL)
+    {
+        return NULL;
+    }
+
+    char *p = desc;
+    for (int i = 0; i < clist->num; i++)
+    {
+        cmd_buff_t *cmd = &clist->commands[i];
+        if (i > 0)
+        {
+            p += sprintf(p, " | ");
+        }
+        for (int a = 0; a < cmd->argc; a++)
+        {
+            p += sprintf(p, a > 0 ? " %s" : "%s", cmd->argv[a]);
+        }
+        if (cmd->input_file)
+        {
+            p += sprintf(p, " < %s", cmd->input_file);
+        }
+        if (cmd->output_file)
+        {
+            p += sprintf(p, cmd->append_mode ? " >> %s" : " > %s", cmd->output_file);
+        }
+    }
+    *p = '\0';
+    return desc;
+}
+
+static void free_job(job_t *job)
+{
+    for (int k = 0; k < job->num; k++)
+    {
+        if (job->pidfds[k] >= 0)
+        {
+            close(job->pidfds[k]);
+        }
+    }
+    free(job->pids);
+    free(job->pidfds);
+    free(job->desc);
+}
+
+static void remove_job(int idx)
+{
+    free_job(&jobs[idx]);
+    memmove(&jobs[idx], &jobs[idx + 1], (num_jobs - idx - 1) * sizeof(job_t));
+    num_jobs--;
+}
+
+/*
+ *  jobs_add
+ *      clist:    the pipeline that was just started in the background
+ *      pids:     one per stage, -1 for a stage that could not be started
+ *      spawnRc:  why the last stage could not be started, or 0
+ *
+ *  Adds the pipeline to the job table and opens a pidfd for each process.
+ *
+ *  returns:  the job id, or ERR_MEMORY if the table could not grow, then
+ *            the caller has to wait for the processes itself
+ */
+int jobs_add(command_list_t *clist, pid_t *pids, int spawnRc)
+{
+    if (num_jobs == cap_jobs)
+    {
+        int newCap = cap_jobs == 0 ? 8 : cap_jobs * 2;
+        job_t *grown = realloc(jobs, newCap * sizeof(job_t));
+        if (grown == NULL)
+        {
+            return ERR_MEMORY;
+        }
+        jobs = grown;
+        cap_jobs = newCap;
+    }
+
+    job_t *job = &jobs[num_jobs];
+    job->pids = malloc(clist->num * sizeof(pid_t));
+    job->pidfds = malloc(clist->num * sizeof(int));
+    job->desc = describe(clist);
+    if (job->pids == NULL || job->pidfds == NULL || job->desc == NULL)
+    {
+        free(job->pids);
+        free(job->pidfds);
+        free(job->desc);
+        return ERR_MEMORY;
+    }
+
+    // ids start over once every job has been taken care of
+    job->id = num_jobs == 0 ? 1 : jobs[num_jobs - 1].id + 1;
+    job->num = clist->num;
+    job->live = 0;
+    job->status = spawnRc;
+    for (int k = 0; k < clist->num; k++)
+    {
+        job->pids[k] = pids[k];
+        job->pidfds[k] = -1;
+        if (pids[k] != -1)
+        {
+            job->pidfds[k] = jobs_open_pidfd(pids[k]);
+            job->live++;
+        }
+    }
+    num_jobs++;
+
+    if (notify)
+    {
+        printf(JOBS_STARTED, job->id, (int)pids[clist->num - 1]);
+    }
+    return job->id;
+}
+
+// collects process k of the job, blocking if it hasn't finished yet
+static void reap_proc(job_t *job, int k, bool block)
+{
+    int status;
+    pid_t rc = waitpid(job->pids[k], &status, block ? 0 : WNOHANG);
+    if (rc == 0 || (rc < 0 && errno == EINTR))
+    {
+        return;
+    }
+
+    // anything else, including a process that isn't our child, is finished
+    if (rc > 0 && k == job->num - 1)
+    {
+        if (WIFEXITED(status))
+            job->status = WEXITSTATUS(status);
+        else if (WIFSIGNALED(status))
+            job->status = 128 + WTERMSIG(status);
+    }
+    if (job->pidfds[k] >= 0)
+    {
+        close(job->pidfds[k]);
+        job->pidfds[k] = -1;
+    }
+    job->pids[k] = -1;
+    job->live--;
+}
+
+// reaps the processes of job idx, or of every job when idx is -1.  With
+// block it returns once all of them are done, otherwise it takes what has
+// already finished.  poll() on the pidfds does the waiting
+static void reap_jobs(int idx, bool block)
+{
+    int first = idx < 0 ? 0 : idx;
+    int last = idx < 0 ? num_jobs - 1 : idx;
+
+    while (1)
+    {
+        int n = 0;
+        for (int j = first; j <= last; j++)
+        {
+            n += jobs[j].live;
+        }
+        if (n == 0)
+        {
+            return;
+        }
+
+        struct pollfd *fds = malloc(n * sizeof(struct pollfd));
+        int *who = malloc(n * 2 * sizeof(int));
+        if (fds == NULL || who == NULL)
+        {
+            free(fds);
+            free(who);
+            return;
+        }
+
+        n = 0;
+        for (int j = first; j <= last; j++)
+        {
+            for (int k = 0; k < jobs[j].num; k++)
+            {
+                if (jobs[j].pids[k] == -1)
+                {
+                    continue;
+                }
+                // without a pidfd all there is to do is waitpid()
+                if (jobs[j].pidfds[k] < 0)
+                {
+                    reap_proc(&jobs[j], k, block);
+                    continue;
+                }
+                fds[n].fd = jobs[j].pidfds[k];
+                fds[n].events = POLLIN;
+                fds[n].revents = 0;
+                who[2 * n] = j;
+                who[2 * n + 1] = k;
+                n++;
+            }
+        }
+
+        int ready = n > 0 ? poll(fds, n, block ? -1 : 0) : 0;
+        for (int i = 0; ready > 0 && i < n; i++)
+        {
+            if (fds[i].revents != 0)
+            {
+                reap_proc(&jobs[who[2 * i]], who[2 * i + 1], false);
+            }
+        }
+
+        free(fds);
+        free(who);
+        if (!block || (ready < 0 && errno != EINTR))
+        {
+            return;
+        }
+    }
+}
+
+static void print_job(FILE *out, job_t *job)
+{
+    char state[32];
+    if (job->live > 0)
+        snprintf(state, sizeof(state), JOBS_RUNNING);
+    else if (job->status == 0)
+        snprintf(state, sizeof(state), JOBS_DONE);
+    else
+        snprintf(state, sizeof(state), JOBS_EXIT, job->status);
+    fprintf(out, JOBS_ROW, job->id, state, job->desc);
+}
+
+// reaps whatever has finished without blocking.  An interactive shell calls
+// this before each prompt and reports the jobs that are done.  A script
+// keeps them so wait can still return their status
+void jobs_notify(void)
+{
+    if (num_jobs == 0)
+    {
+        return;
+    }
+
+    reap_jobs(-1, false);
+    if (!notify)
+    {
+        return;
+    }
+
+    for (int j = 0; j < num_jobs;)
+    {
+        if (jobs[j].live == 0)
+        {
+            print_job(stdout, &jobs[j]);
+            remove_job(j);
+        }
+        else
+        {
+            j++;
+        }
+    }
+}
+
+// forgets every job, the processes that are still running keep running
+void jobs_free(void)
+{
+    for (int j = 0; j < num_jobs; j++)
+    {
+        free_job(&jobs[j]);
+    }
+    free(jobs);
+    jobs = NULL;
+    num_jobs = 0;
+    cap_jobs = 0;
+}
+
+// finds the job a %N job id or a process id refers to, -1 if there is none
+static int find_job(const char *spec)
+{
+    bool byId = spec[0] == '%';
+    char *end;
+    long n = strtol(byId ? spec + 1 : spec, &end, 10);
+    if (*end != '\0' || end == spec + byId)
+    {
+        return -1;
+    }
+
+    for (int j = 0; j < num_jobs; j++)
+    {
+        if (byId && jobs[j].id == n)
+        {
+            return j;
+        }
+        for (int k = 0; !byId && k < jobs[j].num; k++)
+        {
+            if (jobs[j].pids[k] == n)
+            {
+                return j;
+            }
+        }
+    }
+    return -1;
+}
+
+// waits for job idx to finish, removes it and returns its status
+static int finish_job(int idx)
+{
+    reap_jobs(idx, true);
+    int status = jobs[idx].status;
+    remove_job(idx);
+    return status;
+}
+
+// jobs, lists every job.  The ones that are done are forgotten once listed
+int jobs_cmd(int argc, char *argv[], FILE *out)
+{
+    (void)argc;
+    (void)argv;
+
+    reap_jobs(-1, false);
+    for (int j = 0; j < num_jobs;)
+    {
+        print_job(out, &jobs[j]);
+        if (jobs[j].live == 0)
+            remove_job(j);
+        else
+            j++;
+    }
+    return 0;
+}
+
+/*
+ *  wait_cmd
+ *
+ *  wait              waits for every job, returns 0
+ *  wait %N | pid ... waits for each job given, returns the status of the
+ *                    last one, or 127 if it doesn't exist
+ */
+int wait_cmd(int argc, char *argv[], FILE *out)
+{
+    if (argc == 1)
+    {
+        reap_jobs(-1, true);
+        while (num_jobs > 0)
+        {
+            remove_job(num_jobs - 1);
+        }
+        return 0;
+    }
+
+    int rc = 0;
+    for (int i = 1; i < argc; i++)
+    {
+        int idx = find_job(argv[i]);
+        if (idx < 0)
+        {
+            fprintf(out, JOBS_ERR_NO_JOB, WAIT_CMD, argv[i]);
+            rc = 127;
+            continue;
+        }
+        rc = finish_job(idx);
+    }
+    return rc;
+}
+
+// fg [%N | pid], waits for the job, the newest one by default, and returns
+// its status
+int fg_cmd(int argc, char *argv[], FILE *out)
+{
+    int idx = num_jobs - 1;
+    if (argc > 1)
+    {
+        idx = find_job(argv[1]);
+        if (idx < 0)
+        {
+            fprintf(out, JOBS_ERR_NO_JOB, FG_CMD, argv[1]);
+            return 1;
+        }
+    }
+    else if (idx < 0)
+    {
+        fprintf(out, JOBS_ERR_NO_CURRENT, FG_CMD);
+        return 1;
+    }
+
+    fprintf(out, "%s\n", jobs[idx].desc);
+    fflush(out);
+    return finish_job(idx);
+}
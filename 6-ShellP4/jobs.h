@@ -0,0 +1,51 @@
+#ifndef __JOBS_H__
+#define __JOBS_H__
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <sys/types.h>
+
+#include "dshlib.h"
+
+// A line ending in & runs in the background.  Its processes are kept in a
+// job table and reaped without blocking the shell: each one gets a pidfd
+// (pidfd_open), and poll() on those tells which have finished, so waiting
+// on many jobs never busy waits.  When pidfds aren't available a job is
+// reaped with waitpid() instead.  dsh has no terminal job control, so fg
+// waits for a job but can't stop or resume it.
+
+#define JOBS_CMD "jobs"
+#define WAIT_CMD "wait"
+#define FG_CMD "fg"
+
+typedef struct job
+{
+    int id;       // the %N it is referred to by
+    int num;      // processes in the job, one per pipeline stage
+    int live;     // processes not reaped yet
+    pid_t *pids;  // -1 once reaped, or if the stage never started
+    int *pidfds;  // -1 if there is no pidfd for the process
+    int status;   // exit status of the last stage
+    char *desc;   // the command line, for jobs and fg
+} job_t;
+
+// output constants for jobs
+#define JOBS_STARTED "[%d] %d\n"
+#define JOBS_ROW "[%d]  %-12s%s\n"
+#define JOBS_RUNNING "Running"
+#define JOBS_DONE "Done"
+#define JOBS_EXIT "Exit %d"
+#define JOBS_ERR_NO_JOB "%s: %s: no such job\n"
+#define JOBS_ERR_NO_CURRENT "%s: current: no such job\n"
+
+// prototypes for the job table, see jobs.c
+void jobs_set_notify(bool notify);
+int jobs_open_pidfd(pid_t pid);
+int jobs_add(command_list_t *clist, pid_t *pids, int spawnRc);
+void jobs_notify(void);
+void jobs_free(void);
+int jobs_cmd(int argc, char *argv[], FILE *out);
+int wait_cmd(int argc, char *argv[], FILE *out);
+int fg_cmd(int argc, char *argv[], FILE *out);
+
+#endif
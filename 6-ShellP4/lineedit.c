@@ -0,0 +1,483 @@
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <termios.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+
+#include "dshlib.h"
+#include "lineedit.h"
+
+// the line being edited, kept in the caller's buffer
+typedef struct line_edit
+{
+    const char *prompt;
+    char **buff;
+    size_t *cap;
+    size_t len; // bytes in the line
+    size_t pos; // where the cursor is
+} line_edit_t;
+
+// characters that end the word Tab completes
+static bool is_word_break(char c)
+{
+    return c == SPACE_CHAR || c == TAB_CHAR || c == PIPE_CHAR || c == REDIR_IN_CHAR || c == REDIR_OUT_CHAR ||
+           c == BG_CHAR;
+}
+
+// redraws the whole line and puts the cursor back where it was
+static void refresh(line_edit_t *le)
+{
+    printf("\r%s", le->prompt);
+    fwrite(*le->buff, 1, le->len, stdout);
+    printf("\x1b[K");
+    if (le->pos < le->len)
+    {
+        printf("\x1b[%zuD", le->len - le->pos);
+    }
+    fflush(stdout);
+}
+
+// inserts n bytes at the cursor, returns -1 without memory
+static int insert(line_edit_t *le, const char *s, size_t n)
+{
+    if (le->len + n + 1 > *le->cap)
+    {
+        size_t newCap = (le->len + n + 1) * 2;
+        char *grown = realloc(*le->buff, newCap);
+        if (grown == NULL)
+        {
+            return -1;
+        }
+        *le->buff = grown;
+        *le->cap = newCap;
+    }
+
+    char *b = *le->buff;
+    memmove(b + le->pos + n, b + le->pos, le->len - le->pos);
+    memcpy(b + le->pos, s, n);
+    le->len += n;
+    le->pos += n;
+    return 0;
+}
+
+// removes the bytes from..to of the line and leaves the cursor at from
+static void erase(line_edit_t *le, size_t from, size_t to)
+{
+    char *b = *le->buff;
+    memmove(b + from, b + to, le->len - to);
+    le->len -= to - from;
+    le->pos = from;
+}
+
+static int cmp_items(const void *a, const void *b)
+{
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+/*
+ *  complete_path
+ *      word:  what was typed of the path
+ *      out:   gets the paths starting with word, a directory ends in /
+ *
+ *  Names starting with . are only completed when word's last component
+ *  starts with one.
+ *
+ *  returns:  the number of paths found, -1 if there was no memory
+ */
+int complete_path(const char *word, comp_list_t *out)
+{
+    const char *slash = strrchr(word, '/');
+    size_t dirLen = slash != NULL ? (size_t)(slash - word) + 1 : 0;
+    const char *base = word + dirLen;
+    size_t baseLen = strlen(base);
+    char dir[PATH_MAX];
+    char item[PATH_MAX];
+
+    if (dirLen >= sizeof(dir))
+    {
+        return 0;
+    }
+    memcpy(dir, word, dirLen);
+    strcpy(dir + dirLen, dirLen == 0 ? "." : "");
+
+    DIR *d = opendir(dir);
+    if (d == NULL)
+    {
+        return 0;
+    }
+
+    int rc = 0;
+    struct dirent *e;
+    while (rc == 0 && (e = readdir(d)) != NULL)
+    {
+        const char *name = e->d_name;
+        if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0)
+        {
+            continue;
+        }
+        if ((name[0] == '.' && base[0] != '.') || strncmp(name, base, baseLen) != 0)
+        {
+            continue;
+        }
+
+        struct stat st;
+        bool isDir = e->d_type == DT_DIR;
+        if (e->d_type == DT_LNK || e->d_type == DT_UNKNOWN)
+        {
+            isDir = fstatat(dirfd(d), name, &st, 0) == 0 && S_ISDIR(st.st_mode);
+        }
+        int len = snprintf(item, sizeof(item), "%.*s%s", (int)dirLen, word, name);
+        if (len > 0 && (size_t)len < sizeof(item))
+        {
+            rc = comp_list_add(out, item, len, isDir ? "/" : "");
+        }
+    }
+    closedir(d);
+
+    qsort(out->items, out->num, sizeof(char *), cmp_items);
+    return rc == 0 ? out->num : -1;
+}
+
+// lists the completions below the line in columns, like ls.  skip is how
+// much of each one is left out, the directory they are all in
+static void list_items(comp_list_t *list, size_t skip)
+{
+    struct winsize ws;
+    int width = (ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) == 0 && ws.ws_col > 0) ? ws.ws_col : 80;
+    int num = list->num < LINE_EDIT_LIST_MAX ? list->num : LINE_EDIT_LIST_MAX;
+
+    size_t colWidth = 0;
+    for (int i = 0; i < num; i++)
+    {
+        size_t len = strlen(list->items[i] + skip) + 2;
+        colWidth = len > colWidth ? len : colWidth;
+    }
+    int cols = (int)(width / colWidth) > 0 ? (int)(width / colWidth) : 1;
+    int rows = (num + cols - 1) / cols;
+
+    printf("\n");
+    for (int r = 0; r < rows; r++)
+    {
+        for (int c = 0; c < cols; c++)
+        {
+            int i = c * rows + r;
+            if (i < num)
+            {
+                printf("%-*s", (int)colWidth, list->items[i] + skip);
+            }
+        }
+        printf("\n");
+    }
+    if (num < list->num)
+    {
+        printf(LINE_EDIT_MORE, list->num - num);
+    }
+}
+
+/*
+ *  complete
+ *
+ *  Completes the word that ends at the cursor.  It is a command when it is
+ *  the first word of the line or comes right after a pipe and has no /,
+ *  those come from the command trie.  Anything else is a path.  One
+ *  completion is put in whole, followed by a space unless it is a
+ *  directory.  Several put in what they have in common, or are listed if
+ *  that adds nothing.
+ */
+static void complete(line_edit_t *le)
+{
+    char *b = *le->buff;
+    size_t start = le->pos;
+    while (start > 0 && !is_word_break(b[start - 1]))
+    {
+        start--;
+    }
+    size_t before = start;
+    while (before > 0 && (b[before - 1] == SPACE_CHAR || b[before - 1] == TAB_CHAR))
+    {
+        before--;
+    }
+
+    size_t wordLen = le->pos - start;
+    char *word = strndup(b + start, wordLen);
+    if (word == NULL)
+    {
+        return;
+    }
+    bool isCmd = (before == 0 || b[before - 1] == PIPE_CHAR) && strchr(word, '/') == NULL;
+
+    comp_list_t list = {0};
+    int num = isCmd ? cmd_trie_complete(word, false, &list) : complete_path(word, &list);
+    if (num <= 0)
+    {
+        printf("\a");
+    }
+    else if (num == 1)
+    {
+        const char *item = list.items[0];
+        size_t len = strlen(item);
+        insert(le, item + wordLen, len - wordLen);
+        if (len == 0 || item[len - 1] != '/')
+        {
+            insert(le, " ", 1);
+        }
+    }
+    else
+    {
+        size_t common = strlen(list.items[0]);
+        for (int i = 1; i < num; i++)
+        {
+            size_t j = 0;
+            while (j < common && list.items[i][j] == list.items[0][j])
+            {
+                j++;
+            }
+            common = j;
+        }
+
+        if (common > wordLen)
+        {
+            insert(le, list.items[0] + wordLen, common - wordLen);
+        }
+        else
+        {
+            const char *slash = strrchr(word, '/');
+            list_items(&list, slash != NULL ? (size_t)(slash - word) + 1 : 0);
+        }
+    }
+
+    comp_list_clear(&list);
+    free(word);
+}
+
+// reads what follows an ESC and handles the keys it knows
+static void escape(line_edit_t *le)
+{
+    char seq[3];
+    if (read(STDIN_FILENO, &seq[0], 1) != 1 || read(STDIN_FILENO, &seq[1], 1) != 1)
+    {
+        return;
+    }
+
+    if (seq[0] == '[' && seq[1] >= '0' && seq[1] <= '9')
+    {
+        if (read(STDIN_FILENO, &seq[2], 1) != 1 || seq[2] != '~')
+        {
+            return;
+        }
+        if (seq[1] == '3' && le->pos < le->len)
+            erase(le, le->pos, le->pos + 1);
+        else if (seq[1] == '1' || seq[1] == '7')
+            le->pos = 0;
+        else if (seq[1] == '4' || seq[1] == '8')
+            le->pos = le->len;
+        return;
+    }
+
+    if (seq[0] != '[' && seq[0] != 'O')
+    {
+        return;
+    }
+    switch (seq[1])
+    {
+    case 'C':
+        le->pos += le->pos < le->len;
+        break;
+    case 'D':
+        le->pos -= le->pos > 0;
+        break;
+    case 'H':
+        le->pos = 0;
+        break;
+    case 'F':
+        le->pos = le->len;
+        break;
+    default:
+        break;
+    }
+}
+
+/*
+ *  line_edit_read
+ *      prompt:  the prompt the caller printed, redrawn with the line
+ *      buff:    gets the line, null terminated, grown as needed
+ *      cap:     the size of buff
+ *
+ *  Reads one line from the terminal, with the terminal in raw mode only
+ *  while the line is read so commands still run in a normal one.  Starts
+ *  building the command trie if it is missing or stale, so Tab doesn't
+ *  wait for it.
+ *
+ *  returns:  OK, or EOF for ^D on an empty line or the end of input
+ */
+int line_edit_read(const char *prompt, char **buff, size_t *cap)
+{
+    line_edit_t le = {prompt, buff, cap, 0, 0};
+    struct termios orig;
+    struct termios raw;
+    bool isRaw = tcgetattr(STDIN_FILENO, &orig) == 0;
+
+    cmd_trie_refresh();
+    if (isRaw)
+    {
+        raw = orig;
+        raw.c_iflag &= ~(BRKINT | ICRNL | INPCK | ISTRIP | IXON);
+        raw.c_cflag |= CS8;
+        raw.c_lflag &= ~(ECHO | ICANON | IEXTEN | ISIG);
+        raw.c_cc[VMIN] = 1;
+        raw.c_cc[VTIME] = 0;
+        // TCSANOW keeps what was typed ahead, like a pasted line
+        isRaw = tcsetattr(STDIN_FILENO, TCSANOW, &raw) == 0;
+    }
+    fflush(stdout);
+
+    int rc = OK;
+    bool done = false;
+    while (!done)
+    {
+        unsigned char c;
+        ssize_t n = read(STDIN_FILENO, &c, 1);
+        if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n <= 0)
+        {
+            rc = EOF;
+            break;
+        }
+
+        switch (c)
+        {
+        case KEY_ENTER:
+        case '\n':
+            done = true;
+            break;
+        case KEY_CTRL('D'):
+            if (le.len == 0)
+            {
+                rc = EOF;
+                done = true;
+            }
+            else if (le.pos < le.len)
+            {
+                erase(&le, le.pos, le.pos + 1);
+            }
+            break;
+        case KEY_CTRL('C'):
+            printf("^C\n");
+            le.len = le.pos = 0;
+            break;
+        case KEY_BACKSPACE:
+        case KEY_CTRL('H'):
+            if (le.pos > 0)
+            {
+                erase(&le, le.pos - 1, le.pos);
+            }
+            break;
+        case KEY_CTRL('A'):
+            le.pos = 0;
+            break;
+        case KEY_CTRL('E'):
+            le.pos = le.len;
+            break;
+        case KEY_CTRL('B'):
+            le.pos -= le.pos > 0;
+            break;
+        case KEY_CTRL('F'):
+            le.pos += le.pos < le.len;
+            break;
+        case KEY_CTRL('U'):
+            erase(&le, 0, le.pos);
+            break;
+        case KEY_CTRL('K'):
+            le.len = le.pos;
+            break;
+        case KEY_CTRL('W'):
+        {
+            size_t from = le.pos;
+            while (from > 0 && (*buff)[from - 1] == SPACE_CHAR)
+            {
+                from--;
+            }
+            while (from > 0 && (*buff)[from - 1] != SPACE_CHAR)
+            {
+                from--;
+            }
+            erase(&le, from, le.pos);
+            break;
+        }
+        case KEY_CTRL('L'):
+            printf("\x1b[H\x1b[2J");
+            break;
+        case KEY_TAB:
+            complete(&le);
+            break;
+        case KEY_ESC:
+            escape(&le);
+            break;
+        default:
+            // without memory for a longer line the key is dropped
+            if (c >= ' ' && insert(&le, (char *)&c, 1) != 0)
+            {
+                printf("\a");
+            }
+            break;
+        }
+        if (!done)
+        {
+            refresh(&le);
+        }
+    }
+
+    if (isRaw)
+    {
+        tcsetattr(STDIN_FILENO, TCSANOW, &orig);
+    }
+    printf("\n");
+    fflush(stdout);
+
+    // insert() always leaves room for the null
+    (*buff)[le.len] = '\0';
+    return rc;
+}
+
+/*
+ *  compgen_cmd
+ *
+ *  compgen -c [word]   prints the commands word completes to, one a line
+ *  compgen -f [word]   prints the paths
+ *
+ *  What Tab would offer, for scripts and tests.  compgen -c waits for the
+ *  command trie to be up to date first.
+ */
+int compgen_cmd(int argc, char *argv[], FILE *out)
+{
+    if (argc < 2 || argc > 3 || (strcmp(argv[1], "-c") != 0 && strcmp(argv[1], "-f") != 0))
+    {
+        fprintf(out, COMPGEN_USAGE);
+        return 1;
+    }
+
+    comp_list_t list = {0};
+    const char *word = argc == 3 ? argv[2] : "";
+    int num = argv[1][1] == 'c' ? cmd_trie_complete(word, true, &list) : complete_path(word, &list);
+    if (num < 0)
+    {
+        fprintf(out, CMD_ERR_MEMORY);
+    }
+    for (int i = 0; i < num; i++)
+    {
+        fprintf(out, "%s\n", list.items[i]);
+    }
+    comp_list_clear(&list);
+    return num > 0 ? 0 : 1;
+}
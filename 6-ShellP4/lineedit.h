@@ -0,0 +1,38 @@
+#ifndef __LINEEDIT_H__
+#define __LINEEDIT_H__
+
+#include <stddef.h>
+#include <stdio.h>
+
+#include "cmdtrie.h"
+
+// When dsh reads from a terminal, lines are read with the terminal in raw
+// mode so they can be edited: the arrows, Home and End move in the line,
+// Backspace and Delete remove a character, ^A ^E ^B ^F ^U ^K ^W work like
+// they do in bash, ^C drops the line and ^D on an empty line exits.  Tab
+// completes the word under the cursor: the first word of a command from
+// the command trie (see cmdtrie.h), anything else as a path.  When a word
+// has several completions their common prefix is filled in, and if that
+// adds nothing they are listed below the line.
+#define COMPGEN_CMD "compgen"
+
+// at most this many completions are listed
+#define LINE_EDIT_LIST_MAX 200
+
+// control keys
+#define KEY_CTRL(c) ((c) & 0x1f)
+#define KEY_TAB 9
+#define KEY_ENTER 13
+#define KEY_ESC 27
+#define KEY_BACKSPACE 127
+
+// output constants for the line editor and compgen
+#define LINE_EDIT_MORE "... and %d more\n"
+#define COMPGEN_USAGE "usage: compgen -c | -f [word]\n"
+
+// prototypes for the line editor, see lineedit.c
+int line_edit_read(const char *prompt, char **buff, size_t *cap);
+int complete_path(const char *word, comp_list_t *out);
+int compgen_cmd(int argc, char *argv[], FILE *out);
+
+#endif
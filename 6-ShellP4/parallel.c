@@ -0,0 +1,486 @@
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/sendfile.h>
+#include <sys/wait.h>
+
+#include "parallel.h"
+#include "jobs.h"
+
+// copies word into out with every {} replaced by arg, or when out is NULL
+// only counts.  returns the bytes needed, 0 if word has no {}
+static size_t replace_word(const char *word, const char *arg, size_t argLen, char *out)
+{
+    const char *brace = strstr(word, PARALLEL_ARG);
+    if (brace == NULL)
+    {
+        return 0;
+    }
+
+    size_t len = 0;
+    while (brace != NULL)
+    {
+        size_t head = brace - word;
+        if (out != NULL)
+        {
+            memcpy(out + len, word, head);
+            memcpy(out + len + head, arg, argLen);
+        }
+        len += head + argLen;
+        word = brace + strlen(PARALLEL_ARG);
+        brace = strstr(word, PARALLEL_ARG);
+    }
+
+    size_t tail = strlen(word);
+    if (out != NULL)
+    {
+        memcpy(out + len, word, tail + 1);
+    }
+    return len + tail + 1;
+}
+
+// replaces every word and file name of the commands that has a {}, writing
+// the new words into buff, or only counting when buff is NULL.  returns the
+// bytes needed, 0 if the template has no {}
+static size_t replace_all(command_list_t *clist, const char *arg, size_t argLen, char *buff)
+{
+    size_t used = 0;
+    for (int i = 0; i < clist->num; i++)
+    {
+        cmd_buff_t *cmd = &clist->commands[i];
+        char **words[cmd->argc + 2];
+        int n = 0;
+        for (int a = 0; a < cmd->argc; a++)
+        {
+            words[n++] = &cmd->argv[a];
+        }
+        if (cmd->input_file != NULL)
+        {
+            words[n++] = &cmd->input_file;
+        }
+        if (cmd->output_file != NULL)
+        {
+            words[n++] = &cmd->output_file;
+        }
+
+        for (int w = 0; w < n; w++)
+        {
+            size_t len = replace_word(*words[w], arg, argLen, buff != NULL ? buff + used : NULL);
+            if (len > 0 && buff != NULL)
+            {
+                *words[w] = buff + used;
+            }
+            used += len;
+        }
+    }
+    return used;
+}
+
+// parses the template into the slot's command list and puts the line in
+static int fill_template(par_job_t *job, char *templateLine, const char *arg)
+{
+    clear_cmd_list(job->clist);
+    int rc = build_cmd_list(templateLine, job->clist);
+    if (rc != OK)
+    {
+        return rc;
+    }
+
+    size_t argLen = strlen(arg);
+    size_t need = replace_all(job->clist, arg, argLen, NULL);
+    char *words = realloc(job->words, need > 0 ? need : argLen + 1);
+    if (words == NULL)
+    {
+        return ERR_MEMORY;
+    }
+    job->words = words;
+
+    if (need > 0)
+    {
+        replace_all(job->clist, arg, argLen, words);
+        return OK;
+    }
+
+    // no {}, the line is the last argument of the last command
+    cmd_buff_t *last = &job->clist->commands[job->clist->num - 1];
+    memcpy(words, arg, argLen + 1);
+    if (add_token(last, words, argLen) != OK)
+    {
+        return ERR_MEMORY;
+    }
+    last->argv[last->argc] = NULL;
+    return OK;
+}
+
+// starts the job for arg in a free slot, through the same launch path as
+// any other pipeline.  returns OK, or an error if the job could not start
+static int start_job(par_job_t *job, char *templateLine, char *arg, int seq)
+{
+    job->seq = seq;
+    job->arg = arg;
+    job->status = 0;
+    job->live = 0;
+    job->num = 0;
+    job->out = -1;
+    job->busy = true;
+
+    int rc = fill_template(job, templateLine, arg);
+    if (rc == OK)
+    {
+        job->out = memfd_create("parallel", MFD_CLOEXEC);
+        job->pids = malloc(job->clist->num * sizeof(pid_t));
+        job->pidfds = malloc(job->clist->num * sizeof(int));
+        if (job->out < 0 || job->pids == NULL || job->pidfds == NULL)
+        {
+            rc = ERR_MEMORY;
+        }
+    }
+    if (rc != OK)
+    {
+        job->status = EXIT_FAILURE;
+        return rc;
+    }
+
+    // jobs run like background pipelines, so they don't read the lines
+    // meant for parallel and even built ins get their own process
+    job->clist->background = true;
+    job->clist->out_fd = job->out;
+    job->num = job->clist->num;
+
+    int spawnRc;
+    rc = launch_pipeline(job->clist, job->pids, &spawnRc);
+    job->status = rc < 0 ? EXIT_FAILURE : spawnRc;
+    for (int k = 0; k < job->num; k++)
+    {
+        job->pidfds[k] = -1;
+        if (job->pids[k] != -1)
+        {
+            job->pidfds[k] = jobs_open_pidfd(job->pids[k]);
+            job->live++;
+        }
+    }
+    return rc;
+}
+
+static void reap_stage(par_job_t *job, int k, bool block)
+{
+    int status;
+    pid_t rc = waitpid(job->pids[k], &status, block ? 0 : WNOHANG);
+    if (rc == 0 || (rc < 0 && errno == EINTR))
+    {
+        return;
+    }
+
+    if (rc > 0 && k == job->num - 1)
+    {
+        if (WIFEXITED(status))
+            job->status = WEXITSTATUS(status);
+        else if (WIFSIGNALED(status))
+            job->status = 128 + WTERMSIG(status);
+    }
+    if (job->pidfds[k] >= 0)
+    {
+        close(job->pidfds[k]);
+    }
+    job->pids[k] = -1;
+    job->pidfds[k] = -1;
+    job->live--;
+}
+
+// blocks until at least one busy slot has no processes left, poll() on the
+// pidfds of every running stage does the waiting.  returns that slot
+static int wait_any(par_job_t *slots, int numSlots)
+{
+    int totalLive = 0;
+    for (int s = 0; s < numSlots; s++)
+    {
+        totalLive += slots[s].busy ? slots[s].live : 0;
+    }
+    struct pollfd fds[totalLive > 0 ? totalLive : 1];
+    int who[totalLive > 0 ? totalLive : 1][2];
+
+    while (1)
+    {
+        int n = 0;
+        for (int s = 0; s < numSlots; s++)
+        {
+            if (!slots[s].busy)
+            {
+                continue;
+            }
+            if (slots[s].live == 0)
+            {
+                return s;
+            }
+            for (int k = 0; k < slots[s].num; k++)
+            {
+                if (slots[s].pids[k] == -1)
+                {
+                    continue;
+                }
+                // without a pidfd all there is to do is waitpid()
+                if (slots[s].pidfds[k] < 0)
+                {
+                    reap_stage(&slots[s], k, true);
+                    continue;
+                }
+                fds[n].fd = slots[s].pidfds[k];
+                fds[n].events = POLLIN;
+                fds[n].revents = 0;
+                who[n][0] = s;
+                who[n][1] = k;
+                n++;
+            }
+        }
+
+        if (n == 0)
+        {
+            continue;
+        }
+        if (poll(fds, n, -1) < 0 && errno != EINTR)
+        {
+            return -1;
+        }
+        for (int i = 0; i < n; i++)
+        {
+            if (fds[i].revents != 0)
+            {
+                reap_stage(&slots[who[i][0]], who[i][1], false);
+            }
+        }
+    }
+}
+
+// writes the job's output in one piece, then reports its status if it
+// failed.  returns true if the job failed
+static bool finish_job(par_job_t *job)
+{
+    if (job->out >= 0)
+    {
+        off_t size = lseek(job->out, 0, SEEK_END);
+        off_t off = 0;
+        bool copy = false; // sendfile() can't write to an O_APPEND file
+        while (off < size)
+        {
+            ssize_t n;
+            if (!copy)
+            {
+                n = sendfile(STDOUT_FILENO, job->out, &off, size - off);
+                if (n < 0 && errno == EINVAL)
+                {
+                    copy = true;
+                    continue;
+                }
+            }
+            else
+            {
+                char buff[PARALLEL_COPY_BUFF_SZ];
+                n = pread(job->out, buff, sizeof(buff), off);
+                if (n > 0)
+                {
+                    n = write(STDOUT_FILENO, buff, n);
+                    off += n > 0 ? n : 0;
+                }
+            }
+            if (n <= 0 && errno != EINTR)
+            {
+                break;
+            }
+        }
+        close(job->out);
+    }
+
+    bool failed = job->status != 0;
+    if (failed)
+    {
+        fprintf(stderr, PARALLEL_JOB_FAILED, job->seq, job->arg, job->status);
+    }
+
+    free(job->arg);
+    free(job->pids);
+    free(job->pidfds);
+    job->arg = NULL;
+    job->pids = NULL;
+    job->pidfds = NULL;
+    job->busy = false;
+    return failed;
+}
+
+// the template is every word after the options.  A single word is parsed
+// as a whole pipeline, so "grep x {} | wc -l" works.  Several words are
+// quoted so each one stays a single word when the line is parsed again
+static char *join_template(int argc, char *argv[])
+{
+    if (argc == 1)
+    {
+        return strdup(argv[0]);
+    }
+
+    size_t len = 1;
+    for (int i = 0; i < argc; i++)
+    {
+        len += strlen(argv[i]) + 3;
+    }
+
+    char *line = malloc(len);
+    if (line == NULL)
+    {
+        return NULL;
+    }
+    char *p = line;
+    for (int i = 0; i < argc; i++)
+    {
+        // a word with both kinds of quotes can't be quoted, it goes as is
+        char quote = strchr(argv[i], '\"') == NULL ? '\"' : '\'';
+        if (strchr(argv[i], quote) != NULL)
+        {
+            quote = ' ';
+        }
+        p += sprintf(p, "%s%c%s%c", i > 0 ? " " : "", quote, argv[i], quote);
+    }
+    return line;
+}
+
+/*
+ *  parallel_cmd
+ *      cmd:  the parallel command, its < file is read instead of stdin
+ *
+ *  Runs the template once per input line with up to N jobs at a time (the
+ *  number of CPUs by default).  A new job is started as soon as one
+ *  finishes.  Output is written a job at a time in the order the jobs
+ *  finish, and each failed job is reported on stderr with its status.
+ *
+ *  returns:  the number of failed jobs, up to PARALLEL_MAX_FAILED_SC, or
+ *            PARALLEL_USAGE_SC if the options or the template are bad
+ */
+int parallel_cmd(cmd_buff_t *cmd)
+{
+    int argc = cmd->argc;
+    char **argv = cmd->argv;
+    long numSlots = sysconf(_SC_NPROCESSORS_ONLN);
+    int i = 1;
+
+    if (i < argc && strcmp(argv[i], "-j") == 0 && i + 1 < argc)
+    {
+        numSlots = atol(argv[i + 1]);
+        i += 2;
+    }
+    else if (i < argc && strncmp(argv[i], "-j", 2) == 0)
+    {
+        numSlots = atol(argv[i] + 2);
+        i++;
+    }
+    if (numSlots <= 0 || i == argc)
+    {
+        fprintf(stderr, PARALLEL_USAGE);
+        return PARALLEL_USAGE_SC;
+    }
+
+    FILE *in = stdin;
+    if (cmd->input_file != NULL)
+    {
+        in = fopen(cmd->input_file, "r");
+        if (in == NULL)
+        {
+            fprintf(stderr, PARALLEL_ERR_INPUT, cmd->input_file);
+            return PARALLEL_USAGE_SC;
+        }
+    }
+
+    char *templateLine = join_template(argc - i, argv + i);
+    par_job_t *slots = calloc(numSlots, sizeof(par_job_t));
+    int rc = (templateLine != NULL && slots != NULL) ? OK : ERR_MEMORY;
+    for (int s = 0; s < numSlots && rc == OK; s++)
+    {
+        rc = alloc_cmd_list(&slots[s].clist);
+    }
+
+    // parse it once up front so a bad template is reported only once
+    if (rc == OK)
+    {
+        rc = fill_template(&slots[0], templateLine, "");
+    }
+
+    int failed = 0;
+    int seq = 0;
+    int running = 0;
+    char *line = NULL;
+    size_t lineCap = 0;
+    bool eof = (rc != OK);
+
+    // anything the shell has buffered goes out before the first job's output
+    fflush(stdout);
+    while (!eof || running > 0)
+    {
+        // fill every free slot, then wait for one to finish
+        for (int s = 0; s < numSlots && !eof; s++)
+        {
+            if (slots[s].busy)
+            {
+                continue;
+            }
+
+            ssize_t len = getline(&line, &lineCap, in);
+            if (len < 0)
+            {
+                eof = true;
+                break;
+            }
+            if (len > 0 && line[len - 1] == '\n')
+            {
+                line[len - 1] = '\0';
+            }
+
+            char *arg = strdup(line);
+            if (arg == NULL)
+            {
+                eof = true;
+                break;
+            }
+            // a job that could not start is finished with a failed status
+            running++;
+            start_job(&slots[s], templateLine, arg, ++seq);
+        }
+
+        if (running == 0)
+        {
+            break;
+        }
+
+        int done = wait_any(slots, numSlots);
+        if (done < 0)
+        {
+            break;
+        }
+        failed += finish_job(&slots[done]);
+        running--;
+    }
+
+    free(line);
+    if (in != stdin)
+    {
+        fclose(in);
+    }
+    for (int s = 0; slots != NULL && s < numSlots; s++)
+    {
+        if (slots[s].clist != NULL)
+        {
+            free_cmd_list(slots[s].clist);
+        }
+        free(slots[s].words);
+    }
+    free(slots);
+    free(templateLine);
+
+    if (rc != OK)
+    {
+        return PARALLEL_USAGE_SC;
+    }
+    return failed < PARALLEL_MAX_FAILED_SC ? failed : PARALLEL_MAX_FAILED_SC;
+}
@@ -0,0 +1,53 @@
+#ifndef __PARALLEL_H__
+#define __PARALLEL_H__
+
+#include <stdbool.h>
+#include <sys/types.h>
+
+#include "dshlib.h"
+
+// parallel [-j N] command ...
+//
+// Reads argument lines from stdin and runs the command once per line, with
+// at most N of them running at a time, like xargs -P or GNU parallel but
+// without the extra process.  A command given as one quoted word is parsed
+// as a pipeline, so it can have pipes and redirections.  Every {} in the
+// words or file names is replaced by the line.  Without a {} the line is added as the
+// last argument.  Each job writes into its own memfd, which is copied to the
+// output as a whole once the job is done, so the output of one job is never
+// mixed with another's.
+#define PARALLEL_CMD "parallel"
+#define PARALLEL_ARG "{}"
+
+// exit statuses, like GNU parallel: the number of failed jobs up to 100,
+// then 101, or 255 for a usage error
+#define PARALLEL_MAX_FAILED_SC 101
+#define PARALLEL_USAGE_SC 255
+
+// chunk size when a job's output can't be sent with sendfile()
+#define PARALLEL_COPY_BUFF_SZ 65536
+
+typedef struct par_job
+{
+    bool busy;              // this slot is running a job
+    int seq;                // job number, in the order the lines were read
+    char *arg;              // the line the job was started for
+    command_list_t *clist;  // the template with {} replaced, reused by the slot
+    char *words;            // the replaced words, argv[] points into it
+    pid_t *pids;            // one per stage, -1 once reaped
+    int *pidfds;            // -1 if there is no pidfd for the process
+    int num;                // stages in pids and pidfds
+    int live;               // processes not reaped yet
+    int status;             // exit status of the last stage
+    int out;                // memfd collecting the job's output
+} par_job_t;
+
+// output constants for parallel
+#define PARALLEL_USAGE "usage: parallel [-j N] command [arg ...]\n"
+#define PARALLEL_JOB_FAILED "parallel: job %d (%s) exited with %d\n"
+#define PARALLEL_ERR_INPUT "parallel: can't read %s\n"
+
+// prototypes for parallel, see parallel.c
+int parallel_cmd(cmd_buff_t *cmd);
+
+#endif
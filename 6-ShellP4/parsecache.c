@@ -0,0 +1,320 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#include "parsecache.h"
+
+static pthread_mutex_t cache_lock = PTHREAD_MUTEX_INITIALIZER;
+static parse_cache_entry_t *buckets[PARSE_CACHE_SLOTS];
+static parse_cache_entry_t *newest = NULL;
+static parse_cache_entry_t *oldest = NULL;
+static int num_entries = 0;
+static size_t num_bytes = 0;
+
+static _Atomic bool cache_on = true;
+static unsigned long hits = 0;
+static unsigned long misses = 0;
+static unsigned long skipped = 0;
+static unsigned long evicted = 0;
+
+bool parse_cache_enabled(void)
+{
+    return atomic_load_explicit(&cache_on, memory_order_relaxed);
+}
+
+/*
+ *  parse_cache_hash
+ *
+ *  Hashes 8 bytes at a time, a long line costs about as much to hash as to
+ *  memcmp().  Each word is multiplied in and folded with a shift, which
+ *  spreads its bits over the whole hash.
+ */
+uint64_t parse_cache_hash(const char *line, size_t len)
+{
+    const uint64_t k = 0x9e3779b97f4a7c15ull;
+    uint64_t h = len * k;
+    size_t i = 0;
+    for (; i + 8 <= len; i += 8)
+    {
+        uint64_t w;
+        memcpy(&w, line + i, 8);
+        h = (h ^ w) * k;
+        h ^= h >> 29;
+    }
+    uint64_t tail = 0;
+    memcpy(&tail, line + i, len - i);
+    h = (h ^ tail) * k;
+    return h ^ (h >> 32);
+}
+
+static void unlink_lru(parse_cache_entry_t *e)
+{
+    if (e->newer != NULL)
+        e->newer->older = e->older;
+    else
+        newest = e->older;
+    if (e->older != NULL)
+        e->older->newer = e->newer;
+    else
+        oldest = e->newer;
+}
+
+static void push_newest(parse_cache_entry_t *e)
+{
+    e->newer = NULL;
+    e->older = newest;
+    if (newest != NULL)
+        newest->newer = e;
+    else
+        oldest = e;
+    newest = e;
+}
+
+// takes the entry out of the table and frees it, with the lock held
+static void drop(parse_cache_entry_t *e)
+{
+    parse_cache_entry_t **p = &buckets[e->hash & (PARSE_CACHE_SLOTS - 1)];
+    while (*p != e)
+    {
+        p = &(*p)->next;
+    }
+    *p = e->next;
+    unlink_lru(e);
+    num_entries--;
+    num_bytes -= e->size;
+    free(e);
+}
+
+// copies what the line parsed to into the list, which has just been cleared
+static int restore(const parse_cache_entry_t *e, command_list_t *clist)
+{
+    if (arena_reserve(&clist->arena, e->dataLen) != OK)
+    {
+        return ERR_MEMORY;
+    }
+    char *base = arena_alloc(&clist->arena, e->dataLen);
+    memcpy(base, e->data, e->dataLen);
+
+    const int *p = e->cmds;
+    for (int i = 0; i < e->num; i++)
+    {
+        if (clist->num >= clist->cap && grow_cmd_list(clist) != OK)
+        {
+            return ERR_MEMORY;
+        }
+        cmd_buff_t *cmd = &clist->commands[clist->num];
+        clear_cmd_buff(cmd);
+
+        int argc = p[0];
+        cmd->input_file = p[1] >= 0 ? base + p[1] : NULL;
+        cmd->output_file = p[2] >= 0 ? base + p[2] : NULL;
+        cmd->append_mode = p[3];
+        p += 4;
+        for (int a = 0; a < argc; a++)
+        {
+            if (add_token(cmd, base + *p++, 0) != OK)
+            {
+                return ERR_MEMORY;
+            }
+        }
+        cmd->argv[cmd->argc] = NULL;
+        clist->num++;
+    }
+    clist->background = e->background;
+    return OK;
+}
+
+/*
+ *  parse_cache_lookup
+ *      line, len:  the line as typed
+ *      hash:       parse_cache_hash() of it
+ *      clist:      a cleared list that gets what the line parsed to
+ *
+ *  returns:  OK if the line was found and copied into clist, -1 if it has
+ *            to be parsed
+ */
+int parse_cache_lookup(const char *line, size_t len, uint64_t hash, command_list_t *clist)
+{
+    pthread_mutex_lock(&cache_lock);
+    parse_cache_entry_t *e = buckets[hash & (PARSE_CACHE_SLOTS - 1)];
+    while (e != NULL && (e->hash != hash || e->lineLen != len || memcmp(e->line, line, len) != 0))
+    {
+        e = e->next;
+    }
+
+    int rc = -1;
+    if (e == NULL)
+    {
+        misses++;
+    }
+    else if (restore(e, clist) == OK)
+    {
+        hits++;
+        unlink_lru(e);
+        push_newest(e);
+        rc = OK;
+    }
+    else
+    {
+        // the list may be half filled, it is cleared and parsed instead
+        clear_cmd_list(clist);
+    }
+    pthread_mutex_unlock(&cache_lock);
+    return rc;
+}
+
+// offset of p in the arena bytes, or -1 for no string
+static int offset_of(const char *p, const char *base)
+{
+    return p != NULL ? (int)(p - base) : -1;
+}
+
+/*
+ *  parse_cache_store
+ *      line, len:  the line as typed
+ *      hash:       parse_cache_hash() of it
+ *      clist:      what it parsed to, every string in the list's arena
+ *
+ *  Remembers the line unless it alone is over PARSE_CACHE_BYTES, dropping
+ *  the least recently used lines to make room.  Without memory for it the
+ *  line just isn't stored.
+ */
+void parse_cache_store(const char *line, size_t len, uint64_t hash, command_list_t *clist)
+{
+    size_t numInts = 0;
+    for (int i = 0; i < clist->num; i++)
+    {
+        numInts += 4 + clist->commands[i].argc;
+    }
+    size_t dataLen = clist->arena.used;
+    size_t size = sizeof(parse_cache_entry_t) + numInts * sizeof(int) + len + 1 + dataLen;
+    if (size > PARSE_CACHE_BYTES)
+    {
+        return;
+    }
+
+    parse_cache_entry_t *e = malloc(size);
+    if (e == NULL)
+    {
+        return;
+    }
+    e->hash = hash;
+    e->size = size;
+    e->lineLen = len;
+    e->dataLen = dataLen;
+    e->num = clist->num;
+    e->background = clist->background;
+    e->cmds = (int *)(e + 1);
+    e->line = (char *)(e->cmds + numInts);
+    e->data = e->line + len + 1;
+    memcpy(e->line, line, len + 1);
+    memcpy(e->data, clist->arena.base, dataLen);
+
+    const char *base = clist->arena.base;
+    int *p = e->cmds;
+    for (int i = 0; i < clist->num; i++)
+    {
+        cmd_buff_t *cmd = &clist->commands[i];
+        *p++ = cmd->argc;
+        *p++ = offset_of(cmd->input_file, base);
+        *p++ = offset_of(cmd->output_file, base);
+        *p++ = cmd->append_mode;
+        for (int a = 0; a < cmd->argc; a++)
+        {
+            *p++ = offset_of(cmd->argv[a], base);
+        }
+    }
+
+    pthread_mutex_lock(&cache_lock);
+    // another thread may have stored the same line since it missed
+    parse_cache_entry_t *old = buckets[hash & (PARSE_CACHE_SLOTS - 1)];
+    while (old != NULL && (old->hash != hash || old->lineLen != len || memcmp(old->line, line, len) != 0))
+    {
+        old = old->next;
+    }
+    if (old != NULL)
+    {
+        drop(old);
+    }
+
+    while (oldest != NULL && (num_entries >= PARSE_CACHE_MAX || num_bytes + size > PARSE_CACHE_BYTES))
+    {
+        drop(oldest);
+        evicted++;
+    }
+    e->next = buckets[hash & (PARSE_CACHE_SLOTS - 1)];
+    buckets[hash & (PARSE_CACHE_SLOTS - 1)] = e;
+    push_newest(e);
+    num_entries++;
+    num_bytes += size;
+    pthread_mutex_unlock(&cache_lock);
+}
+
+// counts a line that parsed but can't be stored, like one with a glob
+void parse_cache_skip(void)
+{
+    pthread_mutex_lock(&cache_lock);
+    skipped++;
+    pthread_mutex_unlock(&cache_lock);
+}
+
+// drops every line, with the lock held
+static void drop_all(void)
+{
+    while (oldest != NULL)
+    {
+        drop(oldest);
+    }
+}
+
+/*
+ *  parse_cache_cmd
+ *
+ *  parsecache            prints how many lines are cached and the hit rate
+ *  parsecache on | off   turns the cache on or off, off also empties it
+ *  parsecache clear      empties it and zeroes the counts
+ */
+int parse_cache_cmd(int argc, char *argv[], FILE *out)
+{
+    if (argc == 1)
+    {
+        pthread_mutex_lock(&cache_lock);
+        unsigned long lookups = hits + misses;
+        fprintf(out, PARSE_CACHE_STATUS, parse_cache_enabled() ? "on" : "off", num_entries, num_bytes);
+        fprintf(out, PARSE_CACHE_STATS, hits, misses, skipped, evicted, lookups > 0 ? 100.0 * hits / lookups : 0.0);
+        pthread_mutex_unlock(&cache_lock);
+        return 0;
+    }
+
+    if (argc == 2 && (strcmp(argv[1], "on") == 0 || strcmp(argv[1], "off") == 0 || strcmp(argv[1], "clear") == 0))
+    {
+        pthread_mutex_lock(&cache_lock);
+        if (strcmp(argv[1], "clear") == 0)
+        {
+            hits = misses = skipped = evicted = 0;
+        }
+        else
+        {
+            atomic_store(&cache_on, strcmp(argv[1], "on") == 0);
+        }
+        if (strcmp(argv[1], "on") != 0)
+        {
+            drop_all();
+        }
+        pthread_mutex_unlock(&cache_lock);
+        return 0;
+    }
+
+    fprintf(out, PARSE_CACHE_USAGE);
+    return 1;
+}
+
+void parse_cache_free(void)
+{
+    pthread_mutex_lock(&cache_lock);
+    drop_all();
+    pthread_mutex_unlock(&cache_lock);
+}
@@ -0,0 +1,61 @@
+#ifndef __PARSECACHE_H__
+#define __PARSECACHE_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "dshlib.h"
+
+// Scripts and rsh clients send the same lines over and over, so
+// build_cmd_list() remembers what each line parsed to.  An entry keeps the
+// line, the bytes the parser wrote into the arena, and for each command
+// where its words and redirections start in those bytes.  A line seen
+// again is copied into the list's arena with one memcpy() and argv[] is
+// pointed back into it, instead of being lexed again.
+//
+// Lines whose words were glob expanded are never stored, what they expand
+// to depends on the files there are when they run.  Lines that failed to
+// parse aren't either, so their error is printed every time.  The least
+// recently used lines are dropped once there are PARSE_CACHE_MAX of them or
+// they take more than PARSE_CACHE_BYTES.  Every shell thread shares the
+// cache, behind a mutex.
+#define PARSE_CACHE_CMD "parsecache"
+
+// buckets of the table, a power of two
+#define PARSE_CACHE_SLOTS 1024
+#define PARSE_CACHE_MAX 512
+#define PARSE_CACHE_BYTES (4 * 1024 * 1024)
+
+typedef struct parse_cache_entry
+{
+    struct parse_cache_entry *next;  // in the same bucket
+    struct parse_cache_entry *newer; // the lines used after this one
+    struct parse_cache_entry *older;
+    uint64_t hash;
+    size_t size;    // bytes the entry takes
+    size_t lineLen;
+    size_t dataLen; // arena bytes
+    int num;        // commands in the line
+    bool background;
+    char *line;     // the rest point into the same allocation
+    char *data;
+    int *cmds; // argc, input, output, append and then argc offsets each
+} parse_cache_entry_t;
+
+// output constants for parsecache
+#define PARSE_CACHE_STATUS "parsecache: %s, %d lines, %zu bytes\n"
+#define PARSE_CACHE_STATS "parsecache: %lu hits, %lu misses, %lu not cacheable, %lu evicted, %.1f%% hit rate\n"
+#define PARSE_CACHE_USAGE "usage: parsecache [on | off | clear]\n"
+
+// prototypes for the parse cache, see parsecache.c
+bool parse_cache_enabled(void);
+uint64_t parse_cache_hash(const char *line, size_t len);
+int parse_cache_lookup(const char *line, size_t len, uint64_t hash, command_list_t *clist);
+void parse_cache_store(const char *line, size_t len, uint64_t hash, command_list_t *clist);
+void parse_cache_skip(void);
+int parse_cache_cmd(int argc, char *argv[], FILE *out);
+void parse_cache_free(void);
+
+#endif
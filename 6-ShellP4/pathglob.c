@@ -0,0 +1,693 @@
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+#include "pathglob.h"
+
+// what getdents64() fills its buffer with
+typedef struct dirent64_rec
+{
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+} dirent64_rec_t;
+
+// one component of the pattern, between slashes
+typedef struct glob_comp
+{
+    bool literal;  // no *, ? or [, text is the name
+    bool globstar; // the component is **
+    bool dotOk;    // starts with a literal ., so hidden names can match
+    char *text;    // the component with its escapes removed
+    glob_op_t *ops;
+    int numOps;
+} glob_comp_t;
+
+typedef struct glob_ctx
+{
+    glob_comp_t *comps;
+    int numComps;
+    bool dirOnly;            // the pattern ends in /, only directories match
+    char path[PATH_MAX];     // the path walked so far
+    char *dents;             // getdents64() buffer
+    path_glob_chunk_t **mem; // where matched paths are stored
+    path_glob_chunk_t *cur;  // first chunk that may have room
+    path_glob_list_t *out;
+    bool failed; // out of memory
+} glob_ctx_t;
+
+// the word from src to end as a pattern: quotes are removed like
+// lex_word() does and what they quoted is escaped with a backslash so it
+// only matches itself.  Returns a malloc'd string or NULL
+static char *make_pattern(const char *src, const char *end)
+{
+    char *pat = malloc(2 * (end - src) + 1);
+    if (pat == NULL)
+    {
+        return NULL;
+    }
+
+    char *o = pat;
+    char quote = '\0';
+    for (const char *s = src; s < end; s++)
+    {
+        if (quote == '\0' && (*s == '\"' || *s == '\''))
+        {
+            quote = *s;
+            continue;
+        }
+        if (*s == quote)
+        {
+            quote = '\0';
+            continue;
+        }
+        if (*s == '\\' || (quote != '\0' && (*s == '*' || *s == '?' || *s == '[')))
+        {
+            *o++ = '\\';
+        }
+        *o++ = *s;
+    }
+    *o = '\0';
+    return pat;
+}
+
+static void set_bit(uint8_t *set, unsigned char c)
+{
+    set[c >> 3] |= 1 << (c & 7);
+}
+
+// parses the [...] at p[i], returns the index of its ] or -1 if it isn't
+// closed, then the [ is just a character
+static int compile_set(const char *p, int i, int n, glob_op_t *op)
+{
+    int j = i + 1;
+    bool negate = j < n && (p[j] == '!' || p[j] == '^');
+    j += negate;
+
+    memset(op->set, 0, sizeof(op->set));
+    for (bool first = true; j < n && (p[j] != ']' || first); j++, first = false)
+    {
+        unsigned char lo = p[j];
+        if (lo == '\\' && j + 1 < n)
+        {
+            lo = p[++j];
+        }
+        unsigned char hi = lo;
+        if (j + 2 < n && p[j + 1] == '-' && p[j + 2] != ']')
+        {
+            hi = p[j + 2];
+            j += 2;
+        }
+        for (int c = lo; c <= hi; c++)
+        {
+            set_bit(op->set, c);
+        }
+    }
+    if (j >= n)
+    {
+        return -1;
+    }
+
+    if (negate)
+    {
+        for (int b = 0; b < 32; b++)
+        {
+            op->set[b] = ~op->set[b];
+        }
+    }
+    op->kind = GLOB_OP_SET;
+    return j;
+}
+
+// compiles the n characters of one component, returns -1 without memory
+static int compile_comp(const char *p, int n, glob_comp_t *c)
+{
+    c->ops = malloc((n + 1) * sizeof(glob_op_t));
+    c->text = malloc(n + 1);
+    if (c->ops == NULL || c->text == NULL)
+    {
+        return -1;
+    }
+
+    int len = 0;
+    c->numOps = 0;
+    c->literal = true;
+    for (int i = 0; i < n; i++)
+    {
+        glob_op_t *op = &c->ops[c->numOps];
+        if (p[i] == '*')
+        {
+            // a run of * is one *
+            if (c->numOps == 0 || op[-1].kind != GLOB_OP_STAR)
+            {
+                op->kind = GLOB_OP_STAR;
+                c->numOps++;
+            }
+            c->literal = false;
+            c->text[len++] = '*';
+            continue;
+        }
+        if (p[i] == '?')
+        {
+            op->kind = GLOB_OP_ANY;
+            c->numOps++;
+            c->literal = false;
+            c->text[len++] = '?';
+            continue;
+        }
+        if (p[i] == '[')
+        {
+            int close = compile_set(p, i, n, op);
+            if (close > 0)
+            {
+                c->numOps++;
+                c->literal = false;
+                i = close;
+                continue;
+            }
+        }
+        if (p[i] == '\\' && i + 1 < n)
+        {
+            i++;
+        }
+        op->kind = GLOB_OP_CHAR;
+        op->ch = p[i];
+        c->numOps++;
+        c->text[len++] = p[i];
+    }
+    c->text[len] = '\0';
+
+    c->globstar = !c->literal && n == 2 && memcmp(p, PATH_GLOB_GLOBSTAR, 2) == 0;
+    c->dotOk = c->numOps > 0 && c->ops[0].kind == GLOB_OP_CHAR && c->ops[0].ch == '.';
+    return 0;
+}
+
+static bool op_matches(const glob_op_t *op, unsigned char c)
+{
+    switch (op->kind)
+    {
+    case GLOB_OP_CHAR:
+        return op->ch == c;
+    case GLOB_OP_ANY:
+        return true;
+    case GLOB_OP_SET:
+        return (op->set[c >> 3] >> (c & 7)) & 1;
+    default:
+        return false;
+    }
+}
+
+// runs name through the ops.  A * remembers where it started, and a
+// mismatch later goes back to let it take one more character, so this
+// never backtracks further than the last *
+static bool comp_matches(const glob_comp_t *c, const char *name)
+{
+    if (name[0] == '.' && !c->dotOk)
+    {
+        return false;
+    }
+
+    int o = 0;
+    int starOp = -1;
+    const char *starName = NULL;
+    const char *s = name;
+    while (*s != '\0')
+    {
+        if (o < c->numOps && c->ops[o].kind == GLOB_OP_STAR)
+        {
+            starOp = ++o;
+            starName = s;
+            continue;
+        }
+        if (o < c->numOps && op_matches(&c->ops[o], *s))
+        {
+            o++;
+            s++;
+            continue;
+        }
+        if (starOp < 0)
+        {
+            return false;
+        }
+        o = starOp;
+        s = ++starName;
+    }
+    while (o < c->numOps && c->ops[o].kind == GLOB_OP_STAR)
+    {
+        o++;
+    }
+    return o == c->numOps;
+}
+
+// appends name to the path, returns the new length or 0 if it is too long
+static size_t join(glob_ctx_t *ctx, size_t len, const char *name)
+{
+    size_t nameLen = strlen(name);
+    bool slash = len > 0 && ctx->path[len - 1] != '/';
+    if (len + slash + nameLen + 2 > sizeof(ctx->path))
+    {
+        return 0;
+    }
+    if (slash)
+    {
+        ctx->path[len++] = '/';
+    }
+    memcpy(ctx->path + len, name, nameLen + 1);
+    return len + nameLen;
+}
+
+// for the last component of a pattern ending in /, which follows links
+static bool is_dir(glob_ctx_t *ctx, unsigned char type)
+{
+    struct stat st;
+    if (type == DT_DIR)
+    {
+        return true;
+    }
+    if (type != DT_UNKNOWN && type != DT_LNK)
+    {
+        return false;
+    }
+    return stat(ctx->path, &st) == 0 && S_ISDIR(st.st_mode);
+}
+
+// for **, which never walks through a link so it can't loop
+static bool is_dir_no_follow(glob_ctx_t *ctx, unsigned char type)
+{
+    struct stat st;
+    if (type != DT_UNKNOWN)
+    {
+        return type == DT_DIR;
+    }
+    return lstat(ctx->path, &st) == 0 && S_ISDIR(st.st_mode);
+}
+
+// copies the path of length len into the chunks and adds it to the matches
+static void add_match(glob_ctx_t *ctx, size_t len)
+{
+    if (ctx->dirOnly)
+    {
+        ctx->path[len++] = '/';
+        ctx->path[len] = '\0';
+    }
+
+    while (ctx->cur != NULL && ctx->cur->used + len + 1 > ctx->cur->cap)
+    {
+        if (ctx->cur->next == NULL)
+        {
+            break;
+        }
+        ctx->cur = ctx->cur->next;
+    }
+    if (ctx->cur == NULL || ctx->cur->used + len + 1 > ctx->cur->cap)
+    {
+        size_t cap = len + 1 > PATH_GLOB_CHUNK_SZ ? len + 1 : PATH_GLOB_CHUNK_SZ;
+        path_glob_chunk_t *chunk = malloc(sizeof(path_glob_chunk_t) + cap);
+        if (chunk == NULL)
+        {
+            ctx->failed = true;
+            return;
+        }
+        chunk->next = NULL;
+        chunk->used = 0;
+        chunk->cap = cap;
+        if (ctx->cur == NULL)
+            *ctx->mem = chunk;
+        else
+            ctx->cur->next = chunk;
+        ctx->cur = chunk;
+    }
+
+    path_glob_list_t *out = ctx->out;
+    if (out->num == out->cap)
+    {
+        int newCap = out->cap == 0 ? 64 : out->cap * 2;
+        char **grown = realloc(out->paths, newCap * sizeof(char *));
+        if (grown == NULL)
+        {
+            ctx->failed = true;
+            return;
+        }
+        out->paths = grown;
+        out->cap = newCap;
+    }
+
+    char *copy = ctx->cur->data + ctx->cur->used;
+    memcpy(copy, ctx->path, len + 1);
+    ctx->cur->used += len + 1;
+    out->paths[out->num++] = copy;
+}
+
+// a name read from a directory, kept for walking into once it is closed
+typedef struct glob_name
+{
+    char *name;
+    unsigned char type;
+} glob_name_t;
+
+static void walk(glob_ctx_t *ctx, size_t len, int comp);
+
+/*
+ *  scan_dir
+ *      len:   the directory is the first len bytes of ctx->path
+ *      comp:  the component its entries are matched against
+ *
+ *  Reads the directory with getdents64().  For the last component a
+ *  matching name is added right away.  Otherwise the matching names are
+ *  kept and walked into once the directory is closed, so the one dents
+ *  buffer is never needed by two directories at once.
+ */
+static void scan_dir(glob_ctx_t *ctx, size_t len, int comp)
+{
+    glob_comp_t *c = &ctx->comps[comp];
+    bool last = comp == ctx->numComps - 1;
+    glob_name_t *keep = NULL;
+    int numKeep = 0;
+    int capKeep = 0;
+
+    int fd = open(len == 0 ? "." : ctx->path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        return;
+    }
+
+    while (!ctx->failed)
+    {
+        long n = syscall(SYS_getdents64, fd, ctx->dents, PATH_GLOB_DENTS_SZ);
+        if (n <= 0)
+        {
+            break;
+        }
+        for (long pos = 0; pos < n;)
+        {
+            dirent64_rec_t *d = (dirent64_rec_t *)(ctx->dents + pos);
+            pos += d->d_reclen;
+
+            const char *name = d->d_name;
+            if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0')))
+            {
+                continue;
+            }
+
+            // ** takes every directory that isn't hidden, and everything
+            // when it is the last component
+            bool take = c->globstar ? name[0] != '.' : comp_matches(c, name);
+            if (!take)
+            {
+                continue;
+            }
+
+            if (last && !c->globstar)
+            {
+                size_t newLen = join(ctx, len, name);
+                if (newLen > 0 && (!ctx->dirOnly || is_dir(ctx, d->d_type)))
+                {
+                    add_match(ctx, newLen);
+                }
+                ctx->path[len] = '\0';
+                continue;
+            }
+
+            if (numKeep == capKeep)
+            {
+                capKeep = capKeep == 0 ? 16 : capKeep * 2;
+                glob_name_t *grown = realloc(keep, capKeep * sizeof(glob_name_t));
+                if (grown == NULL)
+                {
+                    ctx->failed = true;
+                    break;
+                }
+                keep = grown;
+            }
+            keep[numKeep].name = strdup(name);
+            keep[numKeep].type = d->d_type;
+            if (keep[numKeep].name == NULL)
+            {
+                ctx->failed = true;
+                break;
+            }
+            numKeep++;
+        }
+    }
+    close(fd);
+
+    for (int k = 0; k < numKeep; k++)
+    {
+        size_t newLen = join(ctx, len, keep[k].name);
+        if (newLen > 0 && !ctx->failed)
+        {
+            if (!c->globstar)
+                walk(ctx, newLen, comp + 1);
+            else if (is_dir_no_follow(ctx, keep[k].type))
+                walk(ctx, newLen, comp);
+            else if (last && !ctx->dirOnly)
+                add_match(ctx, newLen);
+        }
+        ctx->path[len] = '\0';
+        free(keep[k].name);
+    }
+    free(keep);
+}
+
+// matches the components from comp on below the first len bytes of the path
+static void walk(glob_ctx_t *ctx, size_t len, int comp)
+{
+    if (comp == ctx->numComps)
+    {
+        // only ** gets here, having matched no more directories
+        if (len > 0)
+        {
+            add_match(ctx, len);
+        }
+        return;
+    }
+
+    glob_comp_t *c = &ctx->comps[comp];
+    if (c->literal)
+    {
+        // nothing to match, the name is just used
+        struct stat st;
+        size_t newLen = join(ctx, len, c->text);
+        if (newLen == 0)
+            ;
+        else if (comp < ctx->numComps - 1)
+            walk(ctx, newLen, comp + 1);
+        else if (ctx->dirOnly ? stat(ctx->path, &st) == 0 && S_ISDIR(st.st_mode) : lstat(ctx->path, &st) == 0)
+            add_match(ctx, newLen);
+        ctx->path[len] = '\0';
+        return;
+    }
+
+    if (c->globstar)
+    {
+        walk(ctx, len, comp + 1);
+    }
+    scan_dir(ctx, len, comp);
+}
+
+static int cmp_paths(const void *a, const void *b)
+{
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+// a path and its first 8 bytes as a big endian number, so comparing keys
+// orders paths like strcmp() does as far as the keys go
+typedef struct glob_key
+{
+    uint64_t key;
+    char *path;
+} glob_key_t;
+
+static uint64_t prefix_key(const char *s)
+{
+    uint64_t key = 0;
+    for (int i = 0; i < 8; i++)
+    {
+        key = key << 8 | (unsigned char)*s;
+        s += *s != '\0';
+    }
+    return key;
+}
+
+/*
+ *  sort_paths
+ *
+ *  Sorting is half the work on a big directory, and qsort() calls strcmp()
+ *  through a pointer n log n times.  Instead the paths are radix sorted by
+ *  their first 8 bytes, a pass per byte skipping the bytes every path
+ *  shares, and only paths whose first 8 bytes are all the same are left to
+ *  qsort().
+ */
+static void sort_paths(path_glob_list_t *out)
+{
+    int n = out->num;
+    glob_key_t *keys = n >= PATH_GLOB_RADIX_MIN ? malloc(2 * n * sizeof(glob_key_t)) : NULL;
+    if (keys == NULL)
+    {
+        qsort(out->paths, n, sizeof(char *), cmp_paths);
+        return;
+    }
+
+    glob_key_t *from = keys;
+    glob_key_t *to = keys + n;
+    for (int i = 0; i < n; i++)
+    {
+        from[i].key = prefix_key(out->paths[i]);
+        from[i].path = out->paths[i];
+    }
+
+    for (int shift = 0; shift < 64; shift += 8)
+    {
+        int count[257] = {0};
+        for (int i = 0; i < n; i++)
+        {
+            count[((from[i].key >> shift) & 0xff) + 1]++;
+        }
+        if (count[((from[0].key >> shift) & 0xff) + 1] == n)
+        {
+            continue;
+        }
+        for (int b = 0; b < 256; b++)
+        {
+            count[b + 1] += count[b];
+        }
+        for (int i = 0; i < n; i++)
+        {
+            to[count[(from[i].key >> shift) & 0xff]++] = from[i];
+        }
+        glob_key_t *swap = from;
+        from = to;
+        to = swap;
+    }
+
+    for (int i = 0; i < n;)
+    {
+        int j = i + 1;
+        while (j < n && from[j].key == from[i].key)
+        {
+            j++;
+        }
+        for (int k = i; k < j; k++)
+        {
+            out->paths[k] = from[k].path;
+        }
+        // a key ending in 0 is a whole path, so equal keys are equal paths
+        if (j - i > 1 && (from[i].key & 0xff) != 0)
+        {
+            qsort(out->paths + i, j - i, sizeof(char *), cmp_paths);
+        }
+        i = j;
+    }
+    free(keys);
+}
+
+/*
+ *  path_glob_expand
+ *      src, end:  the word as it was typed, with its quotes
+ *      mem:       the chunk chain the paths are stored in, grown as needed
+ *      out:       gets the matched paths, sorted.  out->paths is reused by
+ *                 the next call and freed by the caller
+ *
+ *  Expands the word like sh does, what it quoted only matches itself.
+ *
+ *  returns:  the number of paths matched, 0 if none did, -1 if there was
+ *            no memory
+ */
+int path_glob_expand(const char *src, const char *end, path_glob_chunk_t **mem, path_glob_list_t *out)
+{
+    out->num = 0;
+    char *pat = make_pattern(src, end);
+    glob_ctx_t *ctx = calloc(1, sizeof(glob_ctx_t));
+    int maxComps = 1;
+    for (const char *s = src; s < end; s++)
+    {
+        maxComps += *s == '/';
+    }
+    glob_comp_t *comps = calloc(maxComps, sizeof(glob_comp_t));
+    char *dents = malloc(PATH_GLOB_DENTS_SZ);
+
+    int rc = -1;
+    if (pat == NULL || ctx == NULL || comps == NULL || dents == NULL)
+    {
+        goto done;
+    }
+
+    ctx->comps = comps;
+    ctx->dents = dents;
+    ctx->mem = mem;
+    ctx->cur = *mem;
+    ctx->out = out;
+
+    size_t len = 0;
+    const char *p = pat;
+    if (*p == '/')
+    {
+        ctx->path[len++] = '/';
+    }
+    while (*p != '\0')
+    {
+        const char *slash = strchr(p, '/');
+        int n = slash != NULL ? slash - p : (int)strlen(p);
+        if (n > 0 && compile_comp(p, n, &comps[ctx->numComps++]) < 0)
+        {
+            goto done;
+        }
+        if (slash == NULL)
+        {
+            break;
+        }
+        ctx->dirOnly = slash[1] == '\0';
+        p = slash + 1;
+    }
+
+    if (ctx->numComps > 0)
+    {
+        walk(ctx, len, 0);
+    }
+    if (!ctx->failed)
+    {
+        sort_paths(out);
+        rc = out->num;
+    }
+
+done:
+    for (int i = 0; i < maxComps && comps != NULL; i++)
+    {
+        free(comps[i].ops);
+        free(comps[i].text);
+    }
+    free(comps);
+    free(dents);
+    free(ctx);
+    free(pat);
+    return rc;
+}
+
+// empties the chunks for the next line, keeping their memory
+void path_glob_reset(path_glob_chunk_t *mem)
+{
+    for (; mem != NULL; mem = mem->next)
+    {
+        mem->used = 0;
+    }
+}
+
+void path_glob_free(path_glob_chunk_t **mem)
+{
+    while (*mem != NULL)
+    {
+        path_glob_chunk_t *next = (*mem)->next;
+        free(*mem);
+        *mem = next;
+    }
+}
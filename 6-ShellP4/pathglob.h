@@ -0,0 +1,69 @@
+#ifndef __PATHGLOB_H__
+#define __PATHGLOB_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// A word with an unquoted *, ? or [ is a pattern, and the parser replaces
+// it with the sorted list of paths it matches, or keeps the word as it is
+// when nothing matches, like sh.  ** as a whole path component matches any
+// number of directories, bash's globstar.  Names starting with . are only
+// matched by a pattern that starts with one.
+//
+// Directories are read with getdents64() in big batches instead of one
+// readdir() call per entry, and each component is compiled once into a
+// small op list that every name is run through, so a directory of 100k
+// entries takes a few system calls and no process.
+#define PATH_GLOB_GLOBSTAR "**"
+
+// getdents64() is asked for this many bytes of entries at a time
+#define PATH_GLOB_DENTS_SZ (256 * 1024)
+
+// matched paths are stored in chunks of at least this many bytes
+#define PATH_GLOB_CHUNK_SZ (64 * 1024)
+
+// fewer matches than this are sorted with qsort(), more are radix sorted
+#define PATH_GLOB_RADIX_MIN 64
+
+// ops a component pattern is compiled into
+typedef enum
+{
+    GLOB_OP_CHAR, // one given character
+    GLOB_OP_ANY,  // ?, any one character
+    GLOB_OP_STAR, // *, any run of characters
+    GLOB_OP_SET,  // [...], one character of a set
+} glob_op_kind_t;
+
+typedef struct glob_op
+{
+    glob_op_kind_t kind;
+    unsigned char ch;  // for GLOB_OP_CHAR
+    uint8_t set[32];   // for GLOB_OP_SET, a bit per byte value
+} glob_op_t;
+
+// the paths made by expansion live in a chain of chunks owned by the
+// command list, they never move so argv[] can point into them, and they
+// are reused by the next line
+typedef struct path_glob_chunk
+{
+    struct path_glob_chunk *next;
+    size_t used;
+    size_t cap;
+    char data[];
+} path_glob_chunk_t;
+
+// the paths a pattern matched, sorted
+typedef struct path_glob_list
+{
+    char **paths; // point into the chunks
+    int num;
+    int cap;
+} path_glob_list_t;
+
+// prototypes for glob expansion, see pathglob.c
+int path_glob_expand(const char *src, const char *end, path_glob_chunk_t **mem, path_glob_list_t *out);
+void path_glob_reset(path_glob_chunk_t *mem);
+void path_glob_free(path_glob_chunk_t **mem);
+
+#endif
@@ -0,0 +1,263 @@
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/stat.h>
+
+#include "pathhash.h"
+
+static path_hash_entry_t *buckets[PATH_HASH_BUCKETS];
+static char *hashed_path = NULL; // the PATH every entry was resolved with
+static unsigned long num_hits = 0;
+static unsigned long num_misses = 0;
+
+// FNV-1a, command names are short so this is plenty
+static unsigned int hash_name(const char *name)
+{
+    unsigned int h = 2166136261u;
+    for (const unsigned char *p = (const unsigned char *)name; *p != '\0'; p++)
+    {
+        h ^= *p;
+        h *= 16777619u;
+    }
+    return h % PATH_HASH_BUCKETS;
+}
+
+// empties the table if PATH is not the one the entries were resolved with
+static void check_path(const char *pathVar)
+{
+    if (hashed_path != NULL && strcmp(hashed_path, pathVar) == 0)
+    {
+        return;
+    }
+    path_hash_clear();
+    // if this fails the table is just emptied again on the next lookup
+    hashed_path = strdup(pathVar);
+}
+
+// searches every PATH directory in order, like execvp, for an executable
+// regular file.  Returns 0 and the malloc'd path in *out, EACCES if the only
+// matches are not executable or ENOENT if there are none
+static int resolve(const char *name, const char *pathVar, char **out)
+{
+    size_t nameLen = strlen(name);
+    // the longest candidate is all of PATH, or ".", plus the slash and name
+    char *full = malloc(strlen(pathVar) + nameLen + 3);
+    if (full == NULL)
+    {
+        return ENOMEM;
+    }
+
+    int err = ENOENT;
+    const char *dir = pathVar;
+    while (1)
+    {
+        const char *end = strchrnul(dir, ':');
+        size_t dirLen = end - dir;
+
+        // an empty entry is the current directory
+        if (dirLen == 0)
+        {
+            full[0] = '.';
+            dirLen = 1;
+        }
+        else
+        {
+            memcpy(full, dir, dirLen);
+        }
+        full[dirLen] = '/';
+        memcpy(full + dirLen + 1, name, nameLen + 1);
+
+        struct stat st;
+        if (stat(full, &st) == 0 && S_ISREG(st.st_mode))
+        {
+            if (access(full, X_OK) == 0)
+            {
+                *out = full;
+                return 0;
+            }
+            err = EACCES;
+        }
+
+        if (*end == '\0')
+        {
+            break;
+        }
+        dir = end + 1;
+    }
+
+    free(full);
+    return err;
+}
+
+// finds name in the table, resolving and adding it on a miss.  countUse is
+// false when the hash built in adds a command that isn't being run
+static int find_or_resolve(const char *name, bool countUse, const char **path)
+{
+    const char *pathVar = getenv("PATH");
+    if (pathVar == NULL)
+    {
+        pathVar = PATH_HASH_DEF_PATH;
+    }
+    check_path(pathVar);
+
+    unsigned int b = hash_name(name);
+    for (path_hash_entry_t *e = buckets[b]; e != NULL; e = e->next)
+    {
+        if (strcmp(e->name, name) == 0)
+        {
+            if (countUse)
+            {
+                e->hits++;
+                num_hits++;
+            }
+            *path = e->path;
+            return 0;
+        }
+    }
+
+    if (countUse)
+    {
+        num_misses++;
+    }
+
+    char *full;
+    int err = resolve(name, pathVar, &full);
+    if (err != 0)
+    {
+        return err;
+    }
+
+    path_hash_entry_t *e = malloc(sizeof(path_hash_entry_t) + strlen(name) + 1);
+    if (e == NULL)
+    {
+        free(full);
+        return ENOMEM;
+    }
+    strcpy(e->name, name);
+    e->path = full;
+    e->hits = countUse ? 1 : 0;
+    e->next = buckets[b];
+    buckets[b] = e;
+
+    *path = e->path;
+    return 0;
+}
+
+/*
+ *  path_hash_lookup
+ *      name:  the command as typed, argv[0]
+ *      path:  set to the file to execute
+ *
+ *  Names with a slash are used as they are.  Anything else is looked up in
+ *  the table and resolved against PATH on a miss.  *path belongs to the table
+ *  and is only good until the next lookup, forget or clear.
+ *
+ *  returns:  0        on success
+ *            ENOENT   no file called name in PATH
+ *            EACCES   found, but none of the matches can be executed
+ *            ENOMEM   the table could not grow
+ */
+int path_hash_lookup(const char *name, const char **path)
+{
+    if (strchr(name, '/') != NULL)
+    {
+        *path = name;
+        return 0;
+    }
+
+    return find_or_resolve(name, true, path);
+}
+
+// drops the entry for name, used when the file it points to went away
+void path_hash_forget(const char *name)
+{
+    path_hash_entry_t **link = &buckets[hash_name(name)];
+    while (*link != NULL)
+    {
+        path_hash_entry_t *e = *link;
+        if (strcmp(e->name, name) == 0)
+        {
+            *link = e->next;
+            free(e->path);
+            free(e);
+            return;
+        }
+        link = &e->next;
+    }
+}
+
+// forgets every entry, the hit and miss counts are kept
+void path_hash_clear(void)
+{
+    for (int b = 0; b < PATH_HASH_BUCKETS; b++)
+    {
+        while (buckets[b] != NULL)
+        {
+            path_hash_entry_t *e = buckets[b];
+            buckets[b] = e->next;
+            free(e->path);
+            free(e);
+        }
+    }
+    free(hashed_path);
+    hashed_path = NULL;
+}
+
+/*
+ *  path_hash_cmd
+ *
+ *  The hash built in:
+ *      hash            lists every entry with its hits, then the totals
+ *      hash -r         forgets every entry
+ *      hash name ...   resolves and remembers each name without running it
+ *
+ *  returns:  0 on success, 1 if a name could not be found
+ */
+int path_hash_cmd(int argc, char *argv[], FILE *out)
+{
+    if (argc == 1)
+    {
+        bool any = false;
+        for (int b = 0; b < PATH_HASH_BUCKETS; b++)
+        {
+            for (path_hash_entry_t *e = buckets[b]; e != NULL; e = e->next)
+            {
+                if (!any)
+                {
+                    fprintf(out, HASH_HDR);
+                    any = true;
+                }
+                fprintf(out, HASH_ROW, e->hits, e->path);
+            }
+        }
+        if (!any)
+        {
+            fprintf(out, HASH_EMPTY);
+        }
+        fprintf(out, HASH_STATS, num_hits, num_misses);
+        return 0;
+    }
+
+    if (argc == 2 && strcmp(argv[1], "-r") == 0)
+    {
+        path_hash_clear();
+        return 0;
+    }
+
+    int rc = 0;
+    for (int i = 1; i < argc; i++)
+    {
+        // names with a slash are never hashed, there is nothing to do
+        const char *path;
+        if (strchr(argv[i], '/') == NULL && find_or_resolve(argv[i], false, &path) != 0)
+        {
+            fprintf(out, HASH_ERR_NOT_FOUND, argv[i]);
+            rc = 1;
+        }
+    }
+    return rc;
+}
@@ -0,0 +1,40 @@
+#ifndef __PATHHASH_H__
+#define __PATHHASH_H__
+
+#include <stdbool.h>
+#include <stdio.h>
+
+// Commands without a slash are resolved against PATH once and the absolute
+// path is remembered, like the command hash table in bash, so running the
+// same program again doesn't walk every PATH directory.  The table is
+// emptied when PATH changes, and an entry is dropped when the file it points
+// to is gone (see path_hash_forget()).
+#define PATH_HASH_BUCKETS 64
+
+// searched when PATH is not set, same as execvp
+#define PATH_HASH_DEF_PATH "/bin:/usr/bin"
+
+typedef struct path_hash_entry
+{
+    struct path_hash_entry *next; // next entry in the same bucket
+    unsigned long hits;           // times the command was run from here
+    char *path;                   // absolute path the command resolved to
+    char name[];                  // the command as typed
+} path_hash_entry_t;
+
+#define HASH_CMD "hash"
+
+// output constants for the hash built in
+#define HASH_HDR "hits\tcommand\n"
+#define HASH_ROW "%4lu\t%s\n"
+#define HASH_EMPTY "hash: hash table empty\n"
+#define HASH_STATS "hash: %lu hits, %lu misses\n"
+#define HASH_ERR_NOT_FOUND "hash: %s: not found\n"
+
+// prototypes for the command hash table, see pathhash.c
+int path_hash_lookup(const char *name, const char **path);
+void path_hash_forget(const char *name);
+void path_hash_clear(void);
+int path_hash_cmd(int argc, char *argv[], FILE *out);
+
+#endif
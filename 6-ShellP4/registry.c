@@ -0,0 +1,41 @@
+#include <string.h>
+
+#include "registry.h"
+#include "rshlib.h"
+#include "builtins.h"
+#include "pathhash.h"
+#include "jobs.h"
+#include "parallel.h"
+#include "splice.h"
+#include "stats.h"
+#include "trace.h"
+#include "lineedit.h"
+#include "parsecache.h"
+#include "workpool.h"
+#include "bi_table.h"
+
+// the built in called name that one of the shells in flags has, or NULL
+const bi_entry_t *bi_lookup(const char *name, int flags)
+{
+    const bi_entry_t *e = &bi_table[bi_hash(name, BI_TABLE_SEED) & (BI_TABLE_SZ - 1)];
+    if (e->name == NULL || (e->flags & flags) == 0 || strcmp(e->name, name) != 0)
+    {
+        return NULL;
+    }
+    return e;
+}
+
+// the next built in from slot on that one of the shells in flags has, or
+// NULL after the last.  *slot starts at 0
+const bi_entry_t *bi_next(int *slot, int flags)
+{
+    while (*slot < BI_TABLE_SZ)
+    {
+        const bi_entry_t *e = &bi_table[(*slot)++];
+        if (e->name != NULL && (e->flags & flags) != 0)
+        {
+            return e;
+        }
+    }
+    return NULL;
+}
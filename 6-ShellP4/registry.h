@@ -0,0 +1,49 @@
+#ifndef __REGISTRY_H__
+#define __REGISTRY_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/types.h>
+
+#include "dshlib.h"
+
+// Every built in of dsh and of the rsh server is listed once, in
+// builtins.def.  At build time tools/mkbitable finds a seed for which
+// bi_hash() gives each name its own slot and writes the table out as
+// bi_table.h, so looking a command up is one hash and one strcmp() no
+// matter how many built ins there are.
+
+// flags of a built in
+#define BI_F_LOCAL 0x1  // dsh has it
+#define BI_F_REMOTE 0x2 // the rsh server has it
+
+// prints to out, which is stdout in dsh and a stream of the session's own
+// in the rsh server
+typedef int (*bi_handler_t)(int argc, char *argv[], FILE *out);
+
+typedef struct bi_entry
+{
+    const char *name;     // NULL for an empty slot
+    Built_In_Cmds code;
+    bi_handler_t handler; // NULL if the shell runs it itself
+    int flags;
+} bi_entry_t;
+
+// FNV-1a with the seed as the offset basis, shared by the generator
+static inline uint32_t bi_hash(const char *name, uint32_t seed)
+{
+    uint32_t h = seed;
+    for (; *name != '\0'; name++)
+    {
+        h ^= (unsigned char)*name;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+// prototypes for the registry, see registry.c
+const bi_entry_t *bi_lookup(const char *name, int flags);
+const bi_entry_t *bi_next(int *slot, int flags);
+
+#endif
@@ -7,9 +7,134 @@
 #include <unistd.h>
 #include <sys/un.h>
 #include <fcntl.h>
+#include <errno.h>
 
 #include "dshlib.h"
 #include "rshlib.h"
+#include "cmdtrie.h"
+#include "frame.h"
+
+// dsh -c -l speaks the legacy protocol, see rshlib.h
+static int legacy_protocol = 0;
+
+void set_legacy_protocol(int val)
+{
+    legacy_protocol = val;
+}
+
+// prints a legacy reply as it comes, until the EOF character
+static int recv_legacy(int cli_socket, char *rsp_buff)
+{
+    ssize_t io_size;
+    int is_eof;
+
+    // recv all the results
+    while ((io_size = recv(cli_socket, rsp_buff, RDSH_COMM_BUFF_SZ, 0)) > 0)
+    {
+        // at this point we have data
+        is_eof = ((char)rsp_buff[io_size - 1] == RDSH_EOF_CHAR) ? 1 : 0;
+
+        // print the data
+        printf("%.*s", (int)(io_size - is_eof), rsp_buff);
+
+        // we are done
+        if (is_eof)
+        {
+            break;
+        }
+    }
+
+    // we got an error, nothing means the other side is down
+    if (io_size < 0)
+    {
+        perror("recv");
+        return ERR_RDSH_COMMUNICATION;
+    }
+    return OK;
+}
+
+/*
+ * recv_framed(cli_socket, ring)
+ *      cli_socket:  the client socket
+ *      ring:        what was received and not yet printed, see frame.h
+ *
+ *  Prints a framed reply as it comes, until its FRAME_EXIT.  Output is
+ *  written straight from the ring, stderr chunks to stderr.  A reply that
+ *  doesn't start with a frame is a server that turned the client away
+ *  before it knew the protocol, that one is legacy text.
+ *
+ *  Returns:  OK once the reply ended or the server closed,
+ *            ERR_RDSH_COMMUNICATION if the socket failed or the server
+ *            sent something that isn't a frame
+ */
+static int recv_framed(int cli_socket, frame_ring_t *ring)
+{
+    frame_t f;
+    bool text = false;
+    while (1)
+    {
+        if (frame_ring_used(ring) > 0 && (text || frame_ring_peek(ring) != FRAME_MAGIC))
+        {
+            text = true;
+            char *start = ring->data + (ring->head & (ring->cap - 1));
+            size_t used = frame_ring_used(ring);
+            char *end = memchr(start, RDSH_EOF_CHAR, used);
+            fwrite(start, 1, end != NULL ? (size_t)(end - start) : used, stdout);
+            frame_ring_consume(ring, end != NULL ? (size_t)(end - start) + 1 : used);
+            if (end != NULL)
+            {
+                return OK;
+            }
+        }
+
+        int rc = text ? 0 : frame_next(ring, &f);
+        if (rc == 1)
+        {
+            if (f.type == FRAME_STDOUT)
+            {
+                fwrite(f.payload, 1, f.len, stdout);
+            }
+            else if (f.type == FRAME_STDERR)
+            {
+                // what was printed comes first
+                fflush(stdout);
+                fwrite(f.payload, 1, f.len, stderr);
+            }
+            frame_ring_consume(ring, FRAME_HDR_SZ + f.len);
+            if (f.type == FRAME_EXIT)
+            {
+                return OK;
+            }
+            continue;
+        }
+        if (rc < 0)
+        {
+            if (rc == ERR_FRAME_VERSION)
+                printf(FRAME_ERR_VERSION, f.version, FRAME_VERSION);
+            else if (rc == ERR_FRAME_TOO_BIG)
+                printf(FRAME_ERR_TOO_BIG, FRAME_MAX);
+            else
+                printf(FRAME_ERR_BAD);
+            return ERR_RDSH_COMMUNICATION;
+        }
+
+        ssize_t n = frame_ring_recv(ring, cli_socket, 0);
+        if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n < 0)
+        {
+            perror("recv");
+            return ERR_RDSH_COMMUNICATION;
+        }
+        if (n == 0)
+        {
+            // the server is down
+            return OK;
+        }
+    }
+}
 
 /*
  * exec_remote_cmd_loop(server_ip, port)
@@ -63,6 +188,9 @@
  *                    if is_eof is true, this is the last part of the transmission
  *                    from the server and you can break out of the recv() loop.
  *
+ *      That is the legacy protocol, used with -l.  By default commands go
+ *      out as frames and replies are read with recv_framed(), see frame.h.
+ *
  *   returns:
  *          OK:      The client executed all of its commands and is exiting
  *                   either by the `exit` command that terminates the client
@@ -90,17 +218,28 @@
 int exec_remote_cmd_loop(char *address, int port)
 {
     char *cmd_buff;
-    char *rsp_buff;
+    size_t cmd_cap = RDSH_COMM_BUFF_SZ;
+    char *rsp_buff = NULL;
+    frame_ring_t ring = {0};
     int cli_socket;
-    ssize_t io_size;
-    int is_eof;
+    int rc = OK;
 
-    // set up cmd and response buffs
-    cmd_buff = (char *)malloc(RDSH_COMM_BUFF_SZ);
-    rsp_buff = (char *)malloc(RDSH_COMM_BUFF_SZ);
-    if (rsp_buff == NULL || cmd_buff == NULL)
+    // set up cmd and response buffs, framed replies are received into a
+    // ring instead
+    cmd_buff = (char *)malloc(cmd_cap);
+    if (legacy_protocol)
+    {
+        rsp_buff = (char *)malloc(RDSH_COMM_BUFF_SZ);
+    }
+    else if (frame_ring_init(&ring, FRAME_RING_SZ) != OK)
+    {
+        perror("mmap");
+        return client_cleanup(-1, cmd_buff, rsp_buff, ERR_MEMORY);
+    }
+    if ((legacy_protocol && rsp_buff == NULL) || cmd_buff == NULL)
     {
         perror("malloc");
+        frame_ring_free(&ring);
         return client_cleanup(-1, cmd_buff, rsp_buff, ERR_MEMORY);
     }
 
@@ -108,6 +247,7 @@ int exec_remote_cmd_loop(char *address, int port)
     if (cli_socket < 0)
     {
         perror("start client");
+        frame_ring_free(&ring);
         return client_cleanup(cli_socket, cmd_buff, rsp_buff, ERR_RDSH_CLIENT);
     }
 
@@ -117,51 +257,32 @@ int exec_remote_cmd_loop(char *address, int port)
         printf("%s", SH_PROMPT);
 
         // read input
-        if (get_input(cmd_buff) == EOF)
+        if (get_input(&cmd_buff, &cmd_cap) == EOF)
         {
             break;
         }
 
-        // send() over cli_socket
-        int ret = send(cli_socket, cmd_buff, strlen(cmd_buff) + 1, 0);
-        if (ret < 0)
+        // send() over cli_socket, a legacy command ends in its null
+        size_t cmd_len = strlen(cmd_buff);
+        if (legacy_protocol)
+        {
+            rc = send(cli_socket, cmd_buff, cmd_len + 1, 0) < 0 ? ERR_RDSH_COMMUNICATION : OK;
+        }
+        else
+        {
+            rc = frame_send(cli_socket, FRAME_CMD, cmd_buff, cmd_len);
+        }
+        if (rc != OK)
         {
             perror("send");
-            return client_cleanup(cli_socket, cmd_buff, rsp_buff, ERR_RDSH_COMMUNICATION);
+            break;
         }
 
         // recv all the results
-        while ((io_size = recv(cli_socket, rsp_buff, RDSH_COMM_BUFF_SZ, 0)) > 0)
+        rc = legacy_protocol ? recv_legacy(cli_socket, rsp_buff) : recv_framed(cli_socket, &ring);
+        if (rc != OK)
         {
-            // we got an error
-            if (io_size < 0)
-            {
-                perror("recv");
-                return client_cleanup(cli_socket, cmd_buff, rsp_buff, ERR_RDSH_COMMUNICATION);
-            }
-
-            // we got nothing, other side is down
-            if (io_size == 0)
-            {
-                break;
-            }
-
-            // at this point we have data
-            is_eof = ((char)rsp_buff[io_size - 1] == RDSH_EOF_CHAR) ? 1 : 0;
-            if (is_eof)
-            {
-                // null terminate the string
-                rsp_buff[io_size - 1] = '\0';
-            }
-
-            // print the data
-            printf("%.*s", (int)io_size, rsp_buff);
-
-            // we are done
-            if (is_eof)
-            {
-                break;
-            }
+            break;
         }
 
         // break on exit command or stop-server command
@@ -171,7 +292,8 @@ int exec_remote_cmd_loop(char *address, int port)
         }
     }
 
-    return client_cleanup(cli_socket, cmd_buff, rsp_buff, OK);
+    frame_ring_free(&ring);
+    return client_cleanup(cli_socket, cmd_buff, rsp_buff, rc);
 }
 
 /*
@@ -259,6 +381,8 @@ int client_cleanup(int cli_socket, char *cmd_buff, char *rsp_buff, int rc)
     // Free up the buffers
     free(cmd_buff);
     free(rsp_buff);
+    // and the command trie the line editor may have built
+    cmd_trie_free();
 
     // Echo the return value that was passed as a parameter
     return rc;
@@ -1,3 +1,4 @@
+#define _GNU_SOURCE
 
 #include <sys/socket.h>
 #include <sys/wait.h>
@@ -11,6 +12,10 @@
 #include <errno.h>
 #include <pthread.h>
 #include <stdatomic.h>
+#include <poll.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <signal.h>
 
 // INCLUDES for extra credit
 // #include <signal.h>
@@ -19,6 +24,11 @@
 
 #include "dshlib.h"
 #include "rshlib.h"
+#include "trace.h"
+#include "registry.h"
+#include "parsecache.h"
+#include "workpool.h"
+#include "frame.h"
 
 // data to pass to threads
 typedef struct
@@ -27,8 +37,36 @@ typedef struct
     int svr_socket;
 } thread_data_t;
 
+// a client's connection, see exec_client_requests()
+typedef struct rsh_session
+{
+    int sock;
+    int framed;        // -1 until the client's first byte tells, see frame.h
+    frame_ring_t ring; // received and not yet run
+    size_t cmdLen;     // bytes of the ring the command being run takes
+    char *cmdEnd;      // where its null went
+    char held;         // and the byte that was there
+} rsh_session_t;
+
+// the pipes a framed session's pipeline writes, see pump_output()
+typedef struct rsh_pump
+{
+    int sock;
+    int fds[2]; // stdout, stderr
+} rsh_pump_t;
+
+static char *recv_command(rsh_session_t *s);
+static void release_command(rsh_session_t *s);
+static int send_reply(rsh_session_t *s, const char *msg, int status);
+static int rsh_run_framed(rsh_session_t *s, command_list_t *clist);
+static void rsh_free_pipeline(int pipes[][2], pid_t *pids, int *pids_st);
+
 atomic_int stop_server_flag = 0; // allows thread to stop the server
 
+// what the first command of a framed session reads, its socket only
+// carries frames
+static int null_fd = -1;
+
 /*
  * start_server(ifaces, port, is_threaded)
  *      ifaces:  a string in ip address format, indicating the interface
@@ -62,6 +100,8 @@ int start_server(char *ifaces, int port, int is_threaded)
     int svr_socket;
     int rc;
 
+    trace_init();
+    null_fd = open("/dev/null", O_RDONLY | O_CLOEXEC);
     svr_socket = boot_server(ifaces, port);
     if (svr_socket < 0)
     {
@@ -69,9 +109,20 @@ int start_server(char *ifaces, int port, int is_threaded)
         return err_code;
     }
 
+    // connections are run by a fixed pool, see workpool.h.  Sessions still
+    // connected when the server stops are dropped as the process exits
+    if (is_threaded && work_pool_start(POOL_DEF_WORKERS, POOL_DEF_SLOTS, POOL_DEF_TIMEOUT_MS, true) <= 0)
+    {
+        stop_server(svr_socket);
+        return ERR_RDSH_SERVER;
+    }
+
     rc = process_cli_requests(svr_socket, is_threaded);
 
     stop_server(svr_socket);
+    close(null_fd);
+    parse_cache_free();
+    trace_finish();
 
     return rc;
 }
@@ -231,7 +282,12 @@ int process_cli_requests(int svr_socket, int is_threaded)
             return ERR_RDSH_COMMUNICATION;
         }
 
-        // if multithreading is enabled, create a new thread
+        // output and the end of it go out as separate sends, nagle would
+        // hold the second back until the client acks the first
+        int one = 1;
+        setsockopt(cli_socket, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+        // if multithreading is enabled, queue it for a worker
         if (is_threaded)
         {
             // allocate thread data for this connection
@@ -245,18 +301,18 @@ int process_cli_requests(int svr_socket, int is_threaded)
             thread_data->cli_socket = cli_socket;
             thread_data->svr_socket = svr_socket;
 
-            pthread_t thread;
-            rc = pthread_create(&thread, NULL, exec_client_requests_threaded, thread_data);
-            if (rc != 0)
+            // a full queue turns the client away, right away or once the
+            // pool's timeout passes.  It hasn't said which protocol it
+            // speaks yet, a framed client reads this as legacy text
+            rc = work_pool_submit(exec_client_requests_threaded, thread_data);
+            if (rc != OK)
             {
-                printf("Error creating thread %d\n", rc);
+                send_message_string(cli_socket, POOL_MSG_BUSY);
                 free(thread_data);
                 close(cli_socket);
+                rc = OK;
                 continue;
             }
-
-            // detach the thread so that its resources are reclaimed upon termination
-            pthread_detach(thread);
         }
         else
         {
@@ -314,16 +370,13 @@ void *exec_client_requests_threaded(void *arg)
  *  arrive over the recv() socket call rather than reading a string from the
  *  keyboard.
  *
- *  This function also must send the EOF character after a command is
- *  successfully executed to let the client know that the output from the
- *  command it sent is finished.  Use the send_message_eof() to accomplish
- *  this.
+ *  After each command the client is told its output is finished, in the
+ *  protocol it speaks, see frame.h.  A legacy client is sent the EOF
+ *  character with send_message_eof(), a framed one a FRAME_EXIT with the
+ *  status.
  *
- *  Of final note, this function must allocate a buffer for storage to
- *  store the data received by the client. For example:
- *     io_buff = malloc(RDSH_COMM_BUFF_SZ);
- *  And since it is allocating storage, it must also properly clean it up
- *  prior to exiting.
+ *  Commands are received into a ring, see recv_command(), and parsed
+ *  where they are.
  *
  *  Returns:
  *
@@ -336,82 +389,62 @@ void *exec_client_requests_threaded(void *arg)
  */
 int exec_client_requests(int cli_socket)
 {
-    int io_size;
+    rsh_session_t sess = {.sock = cli_socket, .framed = -1};
     command_list_t *cmd_list;
+    char *cmd_buff;
     int rc;
     int cmd_rc;
     int last_rc = 0;
-    char *io_buff;
-    char *cmd_buff;
 
-    // allocate the command list
+    // allocate the command list and the ring commands are received into
     rc = alloc_cmd_list(&cmd_list);
     if (rc != OK)
     {
         perror("malloc");
+        close(cli_socket);
         return rc;
     }
-
-    // allocate buffers for network recv and command storage
-    io_buff = malloc(RDSH_COMM_BUFF_SZ);
-    cmd_buff = malloc(SH_CMD_MAX);
-    if (io_buff == NULL || cmd_buff == NULL)
+    if (frame_ring_init(&sess.ring, FRAME_RING_SZ) != OK)
     {
-        perror("malloc");
+        perror("mmap");
+        free_cmd_list(cmd_list);
+        close(cli_socket);
         return ERR_RDSH_SERVER;
     }
 
+    TRACE_BEGIN("session", NULL);
     while (1)
     {
-        // clear the buffer beforehand
-        memset(io_buff, 0, RDSH_COMM_BUFF_SZ);
-        memset(cmd_buff, 0, SH_CMD_MAX);
         cmd_rc = 0;
-        rc = 0;
+        rc = OK;
 
-        // wait for the next data packet
-        while ((io_size = recv(cli_socket, io_buff, RDSH_COMM_BUFF_SZ, 0)) > 0)
-        {
-            // break if we have an error
-            if (io_size < 0)
-            {
-                rc = ERR_RDSH_COMMUNICATION;
-                break;
-            }
-
-            // break if no data, other side is closed
-            if (io_size == 0)
-            {
-                break;
-            }
-
-            // we have data, append the io_buff to the cmd_buff
-            strcat(cmd_buff, io_buff);
-
-            // check if we have the null character, if so we have the end of the command
-            if (io_buff[io_size - 1] == '\0')
-            {
-                // just to avoid the second break;
-                rc = 1;
-                break;
-            }
-        }
-
-        // break out of loop if there was an error or no data
-        if (rc <= 0)
+        // wait for the next command, the client closing ends the session
+        TRACE_BEGIN("recv", NULL);
+        cmd_buff = recv_command(&sess);
+        TRACE_END("recv");
+        if (cmd_buff == NULL)
         {
             break;
         }
 
-        // ensure we clean the command list before processing
+        // ensure we clean the command list before processing, the parser
+        // copies the line so the ring can take it back right after
         clear_cmd_list(cmd_list);
-
-        // build up the cmd_list struct
         rc = build_cmd_list(cmd_buff, cmd_list);
+        release_command(&sess);
         if (rc == OK)
         {
             // execute the cmd_list as a pipeline
-            cmd_rc = rsh_execute_pipeline(cli_socket, cmd_list);
+            TRACE_BEGIN("pipeline", cmd_list->commands[0].argv[0]);
+            if (sess.framed)
+            {
+                cmd_rc = rsh_run_framed(&sess, cmd_list);
+            }
+            else
+            {
+                cmd_rc = rsh_execute_pipeline(cli_socket, cmd_list);
+            }
+            TRACE_END("pipeline");
 
             if (cmd_rc == EXIT_SC)
             {
@@ -425,15 +458,14 @@ int exec_client_requests(int cli_socket)
             }
             else if (cmd_rc == RC_SC)
             {
-                char *last_rc_str = calloc(10, 1);
-                sprintf(last_rc_str, "%d\n", last_rc);
-                send_message_string(cli_socket, last_rc_str);
-                free(last_rc_str);
+                char last_rc_str[16];
+                snprintf(last_rc_str, sizeof(last_rc_str), "%d\n", last_rc);
+                send_reply(&sess, last_rc_str, 0);
             }
             else
             {
                 // send back appropriate response
-                rc = send_message_eof(cli_socket);
+                rc = send_reply(&sess, "", cmd_rc);
                 if (rc != OK)
                 {
                     printf(CMD_ERR_RDSH_COMM);
@@ -447,36 +479,241 @@ int exec_client_requests(int cli_socket)
         }
         else
         {
-            switch (rc)
+            send_reply(&sess, rsh_parse_error(rc), rc);
+            rc = OK;
+        }
+    }
+
+    TRACE_END("session");
+
+    // cleanup
+    frame_ring_free(&sess.ring);
+    free_cmd_list(cmd_list);
+    close(cli_socket);
+
+    return rc;
+}
+
+// tells the client the server refused what it sent and why
+static void refuse(rsh_session_t *s, int rc, uint8_t version)
+{
+    char msg[128];
+    if (rc == ERR_FRAME_VERSION)
+        snprintf(msg, sizeof(msg), FRAME_ERR_VERSION, version, FRAME_VERSION);
+    else if (rc == ERR_FRAME_TOO_BIG)
+        snprintf(msg, sizeof(msg), FRAME_ERR_TOO_BIG, FRAME_MAX);
+    else if (rc == ERR_MEMORY)
+        snprintf(msg, sizeof(msg), "%s", CMD_ERR_MEMORY);
+    else
+        snprintf(msg, sizeof(msg), "%s", FRAME_ERR_BAD);
+    send_reply(s, msg, rc);
+}
+
+/*
+ * recv_command(s)
+ *      s:  the session
+ *
+ *  Receives into the session's ring until it holds a whole command.  The
+ *  first byte the client sends tells whether it sends frames or legacy
+ *  text, see frame.h.  Neither way is anything copied: the command is
+ *  null terminated where it is in the ring, and each received byte is
+ *  looked at once.
+ *
+ *  Returns:  the command, to be handed back with release_command() once it
+ *            is parsed.  NULL when the client closed or sent something
+ *            that isn't a command, it was told what.
+ */
+static char *recv_command(rsh_session_t *s)
+{
+    frame_t f;
+    char *line = NULL;
+    int rc = 0;
+    while (1)
+    {
+        if (s->framed < 0 && frame_ring_used(&s->ring) > 0)
+        {
+            s->framed = frame_ring_peek(&s->ring) == FRAME_MAGIC;
+        }
+        if (s->framed == 1)
+        {
+            rc = frame_next(&s->ring, &f);
+            if (rc == 1 && f.type != FRAME_CMD)
             {
-            case WARN_NO_CMDS:
-                send_message_string(cli_socket, CMD_WARN_NO_CMD);
-                break;
-            case ERR_CMD_OR_ARGS_TOO_BIG:
-                send_message_string(cli_socket, CMD_ERR_CMD_OR_ARGS_TOO_BIG);
-                break;
-            case ERR_TOO_MANY_COMMANDS:
-                send_message_string(cli_socket, "error: too many commands in pipeline\n");
-                break;
-            case ERR_MEMORY:
-                send_message_string(cli_socket, CMD_ERR_MEMORY);
+                rc = ERR_FRAME_BAD;
+            }
+            if (rc == 1)
+            {
+                line = f.payload;
+                s->cmdLen = FRAME_HDR_SZ + f.len;
+                s->cmdEnd = line + f.len;
                 break;
-            default:
-                send_message_string(cli_socket, CMD_ERR_PIPE_FORMAT);
+            }
+        }
+        else if (s->framed == 0)
+        {
+            line = frame_next_line(&s->ring, &s->cmdLen);
+            if (line != NULL)
+            {
+                s->cmdEnd = line + s->cmdLen - 1;
                 break;
             }
         }
+        if (rc < 0)
+        {
+            refuse(s, rc, f.version);
+            return NULL;
+        }
+
+        ssize_t n = frame_ring_recv(&s->ring, s->sock, 0);
+        if (n < 0 && n != -1)
+        {
+            refuse(s, n, 0);
+            return NULL;
+        }
+        if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n <= 0)
+        {
+            return NULL;
+        }
     }
 
-    // cleanup
-    free(io_buff);
-    free(cmd_buff);
-    free_cmd_list(cmd_list);
-    close(cli_socket);
+    // the byte after a frame may be the next one's, it is put back
+    s->held = *s->cmdEnd;
+    *s->cmdEnd = '\0';
+    return line;
+}
+
+// gives the ring back the command recv_command() returned
+static void release_command(rsh_session_t *s)
+{
+    *s->cmdEnd = s->held;
+    frame_ring_consume(&s->ring, s->cmdLen);
+}
+
+// ends a command's answer, msg is output the server adds itself
+static int send_reply(rsh_session_t *s, const char *msg, int status)
+{
+    if (s->framed == 1)
+    {
+        TRACE_BEGIN("send", NULL);
+        int rc = frame_send_reply(s->sock, FRAME_STDOUT, msg, status);
+        TRACE_END("send");
+        return rc;
+    }
+    return send_message_string(s->sock, (char *)msg);
+}
 
+// frames what a pipeline writes to its stdout and stderr pipes as it comes,
+// until both are closed.  If the client went away the rest is read and
+// dropped, so the pipeline doesn't block
+static void *pump_output(void *arg)
+{
+    rsh_pump_t *p = arg;
+    static const uint8_t types[2] = {FRAME_STDOUT, FRAME_STDERR};
+    struct pollfd pfds[2] = {{.fd = p->fds[0], .events = POLLIN}, {.fd = p->fds[1], .events = POLLIN}};
+    char buff[RDSH_COMM_BUFF_SZ];
+    int open = 2;
+    bool gone = false;
+
+    while (open > 0)
+    {
+        if (poll(pfds, 2, -1) < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            break;
+        }
+        for (int i = 0; i < 2; i++)
+        {
+            if (pfds[i].revents == 0)
+            {
+                continue;
+            }
+            ssize_t n = read(pfds[i].fd, buff, sizeof(buff));
+            if (n > 0 && !gone)
+            {
+                TRACE_BEGIN("send", NULL);
+                gone = frame_send(p->sock, types[i], buff, n) != OK;
+                TRACE_END("send");
+            }
+            else if (n == 0 || (n < 0 && errno != EINTR))
+            {
+                pfds[i].fd = -1;
+                open--;
+            }
+        }
+    }
+    return NULL;
+}
+
+/*
+ * rsh_run_framed(s, clist)
+ *      s:      a framed session
+ *      clist:  the parsed line
+ *
+ *  Runs the pipeline with its stdout and stderr on pipes of their own,
+ *  which a thread frames for the client while it runs.  The first command
+ *  reads /dev/null.
+ *
+ *  Returns:  the same as rsh_execute_pipeline()
+ */
+static int rsh_run_framed(rsh_session_t *s, command_list_t *clist)
+{
+    int outPipe[2], errPipe[2];
+    if (pipe2(outPipe, O_CLOEXEC) < 0)
+    {
+        return ERR_RDSH_CMD_EXEC;
+    }
+    if (pipe2(errPipe, O_CLOEXEC) < 0)
+    {
+        close(outPipe[0]);
+        close(outPipe[1]);
+        return ERR_RDSH_CMD_EXEC;
+    }
+
+    rsh_pump_t pump = {.sock = s->sock, .fds = {outPipe[0], errPipe[0]}};
+    pthread_t tid;
+    bool pumping = pthread_create(&tid, NULL, pump_output, &pump) == 0;
+    int rc = pumping ? rsh_run_pipeline(null_fd, outPipe[1], errPipe[1], clist) : ERR_RDSH_CMD_EXEC;
+    close(outPipe[1]);
+    close(errPipe[1]);
+    if (pumping)
+    {
+        pthread_join(tid, NULL);
+    }
+    close(outPipe[0]);
+    close(errPipe[0]);
     return rc;
 }
 
+/*
+ * rsh_parse_error(rc)
+ *      rc:  what build_cmd_list() returned for a line that didn't parse
+ *
+ *  Returns:  the message the client is sent for it
+ */
+const char *rsh_parse_error(int rc)
+{
+    switch (rc)
+    {
+    case WARN_NO_CMDS:
+        return CMD_WARN_NO_CMD;
+    case ERR_CMD_OR_ARGS_TOO_BIG:
+        return CMD_ERR_CMD_OR_ARGS_TOO_BIG;
+    case ERR_TOO_MANY_COMMANDS:
+        return "error: too many commands in pipeline\n";
+    case ERR_MEMORY:
+        return CMD_ERR_MEMORY;
+    default:
+        return CMD_ERR_PIPE_FORMAT;
+    }
+}
+
 /*
  * send_message_eof(cli_socket)
  *      cli_socket:  The server-side socket that is connected to the client
@@ -495,7 +732,9 @@ int send_message_eof(int cli_socket)
 {
     int send_len = (int)sizeof(RDSH_EOF_CHAR);
     int sent_len;
+    TRACE_BEGIN("send", NULL);
     sent_len = send(cli_socket, &RDSH_EOF_CHAR, send_len, 0);
+    TRACE_END("send");
 
     if (sent_len != send_len)
     {
@@ -525,7 +764,9 @@ int send_message_eof(int cli_socket)
 int send_message_string(int cli_socket, char *buff)
 {
     // writes the buffer back to the client
+    TRACE_BEGIN("send", NULL);
     int ret = send(cli_socket, buff, strlen(buff), 0);
+    TRACE_END("send");
     if (ret == -1)
     {
         return ERR_RDSH_COMMUNICATION;
@@ -535,14 +776,17 @@ int send_message_string(int cli_socket, char *buff)
     return ret;
 }
 
-// This function sets up redirection for a command in a pipeline or with a socket
-void setup_pipeline_redirections(int i, command_list_t *clist, int cli_sock, int pipes[][2])
+// This function sets up redirection for a command in a pipeline or with a
+// socket, in_fd is what the first command reads and out_fd where the last
+// one writes.  Every command's stderr goes to err_fd.  All three are the
+// client socket unless the session is framed or the event server runs it
+void setup_pipeline_redirections(int i, command_list_t *clist, int in_fd, int out_fd, int err_fd, int pipes[][2])
 {
     // if the first command is built in and doesn't have an input file
     if (i == 0 && !clist->commands[i].input_file)
     {
         // link the stdin to the client socket
-        dup2(cli_sock, STDIN_FILENO);
+        dup2(in_fd, STDIN_FILENO);
     }
     else if (i > 0)
     {
@@ -553,33 +797,41 @@ void setup_pipeline_redirections(int i, command_list_t *clist, int cli_sock, int
     // if the last command is built in and doesn't have an ouput file
     if (i == clist->num - 1 && !clist->commands[i].output_file)
     {
-        // link the stdout and stderr to the client socket
-        dup2(cli_sock, STDOUT_FILENO);
-        dup2(cli_sock, STDERR_FILENO);
+        // link the stdout to the client socket
+        dup2(out_fd, STDOUT_FILENO);
     }
     else if (i < clist->num - 1)
     {
         // link the stdout to the next pipe
         dup2(pipes[i][1], STDOUT_FILENO);
     }
+    dup2(err_fd, STDERR_FILENO);
 }
 
 // executes the forked command, handles redirection and error checking
-int rsh_exec_cmd(command_list_t *clist, int pipes[][2], pid_t *pids, int i, int cli_sock)
+int rsh_exec_cmd(command_list_t *clist, int pipes[][2], pid_t *pids, int i, int in_fd, int out_fd, int err_fd)
 {
+    TRACE_BEGIN("fork", clist->commands[i].argv[0]);
+    // a child that can't exec prints and exits, which would also flush
+    // whatever the server hadn't printed yet to the client
+    fflush(stdout);
     pids[i] = fork();
+    if (pids[i] != 0)
+    {
+        TRACE_END("fork");
+    }
     if (pids[i] < 0)
     {
-        printf(CMD_ERR_FORK);
+        // the caller tells the session
         return ERR_MEMORY;
     }
 
     // this is a child process
     if (pids[i] == 0)
     {
-        handle_redirection(i, clist);
+        setup_pipeline_redirections(i, clist, in_fd, out_fd, err_fd, pipes);
 
-        setup_pipeline_redirections(i, clist, cli_sock, pipes);
+        handle_redirection(i, clist);
 
         // Close all pipe ends in child
         for (int j = 0; j < clist->num - 1; j++)
@@ -642,19 +894,52 @@ int rsh_exec_cmd(command_list_t *clist, int pipes[][2], pid_t *pids, int i, int
  */
 int rsh_execute_pipeline(int cli_sock, command_list_t *clist)
 {
-    int pipes[clist->num - 1][2]; // Array of pipes
-    pid_t pids[clist->num];       // Array to store process IDs
-    int pids_st[clist->num];      // Array to store process IDs status
-    Built_In_Cmds bi_cmd;         // Built in command holder
-    int exit_code;                // Exit code that will be returned
+    return rsh_run_pipeline(cli_sock, cli_sock, cli_sock, clist);
+}
+
+/*
+ * rsh_run_pipeline(int in_fd, int out_fd, int err_fd, command_list_t *clist)
+ *      in_fd:   what the first command reads when it has no input file
+ *      out_fd:  where the last command's stdout goes
+ *      err_fd:  where every command's stderr goes
+ *      clist:   the parsed line
+ *
+ *  rsh_execute_pipeline() with the ends apart.  Framed sessions and the
+ *  event server (see evserver.h) read the output from pipes instead of
+ *  the socket.
+ *
+ *  Returns:  the same as rsh_execute_pipeline()
+ */
+int rsh_run_pipeline(int in_fd, int out_fd, int err_fd, command_list_t *clist)
+{
+    Built_In_Cmds bi_cmd; // Built in command holder
+    int exit_code;        // Exit code that will be returned
+    uint64_t start = trace_enabled() ? trace_now() : 0;
+
+    // on the heap, a line can hold far more stages than fit on a worker's
+    // stack
+    int (*pipes)[2] = malloc(sizeof(int[2]) * clist->num); // Array of pipes
+    pid_t *pids = malloc(sizeof(pid_t) * clist->num);      // Array to store process IDs
+    int *pids_st = malloc(sizeof(int) * clist->num);       // Array to store process IDs status
+    if (pipes == NULL || pids == NULL || pids_st == NULL)
+    {
+        dprintf(err_fd, CMD_ERR_MEMORY);
+        rsh_free_pipeline(pipes, pids, pids_st);
+        return ERR_MEMORY;
+    }
 
     // Create all necessary pipes
     for (int i = 0; i < clist->num - 1; i++)
     {
-        if (pipe(pipes[i]) == -1)
+        // close on exec, a session forking on another thread mustn't
+        // keep this pipeline's pipes open.  A pipeline can be longer than
+        // there are descriptors left, which only fails this session
+        if (pipe2(pipes[i], O_CLOEXEC) == -1)
         {
-            perror("pipe");
-            exit(EXIT_FAILURE);
+            dprintf(err_fd, CMD_ERR_PIPE_LIMIT, i + 1);
+            rsh_abort_pipeline(pipes, i, pids, 0);
+            rsh_free_pipeline(pipes, pids, pids_st);
+            return ERR_TOO_MANY_COMMANDS;
         }
     }
 
@@ -663,55 +948,19 @@ int rsh_execute_pipeline(int cli_sock, command_list_t *clist)
         bi_cmd = rsh_match_command(clist->commands[i].argv[0]);
         if (bi_cmd != BI_NOT_BI)
         {
-            // save the original stdin, stdout, and stderr
-            int saved_stdin = dup(STDIN_FILENO);
-            int saved_stdout = dup(STDOUT_FILENO);
-            int saved_stderr = dup(STDERR_FILENO);
-
-            handle_redirection(i, clist);
-
-            setup_pipeline_redirections(i, clist, cli_sock, pipes);
-
             // built in command, doesn't need to be forked, labeled as -1
             pids[i] = -1;
-
-            // execute the built in command
-            bi_cmd = rsh_built_in_cmd(&clist->commands[i]);
-            if (bi_cmd == BI_CMD_EXIT)
-            {
-                // store the exit command
-                pids_st[i] = EXIT_SC;
-            }
-            else if (bi_cmd == BI_CMD_STOP_SVR)
-            {
-                // store the stop-server command
-                pids_st[i] = STOP_SERVER_SC;
-            }
-            else if (bi_cmd == BI_CMD_RC)
-            {
-                // store the rc command
-                pids_st[i] = RC_SC;
-            }
-            else
-            {
-                // handle other built in commands as 0
-                pids_st[i] = 0;
-            }
-
-            // restore the original stdin, stdout, and stderr
-            dup2(saved_stdin, STDIN_FILENO);
-            dup2(saved_stdout, STDOUT_FILENO);
-            dup2(saved_stderr, STDERR_FILENO);
-            close(saved_stdin);
-            close(saved_stdout);
-            close(saved_stderr);
+            pids_st[i] = rsh_run_built_in(clist, i, out_fd, pipes);
         }
         else
         {
             // not a built in command, perform fork/exec
-            int rc = rsh_exec_cmd(clist, pipes, pids, i, cli_sock);
+            int rc = rsh_exec_cmd(clist, pipes, pids, i, in_fd, out_fd, err_fd);
             if (rc < 0)
             {
+                dprintf(err_fd, CMD_ERR_FORK);
+                rsh_abort_pipeline(pipes, clist->num - 1, pids, i);
+                rsh_free_pipeline(pipes, pids, pids_st);
                 return rc;
             }
         }
@@ -725,14 +974,17 @@ int rsh_execute_pipeline(int cli_sock, command_list_t *clist)
     }
 
     // Wait for all children
+    TRACE_BEGIN("wait", NULL);
     for (int i = 0; i < clist->num; i++)
     {
         // wait for forked children only
         if (pids[i] != -1)
         {
             waitpid(pids[i], &pids_st[i], 0);
+            TRACE_COMPLETE("stage", clist->commands[i].argv[0], pids[i], start);
         }
     }
+    TRACE_END("wait");
 
     // by default get exit code of last process
     // use this as the return value
@@ -757,9 +1009,109 @@ int rsh_execute_pipeline(int cli_sock, command_list_t *clist)
             exit_code = STOP_SERVER_SC;
         }
     }
+    rsh_free_pipeline(pipes, pids, pids_st);
     return exit_code;
 }
 
+/*
+ * rsh_abort_pipeline(pipes, num_pipes, pids, started)
+ *      pipes:    a pipeline's pipes, the first num_pipes of them are open
+ *      pids:     its processes, the first started stages were launched
+ *
+ *  Undoes a pipeline that couldn't be set up all the way: closes the pipes
+ *  and kills and reaps the stages that were forked, so the session carries
+ *  on with nothing left behind.
+ */
+void rsh_abort_pipeline(int pipes[][2], int num_pipes, pid_t *pids, int started)
+{
+    for (int i = 0; i < num_pipes; i++)
+    {
+        close(pipes[i][0]);
+        close(pipes[i][1]);
+    }
+    for (int i = 0; i < started; i++)
+    {
+        if (pids[i] > 0)
+        {
+            kill(pids[i], SIGKILL);
+            waitpid(pids[i], NULL, 0);
+        }
+    }
+}
+
+// frees what rsh_run_pipeline() allocated for a pipeline
+static void rsh_free_pipeline(int pipes[][2], pid_t *pids, int *pids_st)
+{
+    free(pipes);
+    free(pids);
+    free(pids_st);
+}
+
+/*
+ * rsh_run_built_in(clist, i, out_fd, pipes)
+ *      clist, pipes:  the pipeline
+ *      i:             the stage, a built in
+ *      out_fd:        where the last stage writes
+ *
+ *  Runs a built in on the session's own thread.  Sessions run side by side,
+ *  so nothing process wide is touched: what it prints goes through a stream
+ *  of its own to the descriptor the stage writes to, its output file, the
+ *  next pipe or out_fd.  Only forked children dup2().  None of the server's
+ *  built ins read their input.
+ *
+ *  Returns:  EXIT_SC, STOP_SERVER_SC or RC_SC for those, otherwise the
+ *            status of the built in
+ */
+int rsh_run_built_in(command_list_t *clist, int i, int out_fd, int pipes[][2])
+{
+    cmd_buff_t *cmd = &clist->commands[i];
+    int fd = i < clist->num - 1 ? pipes[i][1] : out_fd;
+    if (cmd->output_file != NULL)
+    {
+        int flags = O_WRONLY | O_CREAT | O_CLOEXEC | (cmd->append_mode ? O_APPEND : O_TRUNC);
+        int file = open(cmd->output_file, flags, 0644);
+        if (file < 0)
+        {
+            int err = errno;
+            dprintf(fd, "%s", exec_error_msg(err));
+            return err;
+        }
+        fd = file;
+    }
+    else
+    {
+        fd = fcntl(fd, F_DUPFD_CLOEXEC, 0);
+    }
+
+    FILE *out = fd >= 0 ? fdopen(fd, "w") : NULL;
+    if (out == NULL)
+    {
+        if (fd >= 0)
+        {
+            close(fd);
+        }
+        return ERR_RDSH_CMD_EXEC;
+    }
+
+    int rc;
+    switch (rsh_built_in_cmd(cmd, out, &rc))
+    {
+    case BI_CMD_EXIT:
+        rc = EXIT_SC;
+        break;
+    case BI_CMD_STOP_SVR:
+        rc = STOP_SERVER_SC;
+        break;
+    case BI_CMD_RC:
+        rc = RC_SC;
+        break;
+    default:
+        break;
+    }
+    fclose(out);
+    return rc;
+}
+
 /**************   OPTIONAL STUFF  ***************/
 /****
  **** NOTE THAT THE FUNCTIONS BELOW ALIGN TO HOW WE CRAFTED THE SOLUTION
@@ -795,23 +1147,17 @@ int rsh_execute_pipeline(int cli_sock, command_list_t *clist)
  */
 Built_In_Cmds rsh_match_command(const char *input)
 {
-    if (strcmp(input, "exit") == 0)
-        return BI_CMD_EXIT;
-    if (strcmp(input, "dragon") == 0)
-        return BI_CMD_DRAGON;
-    if (strcmp(input, "cd") == 0)
-        return BI_CMD_CD;
-    if (strcmp(input, "stop-server") == 0)
-        return BI_CMD_STOP_SVR;
-    if (strcmp(input, "rc") == 0)
-        return BI_CMD_RC;
-    return BI_NOT_BI;
+    // the same registry as dsh, see registry.h
+    const bi_entry_t *e = bi_lookup(input, BI_F_REMOTE);
+    return e != NULL ? e->code : BI_NOT_BI;
 }
 
 /*
- * rsh_built_in_cmd(cmd_buff_t *cmd)
- *      cmd:  The cmd_buff_t of the command, remember, this is the
- *            parsed version fo the command
+ * rsh_built_in_cmd(cmd_buff_t *cmd, FILE *out, int *status)
+ *      cmd:     The cmd_buff_t of the command, remember, this is the
+ *               parsed version fo the command
+ *      out:     where the built in prints, see rsh_run_built_in()
+ *      status:  set to what the built in returned, 0 for the ones run here
  *
  *  This optional function accepts a parsed cmd and then checks to see if
  *  the cmd is built in or not.  It calls rsh_match_command to see if the
@@ -840,15 +1186,25 @@ Built_In_Cmds rsh_match_command(const char *input)
  *   AGAIN - THIS IS TOTALLY OPTIONAL IF YOU HAVE OR WANT TO HANDLE BUILT-IN
  *   COMMANDS DIFFERENTLY.
  */
-Built_In_Cmds rsh_built_in_cmd(cmd_buff_t *cmd)
+Built_In_Cmds rsh_built_in_cmd(cmd_buff_t *cmd, FILE *out, int *status)
 {
-    Built_In_Cmds ctype = BI_NOT_BI;
-    ctype = rsh_match_command(cmd->argv[0]);
+    const bi_entry_t *e = bi_lookup(cmd->argv[0], BI_F_REMOTE);
+    *status = 0;
+    if (e == NULL)
+    {
+        return BI_NOT_BI;
+    }
+
+    if (e->handler != NULL)
+    {
+        *status = e->handler(cmd->argc, cmd->argv, out);
+        return BI_EXECUTED;
+    }
 
-    switch (ctype)
+    switch (e->code)
     {
     case BI_CMD_DRAGON:
-        print_dragon();
+        print_dragon(out);
         return BI_EXECUTED;
     case BI_CMD_EXIT:
         return BI_CMD_EXIT;
@@ -1,6 +1,8 @@
 #ifndef __RSH_LIB_H__
 #define __RSH_LIB_H__
 
+#include <stdio.h>
+
 #include "dshlib.h"
 
 // common remote shell client and server constants and definitions
@@ -26,6 +28,10 @@
 // use an end of stream marker.  Since rsh is a "shell" program we will be using
 // ascii code 0x04, which is commonly used as the end-of-file (EOF) character in
 // linux based systems.
+//
+// That is the legacy protocol now.  Output holding 0x04 ends early with it, so
+// clients send length-prefixed frames instead, see frame.h.  The servers
+// still serve legacy clients, and dsh -c -l is one.
 static const char RDSH_EOF_CHAR = 0x04;
 
 // rdsh specific error codes for functions
@@ -53,6 +59,7 @@ static const char RDSH_EOF_CHAR = 0x04;
 int start_client(char *address, int port);
 int client_cleanup(int cli_socket, char *cmd_buff, char *rsp_buff, int rc);
 int exec_remote_cmd_loop(char *address, int port);
+void set_legacy_protocol(int val);
 
 // server prototypes for rsh_server.c - see documentation for each function to
 // see what they do
@@ -64,12 +71,16 @@ int send_message_string(int cli_socket, char *buff);
 int process_cli_requests(int svr_socket, int is_threaded);
 int exec_client_requests(int cli_socket);
 int rsh_execute_pipeline(int socket_fd, command_list_t *clist);
-int rsh_exec_cmd(command_list_t *clist, int pipes[][2], pid_t *pids, int i, int cli_sock);
-void setup_pipeline_redirections(int i, command_list_t *clist, int cli_sock, int pipes[][2]);
+int rsh_run_pipeline(int in_fd, int out_fd, int err_fd, command_list_t *clist);
+int rsh_exec_cmd(command_list_t *clist, int pipes[][2], pid_t *pids, int i, int in_fd, int out_fd, int err_fd);
+void setup_pipeline_redirections(int i, command_list_t *clist, int in_fd, int out_fd, int err_fd, int pipes[][2]);
+const char *rsh_parse_error(int rc);
 void *exec_client_requests_threaded(void *arg);
 
 Built_In_Cmds rsh_match_command(const char *input);
-Built_In_Cmds rsh_built_in_cmd(cmd_buff_t *cmd);
+Built_In_Cmds rsh_built_in_cmd(cmd_buff_t *cmd, FILE *out, int *status);
+void rsh_abort_pipeline(int pipes[][2], int num_pipes, pid_t *pids, int started);
+int rsh_run_built_in(command_list_t *clist, int i, int out_fd, int pipes[][2]);
 
 // eliminate from template, for extra credit
 void set_threaded_server(int val);
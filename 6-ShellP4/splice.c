@@ -0,0 +1,444 @@
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "splice.h"
+
+// cat and tee only take the options they have, anything else like
+// `cat -n` is left to the real program
+bool splice_handles(int argc, char *argv[])
+{
+    const char *opts = strcmp(argv[0], TEE_CMD) == 0 ? "a" : "u";
+    for (int i = 1; i < argc && strcmp(argv[i], "--") != 0; i++)
+    {
+        if (argv[i][0] == '-' && argv[i][1] != '\0' && strspn(argv[i] + 1, opts) != strlen(argv[i] + 1))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+// grows a pipe to SPLICE_PIPE_SZ, or as close to it as the kernel allows
+static void grow_pipe(int fd)
+{
+    int size = fcntl(fd, F_GETPIPE_SZ);
+    for (int want = SPLICE_PIPE_SZ; size >= 0 && want > size; want /= 2)
+    {
+        if (fcntl(fd, F_SETPIPE_SZ, want) >= 0)
+        {
+            return;
+        }
+    }
+}
+
+static bool is_pipe(int fd)
+{
+    struct stat st;
+    return fstat(fd, &st) == 0 && S_ISFIFO(st.st_mode);
+}
+
+static int write_all(int fd, const char *buff, size_t n)
+{
+    while (n > 0)
+    {
+        ssize_t m = write(fd, buff, n);
+        if (m < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (m <= 0)
+        {
+            return -1;
+        }
+        buff += m;
+        n -= m;
+    }
+    return 0;
+}
+
+// copies through a buffer, for descriptors the kernel can't move between
+static int copy_all(int in, int out)
+{
+    char buff[SPLICE_COPY_BUFF_SZ];
+    while (1)
+    {
+        ssize_t n = read(in, buff, sizeof(buff));
+        if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n <= 0)
+        {
+            return (int)n;
+        }
+        if (write_all(out, buff, n) < 0)
+        {
+            return -1;
+        }
+    }
+}
+
+// moves everything from in to out with the cheapest call the two kinds of
+// descriptor allow: splice() when either one is a pipe, copy_file_range()
+// between two files, otherwise read() and write().  A call the kernel
+// refuses for these descriptors falls back to copying from where it stopped
+// returns 0, or -1 with errno set
+static int move_all(int in, int out)
+{
+    struct stat inSt;
+    struct stat outSt;
+    if (fstat(in, &inSt) < 0 || fstat(out, &outSt) < 0)
+    {
+        return -1;
+    }
+
+    bool inPipe = S_ISFIFO(inSt.st_mode);
+    bool outPipe = S_ISFIFO(outSt.st_mode);
+    if (inPipe)
+    {
+        grow_pipe(in);
+    }
+    if (outPipe)
+    {
+        grow_pipe(out);
+    }
+
+    if (inPipe || outPipe)
+    {
+        while (1)
+        {
+            ssize_t n = splice(in, NULL, out, NULL, SPLICE_CHUNK_SZ, SPLICE_F_MOVE | SPLICE_F_MORE);
+            if (n == 0)
+            {
+                return 0;
+            }
+            if (n > 0 || errno == EINTR)
+            {
+                continue;
+            }
+            if (errno != EINVAL)
+            {
+                return -1;
+            }
+            break;
+        }
+    }
+    else if (S_ISREG(inSt.st_mode) && S_ISREG(outSt.st_mode))
+    {
+        while (1)
+        {
+            ssize_t n = copy_file_range(in, NULL, out, NULL, SPLICE_CHUNK_SZ, 0);
+            if (n == 0)
+            {
+                return 0;
+            }
+            if (n > 0 || errno == EINTR)
+            {
+                continue;
+            }
+            // EBADF is an output opened with O_APPEND
+            if (errno != EINVAL && errno != EXDEV && errno != ENOSYS && errno != EOPNOTSUPP && errno != EBADF)
+            {
+                return -1;
+            }
+            break;
+        }
+    }
+
+    return copy_all(in, out);
+}
+
+// true if writing in to out would read back its own output
+static bool same_file(int in, int out)
+{
+    struct stat inSt;
+    struct stat outSt;
+    return fstat(in, &inSt) == 0 && fstat(out, &outSt) == 0 && S_ISREG(inSt.st_mode) &&
+           inSt.st_dev == outSt.st_dev && inSt.st_ino == outSt.st_ino && inSt.st_size > 0;
+}
+
+/*
+ *  bi_cat
+ *      in:   standard input of the command
+ *      out:  standard output of the command
+ *
+ *  cat [-u] [file ...], writes each file, or in for - or when there are
+ *  none, to out.  -u is accepted and ignored, nothing is buffered anyway.
+ *
+ *  returns:  0, or 1 if a file could not be read or out written
+ */
+int bi_cat(int argc, char *argv[], int in, int out)
+{
+    int rc = 0;
+    int first = 1;
+    bool opts = true;
+
+    // skip the options, -- ends them
+    for (; first < argc && opts && argv[first][0] == '-' && argv[first][1] != '\0'; first++)
+    {
+        opts = strcmp(argv[first], "--") != 0;
+    }
+
+    // without files it copies its input
+    char *stdinOnly[] = {"-"};
+    char **files = first < argc ? argv + first : stdinOnly;
+    int numFiles = first < argc ? argc - first : 1;
+
+    for (int i = 0; i < numFiles; i++)
+    {
+        const char *name = files[i];
+        int fd = strcmp(name, "-") == 0 ? in : open(name, O_RDONLY);
+        if (fd < 0)
+        {
+            fprintf(stderr, "%s: %s: %s\n", CAT_CMD, name, strerror(errno));
+            rc = 1;
+            continue;
+        }
+
+        if (same_file(fd, out))
+        {
+            fprintf(stderr, "%s: %s: input file is output file\n", CAT_CMD, name);
+            rc = 1;
+        }
+        else if (move_all(fd, out) < 0)
+        {
+            fprintf(stderr, "%s: %s: %s\n", CAT_CMD, name, strerror(errno));
+            rc = 1;
+        }
+
+        if (fd != in)
+        {
+            close(fd);
+        }
+    }
+    return rc;
+}
+
+// takes exactly n bytes, which are already waiting in pipe in, and writes
+// them to fd.  The bytes leave the pipe even when fd is -1 or writing to it
+// fails.  returns 0, or -1 with errno set if writing failed
+static int take_exact(int in, int fd, size_t n)
+{
+    int err = 0;
+    while (n > 0 && fd >= 0)
+    {
+        ssize_t m = splice(in, NULL, fd, NULL, n, SPLICE_F_MOVE);
+        if (m > 0)
+        {
+            n -= m;
+            continue;
+        }
+        if (m < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        // EINVAL is a file splice() can't write to, the rest is copied
+        if (m == 0 || errno != EINVAL)
+        {
+            err = m == 0 ? EIO : errno;
+        }
+        break;
+    }
+
+    char buff[SPLICE_COPY_BUFF_SZ];
+    while (n > 0)
+    {
+        ssize_t m = read(in, buff, n < sizeof(buff) ? n : sizeof(buff));
+        if (m < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (m <= 0)
+        {
+            break;
+        }
+        n -= m;
+        if (fd >= 0 && err == 0 && write_all(fd, buff, m) < 0)
+        {
+            err = errno;
+        }
+    }
+
+    errno = err;
+    return err == 0 ? 0 : -1;
+}
+
+static void file_error(const char *name, int *fd, int *rc)
+{
+    fprintf(stderr, "%s: %s: %s\n", TEE_CMD, name, strerror(errno));
+    close(*fd);
+    *fd = -1;
+    *rc = 1;
+}
+
+// tee between two pipes without copying: tee() duplicates what is waiting
+// in the input into the output without taking it, each file but the last
+// gets its own duplicate through a scratch pipe, and the last file takes
+// the bytes out of the input.  returns false if it can't be done this way
+static bool tee_pipes(int in, int out, char *names[], int fds[], int n, int *rc)
+{
+    int scratch[2] = {-1, -1};
+    grow_pipe(in);
+    grow_pipe(out);
+
+    // a duplicate has to fit the scratch pipe in one go, tee() always
+    // starts at the front of the input
+    if (n > 1)
+    {
+        if (pipe2(scratch, O_CLOEXEC) < 0)
+        {
+            return false;
+        }
+        grow_pipe(scratch[0]);
+        if (fcntl(scratch[0], F_GETPIPE_SZ) < fcntl(in, F_GETPIPE_SZ))
+        {
+            close(scratch[0]);
+            close(scratch[1]);
+            return false;
+        }
+    }
+
+    while (1)
+    {
+        ssize_t len = tee(in, out, SPLICE_CHUNK_SZ, 0);
+        if (len < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (len < 0)
+        {
+            fprintf(stderr, "%s: standard output: %s\n", TEE_CMD, strerror(errno));
+            *rc = 1;
+            break;
+        }
+        if (len == 0)
+        {
+            break;
+        }
+
+        for (int f = 0; f < n - 1; f++)
+        {
+            if (fds[f] < 0)
+            {
+                continue;
+            }
+            ssize_t dup = tee(in, scratch[1], len, 0);
+            if (dup < 0 || take_exact(scratch[0], fds[f], dup) < 0)
+            {
+                file_error(names[f], &fds[f], rc);
+            }
+        }
+        if (take_exact(in, fds[n - 1], len) < 0)
+        {
+            file_error(names[n - 1], &fds[n - 1], rc);
+        }
+    }
+
+    if (scratch[0] >= 0)
+    {
+        close(scratch[0]);
+        close(scratch[1]);
+    }
+    return true;
+}
+
+/*
+ *  bi_tee
+ *      in:   standard input of the command
+ *      out:  standard output of the command
+ *
+ *  tee [-a] [file ...], copies in to out and to each file.  With -a the
+ *  files are appended to instead of truncated.  When in and out are both
+ *  pipes nothing is copied through the process, see tee_pipes().
+ *
+ *  returns:  0, or 1 if a file could not be opened or written
+ */
+int bi_tee(int argc, char *argv[], int in, int out)
+{
+    int rc = 0;
+    bool append = false;
+    int i = 1;
+
+    for (; i < argc && argv[i][0] == '-' && argv[i][1] != '\0'; i++)
+    {
+        if (strcmp(argv[i], "--") == 0)
+        {
+            i++;
+            break;
+        }
+        append = true;
+    }
+
+    int n = 0;
+    char **names = argv + i;
+    int fds[argc > i ? argc - i : 1];
+    for (; i < argc; i++)
+    {
+        int flags = O_WRONLY | O_CREAT | O_CLOEXEC | (append ? O_APPEND : O_TRUNC);
+        fds[n] = open(argv[i], flags, 0644);
+        if (fds[n] < 0)
+        {
+            fprintf(stderr, "%s: %s: %s\n", TEE_CMD, argv[i], strerror(errno));
+            rc = 1;
+        }
+        n++;
+    }
+
+    // with no files tee is cat
+    if (n == 0)
+    {
+        if (move_all(in, out) < 0)
+        {
+            fprintf(stderr, "%s: %s\n", TEE_CMD, strerror(errno));
+            rc = 1;
+        }
+        return rc;
+    }
+
+    if (!is_pipe(in) || !is_pipe(out) || !tee_pipes(in, out, names, fds, n, &rc))
+    {
+        char buff[SPLICE_COPY_BUFF_SZ];
+        bool outOk = true;
+        while (1)
+        {
+            ssize_t len = read(in, buff, sizeof(buff));
+            if (len < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            if (len <= 0)
+            {
+                break;
+            }
+            if (outOk && write_all(out, buff, len) < 0)
+            {
+                fprintf(stderr, "%s: standard output: %s\n", TEE_CMD, strerror(errno));
+                outOk = false;
+                rc = 1;
+            }
+            for (int f = 0; f < n; f++)
+            {
+                if (fds[f] >= 0 && write_all(fds[f], buff, len) < 0)
+                {
+                    file_error(names[f], &fds[f], &rc);
+                }
+            }
+        }
+    }
+
+    for (int f = 0; f < n; f++)
+    {
+        if (fds[f] >= 0)
+        {
+            close(fds[f]);
+        }
+    }
+    return rc;
+}
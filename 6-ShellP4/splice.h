@@ -0,0 +1,31 @@
+#ifndef __SPLICE_H__
+#define __SPLICE_H__
+
+#include <stdbool.h>
+
+// cat and tee are built in so a pipeline that moves a lot of data, like
+// `cat big.log | grep x > out`, doesn't copy every byte into a process and
+// back out again.  Between a file and a pipe the data is moved with
+// splice(), tee duplicates a pipe with tee(), and a file is copied to a
+// file with copy_file_range(), so the bytes stay in the kernel.  Anything
+// else, like a terminal, falls back to read() and write().
+#define CAT_CMD "cat"
+#define TEE_CMD "tee"
+
+// the pipes next to cat and tee are grown to this size, fewer and bigger
+// transfers are what makes them fast.  The kernel caps it at
+// /proc/sys/fs/pipe-max-size, 1 MB by default
+#define SPLICE_PIPE_SZ (1024 * 1024)
+
+// largest transfer asked for in one call
+#define SPLICE_CHUNK_SZ (1024 * 1024)
+
+// buffer for the read() and write() fallback
+#define SPLICE_COPY_BUFF_SZ 65536
+
+// prototypes for cat and tee, see splice.c
+bool splice_handles(int argc, char *argv[]);
+int bi_cat(int argc, char *argv[], int in, int out);
+int bi_tee(int argc, char *argv[], int in, int out);
+
+#endif
@@ -0,0 +1,294 @@
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+#include "stats.h"
+#include "jobs.h"
+#include "trace.h"
+
+static stage_stats_t *stages = NULL; // one per stage of the pipeline
+static int num_stages = 0;
+static int cap_stages = 0;
+static bool recorded = false; // stages holds a pipeline that has finished
+static bool always = false;   // stats on
+static struct timespec start; // when the pipeline was started
+static struct rusage self_start;
+
+// stats on makes every pipeline recorded, not just the timed ones
+bool stats_enabled(void)
+{
+    return always;
+}
+
+static double since_start(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start.tv_sec) + (now.tv_nsec - start.tv_nsec) / 1e9;
+}
+
+static double tv_sec(struct timeval tv)
+{
+    return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+// called before the pipeline is started, names the stages and starts the
+// clock.  If there is no memory for them the pipeline is just not recorded
+void stats_begin(command_list_t *clist)
+{
+    recorded = false;
+    num_stages = 0;
+    if (clist->num > cap_stages)
+    {
+        stage_stats_t *grown = realloc(stages, clist->num * sizeof(stage_stats_t));
+        if (grown == NULL)
+        {
+            return;
+        }
+        stages = grown;
+        cap_stages = clist->num;
+    }
+
+    num_stages = clist->num;
+    memset(stages, 0, num_stages * sizeof(stage_stats_t));
+    for (int i = 0; i < num_stages; i++)
+    {
+        snprintf(stages[i].name, STATS_NAME_SZ, "%s", clist->commands[i].argv[0]);
+        stages[i].pid = -1;
+    }
+
+    getrusage(RUSAGE_SELF, &self_start);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+}
+
+static void record(stage_stats_t *s, int status, struct rusage *ru)
+{
+    s->real = since_start();
+    if (WIFEXITED(status))
+        s->status = WEXITSTATUS(status);
+    else if (WIFSIGNALED(status))
+        s->status = 128 + WTERMSIG(status);
+    s->user = tv_sec(ru->ru_utime);
+    s->sys = tv_sec(ru->ru_stime);
+    s->maxrss = ru->ru_maxrss;
+    s->nvcsw = ru->ru_nvcsw;
+    s->nivcsw = ru->ru_nivcsw;
+}
+
+// a built in that ran in the shell is charged what the shell used meanwhile
+static void record_self(stage_stats_t *s, int status)
+{
+    struct rusage now;
+    getrusage(RUSAGE_SELF, &now);
+    s->real = since_start();
+    s->status = status;
+    s->user = tv_sec(now.ru_utime) - tv_sec(self_start.ru_utime);
+    s->sys = tv_sec(now.ru_stime) - tv_sec(self_start.ru_stime);
+    s->maxrss = now.ru_maxrss;
+    s->nvcsw = now.ru_nvcsw - self_start.ru_nvcsw;
+    s->nivcsw = now.ru_nivcsw - self_start.ru_nivcsw;
+}
+
+// waits for pid with wait4() and records it as stage i
+static int reap_stage(pid_t *pids, int i, bool keep)
+{
+    int status = 0;
+    struct rusage ru;
+    while (wait4(pids[i], &status, 0, &ru) < 0)
+    {
+        if (errno != EINTR)
+        {
+            return status;
+        }
+    }
+    if (keep)
+    {
+        stages[i].pid = pids[i];
+        record(&stages[i], status, &ru);
+    }
+    TRACE_COMPLETE("stage", keep ? stages[i].name : NULL, pids[i],
+                   (uint64_t)start.tv_sec * 1000000000ull + start.tv_nsec);
+    return status;
+}
+
+/*
+ *  stats_wait
+ *      num:      stages in the pipeline
+ *      pids:     one per stage, -1 for a stage that ran in the shell or
+ *                could not be started
+ *      spawnRc:  why the last stage could not be started, or 0
+ *      lastRc:   the status before the pipeline was waited for
+ *
+ *  Waits for the pipeline started after stats_begin() like execute_pipeline()
+ *  does, but with wait4() so each stage's resource usage is recorded.  The
+ *  stages are reaped in the order they finish, poll() on their pidfds tells
+ *  which one that is, so the wall time of each is when it really exited.
+ *  If stats_begin() had no memory for the stages they are only waited for.
+ *
+ *  returns:  the exit status of the pipeline
+ */
+int stats_wait(int num, pid_t *pids, int spawnRc, int lastRc)
+{
+    int n = num;
+    bool keep = num_stages == num;
+    int live = 0;
+
+    // on the heap, a line can hold far more stages than fit on the stack.
+    // Without them every stage is waited for in order
+    int *statuses = malloc(n * sizeof(int));
+    struct pollfd *fds = malloc(n * sizeof(struct pollfd));
+    int *who = malloc(n * sizeof(int));
+    if (statuses == NULL || fds == NULL || who == NULL)
+    {
+        int rc = lastRc;
+        for (int i = 0; i < n; i++)
+        {
+            int status = pids[i] == -1 ? -1 : reap_stage(pids, i, keep);
+            if (status != -1 && WIFEXITED(status))
+            {
+                rc = WEXITSTATUS(status);
+            }
+        }
+        free(statuses);
+        free(fds);
+        free(who);
+        recorded = false;
+        return spawnRc > 0 ? spawnRc : rc;
+    }
+
+    for (int i = 0; i < n; i++)
+    {
+        statuses[i] = -1;
+        if (pids[i] == -1)
+        {
+            continue;
+        }
+        // without a pidfd the stage is waited for in order
+        fds[live].fd = jobs_open_pidfd(pids[i]);
+        if (fds[live].fd < 0)
+        {
+            statuses[i] = reap_stage(pids, i, keep);
+            continue;
+        }
+        fds[live].events = POLLIN;
+        who[live] = i;
+        live++;
+    }
+
+    while (live > 0)
+    {
+        int ready = poll(fds, live, -1);
+        if (ready < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        for (int k = 0; k < live; k++)
+        {
+            if (ready < 0 || fds[k].revents != 0)
+            {
+                statuses[who[k]] = reap_stage(pids, who[k], keep);
+                close(fds[k].fd);
+                fds[k] = fds[live - 1];
+                who[k] = who[live - 1];
+                live--;
+                k--;
+            }
+        }
+    }
+
+    int rc = lastRc;
+    for (int i = 0; i < n; i++)
+    {
+        if (statuses[i] != -1 && WIFEXITED(statuses[i]))
+        {
+            rc = WEXITSTATUS(statuses[i]);
+        }
+    }
+    free(statuses);
+    free(fds);
+    free(who);
+
+    // the last command never ran, its status is why
+    if (spawnRc > 0)
+    {
+        rc = spawnRc;
+    }
+
+    if (keep && n == 1 && pids[0] == -1 && spawnRc == 0)
+    {
+        record_self(&stages[0], lastRc);
+    }
+    else if (keep)
+    {
+        stages[n - 1].status = spawnRc > 0 ? spawnRc : stages[n - 1].status;
+    }
+
+    recorded = keep;
+    return rc;
+}
+
+// prints the last pipeline recorded, a stage per line and then the total
+void stats_print(FILE *out)
+{
+    double real = 0;
+    double user = 0;
+    double sys = 0;
+
+    fprintf(out, STATS_HDR);
+    for (int i = 0; i < num_stages; i++)
+    {
+        stage_stats_t *s = &stages[i];
+        fprintf(out, STATS_ROW, s->real, s->user, s->sys, s->maxrss, s->nvcsw, s->nivcsw, s->status, s->name);
+        real = s->real > real ? s->real : real;
+        user += s->user;
+        sys += s->sys;
+    }
+    fprintf(out, STATS_TOTAL, real, user, sys);
+}
+
+/*
+ *  stats_cmd
+ *
+ *  stats         prints the last pipeline that was timed or recorded
+ *  stats on      records every pipeline from now on
+ *  stats off     only records the ones run with time
+ */
+int stats_cmd(int argc, char *argv[], FILE *out)
+{
+    if (argc == 1)
+    {
+        if (!recorded)
+        {
+            fprintf(out, STATS_ERR_NONE);
+            return 1;
+        }
+        stats_print(out);
+        return 0;
+    }
+
+    if (argc == 2 && (strcmp(argv[1], "on") == 0 || strcmp(argv[1], "off") == 0))
+    {
+        always = strcmp(argv[1], "on") == 0;
+        return 0;
+    }
+
+    fprintf(out, STATS_USAGE);
+    return 1;
+}
+
+void stats_free(void)
+{
+    free(stages);
+    stages = NULL;
+    num_stages = 0;
+    cap_stages = 0;
+    recorded = false;
+}
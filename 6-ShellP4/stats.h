@@ -0,0 +1,50 @@
+#ifndef __STATS_H__
+#define __STATS_H__
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <sys/types.h>
+
+#include "dshlib.h"
+
+// `time pipeline` reports what each stage of the pipeline used: wall time
+// from the start of the pipeline until the stage exited, user and system
+// CPU, max RSS and context switches, taken from wait4().  `stats on` keeps
+// recording every pipeline without printing, and `stats` shows the last one
+// recorded, the way rc shows the last status.  When neither is used the
+// pipeline is waited for with plain waitpid() and nothing is recorded.
+#define TIME_CMD "time"
+#define STATS_CMD "stats"
+
+// stages are named by their command, cut to this length
+#define STATS_NAME_SZ 32
+
+typedef struct stage_stats
+{
+    char name[STATS_NAME_SZ]; // argv[0] of the stage
+    pid_t pid;                // -1 if it ran in the shell or never started
+    int status;               // exit status, 128 + signal if killed
+    double real;              // seconds from the start of the pipeline
+    double user;              // CPU seconds in user mode
+    double sys;               // CPU seconds in the kernel
+    long maxrss;              // KB
+    long nvcsw;               // voluntary context switches
+    long nivcsw;              // involuntary context switches
+} stage_stats_t;
+
+// output constants for time and stats
+#define STATS_HDR "real\tuser\tsys\tmaxrss\tvcsw\tivcsw\tstatus\tcommand\n"
+#define STATS_ROW "%.3f\t%.3f\t%.3f\t%ldK\t%ld\t%ld\t%d\t%s\n"
+#define STATS_TOTAL "%.3f\t%.3f\t%.3f\t\t\t\t\ttotal\n"
+#define STATS_USAGE "usage: stats [on | off]\n"
+#define STATS_ERR_NONE "stats: nothing recorded, use time or stats on\n"
+
+// prototypes for stage accounting, see stats.c
+bool stats_enabled(void);
+void stats_begin(command_list_t *clist);
+int stats_wait(int num, pid_t *pids, int spawnRc, int lastRc);
+void stats_print(FILE *out);
+int stats_cmd(int argc, char *argv[], FILE *out);
+void stats_free(void);
+
+#endif
@@ -0,0 +1,125 @@
+/*
+ * mkbitable.c
+ *
+ * Writes bi_table.h, the perfect hash table of the built ins in
+ * builtins.def, to stdout.  It looks for the smallest power of two table
+ * and a seed for bi_hash() with which no two names share a slot, so
+ * bi_lookup() never has to probe.  Run by the makefile whenever
+ * builtins.def changes.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "registry.h"
+#include "rshlib.h"
+#include "builtins.h"
+#include "pathhash.h"
+#include "jobs.h"
+#include "parallel.h"
+#include "splice.h"
+#include "stats.h"
+#include "trace.h"
+#include "lineedit.h"
+#include "parsecache.h"
+#include "workpool.h"
+
+// seeds tried per table size before the table is doubled
+#define MAX_SEEDS 1000000
+
+typedef struct gen_entry
+{
+    const char *name;
+    const char *code;
+    const char *handler;
+    const char *flags;
+} gen_entry_t;
+
+static const gen_entry_t entries[] = {
+#define BUILTIN(name, code, handler, flags) {name, #code, #handler, #flags},
+#include "builtins.def"
+#undef BUILTIN
+};
+#define NUM_ENTRIES (int)(sizeof(entries) / sizeof(entries[0]))
+
+// true if every name gets its own slot, slots[] is filled with the entries
+static int try_seed(uint32_t seed, uint32_t size, int *slots)
+{
+    for (uint32_t s = 0; s < size; s++)
+    {
+        slots[s] = -1;
+    }
+    for (int i = 0; i < NUM_ENTRIES; i++)
+    {
+        uint32_t s = bi_hash(entries[i].name, seed) & (size - 1);
+        if (slots[s] != -1)
+        {
+            return 0;
+        }
+        slots[s] = i;
+    }
+    return 1;
+}
+
+static void print_name(const char *name)
+{
+    putchar('"');
+    for (; *name != '\0'; name++)
+    {
+        if (*name == '"' || *name == '\\')
+        {
+            putchar('\\');
+        }
+        putchar(*name);
+    }
+    putchar('"');
+}
+
+int main(void)
+{
+    uint32_t size = 1;
+    while (size < (uint32_t)NUM_ENTRIES)
+    {
+        size *= 2;
+    }
+
+    for (;; size *= 2)
+    {
+        int *slots = malloc(size * sizeof(int));
+        if (slots == NULL)
+        {
+            perror("mkbitable");
+            return EXIT_FAILURE;
+        }
+
+        // 2166136261 is the usual FNV offset basis, the seeds count up from it
+        for (uint32_t seed = 2166136261u; seed < 2166136261u + MAX_SEEDS; seed++)
+        {
+            if (!try_seed(seed, size, slots))
+            {
+                continue;
+            }
+
+            printf("// generated by tools/mkbitable from builtins.def, do not edit\n");
+            printf("#ifndef __BI_TABLE_H__\n#define __BI_TABLE_H__\n\n");
+            printf("#define BI_TABLE_SEED %uu\n", seed);
+            printf("#define BI_TABLE_SZ %u\n\n", size);
+            printf("static const bi_entry_t bi_table[BI_TABLE_SZ] = {\n");
+            for (uint32_t s = 0; s < size; s++)
+            {
+                if (slots[s] == -1)
+                {
+                    continue;
+                }
+                const gen_entry_t *e = &entries[slots[s]];
+                printf("    [%u] = {", s);
+                print_name(e->name);
+                printf(", %s, %s, %s},\n", e->code, e->handler, e->flags);
+            }
+            printf("};\n\n#endif\n");
+            free(slots);
+            return EXIT_SUCCESS;
+        }
+        free(slots);
+    }
+}
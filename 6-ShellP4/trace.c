@@ -0,0 +1,266 @@
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "trace.h"
+
+_Atomic bool trace_on = false;
+
+static _Atomic(trace_ring_t *) rings = NULL;
+static __thread trace_ring_t *my_ring = NULL;
+static __thread int my_tid = 0;
+static pthread_key_t ring_key;
+static pthread_once_t ring_key_once = PTHREAD_ONCE_INIT;
+
+uint64_t trace_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+// an exiting thread gives its ring back, its events stay until reused
+static void release_ring(void *ring)
+{
+    atomic_store(&((trace_ring_t *)ring)->owned, false);
+}
+
+static void make_ring_key(void)
+{
+    pthread_key_create(&ring_key, release_ring);
+}
+
+// the calling thread's ring: one given back by a thread that exited, or a
+// new one pushed onto the list.  NULL if there is no memory for it
+static trace_ring_t *get_ring(void)
+{
+    if (my_ring != NULL)
+    {
+        return my_ring;
+    }
+
+    pthread_once(&ring_key_once, make_ring_key);
+    for (trace_ring_t *r = atomic_load(&rings); r != NULL && my_ring == NULL; r = r->next)
+    {
+        bool unowned = false;
+        if (atomic_compare_exchange_strong(&r->owned, &unowned, true))
+        {
+            my_ring = r;
+        }
+    }
+
+    if (my_ring == NULL)
+    {
+        trace_ring_t *r = calloc(1, sizeof(trace_ring_t));
+        if (r == NULL)
+        {
+            return NULL;
+        }
+        atomic_store(&r->owned, true);
+        r->next = atomic_load(&rings);
+        while (!atomic_compare_exchange_weak(&rings, &r->next, r))
+        {
+        }
+        my_ring = r;
+    }
+
+    my_tid = gettid();
+    pthread_setspecific(ring_key, my_ring);
+    return my_ring;
+}
+
+/*
+ *  trace_event
+ *      name:    what happened, a string literal
+ *      detail:  the command it happened for, or NULL
+ *      ph:      TRACE_PH_BEGIN, TRACE_PH_END or TRACE_PH_COMPLETE
+ *      tid:     row of a complete event, 0 for the calling thread
+ *      start:   when a complete event started, from trace_now()
+ *      end:     when a complete event ended
+ *
+ *  Records an event in the calling thread's ring, only that thread writes
+ *  into it so this takes no lock.  Use the TRACE_ macros, which skip the
+ *  call when tracing is off.
+ */
+void trace_event(const char *name, const char *detail, char ph, int tid, uint64_t start, uint64_t end)
+{
+    trace_ring_t *r = get_ring();
+    if (r == NULL)
+    {
+        return;
+    }
+
+    uint64_t head = atomic_load_explicit(&r->head, memory_order_relaxed);
+    trace_event_t *e = &r->events[head % TRACE_RING_SZ];
+    e->ts = ph == TRACE_PH_COMPLETE ? start : trace_now();
+    e->dur = ph == TRACE_PH_COMPLETE ? end - start : 0;
+    e->name = name;
+    snprintf(e->detail, TRACE_DETAIL_SZ, "%s", detail ? detail : "");
+    e->pid = getpid();
+    e->tid = tid != 0 ? tid : my_tid;
+    e->ph = ph;
+
+    // publishes the event to trace_dump()
+    atomic_store_explicit(&r->head, head + 1, memory_order_release);
+}
+
+// DSH_TRACE turns tracing on from the start
+void trace_init(void)
+{
+    if (getenv(TRACE_ENV) != NULL)
+    {
+        atomic_store(&trace_on, true);
+    }
+}
+
+// writes the events to the DSH_TRACE file, if there is one
+void trace_finish(void)
+{
+    const char *path = getenv(TRACE_ENV);
+    if (path == NULL || *path == '\0')
+    {
+        return;
+    }
+
+    FILE *f = fopen(path, "w");
+    if (f == NULL)
+    {
+        fprintf(stderr, TRACE_ERR_FILE, path, strerror(errno));
+        return;
+    }
+    trace_dump(f);
+    fclose(f);
+}
+
+static void dump_string(FILE *out, const char *s)
+{
+    fputc('"', out);
+    for (; *s != '\0'; s++)
+    {
+        if (*s == '"' || *s == '\\')
+            fprintf(out, "\\%c", *s);
+        else if ((unsigned char)*s < 0x20)
+            fprintf(out, "\\u%04x", *s);
+        else
+            fputc(*s, out);
+    }
+    fputc('"', out);
+}
+
+static unsigned long count_events(void)
+{
+    unsigned long n = 0;
+    for (trace_ring_t *r = atomic_load(&rings); r != NULL; r = r->next)
+    {
+        uint64_t head = atomic_load_explicit(&r->head, memory_order_acquire);
+        uint64_t from = atomic_load(&r->base);
+        from = head - from > TRACE_RING_SZ ? head - TRACE_RING_SZ : from;
+        n += head - from;
+    }
+    return n;
+}
+
+/*
+ *  trace_dump
+ *      out:  where the JSON is written
+ *
+ *  Writes every event still in the rings as a Chrome trace_event JSON
+ *  object.  Threads keep recording while this runs, so the oldest events
+ *  of a busy ring can be overwritten as they are read.
+ *
+ *  returns:  the number of events written
+ */
+int trace_dump(FILE *out)
+{
+    int n = 0;
+    fprintf(out, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+    for (trace_ring_t *r = atomic_load(&rings); r != NULL; r = r->next)
+    {
+        uint64_t head = atomic_load_explicit(&r->head, memory_order_acquire);
+        uint64_t from = atomic_load(&r->base);
+        from = head - from > TRACE_RING_SZ ? head - TRACE_RING_SZ : from;
+
+        for (uint64_t i = from; i < head; i++)
+        {
+            trace_event_t *e = &r->events[i % TRACE_RING_SZ];
+            fprintf(out, "%s\n{\"name\":", n > 0 ? "," : "");
+            dump_string(out, e->name);
+            fprintf(out, ",\"ph\":\"%c\",\"ts\":%.3f,\"pid\":%d,\"tid\":%d", e->ph, e->ts / 1e3, e->pid, e->tid);
+            if (e->ph == TRACE_PH_COMPLETE)
+            {
+                fprintf(out, ",\"dur\":%.3f", e->dur / 1e3);
+            }
+            if (e->detail[0] != '\0')
+            {
+                fprintf(out, ",\"args\":{\"cmd\":");
+                dump_string(out, e->detail);
+                fprintf(out, "}");
+            }
+            fprintf(out, "}");
+            n++;
+        }
+    }
+    fprintf(out, "\n]}\n");
+    return n;
+}
+
+/*
+ *  trace_cmd
+ *
+ *  trace               says if tracing is on and how many events there are
+ *  trace on | off      starts or stops recording
+ *  trace clear         forgets the events recorded so far
+ *  trace dump [file]   writes them as JSON to the file, or to stdout
+ */
+int trace_cmd(int argc, char *argv[], FILE *out)
+{
+    if (argc == 1)
+    {
+        fprintf(out, TRACE_STATUS, atomic_load(&trace_on) ? "on" : "off", count_events());
+        return 0;
+    }
+
+    if (argc == 2 && (strcmp(argv[1], "on") == 0 || strcmp(argv[1], "off") == 0))
+    {
+        atomic_store(&trace_on, strcmp(argv[1], "on") == 0);
+        return 0;
+    }
+
+    if (argc == 2 && strcmp(argv[1], "clear") == 0)
+    {
+        for (trace_ring_t *r = atomic_load(&rings); r != NULL; r = r->next)
+        {
+            atomic_store(&r->base, atomic_load(&r->head));
+        }
+        return 0;
+    }
+
+    if ((argc == 2 || argc == 3) && strcmp(argv[1], "dump") == 0)
+    {
+        if (argc == 2)
+        {
+            trace_dump(out);
+            return 0;
+        }
+
+        FILE *f = fopen(argv[2], "w");
+        if (f == NULL)
+        {
+            fprintf(out, TRACE_ERR_FILE, argv[2], strerror(errno));
+            return 1;
+        }
+        trace_dump(f);
+        fclose(f);
+        return 0;
+    }
+
+    fprintf(out, TRACE_USAGE);
+    return 1;
+}
@@ -0,0 +1,96 @@
+#ifndef __TRACE_H__
+#define __TRACE_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// Tracing records what the shell and the server do with timestamps: parsing
+// a line, spawning and forking stages, waiting for them, how long each stage
+// lived, and on the server each session, recv and send.  `trace dump file`
+// writes them as Chrome trace_event JSON, which chrome://tracing and
+// Perfetto open as a timeline with a row per thread and per stage.
+//
+// Every thread writes into a ring of its own, so recording takes no lock.
+// A ring keeps the last TRACE_RING_SZ events and is handed to a new thread
+// once its thread exits.  It is turned on with `trace on` or by setting
+// DSH_TRACE to a file, which the events are written to when dsh exits or
+// the server stops.  When it is off each trace point is one branch on a
+// flag, and building with -DDSH_NO_TRACE removes them entirely.
+#define TRACE_CMD "trace"
+#define TRACE_ENV "DSH_TRACE"
+
+// events kept per thread, the oldest are overwritten
+#define TRACE_RING_SZ 4096
+
+// the command of an event, cut to this length
+#define TRACE_DETAIL_SZ 24
+
+// trace_event phases
+#define TRACE_PH_BEGIN 'B'
+#define TRACE_PH_END 'E'
+#define TRACE_PH_COMPLETE 'X'
+
+typedef struct trace_event
+{
+    uint64_t ts;                  // ns on CLOCK_MONOTONIC
+    uint64_t dur;                 // ns, for a complete event
+    const char *name;             // a string literal
+    char detail[TRACE_DETAIL_SZ]; // the command, if there is one
+    int pid;
+    int tid;
+    char ph;
+} trace_event_t;
+
+typedef struct trace_ring
+{
+    struct trace_ring *next;  // every ring there is, newest first
+    _Atomic bool owned;       // a live thread is writing into it
+    _Atomic uint64_t head;    // events written into it so far
+    _Atomic uint64_t base;    // events before this were cleared
+    trace_event_t events[TRACE_RING_SZ];
+} trace_ring_t;
+
+#ifdef DSH_NO_TRACE
+#define trace_enabled() false
+#else
+extern _Atomic bool trace_on;
+#define trace_enabled() __builtin_expect(trace_on, 0)
+#endif
+
+#define TRACE_BEGIN(name, detail)                               \
+    do                                                          \
+    {                                                           \
+        if (trace_enabled())                                    \
+            trace_event(name, detail, TRACE_PH_BEGIN, 0, 0, 0); \
+    } while (0)
+
+#define TRACE_END(name)                                       \
+    do                                                        \
+    {                                                         \
+        if (trace_enabled())                                  \
+            trace_event(name, NULL, TRACE_PH_END, 0, 0, 0);   \
+    } while (0)
+
+// a span that already ended, on its own row tid, like a pipeline stage
+#define TRACE_COMPLETE(name, detail, tid, start)                                     \
+    do                                                                               \
+    {                                                                                \
+        if (trace_enabled())                                                         \
+            trace_event(name, detail, TRACE_PH_COMPLETE, tid, start, trace_now());   \
+    } while (0)
+
+// output constants for trace
+#define TRACE_USAGE "usage: trace [on | off | clear | dump [file]]\n"
+#define TRACE_STATUS "trace: %s, %lu events\n"
+#define TRACE_ERR_FILE "trace: %s: %s\n"
+
+// prototypes for tracing, see trace.c
+uint64_t trace_now(void);
+void trace_event(const char *name, const char *detail, char ph, int tid, uint64_t start, uint64_t end);
+void trace_init(void);
+void trace_finish(void);
+int trace_dump(FILE *out);
+int trace_cmd(int argc, char *argv[], FILE *out);
+
+#endif
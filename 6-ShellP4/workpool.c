@@ -0,0 +1,265 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sched.h>
+#include <time.h>
+
+#include "dshlib.h"
+#include "workpool.h"
+
+static work_pool_t *pool = NULL;
+
+// what -w, -q and -t asked for, -1 leaves the server's default
+static int cfg_workers = -1;
+static int cfg_slots = -1;
+static int cfg_timeout = -1;
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+void work_pool_config(int workers, int slots, int timeoutMs)
+{
+    cfg_workers = workers;
+    cfg_slots = slots;
+    cfg_timeout = timeoutMs;
+}
+
+// waits for a free cell, as long as the policy allows
+static int take_free_cell(void)
+{
+    if (pool->timeoutMs == 0)
+    {
+        if (sem_trywait(&pool->free) == 0)
+        {
+            return OK;
+        }
+        atomic_fetch_add(&pool->rejected, 1);
+        return ERR_POOL_FULL;
+    }
+
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += pool->timeoutMs / 1000;
+    deadline.tv_nsec += (pool->timeoutMs % 1000) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L)
+    {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+    }
+    while (sem_timedwait(&pool->free, &deadline) != 0)
+    {
+        if (errno != EINTR)
+        {
+            atomic_fetch_add(&pool->timedOut, 1);
+            return ERR_POOL_TIMEOUT;
+        }
+    }
+    return OK;
+}
+
+/*
+ *  push
+ *
+ *  The caller holds a free cell, so the ring has room for its ticket.  The
+ *  cell may still be read by the worker of the ticket a lap before, which
+ *  is waited out.
+ */
+static void push(work_fn_t fn, void *arg)
+{
+    size_t ticket = atomic_fetch_add_explicit(&pool->tail, 1, memory_order_relaxed);
+    work_cell_t *cell = &pool->cells[ticket & pool->mask];
+    while (atomic_load_explicit(&cell->seq, memory_order_acquire) != ticket)
+    {
+        sched_yield();
+    }
+    cell->fn = fn;
+    cell->arg = arg;
+    cell->queued = now_ns();
+    atomic_store_explicit(&cell->seq, ticket + 1, memory_order_release);
+    sem_post(&pool->filled);
+}
+
+/*
+ *  work_pool_submit
+ *      fn, arg:  fn(arg) is run on a worker
+ *
+ *  returns:  OK once it is queued, ERR_POOL_FULL if the ring is full and
+ *            the pool turns work away, ERR_POOL_TIMEOUT if no cell freed up
+ *            in time
+ */
+int work_pool_submit(work_fn_t fn, void *arg)
+{
+    int rc = take_free_cell();
+    if (rc == OK)
+    {
+        push(fn, arg);
+    }
+    return rc;
+}
+
+static void *worker_main(void *unused)
+{
+    (void)unused;
+    while (1)
+    {
+        while (sem_wait(&pool->filled) != 0)
+        {
+            // interrupted, try again
+        }
+        size_t ticket = atomic_fetch_add_explicit(&pool->head, 1, memory_order_relaxed);
+        work_cell_t *cell = &pool->cells[ticket & pool->mask];
+        // the pusher of this ticket may not have written it yet
+        while (atomic_load_explicit(&cell->seq, memory_order_acquire) != ticket + 1)
+        {
+            sched_yield();
+        }
+        work_fn_t fn = cell->fn;
+        void *arg = cell->arg;
+        uint64_t waited = now_ns() - cell->queued;
+        atomic_store_explicit(&cell->seq, ticket + pool->mask + 1, memory_order_release);
+        sem_post(&pool->free);
+
+        if (fn == NULL)
+        {
+            break;
+        }
+        atomic_fetch_add(&pool->run, 1);
+        atomic_fetch_add(&pool->waitNs, waited);
+        uint64_t max = atomic_load(&pool->maxWaitNs);
+        while (waited > max && !atomic_compare_exchange_weak(&pool->maxWaitNs, &max, waited))
+        {
+        }
+
+        atomic_fetch_add(&pool->busy, 1);
+        fn(arg);
+        atomic_fetch_sub(&pool->busy, 1);
+    }
+    return NULL;
+}
+
+/*
+ *  work_pool_start
+ *      workers, slots, timeoutMs:  the server's defaults, -w, -q and -t
+ *                                  replace them
+ *      mayWait:                    false if submitting must never block,
+ *                                  the pool then always turns work away
+ *
+ *  returns:  the number of workers started, or ERR_MEMORY
+ */
+int work_pool_start(int workers, int slots, int timeoutMs, bool mayWait)
+{
+    workers = cfg_workers > 0 ? cfg_workers : workers;
+    slots = cfg_slots > 0 ? cfg_slots : slots;
+    timeoutMs = cfg_timeout >= 0 ? cfg_timeout : timeoutMs;
+
+    // the ring is a power of two long, the semaphore holds the bound
+    size_t len = 1;
+    while (len < (size_t)slots)
+    {
+        len *= 2;
+    }
+
+    work_pool_t *p = aligned_alloc(64, (sizeof(work_pool_t) + 63) & ~(size_t)63);
+    if (p == NULL)
+    {
+        return ERR_MEMORY;
+    }
+    memset(p, 0, sizeof(work_pool_t));
+    p->cells = calloc(len, sizeof(work_cell_t));
+    p->threads = calloc(workers, sizeof(pthread_t));
+    if (p->cells == NULL || p->threads == NULL)
+    {
+        free(p->cells);
+        free(p->threads);
+        free(p);
+        return ERR_MEMORY;
+    }
+    for (size_t i = 0; i < len; i++)
+    {
+        atomic_init(&p->cells[i].seq, i);
+    }
+    p->mask = len - 1;
+    p->slots = slots;
+    p->timeoutMs = mayWait ? timeoutMs : 0;
+    sem_init(&p->filled, 0, 0);
+    sem_init(&p->free, 0, slots);
+    pool = p;
+
+    for (int i = 0; i < workers; i++)
+    {
+        if (pthread_create(&p->threads[i], NULL, worker_main, NULL) != 0)
+        {
+            break;
+        }
+        p->numThreads++;
+    }
+    return p->numThreads;
+}
+
+/*
+ *  work_pool_stop
+ *
+ *  Queues an exit for every worker behind the work already queued, which
+ *  still runs, and waits for them.
+ */
+void work_pool_stop(void)
+{
+    if (pool == NULL)
+    {
+        return;
+    }
+    for (int i = 0; i < pool->numThreads; i++)
+    {
+        while (sem_wait(&pool->free) != 0)
+        {
+        }
+        push(NULL, NULL);
+    }
+    for (int i = 0; i < pool->numThreads; i++)
+    {
+        pthread_join(pool->threads[i], NULL);
+    }
+
+    work_pool_t *p = pool;
+    pool = NULL;
+    sem_destroy(&p->filled);
+    sem_destroy(&p->free);
+    free(p->cells);
+    free(p->threads);
+    free(p);
+}
+
+/*
+ *  pool_cmd
+ *
+ *  pool    prints the workers, how much work is queued, and what was run,
+ *          turned away and how long it waited
+ */
+int pool_cmd(int argc, char *argv[], FILE *out)
+{
+    (void)argv;
+    if (argc != 1)
+    {
+        fprintf(out, POOL_USAGE);
+        return 1;
+    }
+    if (pool == NULL)
+    {
+        fprintf(out, POOL_ERR_NONE);
+        return 1;
+    }
+
+    size_t tail = atomic_load(&pool->tail);
+    size_t head = atomic_load(&pool->head);
+    unsigned long run = atomic_load(&pool->run);
+    fprintf(out, POOL_STATUS, pool->numThreads, atomic_load(&pool->busy), tail > head ? tail - head : 0, pool->slots);
+    fprintf(out, POOL_STATS, run, atomic_load(&pool->rejected), atomic_load(&pool->timedOut),
+           run > 0 ? atomic_load(&pool->waitNs) / 1e6 / run : 0.0, atomic_load(&pool->maxWaitNs) / 1e6);
+    return 0;
+}
@@ -0,0 +1,78 @@
+#ifndef __WORKPOOL_H__
+#define __WORKPOOL_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <pthread.h>
+#include <semaphore.h>
+
+// The rsh servers run their work on one fixed pool of threads.  The
+// threaded server (dsh -s -x) hands it each connection, the event server
+// (dsh -s -e) each pipeline.  Work waits in a bounded ring that any thread
+// may push to and any worker pop from: a push takes a ticket for its cell
+// with one atomic add and a pop does the same at the other end, so the
+// ring itself takes no lock.  Two semaphores count the free and the filled
+// cells, a worker with nothing to do sleeps on one of them.
+//
+// When the ring is full the server either turns the work away at once
+// (-t 0) or waits up to the given milliseconds for a cell (-t MS).  The
+// event server never waits, its loops must not block.  `pool` prints the
+// workers, the depth of the ring and how long work waited in it.
+#define POOL_CMD "pool"
+
+#define POOL_DEF_WORKERS 32
+#define POOL_DEF_SLOTS 64
+#define POOL_DEF_TIMEOUT_MS 10000
+
+// returned by work_pool_submit()
+#define ERR_POOL_FULL -60
+#define ERR_POOL_TIMEOUT -61
+
+typedef void *(*work_fn_t)(void *arg);
+
+typedef struct work_cell
+{
+    _Atomic size_t seq; // the ticket that may use the cell next
+    work_fn_t fn;       // NULL tells a worker to exit
+    void *arg;
+    uint64_t queued; // ns on CLOCK_MONOTONIC
+} work_cell_t;
+
+typedef struct work_pool
+{
+    work_cell_t *cells;
+    size_t mask;                   // cells is a power of two long
+    _Alignas(64) _Atomic size_t tail; // next ticket to push
+    _Alignas(64) _Atomic size_t head; // next ticket to pop
+    _Alignas(64) sem_t filled;
+    sem_t free;
+    pthread_t *threads;
+    int numThreads;
+    int slots;
+    int timeoutMs; // 0 turns work away when the ring is full
+    _Atomic int busy;
+    _Atomic unsigned long run; // started, a session may still be running
+    _Atomic unsigned long rejected;
+    _Atomic unsigned long timedOut;
+    _Atomic uint64_t waitNs; // summed over run
+    _Atomic uint64_t maxWaitNs;
+} work_pool_t;
+
+// output constants for pool
+#define POOL_STATUS "pool: %d workers, %d busy, %zu of %d queued\n"
+#define POOL_STATS "pool: %lu run, %lu rejected, %lu timed out, %.3f ms average wait, %.3f ms longest\n"
+#define POOL_USAGE "usage: pool\n"
+#define POOL_ERR_NONE "pool: the server isn't running one\n"
+#define POOL_MSG_BUSY "rdsh-error: server busy, try again later\n"
+
+// prototypes for the work pool, see workpool.c
+void work_pool_config(int workers, int slots, int timeoutMs);
+int work_pool_start(int workers, int slots, int timeoutMs, bool mayWait);
+int work_pool_submit(work_fn_t fn, void *arg);
+void work_pool_stop(void);
+int pool_cmd(int argc, char *argv[], FILE *out);
+
+#endif